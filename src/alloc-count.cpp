@@ -0,0 +1,199 @@
+/* @file alloc-count.cpp
+ * @brief Allocation counting for the parser tests
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "alloc-count.h"
+
+#ifdef BUILD_TESTS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+
+static const char *phase_names[ALLOC_N_PHASES] = {
+  "other",
+  "read",
+  "mime",
+  "crypto",
+  "finalize"
+};
+
+/* Nothing may be allocated here as this is called from operator
+   new.  */
+static thread_local alloc_profile_t *current_profile;
+static thread_local alloc_phase_t current_phase;
+
+void
+alloc_count_start (alloc_profile_t *profile)
+{
+  for (int i = 0; i < ALLOC_N_PHASES; i++)
+    {
+      profile->count[i] = 0;
+      profile->bytes[i] = 0;
+    }
+  current_phase = ALLOC_PHASE_OTHER;
+  current_profile = profile;
+}
+
+void
+alloc_count_stop (void)
+{
+  current_profile = nullptr;
+}
+
+alloc_phase_t
+alloc_count_set_phase (alloc_phase_t phase)
+{
+  const alloc_phase_t prev = current_phase;
+  current_phase = phase;
+  return prev;
+}
+
+void
+_alloc_count_record (size_t n)
+{
+  alloc_profile_t *profile = current_profile;
+
+  if (profile)
+    {
+      profile->count[current_phase]++;
+      profile->bytes[current_phase] += n;
+    }
+}
+
+const char *
+alloc_phase_name (alloc_phase_t phase)
+{
+  return phase < ALLOC_N_PHASES ? phase_names[phase] : "unknown";
+}
+
+uint64_t
+alloc_profile_count (const alloc_profile_t *profile, alloc_phase_t skip)
+{
+  uint64_t ret = 0;
+
+  for (int i = 0; i < ALLOC_N_PHASES; i++)
+    {
+      if (i != skip)
+        {
+          ret += profile->count[i];
+        }
+    }
+  return ret;
+}
+
+uint64_t
+alloc_profile_bytes (const alloc_profile_t *profile, alloc_phase_t skip)
+{
+  uint64_t ret = 0;
+
+  for (int i = 0; i < ALLOC_N_PHASES; i++)
+    {
+      if (i != skip)
+        {
+          ret += profile->bytes[i];
+        }
+    }
+  return ret;
+}
+
+std::string
+alloc_profile_format (const alloc_profile_t *profile)
+{
+  std::string ret;
+  char buf[64];
+
+  snprintf (buf, sizeof buf, "%lu allocations %lu bytes:",
+            (unsigned long) alloc_profile_count (profile, ALLOC_N_PHASES),
+            (unsigned long) alloc_profile_bytes (profile, ALLOC_N_PHASES));
+  ret += buf;
+  for (int i = 0; i < ALLOC_N_PHASES; i++)
+    {
+      snprintf (buf, sizeof buf, " %s %lu/%lu", phase_names[i],
+                (unsigned long) profile->count[i],
+                (unsigned long) profile->bytes[i]);
+      ret += buf;
+    }
+  return ret;
+}
+
+/* The replaceable global allocation functions.  The deallocation
+   functions are replaced as well so that they always match.  */
+void *
+operator new (size_t n)
+{
+  _alloc_count_record (n);
+  void *p = malloc (n ? n : 1);
+  if (!p)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void *
+operator new[] (size_t n)
+{
+  return operator new (n);
+}
+
+void *
+operator new (size_t n, const std::nothrow_t &) noexcept
+{
+  _alloc_count_record (n);
+  return malloc (n ? n : 1);
+}
+
+void *
+operator new[] (size_t n, const std::nothrow_t &tag) noexcept
+{
+  return operator new (n, tag);
+}
+
+void
+operator delete (void *p) noexcept
+{
+  free (p);
+}
+
+void
+operator delete[] (void *p) noexcept
+{
+  free (p);
+}
+
+void
+operator delete (void *p, const std::nothrow_t &) noexcept
+{
+  free (p);
+}
+
+void
+operator delete[] (void *p, const std::nothrow_t &) noexcept
+{
+  free (p);
+}
+
+#endif /* BUILD_TESTS */
@@ -0,0 +1,108 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+/* @file alloc-count.h
+ * @brief Allocation counting for the parser tests
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* In the test drivers (BUILD_TESTS) the xmalloc functions and the
+   global operator new report every allocation to the profile which
+   was started on the calling thread.  The parser marks its phases
+   with ALLOC_PHASE so that the allocations of a mail can be broken
+   down.  Allocations done by gpgme itself use malloc and are not
+   counted.  In the real add-in this compiles to nothing.  */
+
+typedef enum
+{
+  ALLOC_PHASE_OTHER = 0,
+  ALLOC_PHASE_READ,     /* Reading the input stream.  */
+  ALLOC_PHASE_MIME,     /* Splitting lines and rfc822 parsing.  */
+  ALLOC_PHASE_CRYPTO,   /* Decrypt and verify without the output.  */
+  ALLOC_PHASE_FINALIZE, /* Finishing the body after parsing.  */
+  ALLOC_N_PHASES
+} alloc_phase_t;
+
+typedef struct
+{
+  uint64_t count[ALLOC_N_PHASES];
+  uint64_t bytes[ALLOC_N_PHASES];
+} alloc_profile_t;
+
+#ifdef BUILD_TESTS
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Count the allocations of the calling thread in PROFILE
+  * until alloc_count_stop.  PROFILE is cleared.  */
+void alloc_count_start (alloc_profile_t *profile);
+void alloc_count_stop (void);
+
+/** @brief Set the phase of the calling thread.
+  *
+  * @returns the previous phase.  */
+alloc_phase_t alloc_count_set_phase (alloc_phase_t phase);
+
+/** @brief Count an allocation of N bytes. */
+void _alloc_count_record (size_t n);
+
+const char *alloc_phase_name (alloc_phase_t phase);
+
+/** @brief Sum over all phases except SKIP.  Pass ALLOC_N_PHASES to
+  * sum everything.  */
+uint64_t alloc_profile_count (const alloc_profile_t *profile,
+                              alloc_phase_t skip);
+uint64_t alloc_profile_bytes (const alloc_profile_t *profile,
+                              alloc_phase_t skip);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+
+/** @brief One line with the allocations and bytes per phase. */
+std::string alloc_profile_format (const alloc_profile_t *profile);
+
+/* Sets the phase until it goes out of scope.  */
+class AllocPhase
+{
+public:
+  explicit AllocPhase (alloc_phase_t phase) :
+    m_prev (alloc_count_set_phase (phase))
+  {
+  }
+  ~AllocPhase ()
+  {
+    alloc_count_set_phase (m_prev);
+  }
+
+private:
+  alloc_phase_t m_prev;
+};
+
+# define ALLOC_PHASE(phase) AllocPhase alloc_phase_ (phase)
+#endif /* __cplusplus */
+#else /* !BUILD_TESTS */
+# define ALLOC_PHASE(phase) do { } while (0)
+#endif /* !BUILD_TESTS */
+
+#endif // ALLOC_COUNT_H
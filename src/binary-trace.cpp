@@ -0,0 +1,278 @@
+/* @file binary-trace.cpp
+ * @brief Compact binary trace of the TSTART / TRETURN macros
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "common_indep.h"
+#include "binary-trace.h"
+
+#include <gpg-error.h>
+
+#ifndef HAVE_W32_SYSTEM
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+
+/* 1 MiB of call sites.  GpgOL has about 3000 trace macros.  */
+#define MAX_SITES 8192
+
+/* 16 MiB of events.  */
+#define MAX_EVENTS (1024 * 1024)
+
+static_assert (sizeof (trace_header_t) <= TRACE_SITES_OFFSET,
+               "trace header too large");
+static_assert (sizeof (trace_site_rec_t) == 128, "unexpected site size");
+static_assert (sizeof (trace_event_t) == 16, "unexpected event size");
+
+static trace_header_t *header;
+static trace_site_rec_t *sites;
+static trace_event_t *events;
+static size_t map_size;
+static bool opened;
+
+#ifdef HAVE_W32_SYSTEM
+static HANDLE map_handle;
+#endif
+
+GPGRT_LOCK_DEFINE (site_lock);
+
+static uint64_t
+get_ticks (void)
+{
+#ifdef HAVE_W32_SYSTEM
+  LARGE_INTEGER count;
+
+  QueryPerformanceCounter (&count);
+  return count.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static uint64_t
+get_ticks_per_sec (void)
+{
+#ifdef HAVE_W32_SYSTEM
+  LARGE_INTEGER freq;
+
+  QueryPerformanceFrequency (&freq);
+  return freq.QuadPart;
+#else
+  return 1000000000;
+#endif
+}
+
+/* Create FILENAME with SIZE bytes and map it.  */
+static void *
+map_file (const char *filename, size_t size)
+{
+#ifdef HAVE_W32_SYSTEM
+  HANDLE file;
+  void *ret;
+
+  file = CreateFileA (filename, GENERIC_READ | GENERIC_WRITE,
+                      FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    {
+      return nullptr;
+    }
+  map_handle = CreateFileMapping (file, NULL, PAGE_READWRITE,
+                                  (DWORD) ((uint64_t) size >> 32),
+                                  (DWORD) size, NULL);
+  /* The mapping keeps the file open.  */
+  CloseHandle (file);
+  if (!map_handle)
+    {
+      return nullptr;
+    }
+  ret = MapViewOfFile (map_handle, FILE_MAP_WRITE, 0, 0, size);
+  if (!ret)
+    {
+      CloseHandle (map_handle);
+      map_handle = nullptr;
+    }
+  return ret;
+#else
+  int fd;
+  void *ret;
+
+  fd = open (filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1)
+    {
+      return nullptr;
+    }
+  if (ftruncate (fd, size))
+    {
+      close (fd);
+      return nullptr;
+    }
+  ret = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  return ret == MAP_FAILED ? nullptr : ret;
+#endif
+}
+
+static void
+unmap_file (void *addr, size_t size)
+{
+#ifdef HAVE_W32_SYSTEM
+  (void) size;
+  UnmapViewOfFile (addr);
+  CloseHandle (map_handle);
+  map_handle = nullptr;
+#else
+  munmap (addr, size);
+#endif
+}
+
+int
+trace_open (const char *filename)
+{
+  char *base;
+
+  /* Site ids are only valid for one file.  The options are read
+     again after the config dialog so keep the first file.  */
+  if (opened)
+    {
+      return __atomic_load_n (&header, __ATOMIC_ACQUIRE) ? 0 : -1;
+    }
+
+  map_size = TRACE_SITES_OFFSET + MAX_SITES * sizeof (trace_site_rec_t)
+             + MAX_EVENTS * sizeof (trace_event_t);
+  base = (char *) map_file (filename, map_size);
+  if (!base)
+    {
+      log_error ("%s:%s: Failed to map trace file '%s'",
+                 SRCNAME, __func__, filename);
+      return -1;
+    }
+
+  trace_header_t *hdr = (trace_header_t *) base;
+  memcpy (hdr->magic, TRACE_MAGIC, sizeof hdr->magic);
+  hdr->version = TRACE_VERSION;
+  hdr->max_sites = MAX_SITES;
+  hdr->max_events = MAX_EVENTS;
+  hdr->ticks_per_sec = get_ticks_per_sec ();
+  sites = (trace_site_rec_t *) (base + TRACE_SITES_OFFSET);
+  events = (trace_event_t *) (base + TRACE_SITES_OFFSET
+                              + MAX_SITES * sizeof (trace_site_rec_t));
+  opened = true;
+  __atomic_store_n (&header, hdr, __ATOMIC_RELEASE);
+
+  log_debug ("%s:%s: Writing binary trace to '%s'",
+             SRCNAME, __func__, filename);
+  return 0;
+}
+
+void
+trace_close (void)
+{
+  trace_header_t *hdr = __atomic_exchange_n (&header, nullptr,
+                                             __ATOMIC_ACQ_REL);
+  if (hdr)
+    {
+      unmap_file (hdr, map_size);
+    }
+}
+
+/* Copy the tail of SRC into DST so that long paths keep the
+   interesting part.  */
+static void
+copy_tail (char *dst, size_t size, const char *src)
+{
+  size_t len = strlen (src);
+
+  if (len >= size)
+    {
+      src += len - (size - 1);
+    }
+  strncpy (dst, src, size - 1);
+  dst[size - 1] = 0;
+}
+
+/* Give SITE an id and describe it in the trace file.  */
+static int
+register_site (trace_header_t *hdr, trace_site_t *site)
+{
+  int id;
+
+  gpgrt_lock_lock (&site_lock);
+  id = site->id;
+  if (!id)
+    {
+      if (hdr->n_sites < hdr->max_sites)
+        {
+          trace_site_rec_t *rec = sites + hdr->n_sites;
+
+          rec->line = site->line;
+          copy_tail (rec->file, sizeof rec->file, log_srcname (site->file));
+          copy_tail (rec->func, sizeof rec->func, site->func);
+          id = (int) ++hdr->n_sites;
+        }
+      else
+        {
+          id = -1;
+        }
+      __atomic_store_n (&site->id, id, __ATOMIC_RELEASE);
+    }
+  gpgrt_lock_unlock (&site_lock);
+  return id;
+}
+
+void
+trace_event (trace_site_t *site, int type)
+{
+  trace_header_t *hdr = __atomic_load_n (&header, __ATOMIC_ACQUIRE);
+  trace_event_t *ev;
+  uint64_t ticks;
+  uint64_t n;
+  int id;
+
+  if (!hdr)
+    {
+      return;
+    }
+
+  id = __atomic_load_n (&site->id, __ATOMIC_ACQUIRE);
+  if (!id)
+    {
+      id = register_site (hdr, site);
+    }
+  if (id < 0)
+    {
+      return;
+    }
+
+  ticks = get_ticks ();
+  n = __atomic_fetch_add (&hdr->n_events, 1, __ATOMIC_RELAXED);
+  ev = events + (n % MAX_EVENTS);
+  ev->ticks = ticks;
+  ev->tid = (uint32_t) log_thread_id ();
+  ev->site = ((uint32_t) id << 2) | (type & 3);
+}
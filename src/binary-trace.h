@@ -0,0 +1,124 @@
+#ifndef BINARY_TRACE_H
+#define BINARY_TRACE_H
+/* @file binary-trace.h
+ * @brief Compact binary trace of the TSTART / TRETURN macros
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* The trace file is a memory mapped file with a header, a table of
+   call sites and a ring of events.  It is written by gpgol and read
+   by the trace-decode tool in the tests directory.  All integers are
+   little endian.
+
+   +--------------------+ 0
+   | trace_header_t     |
+   +--------------------+ TRACE_SITES_OFFSET
+   | trace_site_rec_t   |  max_sites times; site id N is at index N-1
+   +--------------------+ TRACE_SITES_OFFSET + max_sites * 128
+   | trace_event_t      |  max_events times; event N is at index
+   |                    |  N % max_events
+   +--------------------+
+  */
+#define TRACE_MAGIC "GPGOLTRC"
+#define TRACE_VERSION 1
+#define TRACE_SITES_OFFSET 4096
+
+typedef enum
+{
+  TRACE_ENTER = 0,
+  TRACE_RETURN,
+  TRACE_BREAK,
+  TRACE_POINT
+} trace_type_t;
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t max_sites;
+  uint32_t max_events;
+  uint32_t reserved;
+  /* Unit of the event timestamps.  */
+  uint64_t ticks_per_sec;
+  /* Number of registered call sites.  */
+  uint64_t n_sites;
+  /* Number of events written.  Only the last max_events of them are
+     in the file.  */
+  uint64_t n_events;
+} trace_header_t;
+
+typedef struct
+{
+  uint32_t line;
+  char file[44];
+  char func[80];
+} trace_site_rec_t;
+
+typedef struct
+{
+  /* Monotonic timestamp in ticks_per_sec.  */
+  uint64_t ticks;
+  uint32_t tid;
+  /* The site id shifted left by two ored with the trace_type_t.  */
+  uint32_t site;
+} trace_event_t;
+
+/* A call site of a trace macro.  Each use of a macro has its own
+   static instance so that the site is described only once in the
+   trace file.  */
+typedef struct
+{
+  const char *file;
+  const char *func;
+  int line;
+  /* Assigned on first use.  -1 if the site table is full.  */
+  int id;
+} trace_site_t;
+
+/** @brief Create the trace file FILENAME and map it.
+  *
+  * Only the first call per process creates a file.  Later calls
+  * return whether it is still open.
+  *
+  * @returns 0 on success.
+  */
+int trace_open (const char *filename);
+
+/** @brief Unmap the trace file.
+  *
+  * No other thread may trace at the same time.
+  */
+void trace_close (void);
+
+/** @brief Record an event of TYPE for SITE. */
+void trace_event (trace_site_t *site, int type);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // BINARY_TRACE_H
@@ -0,0 +1,389 @@
+/* @file charset-conv.cpp
+ * @brief Portable charset conversion to UTF-8
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "common_indep.h"
+#include "charset-conv.h"
+
+#include <errno.h>
+#include <gpg-error.h>
+
+#ifndef HAVE_W32_SYSTEM
+# include <iconv.h>
+#endif
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef HAVE_W32_SYSTEM
+typedef gpgrt_w32_iconv_t conv_t;
+#else
+typedef iconv_t conv_t;
+#endif
+
+/* How many idle converters we keep per charset.  More than one is
+   only needed if several threads convert the same charset at the
+   same time.  */
+#define MAX_POOLED 4
+
+/* How many charsets we keep converters for.  Charset names come from
+   the mail so this needs a bound.  */
+#define MAX_POOLED_CHARSETS 32
+
+static void conv_close (conv_t cd);
+
+/* Idle converters to UTF-8 by normalized charset name.  */
+struct conv_pool_s
+{
+  ~conv_pool_s ()
+    {
+      for (const auto &pair: idle)
+        for (const auto cd: pair.second)
+          conv_close (cd);
+    }
+  std::unordered_map<std::string, std::vector<conv_t> > idle;
+};
+
+GPGRT_LOCK_DEFINE (pool_lock);
+static conv_pool_s pool;
+
+enum fast_charset
+{
+  FAST_NONE = 0,
+  FAST_UTF8,
+  FAST_ASCII,
+  FAST_LATIN1
+};
+
+/* Lowercase CHARSET and strip quotes and spaces.  */
+static std::string
+normalize_charset (const char *charset)
+{
+  std::string ret;
+
+  for (const char *s = charset; *s; s++)
+    {
+      if (*s == '"' || *s == '\'' || ascii_isspace (*s))
+        continue;
+      ret += (*s >= 'A' && *s <= 'Z') ? *s + ('a' - 'A') : *s;
+    }
+  return ret;
+}
+
+static fast_charset
+get_fast_charset (const std::string &name)
+{
+  if (name == "utf-8" || name == "utf8")
+    return FAST_UTF8;
+  if (name == "us-ascii" || name == "ascii" || name == "ansi_x3.4-1968")
+    return FAST_ASCII;
+  if (name == "iso-8859-1" || name == "iso8859-1" || name == "iso_8859-1"
+      || name == "latin1" || name == "l1")
+    return FAST_LATIN1;
+  return FAST_NONE;
+}
+
+static char *
+copy_string (const char *input, size_t inlen)
+{
+  char *ret = (char *) xmalloc (inlen + 1);
+  memcpy (ret, input, inlen);
+  ret[inlen] = 0;
+  return ret;
+}
+
+static char *
+latin1_mem_to_utf8 (const char *input, size_t inlen)
+{
+  const unsigned char *s = (const unsigned char *) input;
+  const unsigned char *end = s + inlen;
+  size_t n = inlen;
+
+  for (; s < end; s++)
+    if (*s & 0x80)
+      n++;
+
+  char *buffer = (char *) xmalloc (n + 1);
+  char *p = buffer;
+  for (s = (const unsigned char *) input; s < end; s++)
+    {
+      if (*s & 0x80)
+        {
+          *p++ = 0xc0 | (*s >> 6);
+          *p++ = 0x80 | (*s & 0x3f);
+        }
+      else
+        *p++ = *s;
+    }
+  *p = 0;
+  return buffer;
+}
+
+static bool
+ascii_p (const char *input, size_t inlen)
+{
+  size_t i;
+
+  for (i = 0; i < inlen && !(input[i] & 0x80); i++)
+    ;
+  return i == inlen;
+}
+
+/* Check if INPUT needs no conversion for the charset FC.  */
+static bool
+utf8_compatible (fast_charset fc, const char *input, size_t inlen)
+{
+  switch (fc)
+    {
+      case FAST_UTF8:
+        return utf8_valid_p (input, inlen);
+      case FAST_ASCII:
+        return ascii_p (input, inlen);
+      default:
+        return false;
+    }
+}
+
+int
+charset_utf8_compatible_p (const char *charset, const char *input,
+                           size_t inlen)
+{
+  if (!charset || !input)
+    {
+      return 0;
+    }
+  return utf8_compatible (get_fast_charset (normalize_charset (charset)),
+                          input, inlen);
+}
+
+char *
+charset_fast_to_utf8 (const char *charset, const char *input, size_t inlen)
+{
+  if (!charset || !input)
+    {
+      return nullptr;
+    }
+
+  const auto fc = get_fast_charset (normalize_charset (charset));
+  if (fc == FAST_LATIN1)
+    {
+      return latin1_mem_to_utf8 (input, inlen);
+    }
+  if (utf8_compatible (fc, input, inlen))
+    {
+      return copy_string (input, inlen);
+    }
+  return nullptr;
+}
+
+static bool
+conv_valid (conv_t cd)
+{
+  return cd && cd != (conv_t)-1;
+}
+
+static conv_t
+conv_open (const std::string &name)
+{
+#ifdef HAVE_W32_SYSTEM
+  return gpgrt_w32_iconv_open ("UTF-8", name.c_str ());
+#else
+  return iconv_open ("UTF-8", name.c_str ());
+#endif
+}
+
+static void
+conv_close (conv_t cd)
+{
+#ifdef HAVE_W32_SYSTEM
+  gpgrt_w32_iconv_close (cd);
+#else
+  iconv_close (cd);
+#endif
+}
+
+static size_t
+conv_run (conv_t cd, const char **inbuf, size_t *inleft,
+          char **outbuf, size_t *outleft)
+{
+#ifdef HAVE_W32_SYSTEM
+  return gpgrt_w32_iconv (cd, inbuf, inleft, outbuf, outleft);
+#else
+  return iconv (cd, const_cast<char **> (inbuf), inleft, outbuf, outleft);
+#endif
+}
+
+/* Take a converter for NAME from the pool or open a new one.  */
+static conv_t
+acquire_conv (const std::string &name)
+{
+  gpgrt_lock_lock (&pool_lock);
+  auto it = pool.idle.find (name);
+  if (it != pool.idle.end () && !it->second.empty ())
+    {
+      conv_t cd = it->second.back ();
+      it->second.pop_back ();
+      gpgrt_lock_unlock (&pool_lock);
+      return cd;
+    }
+  gpgrt_lock_unlock (&pool_lock);
+
+  return conv_open (name);
+}
+
+/* Reset CD and put it back into the pool.  */
+static void
+release_conv (const std::string &name, conv_t cd)
+{
+  conv_run (cd, nullptr, nullptr, nullptr, nullptr);
+
+  gpgrt_lock_lock (&pool_lock);
+  auto it = pool.idle.find (name);
+  if (it == pool.idle.end () && pool.idle.size () < MAX_POOLED_CHARSETS)
+    {
+      it = pool.idle.insert (std::make_pair (name,
+                                             std::vector<conv_t> ())).first;
+    }
+  if (it != pool.idle.end () && it->second.size () < MAX_POOLED)
+    {
+      it->second.push_back (cd);
+      cd = nullptr;
+    }
+  gpgrt_lock_unlock (&pool_lock);
+
+  if (cd)
+    {
+      conv_close (cd);
+    }
+}
+
+/* Double the output BUFFER of the conversion.  */
+static void
+grow_output (char **buffer, size_t *outsize, char **outptr, size_t *outleft)
+{
+  size_t used = *outptr - *buffer;
+
+  *outsize *= 2;
+  *buffer = (char *) xrealloc (*buffer, *outsize + 1);
+  *outptr = *buffer + used;
+  *outleft = *outsize - used;
+}
+
+/* Run the conversion with CD growing the output buffer as needed.  */
+static char *
+do_convert (conv_t cd, const char *input, size_t inlen)
+{
+  size_t outsize = inlen + inlen / 2 + 16;
+  char *buffer = (char *) xmalloc (outsize + 1);
+  const char *inptr = input;
+  size_t inleft = inlen;
+  char *outptr = buffer;
+  size_t outleft = outsize;
+
+  while (inleft)
+    {
+      if (conv_run (cd, &inptr, &inleft, &outptr, &outleft) != (size_t)-1)
+        {
+          continue;
+        }
+      if (errno != E2BIG)
+        {
+          xfree (buffer);
+          return nullptr;
+        }
+      grow_output (&buffer, &outsize, &outptr, &outleft);
+    }
+
+  /* Flush a pending shift sequence.  */
+  while (conv_run (cd, nullptr, nullptr, &outptr, &outleft) == (size_t)-1)
+    {
+      if (errno != E2BIG)
+        {
+          xfree (buffer);
+          return nullptr;
+        }
+      grow_output (&buffer, &outsize, &outptr, &outleft);
+    }
+  *outptr = 0;
+  return buffer;
+}
+
+char *
+charset_iconv_to_utf8 (const char *charset, const char *input, size_t inlen)
+{
+  if (!charset || !input)
+    {
+      STRANGEPOINT;
+      return nullptr;
+    }
+
+  const auto name = normalize_charset (charset);
+  conv_t cd = acquire_conv (name);
+  if (!conv_valid (cd))
+    {
+      log_debug ("%s:%s: Failed to open iconv ctx for '%s'",
+                 SRCNAME, __func__, charset);
+      return nullptr;
+    }
+
+  char *ret = do_convert (cd, input, inlen);
+  if (!ret)
+    {
+      log_error ("%s:%s: Conversion failed for '%s'",
+                 SRCNAME, __func__, charset);
+    }
+  release_conv (name, cd);
+  return ret;
+}
+
+char *
+charset_to_utf8 (const char *charset, const char *input, size_t inlen)
+{
+  char *ret = charset_fast_to_utf8 (charset, input, inlen);
+
+  if (ret)
+    {
+      return ret;
+    }
+  return charset_iconv_to_utf8 (charset, input, inlen);
+}
+
+bool
+charset_convert_to_utf8 (const char *charset, std::string &data)
+{
+  if (charset_utf8_compatible_p (charset, data.c_str (), data.size ()))
+    {
+      return true;
+    }
+
+  char *converted = charset_to_utf8 (charset, data.c_str (), data.size ());
+  if (!converted)
+    {
+      return false;
+    }
+  data = converted;
+  xfree (converted);
+  return true;
+}
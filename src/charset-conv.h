@@ -0,0 +1,82 @@
+#ifndef CHARSET_CONV_H
+#define CHARSET_CONV_H
+/* @file charset-conv.h
+ * @brief Portable charset conversion to UTF-8
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/** @brief Convert INLEN bytes of INPUT in CHARSET to UTF-8.
+  *
+  * UTF-8, US-ASCII and ISO-8859-1 are handled directly, everything
+  * else goes through an iconv converter taken from a pool so that
+  * the converter setup is paid only once per charset.  Safe to be
+  * called from any thread.
+  *
+  * @returns a malloced, Nul terminated UTF-8 string or NULL if the
+  *          charset is unknown or the input is invalid.
+  */
+char *charset_to_utf8 (const char *charset, const char *input,
+                       size_t inlen);
+
+/** @brief Like charset_to_utf8 but only for the direct conversions.
+  *
+  * @returns NULL if CHARSET has no direct conversion or the input
+  *          does not match it.
+  */
+char *charset_fast_to_utf8 (const char *charset, const char *input,
+                            size_t inlen);
+
+/** @brief Like charset_to_utf8 but always uses iconv. */
+char *charset_iconv_to_utf8 (const char *charset, const char *input,
+                             size_t inlen);
+
+/** @brief Check if INPUT in CHARSET already is valid UTF-8.
+  *
+  * This is the case for valid UTF-8 declared as UTF-8 and for pure
+  * ASCII declared as US-ASCII.  Such input can be used as is.
+  *
+  * @returns 1 if no conversion is needed.
+  */
+int charset_utf8_compatible_p (const char *charset, const char *input,
+                               size_t inlen);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+
+/** @brief Convert DATA in CHARSET to UTF-8 in place.
+  *
+  * If DATA already is valid UTF-8 it is left untouched so that the
+  * usual case of a UTF-8 body costs only the validation and no copy.
+  *
+  * @returns false if the conversion failed.  DATA is unchanged then.
+  */
+bool charset_convert_to_utf8 (const char *charset, std::string &data);
+#endif
+#endif // CHARSET_CONV_H
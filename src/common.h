@@ -80,13 +80,6 @@ int verify_dialog_box (gpgme_protocol_t protocol,
 /*-- inspectors.cpp --*/
 int initialize_inspectors (void);
 
-#if __GNUC__ >= 4
-# define GPGOL_GCC_A_SENTINEL(a) __attribute__ ((sentinel(a)))
-#else
-# define GPGOL_GCC_A_SENTINEL(a)
-#endif
-
-
 /*-- common.c --*/
 
 void fatal_error (const char *format, ...);
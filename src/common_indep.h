@@ -205,6 +205,7 @@ struct
   int combinedOpsEnabled;    /* Enable S/MIME and OpenPGP combined operations. */
   int splitBCCMails;         /* Split BCC recipients in their own mails. */
   int encryptSubject;        /* Encrypt the subject with protected headers. */
+  int binaryTransport;       /* Send OpenPGP ciphertext binary in base64. */
 
   /* The forms revision number of the binary.  */
   int forms_revision;
@@ -229,6 +230,7 @@ size_t b64_decode (b64_state_t *state, char *buffer, size_t length);
 char * b64_encode (const char *input, size_t length);
 
 char *latin1_to_utf8 (const char *string);
+int utf8_valid_p (const void *data, size_t length);
 
 char *mem2str (char *dest, const void *src, size_t n);
 
@@ -251,6 +253,12 @@ char *trim_trailing_spaces (char *string);
 void set_default_key (const char *name);
 
 /*-- Convenience macros. -- */
+#if __GNUC__ >= 4
+# define GPGOL_GCC_A_SENTINEL(a) __attribute__ ((sentinel(a)))
+#else
+# define GPGOL_GCC_A_SENTINEL(a)
+#endif
+
 #define DIM(v)		     (sizeof(v)/sizeof((v)[0]))
 #define DIMof(type,member)   DIM(((type *)0)->member)
 
@@ -318,6 +326,11 @@ _gpgol_stpcpy (char *a, const char *b)
 #define BOUNDARYSIZE 20
 char *generate_boundary (char *buffer);
 
+/* The header of the multipart/mixed which holds the separately
+   encrypted parts of a draft.  Its value is the number of parts.
+   Written as the rfc822 parser capitalizes it for the lookup.  */
+#define DRAFT_PARTS_HEADER "X-Gpgol-Draft-Parts"
+
 #ifdef __cplusplus
 }
 
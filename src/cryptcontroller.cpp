@@ -26,12 +26,18 @@
 #include "mail.h"
 #include "mapihelp.h"
 #include "mimemaker.h"
+#include "mime-crypt.h"
 #include "wks-helper.h"
 #include "overlay.h"
 #include "keycache.h"
 #include "mymapitags.h"
 #include "recipient.h"
 #include "windowmessages.h"
+#include "latency.h"
+#include "timeline.h"
+#include "resolution-cache.h"
+#include "split-encrypt.h"
+#include "draft-parts.h"
 
 #include <gpgme++/context.h>
 #include <gpgme++/signingresult.h>
@@ -39,21 +45,19 @@
 
 #include "common.h"
 
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
 #include <sstream>
 
-static int
-sink_data_write (sink_t sink, const void *data, size_t datalen)
-{
-  GpgME::Data *d = static_cast<GpgME::Data *>(sink->cb_data);
-  d->write (data, datalen);
-  return 0;
-}
+/* The number of threads encrypting the copies of a split mail.  */
+#define SPLIT_ENCRYPT_THREADS 4
 
-static int
-create_sign_attach (sink_t sink, protocol_t protocol,
-                    GpgME::Data &signature,
-                    GpgME::Data &signedData,
-                    const char *micalg);
+/* The prepared copies of a split mail are kept until the copies are
+   sent.  Copies which would exceed this many bytes are encrypted
+   when they are sent instead.  */
+#define SPLIT_PREPARED_LIMIT (64 * 1024 * 1024)
 
 /** We have some C Style cruft in here as this was historically how
   GpgOL worked directly in the MAPI data objects. To reduce the regression
@@ -66,6 +70,7 @@ CryptController::CryptController (Mail *mail, bool encrypt, bool sign,
     m_encrypt (encrypt),
     m_sign (sign),
     m_crypto_success (false),
+    m_binary (false),
     m_proto (proto)
 {
   TSTART;
@@ -98,6 +103,14 @@ CryptController::collect_data ()
      we better avoid triggering this bug because the engine
      sometimes hangs.  Fixme: Needs a proper fix. */
 
+  /* A copy of a split mail might already be encrypted.  */
+  m_prepared = m_encrypt ? m_mail->takePreparedOutput () : nullptr;
+  if (m_prepared)
+    {
+      log_debug ("%s:%s: Using the output prepared with the split.",
+                 SRCNAME, __func__);
+      TRETURN 0;
+    }
 
   /* Take the Body from the mail if possible. This is a fix for
      GnuPG-Bug-ID: T3614 because the body is not always properly
@@ -156,17 +169,35 @@ CryptController::collect_data ()
       m_bodyInput.seek (0, SEEK_SET);
     }
 
-  /* Set up the sink object to collect the mime structure */
+  /* Set up the sink object to collect the mime structure.  The many
+     small header writes are batched before they go to gpgme.  */
+  struct sink_s datasinkmem;
+  memset (&datasinkmem, 0, sizeof datasinkmem);
+  datasinkmem.cb_data = &m_input;
+  datasinkmem.writefnc = sink_data_write;
+  struct sink_batch_s batch;
   struct sink_s sinkmem;
   sink_t sink = &sinkmem;
-  memset (sink, 0, sizeof *sink);
-  sink->cb_data = &m_input;
-  sink->writefnc = sink_data_write;
+  sink_init_batch (sink, &batch, &datasinkmem);
 
-  /* Collect the mime strucutre */
-  int err = add_body_and_attachments (sink, message, att_table, m_mail,
+  /* Collect the mime strucutre.  An encrypted draft is collected in
+     parts so that a save only needs to encrypt the changed parts.  */
+  int err;
+  if (m_encrypt && m_mail->isDraftEncrypt () && !do_inline)
+    {
+      err = collect_mime_parts (message, att_table, m_mail, body,
+                                n_att_usable, m_draft_parts);
+    }
+  else
+    {
+      err = add_body_and_attachments (sink, message, att_table, m_mail,
                                       body, n_att_usable);
+    }
   xfree (body);
+  if (!err)
+    {
+      err = sink_flush (sink);
+    }
 
   if (err)
     {
@@ -564,7 +595,6 @@ CryptController::resolve_keys_cached()
 {
   TSTART;
   // Prepare variables
-  const auto recps = m_mail->getCachedRecipientAddresses ();
   bool resolved = false;
   if (opt.enable_smime && opt.prefer_smime)
     {
@@ -633,6 +663,185 @@ CryptController::resolve_keys_cached()
   TRETURN 0;
 }
 
+/* The id under which the resolution for this mail is remembered.  */
+std::string
+CryptController::resolution_id (GpgME::Protocol proto) const
+{
+  std::vector<std::string> mboxes;
+  unsigned int flags = 0;
+
+  for (const auto &recp: m_recipients)
+    {
+      mboxes.push_back (recp.mbox ());
+    }
+  flags |= m_sign ? RES_FLAG_SIGN : 0;
+  flags |= m_encrypt ? RES_FLAG_ENCRYPT : 0;
+  flags |= opt.enable_smime ? RES_FLAG_SMIME : 0;
+  flags |= opt.prefer_smime ? RES_FLAG_PREFER_SMIME : 0;
+  return ResolutionCache::makeId (mboxes, m_sender, proto, flags);
+}
+
+static bool
+is_usable_key (const GpgME::Key &key)
+{
+  return !key.isNull () && !key.isRevoked () && !key.isExpired ()
+         && !key.isDisabled () && !key.isInvalid ();
+}
+
+/* Take the keys from an earlier resolution for the same recipients.
+   Returns 0 on success and 1 if there is no usable one.  */
+int
+CryptController::resolve_keys_memo (const std::string &id)
+{
+  TSTART;
+  const auto memo = ResolutionCache::instance ()->get (id);
+
+  if (!memo)
+    {
+      TRETURN 1;
+    }
+  const auto &res = *memo;
+
+  for (const auto &key: res.signer_keys)
+    {
+      if (!is_usable_key (key))
+        {
+          log_debug ("%s:%s: Remembered signing key is not usable.",
+                     SRCNAME, __func__);
+          TRETURN 1;
+        }
+    }
+  for (const auto &pair: res.recipient_keys)
+    {
+      for (const auto &key: pair.second)
+        {
+          if (!is_usable_key (key))
+            {
+              log_debug ("%s:%s: Remembered key for '%s' is not usable.",
+                         SRCNAME, __func__, anonstr (pair.first.c_str ()));
+              TRETURN 1;
+            }
+        }
+    }
+  if (m_encrypt)
+    {
+      for (const auto &recp: m_recipients)
+        {
+          if (res.recipient_keys.find (ResolutionCache::normalize
+                                       (recp.mbox ()))
+              == res.recipient_keys.end ())
+            {
+              TRACEPOINT;
+              TRETURN 1;
+            }
+        }
+      for (auto &recp: m_recipients)
+        {
+          recp.setKeys (res.recipient_keys.at (ResolutionCache::normalize
+                                               (recp.mbox ())));
+        }
+    }
+  const auto signer_keys = m_signer_keys;
+  if (m_sign)
+    {
+      m_signer_keys = res.signer_keys;
+    }
+  if (!is_resolved ())
+    {
+      log_debug ("%s:%s: Remembered resolution is incomplete.",
+                 SRCNAME, __func__);
+      for (auto &recp: m_recipients)
+        {
+          recp.setKeys (std::vector<GpgME::Key> ());
+        }
+      m_signer_keys = signer_keys;
+      TRETURN 1;
+    }
+  m_proto = res.proto;
+  TRETURN 0;
+}
+
+/* Remember the keys of this resolution under ID.  */
+void
+CryptController::remember_resolution (const std::string &id) const
+{
+  TSTART;
+  ResolutionCache::Resolution res;
+
+  res.proto = m_proto;
+  if (m_sign)
+    {
+      res.signer_keys = m_signer_keys;
+    }
+  if (m_encrypt)
+    {
+      for (const auto &recp: m_recipients)
+        {
+          res.recipient_keys[ResolutionCache::normalize (recp.mbox ())] =
+            recp.keys ();
+        }
+    }
+  ResolutionCache::instance ()->put (id, res);
+  TRETURN;
+}
+
+/* Resolve the keys while the mail is still composed so that
+   resolve_keys finds them through resolve_keys_memo on send.  This
+   may run in any thread and does not touch the mail.  Only the
+   resolution without user interaction is tried and it is only
+   remembered if IS_CURRENT still returns true.  The state of the
+   controller is the same afterwards so it can be run again.
+   Returns 0 if a usable resolution is known.  */
+int
+CryptController::resolve_keys_speculative (const std::function<bool ()>
+                                           &is_current)
+{
+  TSTART;
+  if (!opt.autoresolve || opt.alwaysShowApproval || m_recipients.empty ()
+      || (!m_encrypt && !m_sign))
+    {
+      TRETURN 1;
+    }
+
+  const GpgME::Protocol requested_proto = m_proto;
+  const auto signer_keys = m_signer_keys;
+  const auto memo_id = resolution_id (requested_proto);
+  int ret = 1;
+
+  for (auto &recp: m_recipients)
+    {
+      recp.setKeys (std::vector<GpgME::Key> ());
+    }
+  if (!resolve_keys_memo (memo_id))
+    {
+      log_debug ("%s:%s: already resolved by an earlier resolution",
+                 SRCNAME, __func__);
+      ret = 0;
+    }
+  else if (!is_current ())
+    {
+      log_debug ("%s:%s: canceled", SRCNAME, __func__);
+    }
+  else if (!resolve_keys_cached ())
+    {
+      if (is_current ())
+        {
+          log_debug ("%s:%s: resolved keys through the cache",
+                     SRCNAME, __func__);
+          remember_resolution (memo_id);
+          ret = 0;
+        }
+    }
+
+  for (auto &recp: m_recipients)
+    {
+      recp.setKeys (std::vector<GpgME::Key> ());
+    }
+  m_signer_keys = signer_keys;
+  m_proto = requested_proto;
+  TRETURN ret;
+}
+
 void
 CryptController::clear_keys ()
 {
@@ -647,7 +856,10 @@ int
 CryptController::resolve_keys ()
 {
   TSTART;
+  LATENCY_SCOPE ("CryptController::resolve_keys");
+  TimelineScope timeline_scope (m_mail->timeline (), TL_RESOLVE_KEYS);
 
+  const GpgME::Protocol requested_proto = m_proto;
   m_proto = get_resolved_protocol ();
   if (m_proto != GpgME::UnknownProtocol)
     {
@@ -699,10 +911,25 @@ CryptController::resolve_keys ()
       TRETURN -1;
     }
 
-  if (opt.autoresolve && !opt.alwaysShowApproval && !resolve_keys_cached ())
+  /* Without approval the keys of an earlier send to the same
+     recipients can be used again.  */
+  const bool use_memo = opt.autoresolve && !opt.alwaysShowApproval;
+  const bool sign_requested = m_sign;
+  const auto memo_id = resolution_id (requested_proto);
+  if (use_memo && !resolve_keys_memo (memo_id))
+    {
+      log_debug ("%s:%s: resolved keys through an earlier resolution",
+                 SRCNAME, __func__);
+      start_crypto_overlay();
+      resolving_done ();
+      TRETURN 0;
+    }
+
+  if (use_memo && !resolve_keys_cached ())
     {
       log_debug ("%s:%s: resolved keys through the cache",
                  SRCNAME, __func__);
+      remember_resolution (memo_id);
       start_crypto_overlay();
       resolving_done ();
       TRETURN 0;
@@ -883,13 +1110,170 @@ CryptController::resolve_keys ()
       TRETURN -1;
     }
 
+  /* Remember what the user approved unless the resolver dropped the
+     signature.  */
+  if (!ret && use_memo && m_sign == sign_requested)
+    {
+      remember_resolution (memo_id);
+    }
+
   TRETURN ret;
 }
 
+/* Encrypt the copies for the BCC recipients of a split send before
+   the copies exist.  The mail is collected and signed only once and
+   the copies are encrypted concurrently.  OpenPGP copies share one
+   encryption of the plaintext and differ only in their session key
+   packets.  The results are handed to the mail which passes them on
+   to its copies in splitCopyMailCallback.  BCC recipients with keys
+   of another protocol are left to their copies.  Returns -2 if the
+   user canceled the signing and 0 otherwise.  */
+int
+CryptController::prepare_split_copies ()
+{
+  TSTART;
+  if (!m_encrypt || m_proto == GpgME::UnknownProtocol
+      || m_mail->getDoPGPInline () || m_mail->hasSplitOutputs ())
+    {
+      TRETURN 0;
+    }
+
+  const GpgME::Protocol proto = m_proto;
+  const auto has_proto = [proto] (const GpgME::Key &key)
+    {
+      return key.protocol () == proto;
+    };
+  std::vector<GpgME::Key> own_keys;
+  std::vector<const Recipient *> bccs;
+  for (const auto &recp: m_recipients)
+    {
+      const auto keys = recp.keys ();
+      if (recp.type () == Recipient::olOriginator)
+        {
+          std::copy_if (keys.begin (), keys.end (),
+                        std::back_inserter (own_keys), has_proto);
+        }
+      else if (recp.type () == Recipient::olBCC && !keys.empty ()
+               && std::all_of (keys.begin (), keys.end (), has_proto))
+        {
+          bccs.push_back (&recp);
+        }
+    }
+  if (bccs.empty ())
+    {
+      TRETURN 0;
+    }
+
+  /* The copies read the plaintext from m_input or, when signed, from
+     the multipart/signed put together around it.  */
+  std::unique_ptr<SignedMimeProvider> provider;
+  GpgME::Data multipart;
+  if (m_sign)
+    {
+      /* Every copy gets the same signature.  */
+      auto ctx = GpgME::Context::create (proto);
+      if (!ctx)
+        {
+          log_error ("%s:%s: Failure to create context.",
+                     SRCNAME, __func__);
+          TRETURN 0;
+        }
+      for (const auto &key: m_signer_keys)
+        {
+          if (key.protocol () == proto)
+            {
+              ctx->addSigningKey (key);
+            }
+        }
+      ctx->setTextMode (proto == GpgME::OpenPGP);
+      ctx->setArmor (proto == GpgME::OpenPGP);
+
+      GpgME::Data signature;
+      m_input.seek (0, SEEK_SET);
+      const auto result = ctx->sign (m_input, signature, GpgME::Detached);
+      if (result.error ().isCanceled ())
+        {
+          log_debug ("%s:%s: User cancled",
+                     SRCNAME, __func__);
+          TRETURN -2;
+        }
+      if (result.error ())
+        {
+          log_error ("%s:%s: Signing error %s. Leaving it to the copies.",
+                     SRCNAME, __func__, result.error ().asString ());
+          TRETURN 0;
+        }
+      parse_micalg (result);
+
+      provider.reset (new SignedMimeProvider (proto == GpgME::CMS ?
+                                              PROTOCOL_SMIME :
+                                              PROTOCOL_OPENPGP,
+                                              signature, m_input,
+                                              m_micalg.c_str ()));
+      if (provider->failed ())
+        {
+          TRACEPOINT;
+          TRETURN 0;
+        }
+      multipart = GpgME::Data (provider.get ());
+    }
+
+  const bool binary = proto == GpgME::OpenPGP && opt.binaryTransport;
+  SplitEncrypter encrypter (proto, m_sign ? multipart : m_input);
+  encrypter.setShareSessionKey (true);
+  encrypter.setArmor (!binary);
+  for (const auto recp: bccs)
+    {
+      const auto recp_keys = recp->keys ();
+      auto keys = own_keys;
+      keys.insert (keys.end (), recp_keys.begin (), recp_keys.end ());
+      encrypter.addCopy (keys);
+    }
+
+  std::map<std::string, std::shared_ptr<const SplitOutput> > outputs;
+  std::set<const std::string *> bodies;
+  size_t kept = 0;
+  const int failed = encrypter.run (SPLIT_ENCRYPT_THREADS,
+                                    [&] (size_t idx, const GpgME::Error &err,
+                                         SplitOutput &output)
+    {
+      if (err)
+        {
+          return;
+        }
+      /* A shared body counts only once.  */
+      const bool new_body = output.body && !bodies.count (output.body.get ());
+      const size_t size = output.head.size ()
+                          + (new_body ? output.body->size () : 0);
+      if (kept + size > SPLIT_PREPARED_LIMIT)
+        {
+          log_debug ("%s:%s: Not keeping copy %u of %lu bytes.",
+                     SRCNAME, __func__, (unsigned int) idx,
+                     (unsigned long) size);
+          return;
+        }
+      kept += size;
+      if (new_body)
+        {
+          bodies.insert (output.body.get ());
+        }
+      outputs[bccs[idx]->mbox ()] = std::make_shared<const SplitOutput>
+                                      (std::move (output));
+    });
+  m_input.seek (0, SEEK_SET);
+  log_debug ("%s:%s: Prepared %u copies of %lu bytes, %i failed.",
+             SRCNAME, __func__, (unsigned int) outputs.size (),
+             (unsigned long) kept, failed);
+  m_mail->setSplitOutputs (outputs);
+  TRETURN 0;
+}
+
 int
 CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
 {
   TSTART;
+  LATENCY_SCOPE ("CryptController::do_crypto");
+  TimelineScope timeline_scope (m_mail->timeline (), TL_CRYPTO);
   log_debug ("%s:%s",
              SRCNAME, __func__);
 
@@ -900,6 +1284,19 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
       m_sign = false;
     }
 
+  if (m_prepared)
+    {
+      log_debug ("%s:%s: Encrypted with the split as %s.",
+                 SRCNAME, __func__, to_cstr (m_prepared->proto));
+      m_proto = m_prepared->proto;
+      m_binary = m_prepared->binary;
+      m_prepared_provider.reset (new SplitOutputProvider (m_prepared));
+      m_output = GpgME::Data (m_prepared_provider.get ());
+      m_prepared = nullptr;
+      m_crypto_success = true;
+      TRETURN 0;
+    }
+
   /* Start a WKS check if necessary. */
   WKSHelper::instance()->start_check (m_mail->getSender ());
 
@@ -920,8 +1317,8 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
 
   /* If we need to send multiple emails we jump back from
      here into the main event loop. Copy the mail object
-     and send it out mutiple times. */
-  if (opt.splitBCCMails)
+     and send it out mutiple times.  A draft is only saved.  */
+  if (opt.splitBCCMails && !m_mail->isDraftEncrypt ())
     {
       bool foundOneNormalRecp = false;
       bool foundOneBCCRecp = false;
@@ -932,6 +1329,10 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
               log_debug ("%s:%s: Have both BCC and normal recipients."
                          " Need to send multiple mails.",
                          SRCNAME, __func__);
+              if (prepare_split_copies () == -2)
+                {
+                  TRETURN -2;
+                }
               do_in_ui_thread_async (SEND_MULTIPLE_MAILS, m_mail);
               /* Cancel the crypto of this mail */
               TRETURN -3;
@@ -984,7 +1385,27 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
   ctx->setTextMode (m_proto == GpgME::OpenPGP);
   ctx->setArmor (m_proto == GpgME::OpenPGP);
 
-  if (m_encrypt && m_sign && do_inline)
+  /* The ciphertext of PGP/MIME may be sent binary.  It is then
+     base64 encoded only once by create_encrypt_attach instead of
+     armored.  Signatures stay armored.  */
+  m_binary = m_encrypt && !do_inline && m_proto == GpgME::OpenPGP
+             && opt.binaryTransport;
+
+  /* S/MIME drafts can only hold one part.  */
+  if (!m_draft_parts.empty () && m_proto != GpgME::OpenPGP)
+    {
+      join_draft_parts ();
+    }
+
+  if (!m_draft_parts.empty ())
+    {
+      int rc = encrypt_draft_parts (*ctx, err, r_diag);
+      if (rc)
+        {
+          TRETURN rc;
+        }
+    }
+  else if (m_encrypt && m_sign && do_inline)
     {
       // Sign encrypt combined
       const auto result_pair = ctx->signAndEncrypt (m_enc_keys,
@@ -1048,27 +1469,20 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
       // We now have plaintext in m_input
       // The detached signature in m_output
 
-      // Set up the sink object to construct the multipart/signed
-      GpgME::Data multipart;
-      struct sink_s sinkmem;
-      sink_t sink = &sinkmem;
-      memset (sink, 0, sizeof *sink);
-      sink->cb_data = &multipart;
-      sink->writefnc = sink_data_write;
-
-      if (create_sign_attach (sink,
-                              m_proto == GpgME::CMS ?
-                                         PROTOCOL_SMIME : PROTOCOL_OPENPGP,
-                              m_output, m_input, m_micalg.c_str ()))
+      // Encrypt the multipart/signed while it is put together from
+      // the two.  This way it never exists as a whole in memory.
+      GpgME::Data signature = m_output;
+      SignedMimeProvider provider (m_proto == GpgME::CMS ?
+                                              PROTOCOL_SMIME : PROTOCOL_OPENPGP,
+                                   signature, m_input, m_micalg.c_str ());
+      if (provider.failed ())
         {
           TRACEPOINT;
           TRETURN -1;
         }
-
-      // Now we have the multipart throw away the rest.
+      GpgME::Data multipart (&provider);
       m_output = GpgME::Data ();
-      m_input = GpgME::Data ();
-      multipart.seek (0, SEEK_SET);
+      ctx->setArmor (m_proto == GpgME::OpenPGP && !m_binary);
       const auto encResult = ctx->encrypt (m_enc_keys, multipart,
                                            m_output,
                                            GpgME::Context::AlwaysTrust);
@@ -1092,10 +1506,13 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
                      SRCNAME, __func__);
           TRETURN -2;
         }
-      // Now we have encrypted output just treat it like encrypted.
+      // Now we have encrypted output throw away the rest and just
+      // treat it like encrypted.
+      m_input = GpgME::Data ();
     }
   else if (m_encrypt)
     {
+      ctx->setArmor (m_proto == GpgME::OpenPGP && !m_binary);
       const auto result = ctx->encrypt (m_enc_keys, do_inline ? m_bodyInput : m_input,
                                         m_output,
                                         GpgME::Context::AlwaysTrust);
@@ -1162,182 +1579,120 @@ CryptController::do_crypto (GpgME::Error &err, std::string &r_diag)
   TRETURN 0;
 }
 
-static int
-write_data (sink_t sink, GpgME::Data &data)
-{
-  TSTART;
-  if (!sink || !sink->writefnc)
-    {
-      TRETURN -1;
-    }
-
-  char buf[4096];
-  size_t nread;
-  data.seek (0, SEEK_SET);
-  while ((nread = data.read (buf, 4096)) > 0)
-    {
-      sink->writefnc (sink, buf, nread);
-    }
-
-  TRETURN 0;
-}
-
+/* Encrypt the parts of a draft one by one.  A part which did not
+   change since the draft was saved last is taken from the
+   DraftPartCache.  */
 int
-create_sign_attach (sink_t sink, protocol_t protocol,
-                    GpgME::Data &signature,
-                    GpgME::Data &signedData,
-                    const char *micalg)
+CryptController::encrypt_draft_parts (GpgME::Context &ctx,
+                                      GpgME::Error &err,
+                                      std::string &r_diag)
 {
   TSTART;
-  char boundary[BOUNDARYSIZE+1];
-  char top_header[BOUNDARYSIZE+200];
-  int rc = 0;
-
-  /* Write the top header.  */
-  generate_boundary (boundary);
-  create_top_signing_header (top_header, sizeof top_header,
-                             protocol, 1, boundary,
-                             micalg);
+  auto cache = DraftPartCache::instance ();
+  std::vector<std::string> fprs;
+  unsigned int encrypted = 0;
 
-  if ((rc = write_string (sink, top_header)))
+  for (const auto &key: m_enc_keys)
     {
-      TRACEPOINT;
-      TRETURN rc;
+      fprs.push_back (key.primaryFingerprint () ?
+                      key.primaryFingerprint () : "");
     }
 
-  /* Write the boundary so that it is not included in the hashing.  */
-  if ((rc = write_boundary (sink, boundary, 0)))
+  m_draft_ciphers.clear ();
+  for (const auto &part: m_draft_parts)
     {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  /* Write the signed mime structure */
-  if ((rc = write_data (sink, signedData)))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  /* Write the signature attachment */
-  if ((rc = write_boundary (sink, boundary, 0)))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  if (protocol == PROTOCOL_OPENPGP)
-    {
-      rc = write_string (sink,
-                         "Content-Type: application/pgp-signature;\r\n"
-                         "\tname=\"" OPENPGP_SIG_NAME "\"\r\n"
-                         "Content-Transfer-Encoding: 7Bit\r\n");
-    }
-  else
-    {
-      rc = write_string (sink,
-                         "Content-Transfer-Encoding: base64\r\n"
-                         "Content-Type: application/pkcs7-signature\r\n"
-                         "Content-Disposition: inline;\r\n"
-                         "\tfilename=\"" SMIME_SIG_NAME "\"\r\n");
-      /* rc = write_string (sink, */
-      /*                    "Content-Type: application/x-pkcs7-signature\r\n" */
-      /*                    "\tname=\"smime.p7s\"\r\n" */
-      /*                    "Content-Transfer-Encoding: base64\r\n" */
-      /*                    "Content-Disposition: attachment;\r\n" */
-      /*                    "\tfilename=\"smime.p7s\"\r\n"); */
-
-    }
-
-  if (rc)
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  if ((rc = write_string (sink, "\r\n")))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  // Write the signature data
-  if (protocol == PROTOCOL_SMIME)
-    {
-      const std::string sigStr = signature.toString();
-      if ((rc = write_b64 (sink, (const void *) sigStr.c_str (), sigStr.size())))
+      const auto id = DraftPartCache::makeId (part->hash (),
+                                              m_mail->getUUID (),
+                                              m_proto, fprs, m_binary);
+      auto cipher = cache->get (id);
+      if (!cipher)
         {
-          TRACEPOINT;
-          TRETURN rc;
+          GpgME::Data plaintext = part->data ();
+          GpgME::Data output;
+          ctx.setArmor (!m_binary);
+          const auto result = ctx.encrypt (m_enc_keys, plaintext, output,
+                                           GpgME::Context::AlwaysTrust);
+          err = result.error ();
+          if (err.isCanceled ())
+            {
+              log_debug ("%s:%s: User cancled",
+                         SRCNAME, __func__);
+              TRETURN -2;
+            }
+          if (err)
+            {
+              log_error ("%s:%s: Encryption error %s.",
+                         SRCNAME, __func__, err.asString ());
+              GpgME::Data log;
+              const auto err3 = ctx.getAuditLog
+                (log, GpgME::Context::DiagnosticAuditLog);
+              if (!err3)
+                {
+                  r_diag = log.toString ();
+                }
+              TRETURN -1;
+            }
+          cipher = std::make_shared<const std::string> (output.toString ());
+          cache->put (id, cipher);
+          encrypted++;
         }
+      m_draft_ciphers.push_back (cipher);
     }
-  else if ((rc = write_data (sink, signature)))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  // Add an extra linefeed with should not harm.
-  if ((rc = write_string (sink, "\r\n")))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  /* Write the final boundary.  */
-  if ((rc = write_boundary (sink, boundary, 1)))
-    {
-      TRACEPOINT;
-      TRETURN rc;
-    }
-
-  TRETURN rc;
+  log_debug ("%s:%s: Encrypted %u of %u draft parts",
+             SRCNAME, __func__, encrypted,
+             (unsigned int) m_draft_parts.size ());
+  m_draft_parts.clear ();
+  TRETURN 0;
 }
 
-static int
-create_encrypt_attach (sink_t sink, protocol_t protocol,
-                       GpgME::Data &encryptedData,
-                       int exchange_major_version)
+/* Put the parts of a draft together again into m_input for a draft
+   which is encrypted as a whole.  */
+void
+CryptController::join_draft_parts ()
 {
   TSTART;
+  struct sink_s sinkmem;
   char boundary[BOUNDARYSIZE+1];
-  int rc = create_top_encryption_header (sink, protocol, boundary,
-                                         false, exchange_major_version);
-  // From here on use goto failure pattern.
-  if (rc)
-    {
-      log_error ("%s:%s: Failed to create top header.",
-                 SRCNAME, __func__);
-      TRETURN rc;
-    }
+  int rc = 0;
 
-  if (protocol == PROTOCOL_OPENPGP ||
-      exchange_major_version >= 15)
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &m_input;
+  sinkmem.writefnc = sink_data_write;
+  if (m_draft_parts.size () == 1)
     {
-      // With exchange 2016 we have to construct S/MIME
-      // differently and write the raw data here.
-      rc = write_data (sink, encryptedData);
+      GpgME::Data part = m_draft_parts[0]->data ();
+      rc = write_data (&sinkmem, part);
     }
   else
     {
-      const auto encStr = encryptedData.toString();
-      rc = write_b64 (sink, encStr.c_str(), encStr.size());
+      generate_boundary (boundary);
+      rc = write_multistring (&sinkmem,
+                              "Content-Type: multipart/mixed;\r\n",
+                              "\tboundary=\"", boundary, "\"\r\n",
+                              NULL);
+      for (size_t idx = 0; !rc && idx < m_draft_parts.size (); idx++)
+        {
+          rc = write_boundary (&sinkmem, boundary, 0);
+          if (!rc)
+            {
+              GpgME::Data part = m_draft_parts[idx]->data ();
+              rc = write_data (&sinkmem, part);
+            }
+        }
+      if (!rc)
+        {
+          rc = write_boundary (&sinkmem, boundary, 1);
+        }
     }
-
   if (rc)
     {
-      log_error ("%s:%s: Failed to create top header.",
-                 SRCNAME, __func__);
-      TRETURN rc;
-    }
-
-  /* Write the final boundary (for OpenPGP) and finish the attachment.  */
-  if (*boundary && (rc = write_boundary (sink, boundary, 1)))
-    {
-      log_error ("%s:%s: Failed to write boundary.",
-                 SRCNAME, __func__);
+      log_error ("%s:%s: Joining the parts failed.", SRCNAME, __func__);
     }
-  TRETURN rc;
+  log_debug ("%s:%s: Joined %u parts", SRCNAME, __func__,
+             (unsigned int) m_draft_parts.size ());
+  m_draft_parts.clear ();
+  m_input.seek (0, SEEK_SET);
+  TRETURN;
 }
 
 int
@@ -1432,24 +1787,42 @@ CryptController::update_mail_mapi ()
                                    PROTOCOL_SMIME :
                                    PROTOCOL_OPENPGP;
 
+  /* Batch the small writes before they go to the attachment's
+     stream.  */
+  struct sink_batch_s batch;
+  struct sink_s batchsinkmem;
+  sink_t batchsink = &batchsinkmem;
+  sink_init_batch (batchsink, &batch, sink);
+
   int rc = 0;
   /* Do we have override MIME ? */
   const auto overrideMime = m_mail->get_override_mime_data ();
   if (!overrideMime.empty())
     {
-      rc = write_string (sink, overrideMime.c_str ());
+      rc = write_string (batchsink, overrideMime.c_str ());
+    }
+  else if (!m_draft_ciphers.empty ())
+    {
+      rc = create_draft_parts_attach (batchsink, protocol, m_draft_ciphers,
+                                      exchange_major_version, m_binary);
     }
   else if (m_sign && m_encrypt)
     {
-      rc = create_encrypt_attach (sink, protocol, m_output, exchange_major_version);
+      rc = create_encrypt_attach (batchsink, protocol, m_output,
+                                  exchange_major_version, m_binary);
     }
   else if (m_encrypt)
     {
-      rc = create_encrypt_attach (sink, protocol, m_output, exchange_major_version);
+      rc = create_encrypt_attach (batchsink, protocol, m_output,
+                                  exchange_major_version, m_binary);
     }
   else if (m_sign)
     {
-      rc = create_sign_attach (sink, protocol, m_output, m_input, m_micalg.c_str ());
+      rc = create_sign_attach (batchsink, protocol, m_output, m_input, m_micalg.c_str ());
+    }
+  if (!rc)
+    {
+      rc = sink_flush (batchsink);
     }
 
   // Close our attachment
@@ -28,12 +28,21 @@
 #include <gpgme++/data.h>
 #include <string.h>
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 class Recipient;
 class Mail;
 class Overlay;
+struct SplitOutput;
+class SplitOutputProvider;
+class DraftPart;
 
 namespace GpgME
 {
+  class Context;
   class SigningResult;
   class Error;
 } // namespace GpgME
@@ -92,12 +101,27 @@ public:
     might be necessary to fulfil the operation.
     */
   GpgME::Protocol get_resolved_protocol () const;
+
+  /** @brief Resolve the keys in the background without asking the
+    user and remember the result for the send.  Can be called in a
+    different thread then the UI Thread.  The result is only kept
+    as long as is_current returns true.
+
+    @returns 0 if the keys could be resolved. */
+  int resolve_keys_speculative (const std::function<bool ()> &is_current);
 private:
   void clear_keys ();
   void resolving_done ();
   int resolve_keys ();
   int resolve_keys_cached ();
+  std::string resolution_id (GpgME::Protocol proto) const;
+  int resolve_keys_memo (const std::string &id);
+  void remember_resolution (const std::string &id) const;
   bool resolve_through_protocol (GpgME::Protocol proto);
+  int prepare_split_copies ();
+  int encrypt_draft_parts (GpgME::Context &ctx, GpgME::Error &err,
+                           std::string &r_diag);
+  void join_draft_parts ();
   int parse_output (GpgME::Data &resolverOutput);
   int lookup_fingerprints (const std::vector<std::string> &sigFprs,
                            const std::vector<std::pair<std::string, std::string> > &recpFprs);
@@ -108,15 +132,22 @@ private:
 
 private:
   Mail *m_mail;
+  /* Reads a prepared output for m_output, so it must outlive it.  */
+  std::unique_ptr<SplitOutputProvider> m_prepared_provider;
   GpgME::Data m_input, m_bodyInput, m_signedData, m_output;
   std::string m_micalg;
   bool m_encrypt, m_sign, m_crypto_success;
+  bool m_binary;
   GpgME::Protocol m_proto;
   std::string m_sender;
   std::vector<GpgME::Key> m_signer_keys;
   std::vector<GpgME::Key> m_enc_keys;
   std::vector<Recipient> m_recipients;
   std::unique_ptr<Overlay> m_overlay;
+  std::shared_ptr<const SplitOutput> m_prepared;
+  /* The plaintext parts of a draft and their ciphertexts.  */
+  std::vector<std::unique_ptr<DraftPart> > m_draft_parts;
+  std::vector<std::shared_ptr<const std::string> > m_draft_ciphers;
 };
 
 #endif
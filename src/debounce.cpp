@@ -0,0 +1,182 @@
+/* @file debounce.cpp
+ * @brief Run jobs once their input stopped changing.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <vector>
+
+#include <gpg-error.h>
+
+#include "common_indep.h"
+#include "debounce.h"
+
+/* One lock for all schedulers.  There is only one in GpgOL and the
+   lock is never held while a job runs.  */
+GPGRT_LOCK_DEFINE (debounce_lock);
+
+DebounceScheduler::Token::Token (const DebounceScheduler *scheduler,
+                                 const std::string &key,
+                                 unsigned long long generation):
+  m_scheduler (scheduler),
+  m_key (key),
+  m_generation (generation)
+{
+}
+
+bool
+DebounceScheduler::Token::isCurrent () const
+{
+  return m_scheduler->isCurrent (m_key, m_generation);
+}
+
+DebounceScheduler::DebounceScheduler (msec_t delay):
+  m_delay (delay),
+  m_generation (0)
+{
+}
+
+void
+DebounceScheduler::schedule (const std::string &key, msec_t now,
+                             const job_t &job)
+{
+  gpgol_lock (&debounce_lock);
+  auto &ent = m_entries[key];
+  ent.generation = ++m_generation;
+  ent.due = now + m_delay;
+  ent.job = job;
+  gpgol_unlock (&debounce_lock);
+}
+
+void
+DebounceScheduler::cancel (const std::string &key)
+{
+  gpgol_lock (&debounce_lock);
+  m_entries.erase (key);
+  gpgol_unlock (&debounce_lock);
+}
+
+void
+DebounceScheduler::cancelAll ()
+{
+  gpgol_lock (&debounce_lock);
+  m_entries.clear ();
+  gpgol_unlock (&debounce_lock);
+}
+
+bool
+DebounceScheduler::isCurrent (const std::string &key,
+                              unsigned long long generation) const
+{
+  gpgol_lock (&debounce_lock);
+  const auto it = m_entries.find (key);
+  bool ret = it != m_entries.end () && it->second.generation == generation;
+  gpgol_unlock (&debounce_lock);
+  return ret;
+}
+
+int
+DebounceScheduler::runDue (msec_t now)
+{
+  std::vector<std::pair<Token, job_t> > due;
+
+  gpgol_lock (&debounce_lock);
+  for (auto &pair: m_entries)
+    {
+      entry &ent = pair.second;
+      if (!ent.job || ent.due > now)
+        {
+          continue;
+        }
+      due.push_back (std::make_pair (Token (this, pair.first,
+                                            ent.generation),
+                                     ent.job));
+      ent.job = nullptr;
+    }
+  gpgol_unlock (&debounce_lock);
+
+  for (const auto &pair: due)
+    {
+      if (pair.first.isCurrent ())
+        {
+          pair.second (pair.first);
+        }
+    }
+
+  /* Forget the jobs which were not scheduled again meanwhile.  */
+  gpgol_lock (&debounce_lock);
+  for (auto it = m_entries.begin (); it != m_entries.end ();)
+    {
+      if (!it->second.job)
+        {
+          it = m_entries.erase (it);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+  gpgol_unlock (&debounce_lock);
+  return (int) due.size ();
+}
+
+DebounceScheduler::msec_t
+DebounceScheduler::nextDue (msec_t now, msec_t idle) const
+{
+  msec_t ret = idle;
+
+  gpgol_lock (&debounce_lock);
+  for (const auto &pair: m_entries)
+    {
+      const entry &ent = pair.second;
+      if (!ent.job)
+        {
+          continue;
+        }
+      if (ent.due <= now)
+        {
+          ret = 0;
+          break;
+        }
+      if (ent.due - now < ret)
+        {
+          ret = ent.due - now;
+        }
+    }
+  gpgol_unlock (&debounce_lock);
+  return ret;
+}
+
+size_t
+DebounceScheduler::pending () const
+{
+  size_t ret = 0;
+
+  gpgol_lock (&debounce_lock);
+  for (const auto &pair: m_entries)
+    {
+      if (pair.second.job)
+        {
+          ret++;
+        }
+    }
+  gpgol_unlock (&debounce_lock);
+  return ret;
+}
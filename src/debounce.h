@@ -0,0 +1,103 @@
+/* @file debounce.h
+ * @brief Run jobs once their input stopped changing.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include "config.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+/** Debounce and cancel scheduler for background jobs.
+
+  A job is scheduled under a key, e.g. for a mail.  It becomes due
+  once no other job was scheduled under the same key for the delay
+  of the scheduler.  Scheduling again replaces the pending job and
+  makes a running job for the key stale.  A running job should check
+  its token and stop early if it is no longer current.
+
+  The scheduler does not start threads or timers and gets the time
+  passed in, so that the caller decides where the jobs run.  A
+  worker calls runDue and then waits for nextDue milliseconds or
+  until something was scheduled.  All functions are thread safe.  */
+class DebounceScheduler
+{
+public:
+  typedef unsigned long long msec_t;
+
+  /* Passed to a running job.  */
+  class Token
+    {
+    public:
+      Token (const DebounceScheduler *scheduler, const std::string &key,
+             unsigned long long generation);
+
+      /* False if the job was replaced or canceled.  */
+      bool isCurrent () const;
+
+    private:
+      const DebounceScheduler *m_scheduler;
+      std::string m_key;
+      unsigned long long m_generation;
+    };
+
+  typedef std::function<void (const Token &token)> job_t;
+
+  explicit DebounceScheduler (msec_t delay);
+
+  /* Schedule JOB for KEY at the time NOW plus the delay.  */
+  void schedule (const std::string &key, msec_t now, const job_t &job);
+
+  /* Drop the pending job for KEY and make a running one stale.  */
+  void cancel (const std::string &key);
+
+  /* Drop all pending jobs and make the running ones stale.  */
+  void cancelAll ();
+
+  /* Run the jobs which are due at NOW in the calling thread.
+     Returns the number of jobs run.  */
+  int runDue (msec_t now);
+
+  /* Milliseconds from NOW until the next job is due or IDLE if there
+     is none.  */
+  msec_t nextDue (msec_t now, msec_t idle) const;
+
+  /* The number of pending jobs.  */
+  size_t pending () const;
+
+private:
+  struct entry
+    {
+      unsigned long long generation;
+      msec_t due;
+      job_t job;       /* Empty while the job runs.  */
+    };
+
+  bool isCurrent (const std::string &key,
+                  unsigned long long generation) const;
+
+  msec_t m_delay;
+  unsigned long long m_generation;
+  std::map<std::string, entry> m_entries;
+};
+
+#endif
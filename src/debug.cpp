@@ -21,8 +21,16 @@
 
 #include <gpg-error.h>
 
-#include <string>
-#include <unordered_map>
+#include <atomic>
+
+#ifndef HAVE_W32_SYSTEM
+# include <pthread.h>
+# include <time.h>
+# include <unistd.h>
+# ifdef __linux__
+#  include <sys/syscall.h>
+# endif
+#endif
 
 /* The malloced name of the logfile and the logging stream.  If
    LOGFILE is NULL, no logging is done. */
@@ -31,6 +39,105 @@ static FILE *logfp;
 
 GPGRT_LOCK_DEFINE (log_lock);
 
+/* Log messages are formatted and time stamped on the calling thread
+   and put into a ring buffer owned by that thread.  A writer thread
+   drains the rings into the log file so that callers do not wait for
+   the file system.  Everything that drains a ring or writes to LOGFP
+   holds LOG_LOCK.  Thus each ring has exactly one producer and one
+   consumer at any time and needs no further locking.
+
+   If a ring is full the message is dropped and counted; the count is
+   written to the log with the next drain.  Errors are never dropped
+   and flush all rings so that they are on disk before anything else
+   can go wrong.  */
+
+/* Size of a ring in bytes.  Must be a power of two.  */
+#define LOG_RING_SIZE (128 * 1024)
+
+/* Rings are reused by new threads but there are never more than this
+   many.  Threads without a ring log synchronously.  */
+#define LOG_MAX_RINGS 64
+
+/* Longer messages are written synchronously.  */
+#define LOG_RECORD_MAX (LOG_RING_SIZE / 4)
+
+/* Messages up to this size are formatted without an allocation.  */
+#define LOG_LINE_MAX 1024
+
+/* How often the writer thread drains the rings in milliseconds.  */
+#define LOG_WRITER_INTERVAL 50
+
+/* Marks the unused end of a ring.  */
+#define LOG_RECORD_WRAP 0xffffffff
+
+#define LOG_RECORD_SPACE(len) \
+  ((sizeof (log_record_t) + (len) + 7) & ~(size_t)7)
+
+typedef struct
+{
+#ifdef HAVE_W32_SYSTEM
+  SYSTEMTIME time;
+#else
+  struct timespec time;
+#endif
+  unsigned long tid;
+} log_stamp_t;
+
+/* A record in the ring.  The text follows the header.  */
+typedef struct
+{
+  uint32_t len;
+  log_stamp_t stamp;
+} log_record_t;
+
+struct log_ring_s
+{
+  /* Only changed by the producer.  */
+  std::atomic<size_t> head;
+  /* Only changed by the consumer.  */
+  std::atomic<size_t> tail;
+  std::atomic<unsigned long> dropped;
+  /* Set while a thread produces into this ring.  */
+  std::atomic<bool> owned;
+  alignas (8) char buf[LOG_RING_SIZE];
+};
+
+static std::atomic<log_ring_s *> rings[LOG_MAX_RINGS];
+static std::atomic<int> n_rings;
+GPGRT_LOCK_DEFINE (ring_lock);
+
+enum writer_state
+{
+  WRITER_NONE = 0,
+  WRITER_RUNNING,
+  WRITER_STOPPED
+};
+static std::atomic<int> writer;
+static std::atomic<bool> writer_wake_pending;
+
+/* Gives the ring back when a thread exits.  A new thread may continue
+   with it even if it was not yet drained.  */
+struct ring_holder_s
+{
+  ~ring_holder_s ()
+    {
+      if (ring)
+        ring->owned.store (false, std::memory_order_release);
+    }
+  log_ring_s *ring;
+};
+static thread_local ring_holder_s ring_holder;
+
+/* A line buffer which counts what did not fit.  */
+typedef struct
+{
+  char *buf;
+  size_t size;
+  size_t len;
+} log_line_t;
+
+static void flush_rings (void);
+
 /* Acquire the mutex for logging.  Returns 0 on success. */
 static int
 lock_log (void)
@@ -59,9 +166,12 @@ set_log_file (const char *name)
 {
   if (!lock_log ())
     {
+      /* Pending messages still belong to the old file.  */
+      flush_rings ();
       if (logfp)
         {
-          fclose (logfp);
+          if (logfp != stdout && logfp != stderr)
+            fclose (logfp);
           logfp = NULL;
         }
       free (logfile);
@@ -74,23 +184,43 @@ set_log_file (const char *name)
     }
 }
 
-static void
-do_log (const char *fmt, va_list a, int w32err, int err,
-        const void *buf, size_t buflen)
+unsigned long
+log_thread_id (void)
 {
-  if (!logfile)
-    return;
-
 #ifdef HAVE_W32_SYSTEM
-  if (!opt.enable_debug)
-    return;
+  return (unsigned long) GetCurrentThreadId ();
+#else
+  static thread_local unsigned long tid;
 
-  if (lock_log ())
+  if (!tid)
     {
-      OutputDebugStringA ("GpgOL: Failed to log.");
-      return;
+# ifdef __linux__
+      tid = (unsigned long) syscall (SYS_gettid);
+# else
+      tid = (unsigned long) pthread_self ();
+# endif
     }
+  return tid;
 #endif
+}
+
+static void
+get_stamp (log_stamp_t *stamp)
+{
+#ifdef HAVE_W32_SYSTEM
+  GetSystemTime (&stamp->time);
+#else
+  clock_gettime (CLOCK_REALTIME, &stamp->time);
+#endif
+  stamp->tid = log_thread_id ();
+}
+
+/* Open the log file if needed.  Called with the log lock held.  */
+static FILE *
+get_logfp (void)
+{
+  if (logfp || !logfile)
+    return logfp;
 
   if (!strcmp (logfile, "stdout"))
     {
@@ -101,38 +231,348 @@ do_log (const char *fmt, va_list a, int w32err, int err,
       logfp = stderr;
     }
   if (!logfp)
-    logfp = fopen (logfile, "a+");
+    {
+      logfp = fopen (logfile, "a+");
+      /* We flush explicitly.  */
+      if (logfp)
+        setvbuf (logfp, NULL, _IOFBF, 64 * 1024);
+    }
+  return logfp;
+}
+
+/* Format the "HH:MM:SS" part of the prefix of STAMP into BUF.  */
+static bool
+format_time (const log_stamp_t *stamp, char *buf)
+{
 #ifdef HAVE_W32_SYSTEM
-  if (!logfp)
+  return GetTimeFormatA (LOCALE_INVARIANT,
+                         TIME_FORCE24HOURFORMAT | LOCALE_USE_CP_ACP,
+                         &stamp->time,
+                         "HH:mm:ss",
+                         buf,
+                         9);
+#else
+  struct tm tm;
+
+  if (!gmtime_r (&stamp->time.tv_sec, &tm))
+    return false;
+  snprintf (buf, 9, "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+  return true;
+#endif
+}
+
+/* Write a formatted message to the log file.  Called with the log
+   lock held.  */
+static void
+write_record (const log_stamp_t *stamp, const char *text, size_t len)
+{
+  /* The writer sees long runs of messages from the same second and
+     thread, so the prefix is only formatted when it changes.  */
+  static log_stamp_t last;
+  static char prefix[48];
+  static size_t prefix_len;
+  FILE *fp = get_logfp ();
+
+  if (!fp)
+    return;
+
+#ifdef HAVE_W32_SYSTEM
+  bool same = (stamp->time.wSecond == last.time.wSecond
+               && stamp->time.wMinute == last.time.wMinute
+               && stamp->time.wHour == last.time.wHour);
+#else
+  bool same = stamp->time.tv_sec == last.time.tv_sec;
+#endif
+  if (!prefix_len || !same || stamp->tid != last.tid)
     {
-      unlock_log ();
-      return;
+      char time_str[9];
+
+      prefix_len = snprintf (prefix, sizeof prefix, "%s/%lu/",
+                             format_time (stamp, time_str) ? time_str
+                                                           : "unknown",
+                             stamp->tid);
+      last = *stamp;
+    }
+  fwrite (prefix, 1, prefix_len, fp);
+  fwrite (text, 1, len, fp);
+}
+
+/* Write everything in RING to the log file.  Called with the log lock
+   held.  */
+static void
+drain_ring (log_ring_s *ring)
+{
+  size_t tail = ring->tail.load (std::memory_order_relaxed);
+  const size_t head = ring->head.load (std::memory_order_acquire);
+  unsigned long dropped;
+
+  while (tail != head)
+    {
+      const size_t offset = tail & (LOG_RING_SIZE - 1);
+      log_record_t rec;
+
+      memcpy (&rec.len, ring->buf + offset, sizeof rec.len);
+      if (rec.len == LOG_RECORD_WRAP)
+        {
+          tail += LOG_RING_SIZE - offset;
+          continue;
+        }
+      memcpy (&rec, ring->buf + offset, sizeof rec);
+      write_record (&rec.stamp, ring->buf + offset + sizeof rec, rec.len);
+      tail += LOG_RECORD_SPACE (rec.len);
     }
+  ring->tail.store (tail, std::memory_order_release);
 
-  char time_str[9];
-  SYSTEMTIME utc_time;
-  GetSystemTime (&utc_time);
-  if (GetTimeFormatA (LOCALE_INVARIANT,
-                      TIME_FORCE24HOURFORMAT | LOCALE_USE_CP_ACP,
-                      &utc_time,
-                      "HH:mm:ss",
-                      time_str,
-                      9))
+  dropped = ring->dropped.exchange (0);
+  if (dropped)
     {
-      fprintf (logfp, "%s/%lu/",
-               time_str,
-               (unsigned long)GetCurrentThreadId ());
+      log_stamp_t stamp;
+      char buf[80];
+
+      get_stamp (&stamp);
+      snprintf (buf, sizeof buf, "%s:%s: %lu log messages dropped\n",
+                SRCNAME, __func__, dropped);
+      write_record (&stamp, buf, strlen (buf));
     }
-  else
+}
+
+/* Drain all rings and flush the log file.  Called with the log lock
+   held.  */
+static void
+flush_rings (void)
+{
+  const int n = n_rings.load (std::memory_order_acquire);
+
+  for (int i = 0; i < n; i++)
+    drain_ring (rings[i].load (std::memory_order_acquire));
+  if (logfp)
+    fflush (logfp);
+}
+
+#ifdef HAVE_W32_SYSTEM
+static HANDLE writer_event;
+
+static void
+wake_writer (void)
+{
+  SetEvent (writer_event);
+}
+
+static DWORD WINAPI
+writer_thread (LPVOID)
+{
+  while (writer.load () == WRITER_RUNNING)
+    {
+      WaitForSingleObject (writer_event, LOG_WRITER_INTERVAL);
+      writer_wake_pending.store (false);
+      log_flush ();
+    }
+  return 0;
+}
+
+static bool
+create_writer (void)
+{
+  HANDLE thread;
+
+  writer_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  if (!writer_event)
+    return false;
+  thread = CreateThread (NULL, 0, writer_thread, NULL, 0, NULL);
+  if (!thread)
+    return false;
+  CloseHandle (thread);
+  return true;
+}
+#else
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+
+static void
+wake_writer (void)
+{
+  pthread_mutex_lock (&writer_mutex);
+  pthread_cond_signal (&writer_cond);
+  pthread_mutex_unlock (&writer_mutex);
+}
+
+static void *
+writer_thread (void *)
+{
+  while (writer.load () == WRITER_RUNNING)
     {
-      fprintf (logfp, "unknown/%lu/",
-               (unsigned long)GetCurrentThreadId ());
+      struct timespec ts;
+
+      clock_gettime (CLOCK_REALTIME, &ts);
+      ts.tv_nsec += LOG_WRITER_INTERVAL * 1000000L;
+      if (ts.tv_nsec >= 1000000000L)
+        {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000L;
+        }
+      pthread_mutex_lock (&writer_mutex);
+      if (!writer_wake_pending.load ())
+        pthread_cond_timedwait (&writer_cond, &writer_mutex, &ts);
+      pthread_mutex_unlock (&writer_mutex);
+      writer_wake_pending.store (false);
+      log_flush ();
     }
+  return NULL;
+}
+
+static bool
+create_writer (void)
+{
+  pthread_t thread;
+
+  if (pthread_create (&thread, NULL, writer_thread, NULL))
+    return false;
+  pthread_detach (thread);
+  atexit (log_shutdown);
+  return true;
+}
 #endif
 
+/* Start the writer thread on first use.  Returns true if it is
+   running.  */
+static bool
+start_writer (void)
+{
+  int state = writer.load ();
+
+  if (state != WRITER_NONE)
+    return state == WRITER_RUNNING;
+
+  gpgrt_lock_lock (&ring_lock);
+  if (writer.load () == WRITER_NONE)
+    {
+      writer.store (WRITER_RUNNING);
+      if (!create_writer ())
+        writer.store (WRITER_STOPPED);
+    }
+  gpgrt_lock_unlock (&ring_lock);
+  return writer.load () == WRITER_RUNNING;
+}
+
+/* Return the ring of the current thread or NULL if the message needs
+   to be written synchronously.  */
+static log_ring_s *
+get_ring (void)
+{
+  log_ring_s *ring;
+  int n;
+
+  if (!start_writer ())
+    return NULL;
+  if (ring_holder.ring)
+    return ring_holder.ring;
+
+  n = n_rings.load (std::memory_order_acquire);
+  for (int i = 0; i < n; i++)
+    {
+      bool expected = false;
+
+      ring = rings[i].load (std::memory_order_acquire);
+      if (ring->owned.compare_exchange_strong (expected, true,
+                                               std::memory_order_acq_rel))
+        {
+          ring_holder.ring = ring;
+          return ring;
+        }
+    }
+
+  ring = NULL;
+  gpgrt_lock_lock (&ring_lock);
+  n = n_rings.load (std::memory_order_relaxed);
+  if (n < LOG_MAX_RINGS)
+    {
+      ring = new log_ring_s ();
+      ring->owned.store (true);
+      rings[n].store (ring, std::memory_order_release);
+      n_rings.store (n + 1, std::memory_order_release);
+    }
+  gpgrt_lock_unlock (&ring_lock);
+
+  ring_holder.ring = ring;
+  return ring;
+}
+
+/* Put a message into RING.  Returns false if it is full.  */
+static bool
+ring_push (log_ring_s *ring, const log_stamp_t *stamp,
+           const char *text, size_t len)
+{
+  size_t head = ring->head.load (std::memory_order_relaxed);
+  const size_t tail = ring->tail.load (std::memory_order_acquire);
+  const size_t need = LOG_RECORD_SPACE (len);
+  size_t offset = head & (LOG_RING_SIZE - 1);
+  size_t pad = 0;
+  log_record_t rec;
+
+  /* Records are not split at the end of the buffer.  */
+  if (offset + need > LOG_RING_SIZE)
+    pad = LOG_RING_SIZE - offset;
+  if (head + pad + need - tail > LOG_RING_SIZE)
+    return false;
+
+  if (pad)
+    {
+      const uint32_t wrap = LOG_RECORD_WRAP;
+
+      memcpy (ring->buf + offset, &wrap, sizeof wrap);
+      head += pad;
+      offset = 0;
+    }
+  rec.len = (uint32_t) len;
+  rec.stamp = *stamp;
+  memcpy (ring->buf + offset, &rec, sizeof rec);
+  memcpy (ring->buf + offset + sizeof rec, text, len);
+  head += need;
+  ring->head.store (head, std::memory_order_release);
+
+  if (head - tail > LOG_RING_SIZE / 2
+      && !writer_wake_pending.exchange (true))
+    wake_writer ();
+  return true;
+}
+
+static void
+line_vprintf (log_line_t *line, const char *fmt, va_list a)
+{
+  size_t left = line->len < line->size ? line->size - line->len : 0;
+  int n = vsnprintf (left ? line->buf + line->len : NULL, left, fmt, a);
+
+  if (n > 0)
+    line->len += n;
+}
+
+static void
+line_printf (log_line_t *line, const char *fmt, ...)
+{
+  va_list a;
+
+  va_start (a, fmt);
+  line_vprintf (line, fmt, a);
+  va_end (a);
+}
+
+static void
+line_putc (log_line_t *line, char c)
+{
+  if (line->len + 1 < line->size)
+    line->buf[line->len] = c;
+  line->len++;
+  if (line->len < line->size)
+    line->buf[line->len] = 0;
+}
+
+static void
+format_message (log_line_t *line, const char *fmt, va_list a, int w32err,
+                int err, const void *buf, size_t buflen)
+{
   if (err == 1)
-    fputs ("ERROR/", logfp);
-  vfprintf (logfp, fmt, a);
+    line_printf (line, "ERROR/");
+  line_vprintf (line, fmt, a);
 #ifdef HAVE_W32_SYSTEM
   if (w32err)
     {
@@ -141,12 +581,11 @@ do_log (const char *fmt, va_list a, int w32err, int err,
       FormatMessage (FORMAT_MESSAGE_FROM_SYSTEM, NULL, w32err,
                      MAKELANGID (LANG_NEUTRAL, SUBLANG_DEFAULT),
                      tmpbuf, sizeof (tmpbuf)-1, NULL);
-      fputs (": ", logfp);
       if (*tmpbuf && tmpbuf[strlen (tmpbuf)-1] == '\n')
         tmpbuf[strlen (tmpbuf)-1] = 0;
       if (*tmpbuf && tmpbuf[strlen (tmpbuf)-1] == '\r')
         tmpbuf[strlen (tmpbuf)-1] = 0;
-      fprintf (logfp, "%s (%d)", tmpbuf, w32err);
+      line_printf (line, ": %s (%d)", tmpbuf, w32err);
     }
 #else
   (void) w32err;
@@ -156,16 +595,106 @@ do_log (const char *fmt, va_list a, int w32err, int err,
       const unsigned char *p = (const unsigned char*)buf;
 
       for ( ; buflen; buflen--, p++)
-        fprintf (logfp, "%02X", *p);
-      putc ('\n', logfp);
+        line_printf (line, "%02X", *p);
+      line_putc (line, '\n');
     }
   else if ( *fmt && fmt[strlen (fmt) - 1] != '\n')
-    putc ('\n', logfp);
+    line_putc (line, '\n');
+}
 
-  fflush (logfp);
+/* Write a message directly after draining the rings.  */
+static void
+write_sync (const log_stamp_t *stamp, const char *text, size_t len)
+{
+  if (lock_log ())
+    {
 #ifdef HAVE_W32_SYSTEM
+      OutputDebugStringA ("GpgOL: Failed to log.");
+#endif
+      return;
+    }
+  flush_rings ();
+  write_record (stamp, text, len);
+  if (logfp)
+    fflush (logfp);
   unlock_log ();
+}
+
+static void
+do_log (const char *fmt, va_list a, int w32err, int err,
+        const void *buf, size_t buflen)
+{
+  char tmpbuf[LOG_LINE_MAX];
+  log_line_t line = { tmpbuf, sizeof tmpbuf, 0 };
+  log_stamp_t stamp;
+  log_ring_s *ring;
+  va_list a2;
+
+  if (!logfile)
+    return;
+
+#ifdef HAVE_W32_SYSTEM
+  if (!opt.enable_debug)
+    return;
 #endif
+
+  get_stamp (&stamp);
+
+  va_copy (a2, a);
+  format_message (&line, fmt, a, w32err, err, buf, buflen);
+  if (line.len >= line.size)
+    {
+      /* Not xmalloc as that may log itself.  */
+      line.size = line.len + 1;
+      line.buf = (char *) malloc (line.size);
+      line.len = 0;
+      if (!line.buf)
+        {
+          va_end (a2);
+          return;
+        }
+      format_message (&line, fmt, a2, w32err, err, buf, buflen);
+    }
+  va_end (a2);
+
+  ring = get_ring ();
+  if (ring && line.len <= LOG_RECORD_MAX)
+    {
+      if (ring_push (ring, &stamp, line.buf, line.len))
+        {
+          if (err == 1)
+            log_flush ();
+          goto leave;
+        }
+      if (err != 1)
+        {
+          ring->dropped++;
+          goto leave;
+        }
+    }
+  write_sync (&stamp, line.buf, line.len);
+
+leave:
+  if (line.buf != tmpbuf)
+    free (line.buf);
+}
+
+void
+log_flush (void)
+{
+  if (!lock_log ())
+    {
+      flush_rings ();
+      unlock_log ();
+    }
+}
+
+void
+log_shutdown (void)
+{
+  if (writer.exchange (WRITER_STOPPED) == WRITER_RUNNING)
+    wake_writer ();
+  log_flush ();
 }
 
 const char *
@@ -307,16 +836,90 @@ log_window_hierarchy (HWND window, const char *fmt, ...)
 }
 #endif
 
+/* Anonymized strings are interned in an append only open addressing
+   table.  A slot is published by storing its hash after the entry so
+   that a string seen before is found with one lookup and without a
+   lock.  Only new strings take ANON_STR_LOCK.  Entries are never
+   freed; this survives unload and keeps the returned strings
+   constant.  */
+
+/* Number of slots.  Must be a power of two.  */
+#define ANON_SLOTS 4096
+
+/* The table is full at 3/4 of the slots or if the copies of the
+   strings take more than ANON_MAX_BYTES.  Further strings are all
+   logged as "gpgol_string_overflow".  */
+#define ANON_MAX_STRINGS (ANON_SLOTS / 4 * 3)
+#define ANON_MAX_BYTES (512 * 1024)
+
+typedef struct
+{
+  size_t len;
+  char anon[32];
+  char data[1];
+} anon_entry_t;
+
+static std::atomic<uint64_t> anon_hashes[ANON_SLOTS];
+static anon_entry_t *anon_entries[ANON_SLOTS];
+static unsigned int anon_count;
+static size_t anon_bytes;
+static bool anon_overflow;
+
 GPGRT_LOCK_DEFINE (anon_str_lock);
 
-/* Weel ok this survives unload but we don't want races
-   and it makes a bit of sense to keep the strings constant. */
-static std::unordered_map<std::string, std::string> str_map;
+/* FNV-1a of DATA which also returns the length in R_LEN.  The result
+   is never zero as that marks an empty slot.  */
+static uint64_t
+anon_hash (const char *data, size_t *r_len)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  const char *s;
+
+  for (s = data; *s; s++)
+    {
+      hash = (hash ^ (unsigned char) *s) * 1099511628211ULL;
+    }
+  *r_len = s - data;
+  return hash ? hash : 1;
+}
+
+/* Find DATA in the table starting at slot IDX.  Returns the entry or
+   NULL and the first free slot in R_FREE.  */
+static const anon_entry_t *
+anon_find (uint64_t hash, const char *data, size_t len, unsigned int idx,
+           unsigned int *r_free)
+{
+  for (unsigned int i = 0; i < ANON_SLOTS; i++)
+    {
+      const uint64_t slot_hash = anon_hashes[idx].load
+                                   (std::memory_order_acquire);
+      if (!slot_hash)
+        {
+          *r_free = idx;
+          return nullptr;
+        }
+      if (slot_hash == hash)
+        {
+          const anon_entry_t *entry = anon_entries[idx];
+          if (entry->len == len && !memcmp (entry->data, data, len))
+            {
+              return entry;
+            }
+        }
+      idx = (idx + 1) & (ANON_SLOTS - 1);
+    }
+  *r_free = ANON_SLOTS;
+  return nullptr;
+}
 
 const char *anonstr (const char *data)
 {
-  static int64_t cnt;
-  if (opt.enable_debug & DBG_DATA)
+  const anon_entry_t *entry;
+  unsigned int idx;
+  size_t len;
+  uint64_t hash;
+
+  if (debug_enabled (DBG_DATA))
     {
       return data;
     }
@@ -324,26 +927,49 @@ const char *anonstr (const char *data)
     {
       return "gpgol_str_null";
     }
-  if (!strlen (data))
+  if (!*data)
     {
       return "gpgol_str_empty";
     }
 
-  gpgol_lock (&anon_str_lock);
-  const std::string strData (data);
-  auto it = str_map.find (strData);
-
-  if (it == str_map.end ())
+  hash = anon_hash (data, &len);
+  entry = anon_find (hash, data, len, (unsigned int) hash & (ANON_SLOTS - 1),
+                     &idx);
+  if (entry)
     {
-      const auto anon = std::string ("gpgol_string_") + std::to_string (++cnt);
-      str_map.insert (std::make_pair (strData, anon));
-      it = str_map.find (strData);
+      return entry->anon;
     }
 
-  // As the data is saved in our map we can return
-  // the c_str as it won't be touched as const.
-
-  gpgol_unlock (&anon_str_lock);
+  gpgrt_lock_lock (&anon_str_lock);
+  /* Another thread may have added it in the meantime.  */
+  entry = anon_find (hash, data, len, idx & (ANON_SLOTS - 1), &idx);
+  if (!entry && idx < ANON_SLOTS && anon_count < ANON_MAX_STRINGS
+      && anon_bytes + len <= ANON_MAX_BYTES)
+    {
+      /* Not xmalloc as that may log itself.  */
+      anon_entry_t *newentry = (anon_entry_t *) malloc (sizeof *newentry
+                                                         + len);
+      if (newentry)
+        {
+          newentry->len = len;
+          memcpy (newentry->data, data, len + 1);
+          snprintf (newentry->anon, sizeof newentry->anon,
+                    "gpgol_string_%u", ++anon_count);
+          anon_bytes += len;
+          anon_entries[idx] = newentry;
+          anon_hashes[idx].store (hash, std::memory_order_release);
+          entry = newentry;
+        }
+    }
+  if (!entry && !anon_overflow)
+    {
+      anon_overflow = true;
+      gpgrt_lock_unlock (&anon_str_lock);
+      log_error ("%s:%s: Too many strings. Further strings are not "
+                 "distinguished", SRCNAME, __func__);
+      return "gpgol_string_overflow";
+    }
+  gpgrt_lock_unlock (&anon_str_lock);
 
-  return it->second.c_str();
+  return entry ? entry->anon : "gpgol_string_overflow";
 }
@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 #include "common_indep.h"
+#include "binary-trace.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -54,6 +55,37 @@ extern "C" {
 #define DBG_MEMORY         (1<<2) // 4
 #define DBG_TRACE          (1<<3) // 8
 #define DBG_DATA           (1<<4) // 16
+/* Write the trace macros to a binary trace file instead of the log.
+   Bits 5 to 10 are taken by the compatibility values.  */
+#define DBG_TRACE_BIN      (1<<11) // 2048
+/* Record latency histograms, see latency.h.  */
+#define DBG_LATENCY        (1<<12) // 4096
+
+/* The most verbose log level compiled in, see --enable-log-level.
+   Logging above it is removed at compile time including the
+   evaluation of its arguments.  */
+#define GPGOL_LOG_BASIC    0
+#define GPGOL_LOG_OOM      1
+#define GPGOL_LOG_MEMORY   2
+#define GPGOL_LOG_TRACE    3
+#define GPGOL_LOG_DATA     4
+#ifndef GPGOL_MAX_LOG_LEVEL
+# define GPGOL_MAX_LOG_LEVEL GPGOL_LOG_DATA
+#endif
+
+/* The debug flags which are compiled in.  */
+#define DBG_COMPILED (~0 \
+  & ~(GPGOL_MAX_LOG_LEVEL < GPGOL_LOG_OOM ? DBG_OOM : 0) \
+  & ~(GPGOL_MAX_LOG_LEVEL < GPGOL_LOG_MEMORY ? DBG_MEMORY : 0) \
+  & ~(GPGOL_MAX_LOG_LEVEL < GPGOL_LOG_TRACE ? DBG_TRACE | DBG_TRACE_BIN : 0) \
+  & ~(GPGOL_MAX_LOG_LEVEL < GPGOL_LOG_DATA ? DBG_DATA : 0))
+
+/* True if the debug category FLAG is enabled.  Constant false if it
+   is not compiled in.  Debugging is the exception so the branch is
+   laid out for the disabled case.  */
+#define debug_enabled(flag) \
+  ((DBG_COMPILED & (flag)) \
+   && __builtin_expect (!!(opt.enable_debug & (flag)), 0))
 
 void log_debug (const char *fmt, ...) __attribute__ ((format (printf,1,2)));
 void log_error (const char *fmt, ...) __attribute__ ((format (printf,1,2)));
@@ -67,16 +99,16 @@ void log_hexdump (const void *buf, size_t buflen, const char *fmt,
                   ...)  __attribute__ ((format (printf,3,4)));
 
 const char *anonstr (const char *data);
-#define log_oom(format, ...) if ((opt.enable_debug & DBG_OOM)) \
+#define log_oom(format, ...) if (debug_enabled (DBG_OOM)) \
   log_debug("DBG_OOM/" format, ##__VA_ARGS__)
 
-#define log_data(format, ...) if ((opt.enable_debug & DBG_DATA)) \
+#define log_data(format, ...) if (debug_enabled (DBG_DATA)) \
   log_debug("DBG_DATA/" format, ##__VA_ARGS__)
 
-#define log_memory(format, ...) if ((opt.enable_debug & DBG_MEMORY)) \
+#define log_memory(format, ...) if (debug_enabled (DBG_MEMORY)) \
   log_debug("DBG_MEM/" format, ##__VA_ARGS__)
 
-#define log_trace(format, ...) if ((opt.enable_debug & DBG_TRACE)) \
+#define log_trace(format, ...) if (debug_enabled (DBG_TRACE)) \
   log_debug("TRACE/" format, ##__VA_ARGS__)
 
 #define log_warn(format, ...) if (opt.enable_debug) \
@@ -90,7 +122,7 @@ const char *anonstr (const char *data);
 
 #define gpgol_release(X) \
 { \
-  if (X && opt.enable_debug & DBG_MEMORY) \
+  if (X && debug_enabled (DBG_MEMORY)) \
     { \
       log_memory ("%s:%s:%i: Object: %p released ref: %lu \n", \
                   SRCNAME, __func__, __LINE__, X, X->Release()); \
@@ -105,7 +137,7 @@ const char *anonstr (const char *data);
 
 #define gpgol_lock(X) \
 { \
-  if (opt.enable_debug & DBG_TRACE) \
+  if (debug_enabled (DBG_TRACE)) \
     { \
       log_trace ("%s:%s:%i: lock %p lock", \
                   SRCNAME, __func__, __LINE__, X); \
@@ -116,7 +148,7 @@ const char *anonstr (const char *data);
 
 #define gpgol_unlock(X) \
 { \
-  if (opt.enable_debug & DBG_TRACE) \
+  if (debug_enabled (DBG_TRACE)) \
     { \
       log_trace ("%s:%s:%i: lock %p unlock.", \
                   SRCNAME, __func__, __LINE__, X); \
@@ -129,20 +161,43 @@ const char *log_srcname (const char *s);
 
 #define STRANGEPOINT log_debug ("%s:%s:%d:UNEXPECTED", \
                            SRCNAME, __func__, __LINE__);
-#define TRACEPOINT log_trace ("%s:%s:%d", \
-                              SRCNAME, __func__, __LINE__);
-#define TSTART log_trace ("%s:%s:%d enter", SRCNAME, __func__, __LINE__);
-#define TRETURN log_trace ("%s:%s:%d: return", SRCNAME, __func__, \
-                           __LINE__); \
+/* Emit a trace event of TYPE.  In binary trace mode the call site is
+   registered once and only its id is written.  Otherwise this is the
+   same as log_trace with the location in front of FMT.  */
+#define TRACE_EVENT(type, fmt) \
+{ \
+  if (debug_enabled (DBG_TRACE_BIN)) \
+    { \
+      static trace_site_t trace_site_ = { __FILE__, __func__, __LINE__, 0 }; \
+      trace_event (&trace_site_, type); \
+    } \
+  else if (debug_enabled (DBG_TRACE)) \
+    { \
+      log_debug ("TRACE/%s:%s:%d" fmt, SRCNAME, __func__, __LINE__); \
+    } \
+}
+
+#define TRACEPOINT TRACE_EVENT (TRACE_POINT, "")
+#define TSTART TRACE_EVENT (TRACE_ENTER, " enter")
+#define TRETURN TRACE_EVENT (TRACE_RETURN, ": return") \
                    return
-#define TBREAK log_trace ("%s:%s:%d: break", SRCNAME, __func__, \
-                           __LINE__); \
+#define TBREAK TRACE_EVENT (TRACE_BREAK, ": break") \
                    break
 
 
 const char *get_log_file (void);
 void set_log_file (const char *name);
 
+/* The id of the current thread as used in the log.  */
+unsigned long log_thread_id (void);
+
+/* Write all pending log messages to the log file.  */
+void log_flush (void);
+
+/* Stop the log writer thread.  Messages logged afterwards are
+   written synchronously.  */
+void log_shutdown (void);
+
 #ifdef _WIN64
 #define SIZE_T_FORMAT "%I64u"
 #else
@@ -0,0 +1,502 @@
+/* @file draft-parts.cpp
+ * @brief Remember the encrypted parts of drafts.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+#include <gpg-error.h>
+
+#include "common_indep.h"
+#include "draft-parts.h"
+
+/* How many bytes of ciphertext we keep by default.  */
+#define DEFAULT_LIMIT (64 * 1024 * 1024)
+/* The memory reserved for a part with its first write.  */
+#define PART_MEM_RESERVE 65536
+
+GPGRT_LOCK_DEFINE (draft_parts_lock);
+
+/* SHA-256 as specified in FIPS 180-4.  This is only used to notice
+   changed parts, but a weaker hash would allow to make a changed
+   part look unchanged.  */
+struct sha256_s
+{
+  uint32_t h[8];
+  uint64_t nbytes;
+  unsigned char buf[64];
+  size_t buflen;
+};
+
+static const uint32_t sha256_k[64] =
+{
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_init (struct sha256_s *ctx)
+{
+  ctx->h[0] = 0x6a09e667;
+  ctx->h[1] = 0xbb67ae85;
+  ctx->h[2] = 0x3c6ef372;
+  ctx->h[3] = 0xa54ff53a;
+  ctx->h[4] = 0x510e527f;
+  ctx->h[5] = 0x9b05688c;
+  ctx->h[6] = 0x1f83d9ab;
+  ctx->h[7] = 0x5be0cd19;
+  ctx->nbytes = 0;
+  ctx->buflen = 0;
+}
+
+/* Process the 64 byte block at P.  */
+static void
+sha256_block (struct sha256_s *ctx, const unsigned char *p)
+{
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h;
+  int i;
+
+  for (i = 0; i < 16; i++, p += 4)
+    w[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+           | ((uint32_t) p[2] << 8) | p[3];
+  for (; i < 64; i++)
+    {
+      uint32_t s0 = ROR32 (w[i-15], 7) ^ ROR32 (w[i-15], 18)
+                    ^ (w[i-15] >> 3);
+      uint32_t s1 = ROR32 (w[i-2], 17) ^ ROR32 (w[i-2], 19)
+                    ^ (w[i-2] >> 10);
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+  a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3];
+  e = ctx->h[4]; f = ctx->h[5]; g = ctx->h[6]; h = ctx->h[7];
+  for (i = 0; i < 64; i++)
+    {
+      uint32_t t1 = h + (ROR32 (e, 6) ^ ROR32 (e, 11) ^ ROR32 (e, 25))
+                    + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      uint32_t t2 = (ROR32 (a, 2) ^ ROR32 (a, 13) ^ ROR32 (a, 22))
+                    + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+  ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
+  ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h;
+}
+
+static void
+sha256_write (struct sha256_s *ctx, const unsigned char *data, size_t len)
+{
+  ctx->nbytes += len;
+  if (ctx->buflen)
+    {
+      size_t n = std::min (len, sizeof ctx->buf - ctx->buflen);
+      memcpy (ctx->buf + ctx->buflen, data, n);
+      ctx->buflen += n;
+      data += n;
+      len -= n;
+      if (ctx->buflen < sizeof ctx->buf)
+        return;
+      sha256_block (ctx, ctx->buf);
+      ctx->buflen = 0;
+    }
+  for (; len >= 64; data += 64, len -= 64)
+    sha256_block (ctx, data);
+  memcpy (ctx->buf, data, len);
+  ctx->buflen = len;
+}
+
+static void
+sha256_final (struct sha256_s *ctx, unsigned char *digest)
+{
+  uint64_t nbits = ctx->nbytes * 8;
+  unsigned char pad[72];
+  size_t padlen;
+  int i;
+
+  /* A one bit, zeros up to 56 mod 64 and the length in bits.  */
+  padlen = (ctx->buflen < 56 ? 56 : 120) - ctx->buflen;
+  memset (pad, 0, sizeof pad);
+  pad[0] = 0x80;
+  for (i = 0; i < 8; i++)
+    pad[padlen + i] = (unsigned char) (nbits >> (56 - 8 * i));
+  sha256_write (ctx, pad, padlen + 8);
+
+  for (i = 0; i < 8; i++)
+    {
+      digest[4*i]   = (unsigned char) (ctx->h[i] >> 24);
+      digest[4*i+1] = (unsigned char) (ctx->h[i] >> 16);
+      digest[4*i+2] = (unsigned char) (ctx->h[i] >> 8);
+      digest[4*i+3] = (unsigned char) ctx->h[i];
+    }
+}
+
+/* Finish CTX and return the digest as hex digits.  */
+static std::string
+sha256_hex (struct sha256_s *ctx)
+{
+  static const char hexdigits[] = "0123456789abcdef";
+  unsigned char digest[32];
+  std::string ret;
+
+  sha256_final (ctx, digest);
+
+  ret.reserve (2 * sizeof digest);
+  for (unsigned char c: digest)
+    {
+      ret += hexdigits[c >> 4];
+      ret += hexdigits[c & 15];
+    }
+  return ret;
+}
+
+std::string
+draft_part_hash (const void *data, size_t datalen)
+{
+  struct sha256_s ctx;
+
+  sha256_init (&ctx);
+  sha256_write (&ctx, static_cast<const unsigned char *>(data), datalen);
+  return sha256_hex (&ctx);
+}
+
+/* The plaintext is only kept in memory.  Writing it to a temporary
+   file would put the content of an encrypted draft on the disk.  */
+class DraftPart::Private
+{
+public:
+  Private ()
+  {
+    sha256_init (&m_ctx);
+  }
+
+  int write (const void *data, size_t datalen)
+  {
+    if (!data)
+      {
+        return 0;
+      }
+    sha256_write (&m_ctx, static_cast<const unsigned char *>(data),
+                  datalen);
+    if (m_mem.empty ())
+      {
+        m_mem.reserve (PART_MEM_RESERVE);
+      }
+    m_mem.append (static_cast<const char *>(data), datalen);
+    return 0;
+  }
+
+  struct sha256_s m_ctx;
+  std::string m_hash;
+  std::string m_mem;
+};
+
+DraftPart::DraftPart ():
+  d (new Private)
+{
+}
+
+DraftPart::~DraftPart ()
+{
+}
+
+void
+DraftPart::initSink (sink_t sink)
+{
+  memset (sink, 0, sizeof *sink);
+  sink->cb_data = d.get ();
+  sink->writefnc = [] (sink_t self, const void *data, size_t datalen)
+    {
+      return static_cast<Private *>(self->cb_data)->write (data, datalen);
+    };
+}
+
+int
+DraftPart::finish ()
+{
+  d->m_hash = sha256_hex (&d->m_ctx);
+  return 0;
+}
+
+const std::string &
+DraftPart::hash () const
+{
+  return d->m_hash;
+}
+
+size_t
+DraftPart::size () const
+{
+  return d->m_mem.size ();
+}
+
+GpgME::Data
+DraftPart::data ()
+{
+  return GpgME::Data (d->m_mem.data (), d->m_mem.size (), false);
+}
+
+typedef std::pair<std::string, std::shared_ptr<const std::string> > entry_t;
+
+class DraftPartCache::Private
+{
+public:
+  Private () :
+    m_bytes (0),
+    m_limit (DEFAULT_LIMIT)
+  {
+  }
+
+  std::shared_ptr<const std::string> get (const std::string &id)
+  {
+    gpgol_lock (&draft_parts_lock);
+    const auto it = m_map.find (id);
+    if (it == m_map.end ())
+      {
+        gpgol_unlock (&draft_parts_lock);
+        return nullptr;
+      }
+    /* Move it to the front.  */
+    m_lru.splice (m_lru.begin (), m_lru, it->second);
+    const auto ret = it->second->second;
+    gpgol_unlock (&draft_parts_lock);
+    return ret;
+  }
+
+  void put (const std::string &id,
+            const std::shared_ptr<const std::string> &ciphertext)
+  {
+    gpgol_lock (&draft_parts_lock);
+    erase (id);
+    m_current = id.substr (0, id.find ('\n') + 1);
+    m_bytes += ciphertext->size ();
+    m_lru.push_front (std::make_pair (id, ciphertext));
+    m_map.insert (std::make_pair (id, m_lru.begin ()));
+    shrink ();
+    gpgol_unlock (&draft_parts_lock);
+  }
+
+  void clear ()
+  {
+    gpgol_lock (&draft_parts_lock);
+    m_map.clear ();
+    m_lru.clear ();
+    m_bytes = 0;
+    m_current.clear ();
+    gpgol_unlock (&draft_parts_lock);
+  }
+
+  void dropDraft (const std::string &draft)
+  {
+    const std::string prefix = draft + '\n';
+
+    gpgol_lock (&draft_parts_lock);
+    for (auto it = m_lru.begin (); it != m_lru.end ();)
+      {
+        if (it->first.compare (0, prefix.size (), prefix))
+          {
+            ++it;
+            continue;
+          }
+        m_bytes -= it->second->size ();
+        m_map.erase (it->first);
+        it = m_lru.erase (it);
+      }
+    if (m_current == prefix)
+      {
+        m_current.clear ();
+      }
+    gpgol_unlock (&draft_parts_lock);
+  }
+
+  void setLimit (size_t limit)
+  {
+    gpgol_lock (&draft_parts_lock);
+    m_limit = limit;
+    shrink ();
+    gpgol_unlock (&draft_parts_lock);
+  }
+
+  size_t size ()
+  {
+    gpgol_lock (&draft_parts_lock);
+    size_t ret = m_map.size ();
+    gpgol_unlock (&draft_parts_lock);
+    return ret;
+  }
+
+  size_t bytes ()
+  {
+    gpgol_lock (&draft_parts_lock);
+    size_t ret = m_bytes;
+    gpgol_unlock (&draft_parts_lock);
+    return ret;
+  }
+
+private:
+  /* Must be called with the lock held.  */
+  void erase (const std::string &id)
+  {
+    const auto it = m_map.find (id);
+    if (it == m_map.end ())
+      {
+        return;
+      }
+    m_bytes -= it->second->second->size ();
+    m_lru.erase (it->second);
+    m_map.erase (it);
+  }
+
+  /* Drop the least recently used parts until we are within the
+     limit.  The parts of the current draft are kept.  Must be called
+     with the lock held.  */
+  void shrink ()
+  {
+    auto it = m_lru.end ();
+    while (m_bytes > m_limit && it != m_lru.begin ())
+      {
+        --it;
+        if (!m_current.empty ()
+            && !it->first.compare (0, m_current.size (), m_current))
+          {
+            continue;
+          }
+        m_bytes -= it->second->size ();
+        m_map.erase (it->first);
+        it = m_lru.erase (it);
+      }
+  }
+
+  std::list<entry_t> m_lru;
+  std::unordered_map<std::string, std::list<entry_t>::iterator> m_map;
+  size_t m_bytes;
+  size_t m_limit;
+  std::string m_current; /* The id prefix of the draft stored last.  */
+};
+
+DraftPartCache::DraftPartCache ():
+  d (new Private)
+{
+}
+
+DraftPartCache *
+DraftPartCache::instance ()
+{
+  static DraftPartCache *singleton;
+
+  if (!singleton)
+    {
+      singleton = new DraftPartCache ();
+    }
+  return singleton;
+}
+
+std::string
+DraftPartCache::makeId (const std::string &hash, const std::string &draft,
+                        GpgME::Protocol proto,
+                        const std::vector<std::string> &fprs, bool binary)
+{
+  std::vector<std::string> sorted (fprs);
+  std::sort (sorted.begin (), sorted.end ());
+
+  /* The draft comes first for dropDraft and to keep the parts of
+     the current draft.  */
+  std::string ret = draft;
+  ret += '\n';
+  ret += std::to_string ((int) proto);
+  ret += binary ? ":b:" : ":a:";
+  for (const auto &fpr: sorted)
+    {
+      ret += fpr;
+      ret += ',';
+    }
+  ret += hash;
+  return ret;
+}
+
+std::shared_ptr<const std::string>
+DraftPartCache::get (const std::string &id)
+{
+  return d->get (id);
+}
+
+void
+DraftPartCache::put (const std::string &id,
+                     const std::shared_ptr<const std::string> &ciphertext)
+{
+  if (!ciphertext)
+    {
+      TRACEPOINT;
+      return;
+    }
+  d->put (id, ciphertext);
+}
+
+void
+DraftPartCache::clear ()
+{
+  d->clear ();
+}
+
+void
+DraftPartCache::dropDraft (const std::string &draft)
+{
+  d->dropDraft (draft);
+}
+
+void
+DraftPartCache::setLimit (size_t limit)
+{
+  d->setLimit (limit);
+}
+
+size_t
+DraftPartCache::size () const
+{
+  return d->size ();
+}
+
+size_t
+DraftPartCache::bytes () const
+{
+  return d->bytes ();
+}
@@ -0,0 +1,135 @@
+/* @file draft-parts.h
+ * @brief Remember the encrypted parts of drafts.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DRAFT_PARTS_H
+#define DRAFT_PARTS_H
+
+#include "config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gpgme++/data.h>
+#include <gpgme++/global.h>
+
+#include "mime-writer.h"
+
+/* Return the SHA-256 of DATALEN bytes at DATA as 64 lower case hex
+   digits.  */
+std::string draft_part_hash (const void *data, size_t datalen);
+
+/** The plaintext of one part of a draft.
+
+  The part is hashed while it is written, so the cache can be asked
+  for its ciphertext without reading it again.  The plaintext is
+  kept in memory and never written to a file.  */
+class DraftPart
+{
+public:
+    DraftPart ();
+    ~DraftPart ();
+
+    /* Setup SINK to write to the part.  */
+    void initSink (sink_t sink);
+
+    /* Finish the part after the last write.  Returns 0 on success.  */
+    int finish ();
+
+    /* The draft_part_hash of the part.  Only valid after finish.  */
+    const std::string &hash () const;
+
+    /* The number of bytes written to the part.  */
+    size_t size () const;
+
+    /* The plaintext of the part for GpgME.  It must not be used after
+       the part is destroyed.  */
+    GpgME::Data data ();
+
+private:
+    class Private;
+    std::shared_ptr<Private> d;
+};
+
+/** The encrypted parts of drafts by the hash of their plaintext.
+
+  An encrypted draft is saved again and again while it is composed.
+  The body and every attachment are encrypted on their own, so on
+  the next save only the parts which changed need to be encrypted
+  again.  The others are taken from here.
+
+  The parts of a draft are only reused for the same draft, so two
+  drafts never share a ciphertext.  The cache is bounded by the
+  size of the ciphertexts kept and drops the least recently used
+  part first.  The parts of the draft which was stored last are
+  never dropped for the limit, so a draft larger than the limit is
+  not encrypted as a whole on every save.  All functions are thread
+  safe.  */
+class DraftPartCache
+{
+protected:
+    /** Internal ctor */
+    explicit DraftPartCache ();
+
+public:
+    /** Get the DraftPartCache */
+    static DraftPartCache* instance ();
+
+    /* Build the id of the ciphertext of the part with the
+       draft_part_hash HASH in the draft with the id DRAFT when
+       encrypted with PROTO to the keys with the fingerprints FPRS.
+       BINARY is set if the ciphertext is not armored.  */
+    static std::string makeId (const std::string &hash,
+                               const std::string &draft,
+                               GpgME::Protocol proto,
+                               const std::vector<std::string> &fprs,
+                               bool binary);
+
+    /* Look up the ciphertext for ID.  Returns NULL if there is
+       none.  */
+    std::shared_ptr<const std::string> get (const std::string &id);
+
+    /* Remember CIPHERTEXT under ID.  The parts of other drafts are
+       dropped to stay within the limit.  */
+    void put (const std::string &id,
+              const std::shared_ptr<const std::string> &ciphertext);
+
+    /* Forget all parts.  */
+    void clear ();
+
+    /* Forget the parts of the draft with the id DRAFT.  */
+    void dropDraft (const std::string &draft);
+
+    /* Keep at most LIMIT bytes of ciphertext unless the parts of the
+       last draft are larger.  */
+    void setLimit (size_t limit);
+
+    /* The number of parts kept.  */
+    size_t size () const;
+
+    /* The number of bytes of ciphertext kept.  */
+    size_t bytes () const;
+
+private:
+    class Private;
+    std::shared_ptr<Private> d;
+};
+
+#endif
@@ -50,6 +50,8 @@
 #include "dispcache.h"
 #include "categorymanager.h"
 #include "keycache.h"
+#include "latency.h"
+#include "timeline.h"
 
 #include <gpg-error.h>
 #include <list>
@@ -594,6 +596,8 @@ GpgolRibbonExtender::~GpgolRibbonExtender (void)
   log_debug ("%s:%s: cleaning up GpgolRibbonExtender object;",
              SRCNAME, __func__);
   memdbg_dump ();
+  latency_dump ();
+  timeline_dump ();
 }
 
 STDMETHODIMP
@@ -1305,6 +1309,9 @@ GpgolAddin::shutdown ()
 
   write_options ();
 
+  /* Stop resolving keys before the mails go away.  */
+  Mail::stopPreResolve ();
+
   if (Mail::closeAllMails_o ())
     {
       MessageBox (NULL,
@@ -1318,6 +1325,10 @@ GpgolAddin::shutdown ()
 
   gpgol_release (m_application);
   m_application = nullptr;
+
+  /* Write out what is still queued.  Everything logged from now on
+     is written synchronously.  */
+  log_shutdown ();
   TRETURN;
 }
 
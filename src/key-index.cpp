@@ -0,0 +1,80 @@
+/* @file key-index.cpp
+ * @brief Find the keys of the key cache by fingerprint.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "common_indep.h"
+#include "key-index.h"
+
+void
+KeyIndex::addSubkey (const char *subfpr, const char *fpr)
+{
+  if (!subfpr || !fpr)
+    {
+      return;
+    }
+  m_sub_fpr_map.insert (std::make_pair (std::string (subfpr),
+                                        std::string (fpr)));
+}
+
+GpgME::Key &
+KeyIndex::insert (const char *fpr, const GpgME::Key &key, bool *inserted)
+{
+  const auto ret = m_fpr_map.insert (std::make_pair (std::string (fpr),
+                                                     key));
+  *inserted = ret.second;
+  return ret.first->second;
+}
+
+GpgME::Key
+KeyIndex::get (const char *fpr) const
+{
+  if (!fpr)
+    {
+      return GpgME::Key ();
+    }
+
+  /* Look up with the same string in both maps and do not copy the
+     primary fingerprint.  */
+  const std::string sfpr (fpr);
+  const auto it = m_sub_fpr_map.find (sfpr);
+  const std::string &primary = it == m_sub_fpr_map.end () ? sfpr
+                                                          : it->second;
+  if (&primary != &sfpr)
+    {
+      log_debug ("%s:%s using \"%s\" for \"%s\"",
+                 SRCNAME, __func__, anonstr (primary.c_str ()),
+                 anonstr (fpr));
+    }
+
+  const auto keyIt = m_fpr_map.find (primary);
+  if (keyIt == m_fpr_map.end ())
+    {
+      return GpgME::Key ();
+    }
+  return keyIt->second;
+}
+
+size_t
+KeyIndex::size () const
+{
+  return m_fpr_map.size ();
+}
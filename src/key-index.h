@@ -0,0 +1,62 @@
+/* @file key-index.h
+ * @brief Find the keys of the key cache by fingerprint.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEY_INDEX_H
+#define KEY_INDEX_H
+
+#include "config.h"
+
+#include <string>
+#include <unordered_map>
+
+#include <gpgme++/key.h>
+
+/** The keys of the KeyCache by primary fingerprint.  The fingerprints
+  of the subkeys are mapped to that of their primary key so that a
+  key can be found by the fingerprint of a signature.
+
+  This is the part of the key cache which is looked up for every
+  signature and every recipient override.  It does not lock; the
+  KeyCache holds its fpr_map_lock.  */
+class KeyIndex
+{
+public:
+    /* Map the subkey fingerprint SUBFPR to the primary fingerprint
+       FPR unless SUBFPR is already known.  */
+    void addSubkey (const char *subfpr, const char *fpr);
+
+    /* Return the key stored under the primary fingerprint FPR.  If
+       there is none KEY is stored and *INSERTED is set.  */
+    GpgME::Key &insert (const char *fpr, const GpgME::Key &key,
+                        bool *inserted);
+
+    /* The key with the primary or subkey fingerprint FPR or a null
+       key.  */
+    GpgME::Key get (const char *fpr) const;
+
+    /* The number of primary keys.  */
+    size_t size () const;
+
+private:
+    std::unordered_map<std::string, GpgME::Key> m_fpr_map;
+    std::unordered_map<std::string, std::string> m_sub_fpr_map;
+};
+
+#endif
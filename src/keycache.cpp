@@ -24,6 +24,9 @@
 #include "common.h"
 #include "cpphelp.h"
 #include "mail.h"
+#include "latency.h"
+#include "resolution-cache.h"
+#include "key-index.h"
 
 #include <gpg-error.h>
 #include <gpgme++/context.h>
@@ -366,7 +369,7 @@ gpgsm_learn ()
       log_debug ("%s:%s: gpgsm learn spawn code: %i asString: %s",
                  SRCNAME, __func__, err.code(), err.asString());
     }
-  if ((opt.enable_debug & DBG_DATA))
+  if (debug_enabled (DBG_DATA))
     {
       log_data ("stdout:\n'%s'\nstderr:\n%s", mystdout.toString ().c_str (),
                 mystderr.toString ().c_str ());
@@ -465,6 +468,7 @@ static DWORD WINAPI
 do_populate (LPVOID)
 {
   TSTART;
+  LATENCY_SCOPE ("KeyCache::populate");
 
   log_dbg ("Populating config");
   gpgrt_lock_lock (&config_lock);
@@ -489,6 +493,20 @@ do_populate (LPVOID)
 }
 
 
+/* True if A and B are the same key or both are null.  */
+static bool
+same_key (const GpgME::Key &a, const GpgME::Key &b)
+{
+  const char *fa = a.primaryFingerprint ();
+  const char *fb = b.primaryFingerprint ();
+
+  if (!fa || !fb)
+    {
+      return !fa && !fb;
+    }
+  return !strcmp (fa, fb);
+}
+
 class KeyCache::Private
 {
 public:
@@ -505,9 +523,14 @@ public:
     if (it == m_pgp_key_map.end ())
       {
         m_pgp_key_map.insert (std::pair<std::string, GpgME::Key> (mbox, key));
+        ResolutionCache::instance ()->clear ();
       }
     else
       {
+        if (!same_key (it->second, key))
+          {
+            ResolutionCache::instance ()->clear ();
+          }
         it->second = key;
       }
     insertOrUpdateInFprMap (key);
@@ -524,9 +547,14 @@ public:
     if (it == m_smime_key_map.end ())
       {
         m_smime_key_map.insert (std::pair<std::string, GpgME::Key> (mbox, key));
+        ResolutionCache::instance ()->clear ();
       }
     else
       {
+        if (!same_key (it->second, key))
+          {
+            ResolutionCache::instance ()->clear ();
+          }
         it->second = key;
       }
     insertOrUpdateInFprMap (key);
@@ -621,10 +649,16 @@ public:
     if (it == m_pgp_skey_map.end ())
       {
         m_pgp_skey_map.insert (std::pair<std::string, GpgME::Key> (mbox, key));
+        ResolutionCache::instance ()->clear ();
       }
     else
       {
-        it->second = compareSkeys (it->second, key);
+        const auto old = it->second;
+        it->second = compareSkeys (old, key);
+        if (!same_key (old, it->second))
+          {
+            ResolutionCache::instance ()->clear ();
+          }
       }
     if (insert)
       {
@@ -644,10 +678,16 @@ public:
     if (it == m_smime_skey_map.end ())
       {
         m_smime_skey_map.insert (std::pair<std::string, GpgME::Key> (mbox, key));
+        ResolutionCache::instance ()->clear ();
       }
     else
       {
-        it->second = compareSkeys (it->second, key);
+        const auto old = it->second;
+        it->second = compareSkeys (old, key);
+        if (!same_key (old, it->second))
+          {
+            ResolutionCache::instance ()->clear ();
+          }
       }
     if (insert)
       {
@@ -943,22 +983,14 @@ public:
 
       for (const auto &sub: key.subkeys())
         {
-          const char *subFpr = sub.fingerprint();
-          auto it = m_sub_fpr_map.find (subFpr);
-          if (it == m_sub_fpr_map.end ())
-            {
-              m_sub_fpr_map.insert (std::make_pair(
-                                     std::string (subFpr),
-                                     std::string (primaryFpr)));
-            }
+          m_fpr_index.addSubkey (sub.fingerprint(), primaryFpr);
         }
 
-      auto it = m_fpr_map.find (primaryFpr);
+      bool inserted;
+      auto &cached = m_fpr_index.insert (primaryFpr, key, &inserted);
 
-      if (it == m_fpr_map.end ())
+      if (inserted)
         {
-          m_fpr_map.insert (std::make_pair (primaryFpr, key));
-
           gpgol_unlock (&fpr_map_lock);
           TRETURN;
         }
@@ -1008,17 +1040,17 @@ public:
             }
         }
 
-      if (it->second.hasSecret () && !key.hasSecret())
+      if (cached.hasSecret () && !key.hasSecret())
         {
           log_debug ("%s:%s Lost secret info on update. Merging.",
                      SRCNAME, __func__);
           auto merged = key;
-          merged.mergeWith (it->second);
-          it->second = merged;
+          merged.mergeWith (cached);
+          cached = merged;
         }
       else
         {
-          it->second = key;
+          cached = key;
         }
       gpgol_unlock (&fpr_map_lock);
       TRETURN;
@@ -1034,29 +1066,9 @@ public:
       }
 
     gpgol_lock (&fpr_map_lock);
-    std::string primaryFpr;
-    const auto it = m_sub_fpr_map.find (fpr);
-    if (it != m_sub_fpr_map.end ())
-      {
-        log_debug ("%s:%s using \"%s\" for \"%s\"",
-                   SRCNAME, __func__, anonstr (it->second.c_str()),
-                   anonstr (fpr));
-        primaryFpr = it->second;
-      }
-    else
-      {
-        primaryFpr = fpr;
-      }
-
-    const auto keyIt = m_fpr_map.find (primaryFpr);
-    if (keyIt != m_fpr_map.end ())
-      {
-        const auto ret = keyIt->second;
-        gpgol_unlock (&fpr_map_lock);
-        TRETURN ret;
-      }
+    const auto ret = m_fpr_index.get (fpr);
     gpgol_unlock (&fpr_map_lock);
-    TRETURN GpgME::Key();
+    TRETURN ret;
   }
 
   GpgME::Key getByFpr (const char *fpr, bool block) const
@@ -1162,6 +1174,9 @@ public:
         }
       TRACEPOINT;
       insertOrUpdateInFprMap (key);
+      /* The validity of the key might have changed.  */
+      ResolutionCache::instance ()->dropKey (key.isNull () ? fpr :
+                                             key.primaryFingerprint ());
       gpgol_lock (&update_lock);
       const auto it = m_update_jobs.find(fpr);
 
@@ -1236,6 +1251,7 @@ public:
           override_map->insert (std::make_pair (mbox, result_fprs));
         }
       gpgol_unlock (&keycache_lock);
+      ResolutionCache::instance ()->clear ();
       gpgol_lock (&import_lock);
       const auto job_it = job_set->find(mbox);
 
@@ -1260,6 +1276,7 @@ public:
       gpgrt_lock_lock (&keycache_lock);
       m_ultimate_keys.clear ();
       gpgrt_lock_unlock (&keycache_lock);
+      ResolutionCache::instance ()->clear ();
       CloseHandle (CreateThread (nullptr, 0, do_populate,
                                  nullptr, 0,
                                  nullptr));
@@ -1283,8 +1300,7 @@ public:
   std::unordered_map<std::string, GpgME::Key> m_smime_key_map;
   std::unordered_map<std::string, GpgME::Key> m_pgp_skey_map;
   std::unordered_map<std::string, GpgME::Key> m_smime_skey_map;
-  std::unordered_map<std::string, GpgME::Key> m_fpr_map;
-  std::unordered_map<std::string, std::string> m_sub_fpr_map;
+  KeyIndex m_fpr_index;
   std::unordered_map<std::string, std::vector<std::string> >
     m_pgp_overrides;
   std::unordered_map<std::string, std::vector<std::string> >
@@ -1439,6 +1455,7 @@ static DWORD WINAPI
 do_locate (LPVOID arg)
 {
   TSTART;
+  LATENCY_SCOPE ("KeyCache::locate");
   if (!arg)
     {
       TRETURN 0;
@@ -1555,7 +1572,7 @@ locate_secret (const char *addr, GpgME::Protocol proto)
       if (key.isRevoked() || key.isExpired() ||
           key.isDisabled() || key.isInvalid())
         {
-          if ((opt.enable_debug & DBG_DATA))
+          if (debug_enabled (DBG_DATA))
             {
               std::stringstream ss;
               ss << key;
@@ -1588,6 +1605,7 @@ static DWORD WINAPI
 do_locate_secret (LPVOID arg)
 {
   TSTART;
+  LATENCY_SCOPE ("KeyCache::locate_secret");
   auto args = std::unique_ptr<LocateArgs> ((LocateArgs *) arg);
 
   log_debug ("%s:%s searching secret key for addr: \"%s\"",
@@ -1832,7 +1850,7 @@ KeyCache::import_pgp_key_data (const GpgME::Data &data)
       TRETURN false;
     }
 
-  if (opt.enable_debug & DBG_DATA)
+  if (debug_enabled (DBG_DATA))
     {
       std::stringstream ss;
       for (const auto &key: keys)
@@ -1843,7 +1861,7 @@ KeyCache::import_pgp_key_data (const GpgME::Data &data)
     }
   const auto result = ctx->importKeys(data);
 
-  if ((opt.enable_debug & DBG_DATA))
+  if (debug_enabled (DBG_DATA))
     {
       std::stringstream ss;
       ss << result;
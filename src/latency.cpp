@@ -0,0 +1,321 @@
+/* @file latency.cpp
+ * @brief Latency histograms for important operations
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "common_indep.h"
+#include "latency.h"
+
+#include <gpg-error.h>
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define N_BUCKETS ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+
+/* Histograms are never freed so that the static pointers in the
+   LATENCY_TIMER macro stay valid.  */
+#define MAX_HISTOGRAMS 64
+
+struct latency_hist_s
+{
+  char *name;
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> min;
+  std::atomic<uint64_t> max;
+  std::atomic<uint64_t> buckets[N_BUCKETS];
+};
+
+static latency_hist_t *histograms[MAX_HISTOGRAMS];
+static std::atomic<int> n_histograms;
+GPGRT_LOCK_DEFINE (hist_lock);
+
+static unsigned int
+bucket_index (uint64_t value)
+{
+  int msb, shift;
+
+  if (value < SUB_BUCKETS)
+    {
+      return (unsigned int) value;
+    }
+  msb = 63 - __builtin_clzll (value);
+  shift = msb - SUB_BITS;
+  return ((shift + 1) << SUB_BITS) + ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+/* The highest value which ends up in bucket IDX.  */
+static uint64_t
+bucket_upper (unsigned int idx)
+{
+  int shift;
+
+  if (idx < SUB_BUCKETS)
+    {
+      return idx;
+    }
+  shift = (idx >> SUB_BITS) - 1;
+  return ((uint64_t) (SUB_BUCKETS + (idx & (SUB_BUCKETS - 1))) << shift)
+         + ((uint64_t) 1 << shift) - 1;
+}
+
+latency_hist_t *
+latency_get (const char *name)
+{
+  latency_hist_t *ret = nullptr;
+  int n;
+
+  gpgrt_lock_lock (&hist_lock);
+  n = n_histograms.load ();
+  for (int i = 0; i < n; i++)
+    {
+      if (!strcmp (histograms[i]->name, name))
+        {
+          ret = histograms[i];
+          break;
+        }
+    }
+  if (!ret && n < MAX_HISTOGRAMS)
+    {
+      ret = new latency_hist_t ();
+      ret->name = xstrdup (name);
+      ret->min = UINT64_MAX;
+      histograms[n] = ret;
+      n_histograms.store (n + 1);
+    }
+  gpgrt_lock_unlock (&hist_lock);
+
+  if (!ret)
+    {
+      log_error ("%s:%s: Too many histograms. Ignoring '%s'",
+                 SRCNAME, __func__, name);
+    }
+  return ret;
+}
+
+void
+latency_record (latency_hist_t *hist, uint64_t nsec)
+{
+  uint64_t cur;
+
+  if (!hist)
+    {
+      return;
+    }
+  hist->buckets[bucket_index (nsec)].fetch_add (1, std::memory_order_relaxed);
+  hist->sum.fetch_add (nsec, std::memory_order_relaxed);
+  cur = hist->min.load (std::memory_order_relaxed);
+  while (nsec < cur && !hist->min.compare_exchange_weak (cur, nsec))
+    ;
+  cur = hist->max.load (std::memory_order_relaxed);
+  while (nsec > cur && !hist->max.compare_exchange_weak (cur, nsec))
+    ;
+  hist->count.fetch_add (1, std::memory_order_release);
+}
+
+uint64_t
+latency_count (const latency_hist_t *hist)
+{
+  return hist ? hist->count.load (std::memory_order_acquire) : 0;
+}
+
+uint64_t
+latency_percentile (const latency_hist_t *hist, double percent)
+{
+  uint64_t count = latency_count (hist);
+  uint64_t seen = 0;
+  uint64_t max;
+
+  if (!count)
+    {
+      return 0;
+    }
+  uint64_t rank = (uint64_t) (percent / 100.0 * count + 0.5);
+  if (!rank)
+    {
+      rank = 1;
+    }
+  max = hist->max.load (std::memory_order_relaxed);
+  for (unsigned int i = 0; i < N_BUCKETS; i++)
+    {
+      seen += hist->buckets[i].load (std::memory_order_relaxed);
+      if (seen >= rank)
+        {
+          const uint64_t upper = bucket_upper (i);
+          return upper < max ? upper : max;
+        }
+    }
+  return max;
+}
+
+static void
+report_text (std::ostringstream &ss, const latency_hist_t *hist,
+             uint64_t count)
+{
+  char line[256];
+
+  snprintf (line, sizeof line,
+            "%-36s %8lu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+            hist->name, (unsigned long) count,
+            hist->sum.load () / 1e6 / count,
+            latency_percentile (hist, 50) / 1e6,
+            latency_percentile (hist, 90) / 1e6,
+            latency_percentile (hist, 99) / 1e6,
+            latency_percentile (hist, 99.9) / 1e6,
+            hist->max.load () / 1e6);
+  ss << line;
+}
+
+static void
+report_json (std::ostringstream &ss, const latency_hist_t *hist,
+             uint64_t count)
+{
+  ss << "{\"name\":\"" << hist->name << "\""
+     << ",\"count\":" << count
+     << ",\"sum_ns\":" << hist->sum.load ()
+     << ",\"min_ns\":" << hist->min.load ()
+     << ",\"p50_ns\":" << latency_percentile (hist, 50)
+     << ",\"p90_ns\":" << latency_percentile (hist, 90)
+     << ",\"p99_ns\":" << latency_percentile (hist, 99)
+     << ",\"p999_ns\":" << latency_percentile (hist, 99.9)
+     << ",\"max_ns\":" << hist->max.load ()
+     << ",\"buckets\":[";
+  bool first = true;
+  for (unsigned int i = 0; i < N_BUCKETS; i++)
+    {
+      const uint64_t n = hist->buckets[i].load (std::memory_order_relaxed);
+      if (!n)
+        {
+          continue;
+        }
+      ss << (first ? "" : ",") << "[" << bucket_upper (i) << "," << n << "]";
+      first = false;
+    }
+  ss << "]}";
+}
+
+std::string
+latency_report (bool json)
+{
+  std::ostringstream ss;
+  const int n = n_histograms.load ();
+  bool first = true;
+
+  if (json)
+    {
+      ss << "{\"histograms\":[";
+    }
+  else
+    {
+      char line[256];
+      snprintf (line, sizeof line,
+                "%-36s %8s %9s %9s %9s %9s %9s %9s\n", "operation (ms)",
+                "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+      ss << line;
+    }
+  for (int i = 0; i < n; i++)
+    {
+      const latency_hist_t *hist = histograms[i];
+      const uint64_t count = latency_count (hist);
+
+      if (!count)
+        {
+          continue;
+        }
+      if (json)
+        {
+          ss << (first ? "" : ",");
+          report_json (ss, hist, count);
+        }
+      else
+        {
+          report_text (ss, hist, count);
+        }
+      first = false;
+    }
+  if (json)
+    {
+      ss << "]}\n";
+    }
+  return ss.str ();
+}
+
+void
+latency_dump ()
+{
+  if (!(opt.enable_debug & DBG_LATENCY))
+    {
+      return;
+    }
+
+  log_debug ("%s:%s: Latency histograms:\n%s", SRCNAME, __func__,
+             latency_report (false).c_str ());
+
+  const std::string logfile = get_log_file ();
+  if (logfile.empty () || logfile == "stdout" || logfile == "stderr")
+    {
+      return;
+    }
+  const std::string name = logfile + ".latency.json";
+  FILE *fp = fopen (name.c_str (), "w");
+  if (!fp)
+    {
+      log_error ("%s:%s: Failed to open '%s'", SRCNAME, __func__,
+                 name.c_str ());
+      return;
+    }
+  fputs (latency_report (true).c_str (), fp);
+  fclose (fp);
+}
+
+static uint64_t
+now_ns ()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+    (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+LatencyTimer::LatencyTimer (latency_hist_t *hist) :
+  m_hist ((opt.enable_debug & DBG_LATENCY) ? hist : nullptr),
+  m_start (m_hist ? now_ns () : 0)
+{
+}
+
+LatencyTimer::~LatencyTimer ()
+{
+  stop ();
+}
+
+void
+LatencyTimer::stop ()
+{
+  if (m_hist)
+    {
+      latency_record (m_hist, now_ns () - m_start);
+      m_hist = nullptr;
+    }
+}
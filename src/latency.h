@@ -0,0 +1,81 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+/* @file latency.h
+ * @brief Latency histograms for important operations
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include <string>
+
+/* Durations are only recorded with the "latency" debug flag
+   (DBG_LATENCY).  Each histogram has logarithmic buckets with 16
+   linear steps per power of two, so percentiles are precise to about
+   6%.  Recording is lock free.  */
+
+typedef struct latency_hist_s latency_hist_t;
+
+/** @brief Get the histogram NAME, creating it on first use.
+  *
+  * @returns NULL if there are too many histograms.
+  */
+latency_hist_t *latency_get (const char *name);
+
+/** @brief Add a duration of NSEC nanoseconds to HIST. */
+void latency_record (latency_hist_t *hist, uint64_t nsec);
+
+/** @brief Number of durations in HIST. */
+uint64_t latency_count (const latency_hist_t *hist);
+
+/** @brief The duration in nanoseconds below which PERCENT of the
+  * durations in HIST are.  */
+uint64_t latency_percentile (const latency_hist_t *hist, double percent);
+
+/** @brief Report of all histograms with data as text or JSON. */
+std::string latency_report (bool json);
+
+/** @brief Log the text report and write the JSON report to
+  * LOGFILE.latency.json.  Does nothing without DBG_LATENCY.  */
+void latency_dump ();
+
+/* Measures the time until it goes out of scope or stop is called.  */
+class LatencyTimer
+{
+public:
+  explicit LatencyTimer (latency_hist_t *hist);
+  ~LatencyTimer ();
+
+  void stop ();
+
+private:
+  latency_hist_t *m_hist;
+  uint64_t m_start;
+};
+
+/* Declare the timer VAR for the histogram NAME.  The histogram is
+   looked up only once per call site.  */
+#define LATENCY_TIMER(var, name) \
+  static latency_hist_t *const var ## _hist_ = latency_get (name); \
+  LatencyTimer var (var ## _hist_)
+
+/* Time the rest of the current scope.  */
+#define LATENCY_SCOPE(name) LATENCY_TIMER (latency_scope_, name)
+
+#endif // LATENCY_H
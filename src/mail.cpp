@@ -36,13 +36,18 @@
 #include "mymapitags.h"
 #include "parsecontroller.h"
 #include "cryptcontroller.h"
+#include "debounce.h"
+#include "draft-parts.h"
+#include "split-encrypt.h"
 #include "windowmessages.h"
 #include "mlang-charset.h"
+#include "charset-conv.h"
 #include "wks-helper.h"
 #include "keycache.h"
 #include "cpphelp.h"
 #include "addressbook.h"
 #include "recipient.h"
+#include "timeline.h"
 
 #include <gpgme++/configuration.h>
 #include <gpgme++/tofuinfo.h>
@@ -139,6 +144,10 @@ Mail::Mail (LPDISPATCH mailitem) :
     m_attachs_added(false)
 {
   TSTART;
+  char label[64];
+  snprintf (label, sizeof label, "Mail %p", this);
+  m_timeline = std::make_shared<Timeline> (label);
+
   if (getMailForItem (mailitem))
     {
       log_error ("Mail object for item: %p already exists. Bug.",
@@ -222,6 +231,7 @@ Mail::~Mail()
           s_uid_map.erase (it2);
         }
       gpgol_unlock (&uid_map_lock);
+      DraftPartCache::instance ()->dropDraft (m_uuid);
     }
 
   log_oom ("%s:%s: removing categories",
@@ -230,6 +240,8 @@ Mail::~Mail()
 
   log_oom ("%s:%s: releasing mailitem",
                  SRCNAME, __func__);
+  cancelPreResolve ();
+
   gpgol_release(m_mailitem);
   xfree (m_cached_html_body);
   xfree (m_cached_plain_body);
@@ -247,6 +259,7 @@ Mail::~Mail()
                  SRCNAME, __func__);
   m_parser = nullptr;
   m_crypter = nullptr;
+  timeline_finish (m_timeline);
 
   releaseCurrentItem();
   gpgol_unlock (&dtor_lock);
@@ -962,9 +975,12 @@ do_parsing (LPVOID arg)
   /* This takes a shared ptr of parser. So the parser is
      still valid when the mail is deleted. */
   auto parser = mail->parser ();
+  auto timeline = mail->timeline ();
   gpgol_unlock (&dtor_lock);
 
+  timeline->begin (TL_PARSER_LOCK);
   gpgol_lock (&parser_lock);
+  timeline->end (TL_PARSER_LOCK);
   /* We lock the parser here to avoid too many
      decryption attempts if there are
      multiple mailobjects which might have already
@@ -1334,7 +1350,9 @@ Mail::decryptVerify_o ()
 
   check_html_preferred ();
 
+  m_timeline->begin (TL_STREAM_OPEN);
   auto cipherstream = get_attachment_stream_o (m_mailitem, m_moss_position);
+  m_timeline->end (TL_STREAM_OPEN);
   if (!cipherstream)
     {
       m_is_junk = is_junk_mail (m_mailitem);
@@ -1445,6 +1463,9 @@ Mail::decryptVerify_o ()
 
   m_parser = std::shared_ptr <ParseController> (new ParseController (cipherstream, m_type));
   m_parser->setSender(GpgME::UserID::addrSpecFromString(getSender_o ().c_str()));
+  m_parser->setTimeline (m_timeline);
+  /* Only our own drafts are stored in parts.  */
+  m_parser->setAllowDraftParts (is_draft_mail (m_mailitem));
 
   if (opt.autoimport)
     {
@@ -1567,10 +1588,34 @@ set_body (LPDISPATCH item, const std::string &plain, const std::string &html)
     }
 }
 
+/* Return DATA in CHARSET or CODEPAGE as UTF-8.  Decrypted bodies are
+   usually UTF-8 already; in that case DATA itself is returned and no
+   copy is made.  Otherwise the conversion is stored at R_CONVERTED
+   which the caller needs to free.  The time is recorded in
+   TIMELINE.  */
+static const char *
+body_to_utf8 (const std::string &charset, const std::string &data,
+              int codepage, char **r_converted,
+              const std::shared_ptr<Timeline> &timeline)
+{
+  TimelineScope timeline_scope (timeline, TL_CHARSET);
+
+  *r_converted = nullptr;
+  if (!codepage && charset_utf8_compatible_p (charset.c_str (), data.c_str (),
+                                              data.size ()))
+    {
+      return data.c_str ();
+    }
+  *r_converted = ansi_charset_to_utf8 (charset.c_str (), data.c_str (),
+                                       data.size (), codepage);
+  return *r_converted;
+}
+
 void
 Mail::updateBody_o (bool is_preview)
 {
   TSTART;
+  TimelineScope timeline_scope (m_timeline, TL_UPDATE_BODY);
   if (!m_parser)
     {
       TRACEPOINT;
@@ -1616,42 +1661,43 @@ Mail::updateBody_o (bool is_preview)
             }
 
           char *converted = nullptr;
+          const char *utf8 = nullptr;
 
           if (!html.empty () || !is_preview)
             {
-              converted = ansi_charset_to_utf8 (charset.c_str(), html.c_str(),
-                                                html.size(), codepage);
-
+              utf8 = body_to_utf8 (charset, html, codepage, &converted,
+                                   m_timeline);
             }
           if (is_preview)
             {
               char *buf;
-              if (!converted)
+              if (!utf8)
                 {
                   /* Convert plaintext to HTML for preview using outlook. */
                   charset = m_parser->get_body_charset ();
-                  converted = ansi_charset_to_utf8 (charset.c_str(), body.c_str(),
-                                                    body.size(), codepage);
-                  put_oom_string (m_mailitem, "Body", converted);
+                  utf8 = body_to_utf8 (charset, body, codepage, &converted,
+                                       m_timeline);
+                  put_oom_string (m_mailitem, "Body", utf8);
                   xfree (converted);
                   converted = get_oom_string (m_mailitem, "HTMLBody");
+                  utf8 = converted;
                 }
-              if (converted)
+              if (utf8)
               {
                 gpgrt_asprintf (&buf, HTML_PREVIEW_PLACEHOLDER,
                                 isSMIME_m () ? "S/MIME" : "OpenPGP",
                                 _("message"),
                                 _("Please wait while the message is being verified..."),
-                                converted);
+                                utf8);
                 memdbg_alloc (buf);
                 xfree (converted);
                 converted = buf;
+                utf8 = converted;
               }
             }
           TRACEPOINT;
           put_oom_int (m_mailitem, "BodyFormat", 2);
-          int ret = put_oom_string (m_mailitem, "HTMLBody", converted ?
-                                                            converted : "");
+          int ret = put_oom_string (m_mailitem, "HTMLBody", utf8 ? utf8 : "");
           xfree (converted);
           TRACEPOINT;
           if (ret)
@@ -1767,9 +1813,9 @@ Mail::updateBody_o (bool is_preview)
                  SRCNAME, __func__, codepage);
     }
 
-  char *converted = ansi_charset_to_utf8 (plain_charset.c_str(),
-                                          body.c_str(), body.size(),
-                                          codepage);
+  char *converted = nullptr;
+  const char *utf8 = body_to_utf8 (plain_charset, body, codepage, &converted,
+                                   m_timeline);
   if (is_preview)
     {
       char *buf;
@@ -1777,14 +1823,15 @@ Mail::updateBody_o (bool is_preview)
                       isSMIME_m () ? "S/MIME" : "OpenPGP",
                       _("message"),
                       _("Please wait while the message is being verified..."),
-                      converted);
+                      utf8);
       memdbg_alloc (buf);
       xfree (converted);
       converted = buf;
+      utf8 = converted;
     }
   TRACEPOINT;
   put_oom_int (m_mailitem, "BodyFormat", 1);
-  int ret = put_oom_string (m_mailitem, "Body", converted ? converted : "");
+  int ret = put_oom_string (m_mailitem, "Body", utf8 ? utf8 : "");
   TRACEPOINT;
   xfree (converted);
   if (ret)
@@ -1880,6 +1927,7 @@ void
 Mail::parsingDone_o (bool is_preview)
 {
   TSTART;
+  TimelineScope timeline_scope (m_timeline, TL_PARSING_DONE);
   TRACEPOINT;
   log_oom ("Mail %p Parsing done for parser num %i: %p",
            this, parsed_count++, m_parser.get());
@@ -1997,6 +2045,7 @@ Mail::parsingDone_o (bool is_preview)
     {
       log_debug ("%s:%s: Delayed invalidate to update sigstate.",
                  SRCNAME, __func__);
+      m_timeline->mark (TL_INVALIDATE_UI);
       CloseHandle(CreateThread (NULL, 0, delayed_invalidate_ui, (LPVOID) 300, 0,
                                 NULL));
     }
@@ -2029,6 +2078,9 @@ Mail::encryptSignStart_o ()
   flags = get_gpgol_draft_info_flags (message);
   gpgol_release (message);
 
+  /* The resolution of the send takes over.  */
+  cancelPreResolve ();
+
   const auto window = get_active_hwnd ();
 
   if (m_is_gsuite)
@@ -3845,6 +3897,7 @@ Mail::locateKeys_o ()
     }
 
   autosecureCheck ();
+  preResolve_o ();
 
   m_locate_in_progress = false;
   TRETURN;
@@ -4569,6 +4622,8 @@ Mail::decrementLocateCount ()
   if (!m_locate_count)
     {
       autosecureCheck ();
+      /* The located keys might complete the resolution.  */
+      schedulePreResolve ();
     }
   TRETURN;
 }
@@ -4633,6 +4688,172 @@ Mail::setDoAutosecure_m (bool value)
   set_gpgol_draft_info_flags (msg, value ? 3 : opt.sign_default ? 2 : 0);
   gpgol_release (msg);
   gpgoladdin_invalidate_ui();
+  preResolve_o ();
+  TRETURN;
+}
+
+/* Resolve the keys of a mail being composed once its recipients did
+   not change for this many milliseconds.  */
+#define PRE_RESOLVE_DELAY 1500
+
+/* How long the shutdown waits for a running resolution to notice
+   that it is stale.  */
+#define PRE_RESOLVE_STOP_TIMEOUT 5000
+
+static DebounceScheduler s_pre_resolve (PRE_RESOLVE_DELAY);
+static HANDLE s_pre_resolve_event;
+static HANDLE s_pre_resolve_thread;
+static bool s_pre_resolve_stop;  /* Protected by pre_resolve_lock.  */
+GPGRT_LOCK_DEFINE (pre_resolve_lock);
+
+static DWORD WINAPI
+do_pre_resolve (LPVOID)
+{
+  while (true)
+    {
+      gpgol_lock (&pre_resolve_lock);
+      const bool stop = s_pre_resolve_stop;
+      gpgol_unlock (&pre_resolve_lock);
+      if (stop)
+        {
+          break;
+        }
+      s_pre_resolve.runDue (GetTickCount64 ());
+      WaitForSingleObject (s_pre_resolve_event,
+                           (DWORD) s_pre_resolve.nextDue (GetTickCount64 (),
+                                                          INFINITE));
+    }
+  return 0;
+}
+
+/* Start the thread for the pre resolution if it is not yet running.
+   Must be called with pre_resolve_lock held.  */
+static bool
+start_pre_resolve_thread ()
+{
+  if (s_pre_resolve_stop)
+    {
+      return false;
+    }
+  if (s_pre_resolve_event)
+    {
+      return true;
+    }
+  s_pre_resolve_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+  if (!s_pre_resolve_event)
+    {
+      log_error ("%s:%s: Failed to create event.",
+                 SRCNAME, __func__);
+      return false;
+    }
+  s_pre_resolve_thread = CreateThread (NULL, 0, do_pre_resolve, NULL, 0,
+                                       NULL);
+  if (!s_pre_resolve_thread)
+    {
+      log_error ("%s:%s: Failed to create thread.",
+                 SRCNAME, __func__);
+      CloseHandle (s_pre_resolve_event);
+      s_pre_resolve_event = nullptr;
+      return false;
+    }
+  return true;
+}
+
+void
+Mail::stopPreResolve ()
+{
+  TSTART;
+  gpgol_lock (&pre_resolve_lock);
+  s_pre_resolve_stop = true;
+  s_pre_resolve.cancelAll ();
+  HANDLE thread = s_pre_resolve_thread;
+  s_pre_resolve_thread = nullptr;
+  if (s_pre_resolve_event)
+    {
+      SetEvent (s_pre_resolve_event);
+    }
+  gpgol_unlock (&pre_resolve_lock);
+
+  if (!thread)
+    {
+      TRETURN;
+    }
+  /* A resolution stuck in gpgme must not block Outlook from closing,
+     so do not wait forever.  */
+  if (WaitForSingleObject (thread, PRE_RESOLVE_STOP_TIMEOUT) != WAIT_OBJECT_0)
+    {
+      log_error ("%s:%s: Pre resolution thread did not stop.",
+                 SRCNAME, __func__);
+    }
+  CloseHandle (thread);
+  TRETURN;
+}
+
+void
+Mail::preResolve_o ()
+{
+  TSTART;
+  if (!opt.autoresolve || opt.alwaysShowApproval || m_is_draft_encrypt)
+    {
+      cancelPreResolve ();
+      TRETURN;
+    }
+  const int flags = needs_crypto_m ();
+  if (!flags || m_cached_recipients.empty ())
+    {
+      cancelPreResolve ();
+      TRETURN;
+    }
+
+  GpgME::Protocol proto = opt.enable_smime ? GpgME::UnknownProtocol: GpgME::OpenPGP;
+
+  /* Like in encryptSignStart_o so that the send finds the result.  */
+  auto crypter = std::make_shared<CryptController> (this, flags & 1,
+                                                    flags & 2, proto);
+  gpgol_lock (&pre_resolve_lock);
+  m_pre_crypter = crypter;
+  gpgol_unlock (&pre_resolve_lock);
+  schedulePreResolve ();
+  TRETURN;
+}
+
+/* Schedule the pre resolution again.  Every call starts the delay
+   over and makes a running resolution for this mail stale.  This
+   may be called from any thread.  */
+void
+Mail::schedulePreResolve ()
+{
+  TSTART;
+  const std::string key = std::to_string ((uintptr_t) this);
+
+  gpgol_lock (&pre_resolve_lock);
+  const auto crypter = m_pre_crypter;
+  if (!crypter || !start_pre_resolve_thread ())
+    {
+      gpgol_unlock (&pre_resolve_lock);
+      TRETURN;
+    }
+  s_pre_resolve.schedule (key, GetTickCount64 (),
+                          [crypter] (const DebounceScheduler::Token &token)
+    {
+      crypter->resolve_keys_speculative ([&token] ()
+        {
+          return token.isCurrent ();
+        });
+    });
+  SetEvent (s_pre_resolve_event);
+  gpgol_unlock (&pre_resolve_lock);
+  TRETURN;
+}
+
+void
+Mail::cancelPreResolve ()
+{
+  TSTART;
+  gpgol_lock (&pre_resolve_lock);
+  m_pre_crypter = nullptr;
+  s_pre_resolve.cancel (std::to_string ((uintptr_t) this));
+  gpgol_unlock (&pre_resolve_lock);
   TRETURN;
 }
 
@@ -4963,6 +5184,7 @@ Mail::splitCopyMailCallback (Mail *copied_mail)
       else if (recp.type () == Recipient::olBCC && !bccFound)
         {
           const auto bccKeys = recp.keys ();
+          const auto prepared = takeSplitOutput (recp.mbox ());
           if (bccKeys.empty())
             {
               log_err ("Empty keylist for recipient!");
@@ -4992,6 +5214,12 @@ Mail::splitCopyMailCallback (Mail *copied_mail)
               newRecipientsForCopy.push_back (recp);
               /* Our keylist is of a single protocol so we can take that. */
               copyProtocol = bccKeys[0].protocol ();
+              if (prepared && prepared->proto == copyProtocol)
+                {
+                  log_dbg ("Copy for '%s' is already encrypted.",
+                           anonstr (recp.mbox ().c_str ()));
+                  copied_mail->setPreparedOutput (prepared);
+                }
               log_dbg ("Recipient '%s' is BCC. Gets its own mail with "
                        "protocol: %s", anonstr (recp.mbox().c_str ()),
                        to_cstr (copyProtocol));
@@ -5074,6 +5302,7 @@ Mail::resetRecipients ()
   m_cached_recipients.clear ();
   m_resolved_signing_keys.clear ();
   m_recipients_set = false;
+  m_split_outputs.clear ();
 }
 
 void
@@ -5088,6 +5317,47 @@ Mail::isSplitCopy () const
   return m_is_split_copy;
 }
 
+void
+Mail::setSplitOutputs (const std::map<std::string,
+                       std::shared_ptr<const SplitOutput> > &outputs)
+{
+  m_split_outputs = outputs;
+}
+
+bool
+Mail::hasSplitOutputs () const
+{
+  return !m_split_outputs.empty ();
+}
+
+std::shared_ptr<const SplitOutput>
+Mail::takeSplitOutput (const std::string &mbox)
+{
+  std::shared_ptr<const SplitOutput> ret;
+  const auto it = m_split_outputs.find (mbox);
+
+  if (it != m_split_outputs.end ())
+    {
+      ret = it->second;
+      m_split_outputs.erase (it);
+    }
+  return ret;
+}
+
+void
+Mail::setPreparedOutput (std::shared_ptr<const SplitOutput> output)
+{
+  m_prepared_output = output;
+}
+
+std::shared_ptr<const SplitOutput>
+Mail::takePreparedOutput ()
+{
+  std::shared_ptr<const SplitOutput> ret = m_prepared_output;
+  m_prepared_output = nullptr;
+  return ret;
+}
+
 int
 Mail::buildProtectedHeaders_o ()
 {
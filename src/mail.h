@@ -28,12 +28,16 @@
 #include "gpgme++/decryptionresult.h"
 #include "gpgme++/key.h"
 
+#include <map>
+#include <memory>
 #include <string>
 
 class ParseController;
 class CryptController;
+class Timeline;
 class Attachment;
 class Recipient;
+struct SplitOutput;
 
 /** @brief Data wrapper around a mailitem.
  *
@@ -227,6 +231,14 @@ public:
     */
   static void locateAllCryptoRecipients_o ();
 
+  /** @brief Stop the thread which resolves the keys in the background.
+    *
+    * Pending resolutions are dropped and a running one is made stale.
+    * Nothing is resolved in the background afterwards.  Called on
+    * shutdown.
+    */
+  static void stopPreResolve ();
+
   /** @brief Reference to the mailitem. Do not Release! */
   LPDISPATCH item () { return m_mailitem; }
 
@@ -352,6 +364,9 @@ public:
     only valid while the crypting happens. */
   std::shared_ptr<CryptController> cryper () { return m_crypter; }
 
+  /** @brief get the timeline of this mail. */
+  std::shared_ptr<Timeline> timeline () { return m_timeline; }
+
   /** To be called from outside once the paser was done.
    In Qt this would be a slot that is called once it is finished
    we hack around that a bit by calling it from our windowmessages
@@ -615,6 +630,11 @@ public:
    */
   void setDoAutosecure_m (bool value);
 
+  /* Resolve the keys for the current recipients in the background
+     so that the send does not have to wait for it.  Drops a pending
+     resolution if the mail does not need crypto.  */
+  void preResolve_o ();
+
   /* Install an event handler for the folder of this mail. */
   void installFolderEventHandler_o ();
 
@@ -688,6 +708,17 @@ public:
   /* Setter for isSplitCopy */
   void setSplitCopy (bool val);
 
+  /* The encrypted copies for the BCC recipients of a split by
+     mailbox.  Set by the CryptController when it prepared them.  */
+  void setSplitOutputs (const std::map<std::string,
+                        std::shared_ptr<const SplitOutput> > &outputs);
+  bool hasSplitOutputs () const;
+
+  /* The prepared output of a split copy.  The CryptController of
+     the copy takes it instead of encrypting again.  */
+  void setPreparedOutput (std::shared_ptr<const SplitOutput> output);
+  std::shared_ptr<const SplitOutput> takePreparedOutput ();
+
   /* Set protected headers data */
   void setProtectedHeaders (const std::string &hdrs);
   std::string protectedHeaders () const;
@@ -710,6 +741,9 @@ private:
   void updateSigstate ();
   int add_attachments_o (std::vector<std::shared_ptr<Attachment> > attachments);
   int buildProtectedHeaders_o ();
+  void schedulePreResolve ();
+  void cancelPreResolve ();
+  std::shared_ptr<const SplitOutput> takeSplitOutput (const std::string &mbox);
 
   LPDISPATCH m_mailitem;
   LPDISPATCH m_event_sink;
@@ -735,6 +769,8 @@ private:
   msgtype_t m_type; /* Our messagetype as set in mapi */
   std::shared_ptr <ParseController> m_parser;
   std::shared_ptr <CryptController> m_crypter;
+  std::shared_ptr <CryptController> m_pre_crypter; /* For preResolve_o. */
+  std::shared_ptr <Timeline> m_timeline;
   GpgME::VerificationResult m_verify_result;
   GpgME::DecryptionResult m_decrypt_result;
   GpgME::Signature m_sig;
@@ -772,6 +808,8 @@ private:
   std::string m_protected_headers;
   header_info_s m_header_info; /* Information about the original headers */
   bool m_attachs_added; /* State variable to track if we have added attachments to this mail. */
+  std::map<std::string, std::shared_ptr<const SplitOutput> > m_split_outputs; /* Prepared copies of a split by mailbox. */
+  std::shared_ptr<const SplitOutput> m_prepared_output; /* Prepared output of a split copy. */
   std::string m_dec_content_type; /* Top level content type of the decrypted mail. */
 };
 
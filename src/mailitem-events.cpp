@@ -31,6 +31,8 @@
 #include "mapihelp.h"
 #include "gpgoladdin.h"
 #include "wks-helper.h"
+#include "latency.h"
+#include "timeline.h"
 
 #undef _
 #define _(a) utf8_gettext (a)
@@ -901,6 +903,8 @@ EVENT_SINK_INVOKE(MailItemEvents)
           log_oom ("%s:%s: deletion done",
                          SRCNAME, __func__);
           memdbg_dump ();
+          latency_dump ();
+          timeline_dump ();
           TRETURN S_OK;
         }
       case ReplyAll:
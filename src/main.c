@@ -265,6 +265,10 @@ read_options (void)
             opt.enable_debug |= DBG_OOM;
           else if (!strcmp (p, "oom-extra"))
             opt.enable_debug |= DBG_OOM;
+          else if (!strcmp (p, "trace-binary"))
+            opt.enable_debug |= DBG_TRACE_BIN;
+          else if (!strcmp (p, "latency"))
+            opt.enable_debug |= DBG_LATENCY;
           else
             log_debug ("invalid debug flag `%s' ignored", p);
         }
@@ -279,12 +283,34 @@ read_options (void)
   /* Yes we use free here because memtracing did not track the alloc
      as the option for debuging was not read before. */
   free (val); val = NULL;
+  if ((opt.enable_debug & ~DBG_COMPILED))
+    {
+      log_debug ("debug flags 0x%x are not available in this build",
+                 opt.enable_debug & ~DBG_COMPILED);
+      opt.enable_debug &= DBG_COMPILED;
+    }
+  if ((opt.enable_debug & DBG_TRACE_BIN))
+    {
+      /* The binary trace goes next to the log file.  */
+      char *tracefile = NULL;
+
+      if (*get_log_file ())
+        {
+          gpgrt_asprintf (&tracefile, "%s.trace", get_log_file ());
+          memdbg_alloc (tracefile);
+        }
+      if (!tracefile || trace_open (tracefile))
+        opt.enable_debug &= ~DBG_TRACE_BIN;
+      xfree (tracefile);
+    }
   if (opt.enable_debug)
-    log_debug ("enabled debug flags:%s%s%s%s\n",
+    log_debug ("enabled debug flags:%s%s%s%s%s%s\n",
                (opt.enable_debug & DBG_MEMORY)? " memory":"",
                (opt.enable_debug & DBG_DATA)? " data":"",
                (opt.enable_debug & DBG_OOM)? " oom":"",
-               (opt.enable_debug & DBG_TRACE)? " trace":""
+               (opt.enable_debug & DBG_TRACE)? " trace":"",
+               (opt.enable_debug & DBG_TRACE_BIN)? " trace-binary":"",
+               (opt.enable_debug & DBG_LATENCY)? " latency":""
                );
 
   opt.enable_smime = get_conf_bool ("enableSmime", 0);
@@ -305,6 +331,7 @@ read_options (void)
   opt.splitBCCMails = get_conf_bool ("splitBCCMails", 0);
   opt.combinedOpsEnabled = get_conf_bool ("combinedOpsEnabled", 0);
   opt.encryptSubject = get_conf_bool ("encryptSubject", 0);
+  opt.binaryTransport = get_conf_bool ("binaryTransport", 0);
 
   if (!opt.automation)
     {
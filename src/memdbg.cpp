@@ -27,17 +27,185 @@
 
 #include <gpg-error.h>
 
+#include <atomic>
 #include <unordered_map>
 #include <string>
+#include <vector>
+
+/* Tracking happens for every xmalloc and every reference of an
+   Outlook object so it has to be cheap.  Pointers are spread over
+   shards with their own lock, allocations only store the id of
+   their call site and the C++ object counters are split into
+   per thread slots which are summed up by memdbg_dump.  */
+#define MEMDBG_SHARDS 16
+#define SHARD_RESERVE 1024
+#define COUNTER_SLOTS 8
+#define MAX_CLASSES 64
+/* Lines of the dump between two log flushes.  */
+#define DUMP_FLUSH_LINES 256
+/* Hash table of the objName pointers.  Must be a power of two.  */
+#define CLASS_KEYS 256
+
+struct alignas (64) memdbg_shard_s
+{
+  gpgrt_lock_t lock = GPGRT_LOCK_INITIALIZER;
+  bool reserved = false;
+  /* Pointer to call site id.  */
+  std::unordered_map <void *, int> allocs;
+  std::unordered_map <void *, int> olObjs;
+  std::unordered_map <void *, std::string> olNames;
+};
+
+static memdbg_shard_s shards[MEMDBG_SHARDS];
+
+/* Counters of one slot.  Each thread uses one slot.  */
+struct alignas (64) counter_row_s
+{
+  std::atomic<long> counts[MAX_CLASSES];
+};
+
+static counter_row_s counter_rows[COUNTER_SLOTS];
+static std::atomic<unsigned int> next_slot;
+
+/* The objName pointers seen so far.  The same name from different
+   compilation units may have different pointers.  */
+static std::atomic<const char *> class_keys[CLASS_KEYS];
+static std::atomic<int> class_ids[CLASS_KEYS];
+static const char *class_names[MAX_CLASSES];
+static int n_classes;
 
-std::unordered_map <std::string, int> cppObjs;
-std::unordered_map <void *, int> olObjs;
-std::unordered_map <void *, std::string> olNames;
-std::unordered_map <void *, std::string> allocs;
+static std::vector<memdbg_site_t *> sites;
 
 GPGRT_LOCK_DEFINE (memdbg_log);
 
-#define DBGGUARD if (!(opt.enable_debug & DBG_MEMORY)) return
+#define DBGGUARD if (!debug_enabled (DBG_MEMORY)) return
+
+static memdbg_shard_s &
+get_shard (const void *ptr)
+{
+  uintptr_t val = (uintptr_t) ptr;
+
+  /* Allocations are at least 16 byte aligned.  */
+  val = (val >> 4) ^ (val >> 12);
+  return shards[val & (MEMDBG_SHARDS - 1)];
+}
+
+/* Lock the shard of PTR.  */
+static memdbg_shard_s &
+lock_shard (const void *ptr)
+{
+  memdbg_shard_s &shard = get_shard (ptr);
+
+  gpgrt_lock_lock (&shard.lock);
+  if (!shard.reserved)
+    {
+      shard.allocs.reserve (SHARD_RESERVE);
+      shard.olObjs.reserve (SHARD_RESERVE / 4);
+      shard.reserved = true;
+    }
+  return shard;
+}
+
+static std::atomic<long> *
+counter_row (void)
+{
+  static thread_local int slot = -1;
+
+  if (slot == -1)
+    {
+      slot = (int) (next_slot.fetch_add (1, std::memory_order_relaxed)
+                    % COUNTER_SLOTS);
+    }
+  return counter_rows[slot].counts;
+}
+
+/* Returns the id of the class NAME or -1 if there are too many
+   classes.  R_NEW is set if NAME was not known before.  */
+static int
+class_id (const char *name, bool *r_new)
+{
+  unsigned int idx = (unsigned int) (((uintptr_t) name >> 3)
+                                     & (CLASS_KEYS - 1));
+
+  *r_new = false;
+  for (int i = 0; i < CLASS_KEYS; i++, idx = (idx + 1) & (CLASS_KEYS - 1))
+    {
+      const char *key = class_keys[idx].load (std::memory_order_acquire);
+      if (key == name)
+        {
+          return class_ids[idx].load (std::memory_order_relaxed);
+        }
+      if (!key)
+        {
+          break;
+        }
+    }
+
+  /* First use of this pointer.  */
+  int id = -1;
+  gpgrt_lock_lock (&memdbg_log);
+  for (int i = 0; i < n_classes; i++)
+    {
+      if (!strcmp (class_names[i], name))
+        {
+          id = i;
+          break;
+        }
+    }
+  if (id == -1 && n_classes < MAX_CLASSES)
+    {
+      id = n_classes++;
+      class_names[id] = name;
+      *r_new = true;
+    }
+  if (id != -1)
+    {
+      for (int i = 0; i < CLASS_KEYS; i++, idx = (idx + 1) & (CLASS_KEYS - 1))
+        {
+          const char *key = class_keys[idx].load (std::memory_order_relaxed);
+          if (key == name)
+            {
+              break;
+            }
+          if (!key)
+            {
+              class_ids[idx].store (id, std::memory_order_relaxed);
+              class_keys[idx].store (name, std::memory_order_release);
+              break;
+            }
+        }
+    }
+  gpgrt_lock_unlock (&memdbg_log);
+
+  if (id == -1)
+    {
+      log_error ("%s:%s Too many classes. Ignoring %s",
+                 SRCNAME, __func__, name);
+    }
+  return id;
+}
+
+/* Give SITE an id.  */
+static int
+register_site (memdbg_site_t *site)
+{
+  int id;
+
+  gpgrt_lock_lock (&memdbg_log);
+  id = site->id;
+  if (!id)
+    {
+      if (sites.empty ())
+        {
+          sites.reserve (SHARD_RESERVE);
+        }
+      sites.push_back (site);
+      id = (int) sites.size ();
+      __atomic_store_n (&site->id, id, __ATOMIC_RELEASE);
+    }
+  gpgrt_lock_unlock (&memdbg_log);
+  return id;
+}
 
 #ifndef BUILD_TESTS
 # include "oomhelp.h"
@@ -45,7 +213,7 @@ GPGRT_LOCK_DEFINE (memdbg_log);
 
 /* Returns true on a name change */
 static bool
-register_name (void *obj, const char *nameSuggestion)
+register_name (memdbg_shard_s &shard, void *obj, const char *nameSuggestion)
 {
 #ifndef BUILD_TESTS
 
@@ -59,8 +227,8 @@ register_name (void *obj, const char *nameSuggestion)
     }
   if (!name)
     {
-      auto it = olNames.find (obj);
-      if (it != olNames.end())
+      auto it = shard.olNames.find (obj);
+      if (it != shard.olNames.end())
         {
           if (it->second != "unknown")
             {
@@ -76,8 +244,8 @@ register_name (void *obj, const char *nameSuggestion)
   std::string sName = name;
   xfree (name);
 
-  auto it = olNames.find (obj);
-  if (it != olNames.end())
+  auto it = shard.olNames.find (obj);
+  if (it != shard.olNames.end())
     {
       if (it->second != sName)
         {
@@ -90,9 +258,10 @@ register_name (void *obj, const char *nameSuggestion)
     }
   else
     {
-      olNames.insert (std::make_pair (obj, sName));
+      shard.olNames.insert (std::make_pair (obj, sName));
     }
 #else
+  (void) shard;
   (void) obj;
   (void) nameSuggestion;
 #endif
@@ -109,22 +278,22 @@ _memdbg_addRef (void *obj, const char *nameSuggestion)
       return;
     }
 
-  gpgrt_lock_lock (&memdbg_log);
+  memdbg_shard_s &shard = lock_shard (obj);
 
-  auto it = olObjs.find (obj);
+  auto it = shard.olObjs.find (obj);
 
-  if (it == olObjs.end())
+  if (it == shard.olObjs.end())
     {
-      it = olObjs.insert (std::make_pair (obj, 0)).first;
+      it = shard.olObjs.insert (std::make_pair (obj, 0)).first;
     }
-  if (register_name (obj, nameSuggestion) && it->second)
+  if (register_name (shard, obj, nameSuggestion) && it->second)
     {
       log_error ("%s:%s Name change without null ref on %p!",
                  SRCNAME, __func__, obj);
     }
   it->second++;
 
-  gpgrt_lock_unlock (&memdbg_log);
+  gpgrt_lock_unlock (&shard.lock);
 }
 
 void
@@ -137,15 +306,15 @@ memdbg_released (void *obj)
       return;
     }
 
-  gpgrt_lock_lock (&memdbg_log);
+  memdbg_shard_s &shard = lock_shard (obj);
 
-  auto it = olObjs.find (obj);
+  auto it = shard.olObjs.find (obj);
 
-  if (it == olObjs.end())
+  if (it == shard.olObjs.end())
     {
       log_error ("%s:%s Released %p without query if!!",
                  SRCNAME, __func__, obj);
-      gpgrt_lock_unlock (&memdbg_log);
+      gpgrt_lock_unlock (&shard.lock);
       return;
     }
 
@@ -156,12 +325,14 @@ memdbg_released (void *obj)
       log_error ("%s:%s Released %p below zero",
                  SRCNAME, __func__, obj);
     }
-  gpgrt_lock_unlock (&memdbg_log);
+  gpgrt_lock_unlock (&shard.lock);
 }
 
 void
 memdbg_ctor (const char *objName)
 {
+  bool is_new;
+
   DBGGUARD;
 
   if (!objName)
@@ -170,24 +341,21 @@ memdbg_ctor (const char *objName)
       return;
     }
 
-  gpgrt_lock_lock (&memdbg_log);
-
-  const std::string nameStr (objName);
-
-  auto it = cppObjs.find (nameStr);
-
-  if (it == cppObjs.end())
+  const int id = class_id (objName, &is_new);
+  if (id < 0)
     {
-      it = cppObjs.insert (std::make_pair (nameStr, 0)).first;
+      return;
     }
-  it->second++;
-
-  gpgrt_lock_unlock (&memdbg_log);
+  counter_row ()[id].fetch_add (1, std::memory_order_relaxed);
 }
 
+/* A dtor without ctor is found here.  More dtors than ctors are
+   only found by memdbg_dump as the counters are not merged before.  */
 void
 memdbg_dtor (const char *objName)
 {
+  bool is_new;
+
   DBGGUARD;
 
   if (!objName)
@@ -196,30 +364,23 @@ memdbg_dtor (const char *objName)
       return;
     }
 
-  const std::string nameStr (objName);
-  auto it = cppObjs.find (nameStr);
-
-  if (it == cppObjs.end())
+  const int id = class_id (objName, &is_new);
+  if (id < 0)
     {
-      log_error ("%s:%s Dtor of %s before ctor",
-                 SRCNAME, __func__, nameStr.c_str());
-      gpgrt_lock_unlock (&memdbg_log);
       return;
     }
-
-  it->second--;
-
-  if (it->second < 0)
+  if (is_new)
     {
-      log_error ("%s:%s Dtor of %s more often then ctor",
-                 SRCNAME, __func__, nameStr.c_str());
+      log_error ("%s:%s Dtor of %s before ctor",
+                 SRCNAME, __func__, objName);
+      return;
     }
-  gpgrt_lock_unlock (&memdbg_log);
+  counter_row ()[id].fetch_sub (1, std::memory_order_relaxed);
 }
 
 
 void
-_memdbg_alloc (void *ptr, const char *srcname, const char *func, int line)
+_memdbg_alloc (void *ptr, memdbg_site_t *site)
 {
   DBGGUARD;
 
@@ -229,23 +390,20 @@ _memdbg_alloc (void *ptr, const char *srcname, const char *func, int line)
       return;
     }
 
-  gpgrt_lock_lock (&memdbg_log);
-
-  const std::string identifier = std::string (srcname) + std::string (":") +
-                                  std::string (func) + std::string (":") +
-                                  std::to_string (line);
+  int id = __atomic_load_n (&site->id, __ATOMIC_ACQUIRE);
+  if (!id)
+    {
+      id = register_site (site);
+    }
 
-  auto it = allocs.find (ptr);
+  memdbg_shard_s &shard = lock_shard (ptr);
 
-  if (it != allocs.end())
+  if (!shard.allocs.insert (std::make_pair (ptr, id)).second)
     {
       TRACEPOINT;
-      gpgrt_lock_unlock (&memdbg_log);
-      return;
     }
-  allocs.insert (std::make_pair (ptr, identifier));
 
-  gpgrt_lock_unlock (&memdbg_log);
+  gpgrt_lock_unlock (&shard.lock);
 }
 
 
@@ -260,65 +418,95 @@ memdbg_free (void *ptr)
       return false;
     }
 
-  gpgrt_lock_lock (&memdbg_log);
-
-  auto it = allocs.find (ptr);
+  memdbg_shard_s &shard = lock_shard (ptr);
 
-  if (it == allocs.end())
+  if (!shard.allocs.erase (ptr))
     {
+      gpgrt_lock_unlock (&shard.lock);
       log_error ("%s:%s Free unregistered: %p",
                  SRCNAME, __func__, ptr);
-      gpgrt_lock_unlock (&memdbg_log);
       return false;
     }
 
-  allocs.erase (it);
-
-  gpgrt_lock_unlock (&memdbg_log);
+  gpgrt_lock_unlock (&shard.lock);
   return true;
 }
 
 void
 memdbg_dump ()
 {
+  unsigned int lines = 0;
+
   DBGGUARD;
   gpgrt_lock_lock (&memdbg_log);
+  for (int i = 0; i < MEMDBG_SHARDS; i++)
+    {
+      gpgrt_lock_lock (&shards[i].lock);
+    }
   log_memory (""
 "------------------------------MEMORY DUMP----------------------------------");
 
   log_memory("-- C++ Objects --");
-  for (const auto &pair: cppObjs)
+  for (int i = 0; i < n_classes; i++)
     {
-      log_memory("%s\t: %i", pair.first.c_str(), pair.second);
-    }
-  log_memory("-- C++ End --");
-  log_memory("-- OL Objects --");
-  for (const auto &pair: olObjs)
-    {
-      if (!pair.second)
+      long count = 0;
+      for (int slot = 0; slot < COUNTER_SLOTS; slot++)
         {
-          continue;
+          count += counter_rows[slot].counts[i].load (std::memory_order_relaxed);
         }
-      const auto it = olNames.find (pair.first);
-      if (it == olNames.end())
+      log_memory("%s\t: %li", class_names[i], count);
+      if (count < 0)
         {
-          log_memory("%p\t: %i", pair.first, pair.second);
+          log_error ("%s:%s Dtor of %s more often then ctor",
+                     SRCNAME, __func__, class_names[i]);
         }
-      else
+    }
+  log_memory("-- C++ End --");
+  log_memory("-- OL Objects --");
+  for (int i = 0; i < MEMDBG_SHARDS; i++)
+    {
+      const memdbg_shard_s &shard = shards[i];
+      for (const auto &pair: shard.olObjs)
         {
-          log_memory("%p:%s\t: %i", pair.first,
-                    it->second.c_str (), pair.second);
+          if (!pair.second)
+            {
+              continue;
+            }
+          const auto it = shard.olNames.find (pair.first);
+          if (it == shard.olNames.end())
+            {
+              log_memory("%p\t: %i", pair.first, pair.second);
+            }
+          else
+            {
+              log_memory("%p:%s\t: %i", pair.first,
+                        it->second.c_str (), pair.second);
+            }
         }
     }
   log_memory("-- OL End --");
   log_memory("-- Allocated Addresses --");
-  for (const auto &pair: allocs)
+  for (int i = 0; i < MEMDBG_SHARDS; i++)
     {
-      log_memory ("%s: %p", pair.second.c_str(), pair.first);
+      for (const auto &pair: shards[i].allocs)
+        {
+          const memdbg_site_t *site = sites[pair.second - 1];
+          log_memory ("%s:%s:%i: %p", log_srcname (site->file), site->func,
+                      site->line, pair.first);
+          /* Keep the log ring from overflowing.  */
+          if (!(++lines % DUMP_FLUSH_LINES))
+            {
+              log_flush ();
+            }
+        }
     }
   log_memory("-- Allocated Addresses End --");
 
   log_memory(""
 "------------------------------MEMORY END ----------------------------------");
+  for (int i = MEMDBG_SHARDS - 1; i >= 0; i--)
+    {
+      gpgrt_lock_unlock (&shards[i].lock);
+    }
   gpgrt_lock_unlock (&memdbg_log);
 }
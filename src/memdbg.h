@@ -42,12 +42,27 @@ extern "C" {
 void _memdbg_addRef (void *obj, const char *nameSuggestion);
 void memdbg_released (void *obj);
 
+/* OBJNAME must stay valid, usually it is a string literal.  */
 void memdbg_ctor (const char *objName);
 void memdbg_dtor (const char *objName);
 
-void _memdbg_alloc (void *ptr, const char *srcname, const char *func, int line);
+/* The call site of a memdbg_alloc.  Each use of the macro has its
+   own static instance so that an allocation only stores the id.  */
+typedef struct
+{
+  const char *file;
+  const char *func;
+  int line;
+  /* Assigned on first use.  */
+  int id;
+} memdbg_site_t;
+
+void _memdbg_alloc (void *ptr, memdbg_site_t *site);
 #define memdbg_alloc(X) \
-    _memdbg_alloc ((void *)X, log_srcname (__FILE__), __func__, __LINE__);
+{ \
+  static memdbg_site_t memdbg_site_ = { __FILE__, __func__, __LINE__, 0 }; \
+  _memdbg_alloc ((void *)X, &memdbg_site_); \
+}
 int memdbg_free (void *ptr);
 
 void memdbg_dump(void);
@@ -0,0 +1,527 @@
+/* mime-crypt.cpp - MIME structures around GpgME data
+ * Copyright (C) 2018 Intevation GmbH
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The parts of the CryptController which wrap the crypto results
+   into MIME.  They do not need MAPI and are thus tested on Linux.  */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "common_indep.h"
+#include "mime-crypt.h"
+
+/* Size of the chunks write_data reads from a GpgME::Data.  */
+#define DATA_CHUNK_SIZE 16384
+
+int
+sink_data_write (sink_t sink, const void *data, size_t datalen)
+{
+  GpgME::Data *d = static_cast<GpgME::Data *>(sink->cb_data);
+
+  if (!data)
+    return 0;  /* Flush - nothing to do here.  */
+  if (d->write (data, datalen) != (ssize_t) datalen)
+    {
+      log_error ("%s:%s: Write failed", SRCNAME, __func__);
+      return -1;
+    }
+  return 0;
+}
+
+/* Read method of a source that contains a GpgME::Data.  */
+static int
+source_data_read (source_t source, void *buffer, size_t size,
+                  size_t *r_nread)
+{
+  GpgME::Data *d = static_cast<GpgME::Data *>(source->cb_data);
+  ssize_t nread = d->read (buffer, size);
+
+  if (nread < 0)
+    {
+      log_error ("%s:%s: Read failed", SRCNAME, __func__);
+      return -1;
+    }
+  *r_nread = nread;
+  return 0;
+}
+
+static int
+source_data_rewind (source_t source)
+{
+  GpgME::Data *d = static_cast<GpgME::Data *>(source->cb_data);
+
+  if (d->seek (0, SEEK_SET))
+    {
+      log_error ("%s:%s: Seek failed", SRCNAME, __func__);
+      return -1;
+    }
+  return 0;
+}
+
+void
+source_init_data (source_t source, GpgME::Data *data)
+{
+  memset (source, 0, sizeof *source);
+  source->cb_data = data;
+  source->readfnc = source_data_read;
+  source->rewindfnc = source_data_rewind;
+  data->seek (0, SEEK_SET);
+}
+
+int
+write_data (sink_t sink, GpgME::Data &data)
+{
+  TSTART;
+  if (!sink || !sink->writefnc)
+    {
+      TRETURN -1;
+    }
+
+  /* GpgME::Data can only be read into our own buffer.  The chunks
+     are large enough to be passed on by a batching sink without
+     another copy.  */
+  char buf[DATA_CHUNK_SIZE];
+  ssize_t nread;
+  data.seek (0, SEEK_SET);
+  while ((nread = data.read (buf, sizeof buf)) > 0)
+    {
+      if (sink->writefnc (sink, buf, nread))
+        {
+          TRACEPOINT;
+          TRETURN -1;
+        }
+    }
+  if (nread < 0)
+    {
+      log_error ("%s:%s: Read failed", SRCNAME, __func__);
+      TRETURN -1;
+    }
+
+  TRETURN 0;
+}
+
+/* Write the part of a multipart/signed up to the signed data.  */
+static int
+write_sign_head (sink_t sink, protocol_t protocol, const char *boundary,
+                 const char *micalg)
+{
+  TSTART;
+  char top_header[BOUNDARYSIZE+200];
+  int rc = 0;
+
+  /* Write the top header.  */
+  create_top_signing_header (top_header, sizeof top_header,
+                             protocol, 1, boundary,
+                             micalg);
+
+  if ((rc = write_string (sink, top_header)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  /* Write the boundary so that it is not included in the hashing.  */
+  if ((rc = write_boundary (sink, boundary, 0)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+  TRETURN rc;
+}
+
+/* Write the part of a multipart/signed after the signed data.  */
+static int
+write_sign_tail (sink_t sink, protocol_t protocol, const char *boundary,
+                 GpgME::Data &signature)
+{
+  TSTART;
+  int rc = 0;
+
+  /* Write the signature attachment */
+  if ((rc = write_boundary (sink, boundary, 0)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  if (protocol == PROTOCOL_OPENPGP)
+    {
+      rc = write_string (sink,
+                         "Content-Type: application/pgp-signature;\r\n"
+                         "\tname=\"" OPENPGP_SIG_NAME "\"\r\n"
+                         "Content-Transfer-Encoding: 7Bit\r\n");
+    }
+  else
+    {
+      rc = write_string (sink,
+                         "Content-Transfer-Encoding: base64\r\n"
+                         "Content-Type: application/pkcs7-signature\r\n"
+                         "Content-Disposition: inline;\r\n"
+                         "\tfilename=\"" SMIME_SIG_NAME "\"\r\n");
+      /* rc = write_string (sink, */
+      /*                    "Content-Type: application/x-pkcs7-signature\r\n" */
+      /*                    "\tname=\"smime.p7s\"\r\n" */
+      /*                    "Content-Transfer-Encoding: base64\r\n" */
+      /*                    "Content-Disposition: attachment;\r\n" */
+      /*                    "\tfilename=\"smime.p7s\"\r\n"); */
+
+    }
+
+  if (rc)
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  if ((rc = write_string (sink, "\r\n")))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  // Write the signature data
+  if (protocol == PROTOCOL_SMIME)
+    {
+      struct source_s source;
+
+      source_init_data (&source, &signature);
+      if ((rc = write_b64_source (sink, &source)))
+        {
+          TRACEPOINT;
+          TRETURN rc;
+        }
+    }
+  else if ((rc = write_data (sink, signature)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  // Add an extra linefeed with should not harm.
+  if ((rc = write_string (sink, "\r\n")))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  /* Write the final boundary.  */
+  if ((rc = write_boundary (sink, boundary, 1)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  TRETURN rc;
+}
+
+int
+create_sign_attach (sink_t sink, protocol_t protocol,
+                    GpgME::Data &signature,
+                    GpgME::Data &signedData,
+                    const char *micalg)
+{
+  TSTART;
+  char boundary[BOUNDARYSIZE+1];
+  int rc = 0;
+
+  generate_boundary (boundary);
+  if ((rc = write_sign_head (sink, protocol, boundary, micalg)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  /* Write the signed mime structure */
+  if ((rc = write_data (sink, signedData)))
+    {
+      TRACEPOINT;
+      TRETURN rc;
+    }
+
+  TRETURN write_sign_tail (sink, protocol, boundary, signature);
+}
+
+int
+create_encrypt_attach (sink_t sink, protocol_t protocol,
+                       GpgME::Data &encryptedData,
+                       int exchange_major_version,
+                       bool binary)
+{
+  TSTART;
+  char boundary[BOUNDARYSIZE+1];
+  binary = binary && protocol == PROTOCOL_OPENPGP;
+  int rc = create_top_encryption_header (sink, protocol, boundary,
+                                         false, exchange_major_version,
+                                         binary);
+  // From here on use goto failure pattern.
+  if (rc)
+    {
+      log_error ("%s:%s: Failed to create top header.",
+                 SRCNAME, __func__);
+      TRETURN rc;
+    }
+
+  if (!binary && (protocol == PROTOCOL_OPENPGP ||
+                  exchange_major_version >= 15))
+    {
+      // With exchange 2016 we have to construct S/MIME
+      // differently and write the raw data here.
+      rc = write_data (sink, encryptedData);
+    }
+  else
+    {
+      struct source_s source;
+
+      source_init_data (&source, &encryptedData);
+      rc = write_b64_source (sink, &source);
+    }
+
+  if (rc)
+    {
+      log_error ("%s:%s: Failed to create top header.",
+                 SRCNAME, __func__);
+      TRETURN rc;
+    }
+
+  /* Write the final boundary (for OpenPGP) and finish the attachment.  */
+  if (*boundary && (rc = write_boundary (sink, boundary, 1)))
+    {
+      log_error ("%s:%s: Failed to write boundary.",
+                 SRCNAME, __func__);
+    }
+  TRETURN rc;
+}
+
+
+int
+create_draft_parts_attach (sink_t sink, protocol_t protocol,
+                           const std::vector<std::shared_ptr<
+                             const std::string> > &parts,
+                           int exchange_major_version, bool binary)
+{
+  TSTART;
+  char boundary[BOUNDARYSIZE+1];
+  int rc;
+
+  if (parts.empty () || (parts.size () > 1 && protocol != PROTOCOL_OPENPGP))
+    {
+      log_error ("%s:%s: Can't write %lu parts",
+                 SRCNAME, __func__, (unsigned long) parts.size ());
+      TRETURN -1;
+    }
+  if (parts.size () == 1)
+    {
+      GpgME::Data data (parts[0]->data (), parts[0]->size (), false);
+      TRETURN create_encrypt_attach (sink, protocol, data,
+                                     exchange_major_version, binary);
+    }
+
+  generate_boundary (boundary);
+  const std::string count = std::to_string (parts.size ());
+  rc = write_multistring (sink,
+                          "MIME-Version: 1.0\r\n"
+                          DRAFT_PARTS_HEADER ": ", count.c_str (), "\r\n"
+                          "Content-Type: multipart/mixed;\r\n"
+                          "\tboundary=\"", boundary, "\"\r\n",
+                          NULL);
+  for (size_t idx = 0; !rc && idx < parts.size (); idx++)
+    {
+      GpgME::Data data (parts[idx]->data (), parts[idx]->size (), false);
+
+      rc = write_boundary (sink, boundary, 0);
+      if (!rc)
+        {
+          rc = create_encrypt_attach (sink, protocol, data, -1, binary);
+        }
+    }
+  if (!rc)
+    {
+      rc = write_boundary (sink, boundary, 1);
+    }
+  if (rc)
+    {
+      log_error ("%s:%s: Failed to write the parts.", SRCNAME, __func__);
+    }
+  TRETURN rc;
+}
+
+
+SignedMimeProvider::SignedMimeProvider (protocol_t protocol,
+                                        GpgME::Data &signature,
+                                        GpgME::Data &signedData,
+                                        const char *micalg) :
+  m_signed_data (signedData),
+  m_state (0),
+  m_pos (0),
+  m_offset (0),
+  m_failed (false)
+{
+  TSTART;
+  memdbg_ctor ("SignedMimeProvider");
+  char boundary[BOUNDARYSIZE+1];
+  struct sink_s sinkmem;
+  sink_t sink = &sinkmem;
+
+  generate_boundary (boundary);
+  sink_init_string (sink, &m_head);
+  if (write_sign_head (sink, protocol, boundary, micalg))
+    {
+      m_failed = true;
+    }
+  sink_init_string (sink, &m_tail);
+  if (write_sign_tail (sink, protocol, boundary, signature))
+    {
+      m_failed = true;
+    }
+  m_signed_data.seek (0, SEEK_SET);
+  log_debug ("%s:%s: Head %lu tail %lu bytes",
+             SRCNAME, __func__, (unsigned long) m_head.size (),
+             (unsigned long) m_tail.size ());
+  TRETURN;
+}
+
+SignedMimeProvider::~SignedMimeProvider ()
+{
+  memdbg_dtor ("SignedMimeProvider");
+}
+
+bool
+SignedMimeProvider::isSupported (GpgME::DataProvider::Operation op) const
+{
+  return op == GpgME::DataProvider::Read ||
+         op == GpgME::DataProvider::Seek ||
+         op == GpgME::DataProvider::Release;
+}
+
+ssize_t
+SignedMimeProvider::read (void *buffer, size_t bufSize)
+{
+  char *out = static_cast<char *>(buffer);
+  size_t n = 0;
+
+  while (n < bufSize && m_state < 3)
+    {
+      if (m_state == 1)
+        {
+          ssize_t nread = m_signed_data.read (out + n, bufSize - n);
+          if (nread < 0)
+            {
+              log_error ("%s:%s: Failed to read signed data.",
+                         SRCNAME, __func__);
+              return -1;
+            }
+          if (!nread)
+            {
+              m_state++;
+            }
+          n += nread;
+          continue;
+        }
+
+      const std::string &str = m_state ? m_tail : m_head;
+      size_t len = std::min (bufSize - n, str.size () - m_pos);
+      memcpy (out + n, str.data () + m_pos, len);
+      n += len;
+      m_pos += len;
+      if (m_pos == str.size ())
+        {
+          m_state++;
+          m_pos = 0;
+        }
+    }
+  m_offset += n;
+  return n;
+}
+
+ssize_t
+SignedMimeProvider::write (const void *, size_t)
+{
+  errno = EBADF;
+  return -1;
+}
+
+off_t
+SignedMimeProvider::seek (off_t offset, int whence)
+{
+  if (whence == SEEK_CUR)
+    {
+      if (!offset)
+        {
+          return m_offset;
+        }
+      offset += m_offset;
+      whence = SEEK_SET;
+    }
+  if (whence != SEEK_SET || offset < 0)
+    {
+      log_debug ("%s:%s: Unsupported seek %ld %i",
+                 SRCNAME, __func__, (long) offset, whence);
+      errno = EINVAL;
+      return -1;
+    }
+
+  const off_t head_len = m_head.size ();
+  if (offset <= head_len)
+    {
+      m_signed_data.seek (0, SEEK_SET);
+      m_state = 0;
+      m_pos = offset;
+      m_offset = offset;
+      return offset;
+    }
+
+  const off_t signed_len = m_signed_data.seek (0, SEEK_END);
+  if (signed_len < 0)
+    {
+      log_error ("%s:%s: Failed to seek signed data.",
+                 SRCNAME, __func__);
+      return -1;
+    }
+  if (offset - head_len < signed_len)
+    {
+      m_signed_data.seek (offset - head_len, SEEK_SET);
+      m_state = 1;
+      m_pos = 0;
+    }
+  else if (offset - head_len - signed_len <= (off_t) m_tail.size ())
+    {
+      m_state = 2;
+      m_pos = offset - head_len - signed_len;
+    }
+  else
+    {
+      log_debug ("%s:%s: Seek beyond the end %ld",
+                 SRCNAME, __func__, (long) offset);
+      errno = EINVAL;
+      return -1;
+    }
+  m_offset = offset;
+  return offset;
+}
+
+bool
+SignedMimeProvider::failed () const
+{
+  return m_failed;
+}
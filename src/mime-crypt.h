@@ -0,0 +1,118 @@
+/* mime-crypt.h - MIME structures around GpgME data
+ * Copyright (C) 2018 Intevation GmbH
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MIME_CRYPT_H
+#define MIME_CRYPT_H
+
+#include "config.h"
+
+#include <gpgme++/interfaces/dataprovider.h>
+#include <gpgme++/data.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mime-writer.h"
+
+/* A sink writing to the GpgME::Data at its cb_data.  */
+int sink_data_write (sink_t sink, const void *data, size_t datalen);
+
+/* Setup SOURCE to read DATA from its start.  */
+void source_init_data (source_t source, GpgME::Data *data);
+
+/* Copy all of DATA to SINK.  */
+int write_data (sink_t sink, GpgME::Data &data);
+
+/** @brief Write a multipart/signed structure to SINK.
+  *
+  * SIGNEDDATA is the MIME structure which was signed and SIGNATURE
+  * the detached signature over it.  Returns 0 on success.
+  */
+int create_sign_attach (sink_t sink, protocol_t protocol,
+                        GpgME::Data &signature,
+                        GpgME::Data &signedData,
+                        const char *micalg);
+
+/** @brief Write the MIME structure for ENCRYPTEDDATA to SINK.
+  *
+  * For S/MIME with an Exchange older than 2016 (version 15) the
+  * data is base64 encoded on the fly.  OpenPGP data is expected
+  * armored unless BINARY is set, then it is base64 encoded as well.
+  * Returns 0 on success.
+  */
+int create_encrypt_attach (sink_t sink, protocol_t protocol,
+                           GpgME::Data &encryptedData,
+                           int exchange_major_version,
+                           bool binary = false);
+
+/** @brief Write the separately encrypted PARTS of a draft to SINK.
+  *
+  * A single part is written like create_encrypt_attach does.
+  * Several parts are put into a multipart/mixed with the
+  * DRAFT_PARTS_HEADER, each part as its own multipart/encrypted.
+  * This is only done for OpenPGP.  Returns 0 on success.
+  */
+int create_draft_parts_attach (sink_t sink, protocol_t protocol,
+                               const std::vector<std::shared_ptr<
+                                 const std::string> > &parts,
+                               int exchange_major_version,
+                               bool binary = false);
+
+/** A GpgME dataprovider which yields the same multipart/signed
+  structure as create_sign_attach, but only when it is read.
+
+  This is used to encrypt a signed mail without building the
+  multipart/signed in memory first: The headers and the signature
+  part are prepared up front and the signed data is passed through
+  from its GpgME::Data as GpgME reads.  Thus reading the provider
+  allocates no memory proportional to the data and the only complete
+  copy of the mail besides the signed data is the encryption output.
+
+  The signed data must not be modified while the provider is in
+  use.  Seeking to an offset needs the signed data to be seekable.  */
+class SignedMimeProvider : public GpgME::DataProvider
+{
+public:
+  SignedMimeProvider (protocol_t protocol, GpgME::Data &signature,
+                      GpgME::Data &signedData, const char *micalg);
+  ~SignedMimeProvider ();
+
+  /* Dataprovider interface */
+  bool isSupported (Operation op) const;
+  ssize_t read (void *buffer, size_t bufSize);
+  ssize_t write (const void *buffer, size_t bufSize);
+  off_t seek (off_t offset, int whence);
+  void release () {}
+
+  /* True if the headers or the signature part could not be
+     created.  */
+  bool failed () const;
+
+private:
+  GpgME::Data &m_signed_data;
+  std::string m_head;   /* Top header and first boundary.  */
+  std::string m_tail;   /* Signature part and final boundary.  */
+  int m_state;          /* 0: head, 1: signed data, 2: tail, 3: EOF.  */
+  size_t m_pos;         /* Offset into m_head or m_tail.  */
+  off_t m_offset;       /* Number of bytes read.  */
+  bool m_failed;
+};
+
+#endif /*MIME_CRYPT_H*/
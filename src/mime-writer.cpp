@@ -0,0 +1,1733 @@
+/* mime-writer.cpp - Write MIME parts from a data source
+ * Copyright (C) 2007, 2008, 2026 g10 Code GmbH
+ * Copyright (C) 2015 by Bundesamt für Sicherheit in der Informationstechnik
+ * Software engineering by Intevation GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The encoders of mimemaker which do not depend on MAPI.  They are
+   kept apart so that they can be tested and benchmarked without
+   Outlook.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common_indep.h"
+#include "mime-writer.h"
+#include "latency.h"
+
+/* Size of the chunks read from a source.  */
+#define SOURCE_CHUNK 65536
+
+/* The encoders and classify_chunk look at up to 5 bytes following
+   the current one to detect line ends and line start hazards.  */
+#define LOOKAHEAD 6
+
+/* The base-64 list used for base64 encoding. */
+static unsigned char bintoasc[64+1] = ("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                       "abcdefghijklmnopqrstuvwxyz"
+                                       "0123456789+/");
+
+
+/* Write data to a sink_t.  */
+int
+write_buffer (sink_t sink, const void *data, size_t datalen)
+{
+  if (!sink || !sink->writefnc)
+    {
+      log_error ("%s:%s: sink not properly setup", SRCNAME, __func__);
+      return -1;
+    }
+  return sink->writefnc (sink, data, datalen);
+}
+
+/* Same as above but used for passing as callback function.  This
+   fucntion does not return an error code but the number of bytes
+   written.  */
+int
+write_buffer_for_cb (void *opaque, const void *data, size_t datalen)
+{
+  sink_t sink = (sink_t) opaque;
+  sink->enc_counter += datalen;
+  return write_buffer (sink, data, datalen) ? -1 : datalen;
+}
+
+
+int
+sink_forward (sink_t sink, const void *data, size_t datalen)
+{
+  return write_buffer (sink->extrasink, data, datalen);
+}
+
+
+int
+sink_flush (sink_t sink)
+{
+  return write_buffer (sink, NULL, 0);
+}
+
+
+/* Write method of a batching sink.  */
+static int
+sink_batch_write (sink_t sink, const void *data, size_t datalen)
+{
+  struct sink_batch_s *batch = (struct sink_batch_s *) sink->cb_data;
+  int rc;
+
+  if (data && datalen < SINK_BATCH_DIRECT
+      && batch->len + datalen <= sizeof batch->buf)
+    {
+      memcpy (batch->buf + batch->len, data, datalen);
+      batch->len += datalen;
+      batch->copied += datalen;
+      return 0;
+    }
+
+  /* Keep the order: What has been collected goes first.  */
+  if (batch->len)
+    {
+      rc = sink_forward (sink, batch->buf, batch->len);
+      batch->len = 0;
+      if (rc)
+        return rc;
+    }
+  if (data && datalen < SINK_BATCH_DIRECT)
+    {
+      memcpy (batch->buf, data, datalen);
+      batch->len = datalen;
+      batch->copied += datalen;
+      return 0;
+    }
+  return sink_forward (sink, data, datalen);
+}
+
+
+void
+sink_init_batch (sink_t sink, struct sink_batch_s *batch, sink_t next)
+{
+  memset (sink, 0, sizeof *sink);
+  batch->len = 0;
+  batch->copied = 0;
+  sink->cb_data = batch;
+  sink->extrasink = next;
+  sink->writefnc = sink_batch_write;
+}
+
+
+/* Write method of a counting sink.  */
+static int
+sink_count_write (sink_t sink, const void *data, size_t datalen)
+{
+  if (data)
+    sink->enc_counter += datalen;
+  return sink_forward (sink, data, datalen);
+}
+
+
+void
+sink_init_count (sink_t sink, sink_t next)
+{
+  memset (sink, 0, sizeof *sink);
+  sink->extrasink = next;
+  sink->writefnc = sink_count_write;
+}
+
+
+/* Write method of a string sink.  */
+static int
+sink_string_append (sink_t sink, const void *data, size_t datalen)
+{
+  std::string *s = static_cast<std::string *>(sink->cb_data);
+
+  if (data)
+    s->append (static_cast<const char *>(data), datalen);
+  return 0;
+}
+
+
+void
+sink_init_string (sink_t sink, std::string *str)
+{
+  memset (sink, 0, sizeof *sink);
+  sink->cb_data = str;
+  sink->writefnc = sink_string_append;
+}
+
+
+/* Write the string TEXT to the IStream STREAM.  Returns 0 on sucsess,
+   prints an error message and returns -1 on error.  */
+int
+write_string (sink_t sink, const char *text)
+{
+  return write_buffer (sink, text, strlen (text));
+}
+
+
+/* Write the string TEXT1 and all folloing arguments of type (const
+   char*) to the SINK.  The list of argumens needs to be terminated
+   with a NULL.  Returns 0 on sucsess, prints an error message and
+   returns -1 on error.  */
+int
+write_multistring (sink_t sink, const char *text1, ...)
+{
+  va_list arg_ptr;
+  int rc;
+  const char *s;
+
+  va_start (arg_ptr, text1);
+  s = text1;
+  do
+    rc = write_string (sink, s);
+  while (!rc && (s=va_arg (arg_ptr, const char *)));
+  va_end (arg_ptr);
+  return rc;
+}
+
+
+/* Helper to write a boundary to the output sink.  The leading LF
+   will be written as well.  */
+int
+write_boundary (sink_t sink, const char *boundary, int lastone)
+{
+  int rc = write_string (sink, "\r\n--");
+  if (!rc)
+    rc = write_string (sink, boundary);
+  if (!rc)
+    rc = write_string (sink, lastone? "--\r\n":"\r\n");
+  return rc;
+}
+
+/* Read method of a memory source.  */
+static int
+source_mem_read (source_t source, void *buffer, size_t size, size_t *r_nread)
+{
+  const char *data = (const char *) source->cb_data;
+  size_t n = source->len - source->off;
+
+  if (n > size)
+    n = size;
+  memcpy (buffer, data + source->off, n);
+  source->off += n;
+  *r_nread = n;
+  return 0;
+}
+
+static int
+source_mem_rewind (source_t source)
+{
+  source->off = 0;
+  return 0;
+}
+
+/* Setup SOURCE to read DATALEN bytes of DATA.  DATA must stay valid
+   as long as SOURCE is used.  */
+void
+source_init_mem (source_t source, const void *data, size_t datalen)
+{
+  memset (source, 0, sizeof *source);
+  source->cb_data = (void *) data;
+  source->len = datalen;
+  source->readfnc = source_mem_read;
+  source->rewindfnc = source_mem_rewind;
+}
+
+/* Read method of a source that contains a FILE object.  */
+static int
+source_file_read (source_t source, void *buffer, size_t size,
+                  size_t *r_nread)
+{
+  FILE *fp = (FILE *) source->cb_data;
+
+  *r_nread = fread (buffer, 1, size, fp);
+  if (ferror (fp))
+    {
+      log_error ("%s:%s: Read failed", SRCNAME, __func__);
+      return -1;
+    }
+  return 0;
+}
+
+static int
+source_file_rewind (source_t source)
+{
+  if (fseek ((FILE *) source->cb_data, 0, SEEK_SET))
+    {
+      log_error ("%s:%s: Seek failed", SRCNAME, __func__);
+      return -1;
+    }
+  return 0;
+}
+
+/* Setup SOURCE to read FP from its start.  */
+void
+source_init_file (source_t source, FILE *fp)
+{
+  memset (source, 0, sizeof *source);
+  source->cb_data = fp;
+  source->readfnc = source_file_read;
+  source->rewindfnc = source_file_rewind;
+  rewind (fp);
+}
+
+
+/* Pass all data of SOURCE to FNC in chunks of at most SOURCE_CHUNK
+   bytes.  Unless FINAL is set FNC may leave up to LOOKAHEAD - 1
+   bytes unconsumed which are then passed again at the start of the
+   next chunk.  FNC returns the number of bytes it consumed or -1 on
+   error.  The total number of bytes is stored at R_TOTAL.  Returns 0
+   on success.  */
+static int
+source_process (source_t source,
+                ssize_t (*fnc)(void *opaque, const unsigned char *data,
+                               size_t datalen, int final),
+                void *opaque, size_t *r_total)
+{
+  unsigned char *buffer = (unsigned char *) xmalloc (SOURCE_CHUNK
+                                                     + LOOKAHEAD);
+  size_t len = 0;
+  size_t nread;
+  ssize_t used;
+  int final = 0;
+  int rc = 0;
+
+  *r_total = 0;
+  while (!final)
+    {
+      if (source->readfnc (source, buffer + len, SOURCE_CHUNK, &nread))
+        {
+          rc = -1;
+          break;
+        }
+      final = !nread;
+      len += nread;
+      *r_total += nread;
+      if ((used = fnc (opaque, buffer, len, final)) < 0)
+        {
+          rc = -1;
+          break;
+        }
+      len -= used;
+      memmove (buffer, buffer + used, len);
+    }
+  xfree (buffer);
+  return rc;
+}
+
+
+/* Output block used by the line oriented encoders.  Finished lines
+   are collected here and handed to the sink in large chunks so that
+   the sink's write function, which may end up in a gpgme data write,
+   is not called for every single line.  */
+#define OUTBLOCK_SIZE 8192
+struct outblock_s
+{
+  sink_t sink;
+  size_t len;
+  char buf[OUTBLOCK_SIZE];
+};
+
+/* Pass everything collected in BLK to its sink.  */
+static int
+outblock_flush (struct outblock_s *blk)
+{
+  int rc = 0;
+
+  if (blk->len)
+    rc = write_buffer (blk->sink, blk->buf, blk->len);
+  blk->len = 0;
+  return rc;
+}
+
+/* Append DATALEN bytes of DATA to BLK, flushing it as needed.  */
+static int
+outblock_put (struct outblock_s *blk, const char *data, size_t datalen)
+{
+  int rc;
+
+  if (blk->len + datalen > sizeof blk->buf)
+    {
+      if ((rc = outblock_flush (blk)))
+        return rc;
+      if (datalen > sizeof blk->buf)
+        return write_buffer (blk->sink, data, datalen);
+    }
+  memcpy (blk->buf + blk->len, data, datalen);
+  blk->len += datalen;
+  return 0;
+}
+
+
+/* State of the base64 encoder between two chunks.  */
+struct b64enc_s
+{
+  sink_t sink;
+  unsigned char inbuf[4];
+  int idx, quads;
+};
+
+/* Encode DATALEN bytes of DATA.  The last incomplete quad is kept in
+   the state and only written with padding if FINAL is set.  Always
+   consumes everything.  */
+static ssize_t
+b64enc_chunk (void *opaque, const unsigned char *data, size_t datalen,
+              int final)
+{
+  struct b64enc_s *st = (struct b64enc_s *) opaque;
+  const size_t ret = datalen;
+  int rc;
+  const unsigned char *p;
+  unsigned char *inbuf = st->inbuf;
+  char outbuf[2048];
+  size_t outlen;
+
+  outlen = 0;
+  for (p = data; datalen; p++, datalen--)
+    {
+      inbuf[st->idx++] = *p;
+      if (st->idx > 2)
+        {
+          /* We need space for a quad and a possible CR,LF.  */
+          if (outlen+4+2 >= sizeof outbuf)
+            {
+              if ((rc = write_buffer (st->sink, outbuf, outlen)))
+                return -1;
+              outlen = 0;
+            }
+          outbuf[outlen++] = bintoasc[(*inbuf>>2)&077];
+          outbuf[outlen++] = bintoasc[(((*inbuf<<4)&060)
+                                       |((inbuf[1] >> 4)&017))&077];
+          outbuf[outlen++] = bintoasc[(((inbuf[1]<<2)&074)
+                                       |((inbuf[2]>>6)&03))&077];
+          outbuf[outlen++] = bintoasc[inbuf[2]&077];
+          st->idx = 0;
+          if (++st->quads >= (64/4))
+            {
+              st->quads = 0;
+              outbuf[outlen++] = '\r';
+              outbuf[outlen++] = '\n';
+            }
+        }
+    }
+
+  if (final)
+    {
+      /* We need space for a quad and a final CR,LF.  */
+      if (outlen+4+2 >= sizeof outbuf)
+        {
+          if ((rc = write_buffer (st->sink, outbuf, outlen)))
+            return -1;
+          outlen = 0;
+        }
+      if (st->idx)
+        {
+          outbuf[outlen++] = bintoasc[(*inbuf>>2)&077];
+          if (st->idx == 1)
+            {
+              outbuf[outlen++] = bintoasc[((*inbuf<<4)&060)&077];
+              outbuf[outlen++] = '=';
+              outbuf[outlen++] = '=';
+            }
+          else
+            {
+              outbuf[outlen++] = bintoasc[(((*inbuf<<4)&060)
+                                           |((inbuf[1]>>4)&017))&077];
+              outbuf[outlen++] = bintoasc[((inbuf[1]<<2)&074)&077];
+              outbuf[outlen++] = '=';
+            }
+          ++st->quads;
+        }
+
+      if (st->quads)
+        {
+          outbuf[outlen++] = '\r';
+          outbuf[outlen++] = '\n';
+        }
+    }
+
+  if (outlen)
+    {
+      if ((rc = write_buffer (st->sink, outbuf, outlen)))
+        return -1;
+    }
+
+  return ret;
+}
+
+/* Write DATALEN bytes of DATA to SINK in base64 encoding.  This
+   creates a complete Base64 chunk including the trailing fillers.  */
+int
+write_b64 (sink_t sink, const void *data, size_t datalen)
+{
+  struct b64enc_s st;
+
+  log_debug ("  writing base64 of length %d\n", (int)datalen);
+  memset (&st, 0, sizeof st);
+  st.sink = sink;
+  return b64enc_chunk (&st, (const unsigned char *) data, datalen, 1) < 0
+         ? -1 : 0;
+}
+
+/* Write the data of SOURCE to SINK in base64 encoding.  This is the
+   same as write_b64 but reads SOURCE in chunks.  */
+int
+write_b64_source (sink_t sink, source_t source)
+{
+  struct b64enc_s st;
+  size_t total;
+  int rc;
+
+  memset (&st, 0, sizeof st);
+  st.sink = sink;
+  rc = source_process (source, b64enc_chunk, &st, &total);
+  log_debug ("  wrote base64 of length %lu\n", (unsigned long)total);
+  return rc;
+}
+
+
+/* State of the quoted-printable and the plain encoder between two
+   chunks.  OUTBUF holds the current, unfinished output line.  */
+struct lineenc_s
+{
+  struct outblock_s blk;
+  char outbuf[100];
+  int outidx;
+};
+
+/* Encode DATALEN bytes of DATA in quoted-printable.  Unless FINAL is
+   set, encoding stops short of the end of DATA so that the line end
+   checks can look ahead.  Returns the number of bytes consumed.  */
+static ssize_t
+qpenc_chunk (void *opaque, const unsigned char *data, size_t datalen,
+             int final)
+{
+  struct lineenc_s *st = (struct lineenc_s *) opaque;
+  int rc;
+  const unsigned char *p;
+  char *outbuf = st->outbuf; /* We only need 76 octect + 2 for the
+                                lineend. */
+  int outidx = st->outidx;
+
+  /* Check whether the current character is followed by a line ending.
+     Note that the end of the etxt also counts as a lineending */
+#define nextlf_p() ((datalen > 2 && p[1] == '\r' && p[2] == '\n') \
+                    || (datalen > 1 && p[1] == '\n')              \
+                    || datalen == 1 )
+
+  /* Macro to insert a soft line break if needed.  */
+# define do_softlf(n) \
+          do {                                                        \
+            if (outidx + (n) > 76                                     \
+                || (outidx + (n) == 76 && !nextlf_p()))               \
+              {                                                       \
+                outbuf[outidx++] = '=';                               \
+                outbuf[outidx++] = '\r';                              \
+                outbuf[outidx++] = '\n';                              \
+                if ((rc = outblock_put (&st->blk, outbuf, outidx)))   \
+                  return -1;                                          \
+                outidx = 0;                                           \
+              }                                                       \
+          } while (0)
+
+  for (p = data; datalen; p++, datalen--)
+    {
+      if (!final && datalen < LOOKAHEAD)
+        break;
+      if ((datalen > 1 && *p == '\r' && p[1] == '\n') || *p == '\n')
+        {
+          /* Line break.  */
+          outbuf[outidx++] = '\r';
+          outbuf[outidx++] = '\n';
+          if ((rc = outblock_put (&st->blk, outbuf, outidx)))
+            return -1;
+          outidx = 0;
+          if (*p == '\r')
+            {
+              p++;
+              datalen--;
+            }
+        }
+      else if (*p == '\t' || *p == ' ')
+        {
+          /* Check whether tab or space is followed by a line break
+             which forbids verbatim encoding.  If we are already at
+             the end of the buffer we take that as a line end too. */
+          if (nextlf_p())
+            {
+              do_softlf (3);
+              outbuf[outidx++] = '=';
+              outbuf[outidx++] = tohex ((*p>>4)&15);
+              outbuf[outidx++] = tohex (*p&15);
+            }
+          else
+            {
+              do_softlf (1);
+              outbuf[outidx++] = *p;
+            }
+
+        }
+      else if (!outidx && *p == '.' && nextlf_p () )
+        {
+          /* We better protect a line with just a single dot.  */
+          outbuf[outidx++] = '=';
+          outbuf[outidx++] = tohex ((*p>>4)&15);
+          outbuf[outidx++] = tohex (*p&15);
+        }
+      else if (!outidx && datalen >= 5 && !memcmp (p, "From ", 5))
+        {
+          /* Protect the 'F' so that MTAs won't prefix the "From "
+             with an '>' */
+          outbuf[outidx++] = '=';
+          outbuf[outidx++] = tohex ((*p>>4)&15);
+          outbuf[outidx++] = tohex (*p&15);
+        }
+      else if (*p >= '!' && *p <= '~' && *p != '=')
+        {
+          do_softlf (1);
+          outbuf[outidx++] = *p;
+        }
+      else
+        {
+          do_softlf (3);
+          outbuf[outidx++] = '=';
+          outbuf[outidx++] = tohex ((*p>>4)&15);
+          outbuf[outidx++] = tohex (*p&15);
+        }
+    }
+  st->outidx = outidx;
+  if (!final)
+    return p - data;
+
+  if (outidx)
+    {
+      outbuf[outidx++] = '\r';
+      outbuf[outidx++] = '\n';
+      if ((rc = outblock_put (&st->blk, outbuf, outidx)))
+        return -1;
+    }
+
+# undef do_softlf
+# undef nextlf_p
+  return outblock_flush (&st->blk) ? -1 : p - data;
+}
+
+
+/* Encode DATALEN bytes of DATA in plain ascii.  Like qpenc_chunk
+   this stops short of the end of DATA unless FINAL is set.  */
+static ssize_t
+plainenc_chunk (void *opaque, const unsigned char *data, size_t datalen,
+                int final)
+{
+  struct lineenc_s *st = (struct lineenc_s *) opaque;
+  int rc;
+  const unsigned char *p;
+  char *outbuf = st->outbuf;
+  int outidx = st->outidx;
+
+  for (p = data; datalen; p++, datalen--)
+    {
+      if (!final && datalen < LOOKAHEAD)
+        break;
+      if ((datalen > 1 && *p == '\r' && p[1] == '\n') || *p == '\n')
+        {
+          outbuf[outidx++] = '\r';
+          outbuf[outidx++] = '\n';
+          if ((rc = outblock_put (&st->blk, outbuf, outidx)))
+            return -1;
+          outidx = 0;
+          if (*p == '\r')
+            {
+              p++;
+              datalen--;
+            }
+        }
+      else if (!outidx && *p == '.'
+               && ( (datalen > 2 && p[1] == '\r' && p[2] == '\n')
+                    || (datalen > 1 && p[1] == '\n')
+                    || datalen == 1))
+        {
+          /* Better protect a line with just a single dot.  We do
+             this by adding a space.  */
+          outbuf[outidx++] = *p;
+          outbuf[outidx++] = ' ';
+        }
+      else if (outidx > 80)
+        {
+          /* We should never be called for too long lines - QP should
+             have been used.  */
+          log_error ("%s:%s: BUG: line longer than exepcted",
+                     SRCNAME, __func__);
+          return -1;
+        }
+      else
+        outbuf[outidx++] = *p;
+    }
+  st->outidx = outidx;
+  if (!final)
+    return p - data;
+
+  if (outidx)
+    {
+      outbuf[outidx++] = '\r';
+      outbuf[outidx++] = '\n';
+      if ((rc = outblock_put (&st->blk, outbuf, outidx)))
+        return -1;
+    }
+
+  return outblock_flush (&st->blk) ? -1 : p - data;
+}
+
+
+
+
+/* Infer the content type from the FILENAME.  The return value is
+   a static string there won't be an error return.  In case Base 64
+   encoding is required for the type true will be stored at FORCE_B64;
+   however, this is only a shortcut and if that is not set, the caller
+   should infer the encoding by other means. */
+static const char *
+infer_content_type (const char *filename, int is_mapibody, int *force_b64)
+{
+  static struct {
+    char b64;
+    const char *suffix;
+    const char *ct;
+  } suffix_table[] =
+    {
+      { 1, "3gp",   "video/3gpp" },
+      { 1, "abw",   "application/x-abiword" },
+      { 1, "ai",    "application/postscript" },
+      { 1, "au",    "audio/basic" },
+      { 1, "bin",   "application/octet-stream" },
+      { 1, "class", "application/java-vm" },
+      { 1, "cpt",   "application/mac-compactpro" },
+      { 0, "css",   "text/css" },
+      { 0, "csv",   "text/comma-separated-values" },
+      { 1, "deb",   "application/x-debian-package" },
+      { 1, "dl",    "video/dl" },
+      { 1, "doc",   "application/msword" },
+      { 1, "docx",  "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+      { 1, "dot",   "application/msword" },
+      { 1, "dotx",  "application/vnd.openxmlformats-officedocument.wordprocessingml.template" },
+      { 1, "docm",  "application/application/vnd.ms-word.document.macroEnabled.12" },
+      { 1, "dotm",  "application/vnd.ms-word.template.macroEnabled.12" },
+      { 1, "dv",    "video/dv" },
+      { 1, "dvi",   "application/x-dvi" },
+      { 1, "eml",   "message/rfc822" },
+      { 1, "eps",   "application/postscript" },
+      { 1, "fig",   "application/x-xfig" },
+      { 1, "flac",  "application/x-flac" },
+      { 1, "fli",   "video/fli" },
+      { 1, "gif",   "image/gif" },
+      { 1, "gl",    "video/gl" },
+      { 1, "gnumeric", "application/x-gnumeric" },
+      { 1, "hqx",   "application/mac-binhex40" },
+      { 1, "hta",   "application/hta" },
+      { 0, "htm",   "text/html" },
+      { 0, "html",  "text/html" },
+      { 0, "ics",   "text/calendar" },
+      { 1, "jar",   "application/java-archive" },
+      { 1, "jpeg",  "image/jpeg" },
+      { 1, "jpg",   "image/jpeg" },
+      { 1, "js",    "application/x-javascript" },
+      { 1, "latex", "application/x-latex" },
+      { 1, "lha",   "application/x-lha" },
+      { 1, "lzh",   "application/x-lzh" },
+      { 1, "lzx",   "application/x-lzx" },
+      { 1, "m3u",   "audio/mpegurl" },
+      { 1, "m4a",   "audio/mpeg" },
+      { 1, "mdb",   "application/msaccess" },
+      { 1, "midi",  "audio/midi" },
+      { 1, "mov",   "video/quicktime" },
+      { 1, "mp2",   "audio/mpeg" },
+      { 1, "mp3",   "audio/mpeg" },
+      { 1, "mp4",   "video/mp4" },
+      { 1, "mpeg",  "video/mpeg" },
+      { 1, "mpega", "audio/mpeg" },
+      { 1, "mpg",   "video/mpeg" },
+      { 1, "mpga",  "audio/mpeg" },
+      { 1, "msi",   "application/x-msi" },
+      { 1, "mxu",   "video/vnd.mpegurl" },
+      { 1, "nb",    "application/mathematica" },
+      { 1, "oda",   "application/oda" },
+      { 1, "odb",   "application/vnd.oasis.opendocument.database" },
+      { 1, "odc",   "application/vnd.oasis.opendocument.chart" },
+      { 1, "odf",   "application/vnd.oasis.opendocument.formula" },
+      { 1, "odg",   "application/vnd.oasis.opendocument.graphics" },
+      { 1, "odi",   "application/vnd.oasis.opendocument.image" },
+      { 1, "odm",   "application/vnd.oasis.opendocument.text-master" },
+      { 1, "odp",   "application/vnd.oasis.opendocument.presentation" },
+      { 1, "ods",   "application/vnd.oasis.opendocument.spreadsheet" },
+      { 1, "odt",   "application/vnd.oasis.opendocument.text" },
+      { 1, "ogg",   "application/ogg" },
+      { 1, "otg",   "application/vnd.oasis.opendocument.graphics-template" },
+      { 1, "oth",   "application/vnd.oasis.opendocument.text-web" },
+      { 1, "otp",  "application/vnd.oasis.opendocument.presentation-template"},
+      { 1, "ots",   "application/vnd.oasis.opendocument.spreadsheet-template"},
+      { 1, "ott",   "application/vnd.oasis.opendocument.text-template" },
+      { 1, "pdf",   "application/pdf" },
+      { 1, "png",   "image/png" },
+      { 1, "pps",   "application/vnd.ms-powerpoint" },
+      { 1, "ppt",   "application/vnd.ms-powerpoint" },
+      { 1, "pot",   "application/vnd.ms-powerpoint" },
+      { 1, "ppa",   "application/vnd.ms-powerpoint" },
+      { 1, "pptx",  "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+      { 1, "potx",  "application/vnd.openxmlformats-officedocument.presentationml.template" },
+      { 1, "ppsx",  "application/vnd.openxmlformats-officedocument.presentationml.slideshow" },
+      { 1, "ppam",  "application/vnd.ms-powerpoint.addin.macroEnabled.12" },
+      { 1, "pptm",  "application/vnd.ms-powerpoint.presentation.macroEnabled.12" },
+      { 1, "potm",  "application/vnd.ms-powerpoint.template.macroEnabled.12" },
+      { 1, "ppsm",  "application/vnd.ms-powerpoint.slideshow.macroEnabled.12" },
+      { 1, "prf",   "application/pics-rules" },
+      { 1, "ps",    "application/postscript" },
+      { 1, "qt",    "video/quicktime" },
+      { 1, "rar",   "application/rar" },
+      { 1, "rdf",   "application/rdf+xml" },
+      { 1, "rpm",   "application/x-redhat-package-manager" },
+      { 0, "rss",   "application/rss+xml" },
+      { 1, "ser",   "application/java-serialized-object" },
+      { 0, "sh",    "application/x-sh" },
+      { 0, "shtml", "text/html" },
+      { 1, "sid",   "audio/prs.sid" },
+      { 0, "smil",  "application/smil" },
+      { 1, "snd",   "audio/basic" },
+      { 0, "svg",   "image/svg+xml" },
+      { 1, "tar",   "application/x-tar" },
+      { 0, "texi",  "application/x-texinfo" },
+      { 0, "texinfo", "application/x-texinfo" },
+      { 1, "tif",   "image/tiff" },
+      { 1, "tiff",  "image/tiff" },
+      { 1, "torrent", "application/x-bittorrent" },
+      { 1, "tsp",   "application/dsptype" },
+      { 0, "vrml",  "model/vrml" },
+      { 1, "vsd",   "application/vnd.visio" },
+      { 1, "wp5",   "application/wordperfect5.1" },
+      { 1, "wpd",   "application/wordperfect" },
+      { 0, "xhtml", "application/xhtml+xml" },
+      { 1, "xlb",   "application/vnd.ms-excel" },
+      { 1, "xls",   "application/vnd.ms-excel" },
+      { 1, "xlsx",  "application/vnd.ms-excel" },
+      { 1, "xlt",   "application/vnd.ms-excel" },
+      { 1, "xla",   "application/vnd.ms-excel" },
+      { 1, "xltx",  "application/vnd.openxmlformats-officedocument.spreadsheetml.template" },
+      { 1, "xlsm",  "application/vnd.ms-excel.sheet.macroEnabled.12" },
+      { 1, "xltm",  "application/vnd.ms-excel.template.macroEnabled.12" },
+      { 1, "xlam",  "application/vnd.ms-excel.addin.macroEnabled.12" },
+      { 1, "xlsb",  "application/application/vnd.ms-excel.sheet.binary.macroEnabled.12" },
+      { 0, "xml",   "application/xml" },
+      { 0, "xsl",   "application/xml" },
+      { 0, "xul",   "application/vnd.mozilla.xul+xml" },
+      { 1, "zip",   "application/zip" },
+      { 0, NULL, NULL }
+    };
+  int i;
+  std::string suffix;
+
+  *force_b64 = 0;
+  if (filename)
+    {
+      const char *dot = strrchr (filename, '.');
+
+      if (dot)
+        {
+          suffix = dot;
+        }
+    }
+
+  /* Check for at least one char after the dot. */
+  if (suffix.size() > 1)
+    {
+      /* Erase the dot */
+      suffix.erase(0, 1);
+      std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::tolower);
+      for (i=0; suffix_table[i].suffix; i++)
+        {
+          if (!strcmp (suffix_table[i].suffix, suffix.c_str()))
+            {
+              if (suffix_table[i].b64)
+                *force_b64 = 1;
+              return suffix_table[i].ct;
+            }
+        }
+    }
+
+  /* Not found via filename, look at the content.  */
+
+  if (is_mapibody == 1)
+    {
+      return "text/plain";
+    }
+  else if (is_mapibody == 2)
+    {
+      return "text/html";
+    }
+  return "application/octet-stream";
+}
+
+/* Statistics about a part's content as gathered by classify_chunk.
+   They are all that is needed to decide on the transfer encoding so
+   that the data only needs to be scanned once.  */
+struct content_stats_s
+{
+  size_t ntotal;   /* Number of bytes scanned.  */
+  size_t maxlen;   /* Longest line not counting the line ending.  */
+  size_t highbin;  /* Number of bytes with the high bit set.  */
+  size_t lowbin;   /* Number of control characters and bare CRs.  */
+  int need_qp;     /* A line start needs protection ("-- ", "From ",
+                      or something looking like our boundary). */
+  size_t curlen;   /* Length of the current line so far.  */
+};
+typedef struct content_stats_s content_stats_t;
+
+
+#ifdef __SSE2__
+/* Account for the block of 16 bytes at P if it does not contain a
+   CR or LF.  The caller must ensure that P is not at the start of a
+   line because the line start hazards are only checked by the
+   scalar code.  Returns true if the block was consumed.  */
+static inline bool
+classify_block_sse2 (const unsigned char *p, size_t *len,
+                     content_stats_t *stats)
+{
+  const __m128i v = _mm_loadu_si128 ((const __m128i *)p);
+  const __m128i crlf = _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\r')),
+                                     _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\n')));
+  if (_mm_movemask_epi8 (crlf))
+    return false;
+
+  /* The sign bit is set for high bytes; a signed compare against
+     0x20 thus catches controls and high bytes alike.  Tab and form
+     feed are allowed in plain text.  */
+  const unsigned int high = _mm_movemask_epi8 (v);
+  const __m128i ctrl = _mm_andnot_si128 (
+      _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\t')),
+                    _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('\f'))),
+      _mm_or_si128 (_mm_cmplt_epi8 (v, _mm_set1_epi8 (' ')),
+                    _mm_cmpeq_epi8 (v, _mm_set1_epi8 (127))));
+  const unsigned int low = _mm_movemask_epi8 (ctrl) & ~high;
+
+  stats->highbin += __builtin_popcount (high);
+  stats->lowbin += __builtin_popcount (low);
+  *len += 16;
+  return true;
+}
+#endif /*__SSE2__*/
+
+
+/* Gather the statistics for DATALEN bytes of DATA into the
+   content_stats_t at OPAQUE.  Runs of bytes inside a line are
+   handled 16 at a time if SSE2 is available; everything else takes
+   the scalar path.  Unless FINAL is set this stops short of the end
+   of DATA because the line start checks look ahead.  Returns the
+   number of bytes consumed.  */
+static ssize_t
+classify_chunk (void *opaque, const unsigned char *data, size_t datalen,
+                int final)
+{
+  content_stats_t *stats = (content_stats_t *) opaque;
+  const unsigned char *p;
+  size_t len = stats->curlen;
+
+  for (p = data; datalen; p++, datalen--)
+    {
+#ifdef __SSE2__
+      /* Only blocks which do not begin a line can be handled in bulk
+         because the hazard checks below look at the line start.  */
+      if (len)
+        while (datalen >= 16 && classify_block_sse2 (p, &len, stats))
+          {
+            p += 16;
+            datalen -= 16;
+          }
+      if (!datalen)
+        break;
+#endif
+      if (!final && datalen < LOOKAHEAD)
+        break;
+      len++;
+      if ((*p & 0x80))
+        stats->highbin++;
+      else if ((datalen > 1 && *p == '\r' && p[1] == '\n') || *p == '\n')
+        {
+          len--;
+          if (len > stats->maxlen)
+            stats->maxlen = len;
+          len = 0;
+        }
+      else if (*p == '\r')
+        {
+          /* CR not followed by a linefeed. */
+          stats->lowbin++;
+        }
+      else if (*p == '\t' || *p == ' ' || *p == '\f')
+        ;
+      else if (*p < ' ' || *p == 127)
+        stats->lowbin++;
+      else if (len == 1 && datalen > 2
+               && *p == '-' && p[1] == '-' && p[2] == ' '
+               && ( (datalen > 4 && p[3] == '\r' && p[4] == '\n')
+                    || (datalen > 3 && p[3] == '\n')
+                    || datalen == 3))
+        {
+          /* This is a "-- \r\n" line, thus it indicates the usual
+             signature line delimiter.  We need to protect the
+             trailing space.  */
+          stats->need_qp = 1;
+        }
+      else if (len == 1 && datalen > 5 && !memcmp (p, "--=-=", 5))
+        {
+          /* This look pretty much like a our own boundary.
+             We better protect it by forcing QP encoding.  */
+          stats->need_qp = 1;
+        }
+      else if (len == 1 && datalen >= 5 && !memcmp (p, "From ", 5))
+        {
+          /* The usual From hack is required so that MTAs do not
+             prefix it with an '>'.  */
+          stats->need_qp = 1;
+        }
+    }
+  stats->ntotal += p - data;
+  stats->curlen = len;
+  if (final && len > stats->maxlen)
+    stats->maxlen = len;
+  return p - data;
+}
+
+
+/* Gather the statistics for DATALEN bytes of DATA into STATS.  */
+static void
+classify_content (const void *data, size_t datalen, content_stats_t *stats)
+{
+  memset (stats, 0, sizeof *stats);
+  classify_chunk (stats, (const unsigned char *) data, datalen, 1);
+}
+
+
+/* Figure out the best encoding to be used for a part with the content
+   statistics STATS.  Return values are
+     0: Plain ASCII.
+     1: Quoted Printable
+     2: Base64  */
+static int
+infer_content_encoding (const content_stats_t *stats)
+{
+  if (stats->maxlen <= 76 && !stats->lowbin && !stats->highbin
+      && !stats->need_qp)
+    return 0; /* Plain ASCII is sufficient.  */
+
+  /* Somewhere in the Outlook documentation 20% is mentioned as
+     discriminating value for Base64.  Though our counting won't be
+     identical we use that value to behave closely to it. */
+  if (stats->ntotal
+      && ((float)(stats->lowbin + stats->highbin)) / stats->ntotal < 0.20)
+    return 1; /* Use quoted printable.  */
+
+  return 2;   /* Use base64.  */
+}
+
+/* Convert an utf8 input string to RFC2047 base64 encoding which
+   is the subset of RFC2047 outlook likes.
+   Return value needs to be freed.
+   */
+char *
+utf8_to_rfc2047b (const char *input)
+{
+  char *ret,
+       *encoded;
+  int inferred_encoding = 0;
+  content_stats_t stats;
+  if (!input)
+    {
+      return NULL;
+    }
+  classify_content (input, strlen (input), &stats);
+  inferred_encoding = infer_content_encoding (&stats);
+  if (!inferred_encoding)
+    {
+      return xstrdup (input);
+    }
+
+  if (inferred_encoding == 2)
+    {
+      encoded = b64_encode (input, strlen (input));
+      if (gpgrt_asprintf (&ret, "=?utf-8?B?%s?=", encoded) == -1)
+        {
+          log_error ("%s:%s: Error: %i", SRCNAME, __func__, __LINE__);
+          xfree (encoded);
+          return NULL;
+        }
+    }
+  else
+    {
+      /* There is a Bug here. If you encode 4 Byte UTF-8 outlook can't
+         handle it itself. And sends out a message with ?? inserted in
+         that place. This triggers an invalid signature. */
+      encoded = qp_encode (input, strlen (input), NULL);
+      if (gpgrt_asprintf (&ret, "=?utf-8?Q?%s?=", encoded) == -1)
+        {
+          log_error ("%s:%s: Error: %i", SRCNAME, __func__, __LINE__);
+          xfree (encoded);
+          return NULL;
+        }
+    }
+  xfree (encoded);
+  return ret;
+}
+
+/* Write a MIME part to SINK.  First the BOUNDARY is written (unless
+   it is NULL) then the data of SOURCE is analyzed and appropriate
+   headers are written.  If FILENAME is given it will be added to the
+   part's header.  IS_MAPIBODY should be passed as true if the data
+   has been retrieved from the body property.  SOURCE is read in
+   chunks; unless the content type requires base64 it is read twice,
+   once to infer the encoding and once to encode it.  The data is not
+   kept in between so that no plaintext is written to a temporary
+   file.  */
+int
+write_part (sink_t sink, source_t source,
+            const char *boundary, const char *filename, int is_mapibody,
+            const char *content_id, const char *added_headers)
+{
+  int rc;
+  const char *ct;
+  int use_b64, use_qp, is_text;
+  char *encoded_filename;
+  size_t total;
+
+  if (filename)
+    {
+      /* If there is a filename strip the directory part.  Take care
+         that there might be slashes or backslashes.  */
+      const char *s1 = strrchr (filename, '/');
+      const char *s2 = strrchr (filename, '\\');
+
+      if (!s1)
+        s1 = s2;
+      else if (s1 && s2 && s2 > s1)
+        s1 = s2;
+
+      if (s1)
+        filename = s1;
+      if (*filename && filename[1] == ':')
+        filename += 2;
+      if (!*filename)
+        filename = NULL;
+    }
+
+  log_debug ("Writing part%s filename=`%s'\n",
+             is_mapibody? " (body)":"",
+             filename ? anonstr (filename) : "[none]");
+
+  ct = infer_content_type (filename, is_mapibody, &use_b64);
+  use_qp = 0;
+  if (!use_b64)
+    {
+      content_stats_t stats;
+
+      memset (&stats, 0, sizeof stats);
+      if (source_process (source, classify_chunk, &stats, &total)
+          || source->rewindfnc (source))
+        return -1;
+      log_debug ("  content stats: length=%lu maxlen=%d highbin=%d "
+                 "lowbin=%d qp=%d\n", (unsigned long)stats.ntotal,
+                 (int)stats.maxlen, (int)stats.highbin, (int)stats.lowbin,
+                 stats.need_qp);
+      switch (infer_content_encoding (&stats))
+        {
+        case 0: break;
+        case 1: use_qp = 1; break;
+        default: use_b64 = 1; break;
+        }
+    }
+  is_text = !strncmp (ct, "text/", 5);
+
+  if (boundary)
+    if ((rc = write_boundary (sink, boundary, 0)))
+      return rc;
+  if ((rc=write_multistring (sink,
+                             "Content-Type: ", ct,
+                             (is_text || filename? ";\r\n" :"\r\n"),
+                             NULL)))
+    return rc;
+
+  /* OL inserts a charset parameter in many cases, so we do it right
+     away for all text parts.  We can assume us-ascii if no special
+     encoding is required.  */
+  if (is_text)
+    if ((rc=write_multistring (sink,
+                               "\tcharset=\"",
+                               (!use_qp && !use_b64? "us-ascii" : "utf-8"),
+                               filename ? "\";\r\n" : "\"\r\n",
+                               NULL)))
+      return rc;
+
+  encoded_filename = utf8_to_rfc2047b (filename);
+  if (encoded_filename)
+    if ((rc=write_multistring (sink,
+                               "\tname=\"", encoded_filename, "\"\r\n",
+                               NULL)))
+      return rc;
+
+  /* Note that we need to output even 7bit because OL inserts that
+     anyway.  */
+  if ((rc = write_multistring (sink,
+                               "Content-Transfer-Encoding: ",
+                               (use_b64? "base64\r\n":
+                                use_qp? "quoted-printable\r\n":"7bit\r\n"),
+                               NULL)))
+    return rc;
+
+  if (content_id)
+    {
+      if ((rc=write_multistring (sink,
+                                 "Content-ID: <", content_id, ">\r\n",
+                                 NULL)))
+        return rc;
+    }
+  else if (encoded_filename)
+    if ((rc=write_multistring (sink,
+                               "Content-Disposition: attachment;\r\n"
+                               "\tfilename=\"", encoded_filename, "\"\r\n",
+                               NULL)))
+      return rc;
+
+  /* Add any injected additional headers */
+  if (added_headers)
+    {
+      if ((rc = write_multistring (sink, added_headers, nullptr)))
+        {
+          return rc;
+        }
+    }
+
+  xfree(encoded_filename);
+
+  /* Write delimiter.  */
+  if ((rc = write_string (sink, "\r\n")))
+    return rc;
+
+  /* Write the content.  */
+  if (use_b64)
+    {
+      struct b64enc_s st;
+
+      memset (&st, 0, sizeof st);
+      st.sink = sink;
+      rc = source_process (source, b64enc_chunk, &st, &total);
+    }
+  else
+    {
+      struct lineenc_s st;
+
+      memset (&st, 0, sizeof st);
+      st.blk.sink = sink;
+      rc = source_process (source, use_qp? qpenc_chunk : plainenc_chunk,
+                           &st, &total);
+    }
+  log_debug ("  wrote %s of length %lu\n",
+             use_b64? "base64" : use_qp? "qp" : "ascii",
+             (unsigned long)total);
+
+  return rc;
+}
+
+/* Same as write_part but for DATALEN bytes of DATA.  */
+int
+write_part_mem (sink_t sink, const char *data, size_t datalen,
+                const char *boundary, const char *filename, int is_mapibody,
+                const char *content_id, const char *added_headers)
+{
+  struct source_s source;
+
+  source_init_mem (&source, data, datalen);
+  return write_part (sink, &source, boundary, filename, is_mapibody,
+                     content_id, added_headers);
+}
+
+
+/* Write out the attachments of MAIL separated by BOUNDARY to SINK.
+   If only_related is 1 only include attachments for multipart/related they
+   are excluded otherwise.
+   If only_related is 2 all attachments are included regardless of
+   content-id. */
+static int
+write_attachments (sink_t sink, const struct mime_mail_s *mail,
+                   const char *boundary, int only_related)
+{
+  size_t idx;
+  int rc;
+  struct source_s source;
+  LATENCY_SCOPE ("mimemaker::write_attachments");
+
+  for (idx = 0; idx < mail->n_attachments; idx++)
+    {
+      mime_attach_t att = mail->attachments + idx;
+
+      if (!att->usable)
+        {
+          log_debug ("%s:%s: Skipping unusable attachment at idx: %d",
+                     SRCNAME, __func__, (int)idx);
+          continue;
+        }
+      if (only_related == 1 && !att->content_id)
+        {
+          continue;
+        }
+      else if (!only_related && att->content_id)
+        {
+          continue;
+        }
+      memset (&source, 0, sizeof source);
+      if (att->openfnc (att, &source))
+        {
+          log_debug ("Attachment at index %d not found\n", (int)idx);
+          return -1;
+        }
+      log_debug ("Attachment at index %d\n", (int)idx);
+      rc = write_part (sink, &source, boundary, att->filename, 0,
+                       att->content_id, nullptr);
+      if (att->closefnc)
+        att->closefnc (att, &source);
+      if (rc)
+        {
+          /* The source is read while the part is written, so a
+             failed read leaves a truncated attachment.  */
+          log_error ("Write part returned err: %i", rc);
+          return rc;
+        }
+    }
+  return 0;
+}
+
+/* Returns 1 if all attachments are related. 2 if there is a
+   related and a mixed attachment. 0 if there are no other parts*/
+static int
+is_related (const struct mime_mail_s *mail)
+{
+  if (!mail->is_alternative)
+    {
+      return 0;
+    }
+
+  int related = 0;
+  int mixed = 0;
+  for (size_t idx = 0; idx < mail->n_attachments; idx++)
+    {
+      if (mail->attachments[idx].content_id)
+        {
+          related = 1;
+        }
+      else
+        {
+          mixed = 1;
+        }
+    }
+  return mixed + related;
+}
+
+/* Add the body, either as multipart/alternative or just as the
+  simple body part. Depending on the format set in outlook.
+
+  Boundary is the potential outer boundary of a multipart/mixed
+  mail. If it is null we assume the multipart/alternative is
+  the only part.
+
+  return is zero on success.
+*/
+static int
+write_body (sink_t sink, const struct mime_mail_s *mail,
+            const char *boundary)
+{
+  const char *plain_body = mail->plain_body;
+
+  if (!plain_body)
+    {
+      return 0;
+    }
+
+  int rc = 0;
+  if (!mail->is_alternative)
+    {
+      /* Just the plain body. We are done. */
+      return write_part_mem (sink, plain_body, strlen (plain_body),
+                             boundary, NULL, 1, nullptr,
+                             mail->added_headers);
+    }
+
+  if (!mail->html_body)
+    {
+      log_error ("%s:%s: BUG: Body but no html body in alternative mail?",
+                 SRCNAME, __func__);
+      return -1;
+    }
+
+  /* Add a new multipart / mixed element. */
+  if (boundary && write_boundary (sink, boundary, 0))
+    {
+      TRACEPOINT;
+      return 1;
+    }
+
+  /* Now for the multipart/alternative part. We never do HTML only. */
+  char alt_boundary [BOUNDARYSIZE+1];
+  generate_boundary (alt_boundary);
+
+  if ((rc=write_multistring (sink,
+                            "Content-Type: multipart/alternative;\r\n",
+                            "\tboundary=\"", alt_boundary, "\"\r\n",
+                            "\r\n",  /* <-- extra line */
+                            NULL)))
+    {
+      TRACEPOINT;
+      return rc;
+    }
+
+  /* Now the plain body part */
+  if ((rc = write_part_mem (sink, plain_body, strlen (plain_body),
+                           alt_boundary, NULL, 1, nullptr,
+                           mail->added_headers)))
+    {
+      TRACEPOINT;
+      return rc;
+    }
+
+  /* Now the html body.  */
+  if ((rc = write_part_mem (sink, mail->html_body, strlen (mail->html_body),
+                            alt_boundary, NULL, 2, nullptr, nullptr)))
+    {
+      TRACEPOINT;
+      return rc;
+    }
+  /* Finish our multipart */
+  return write_boundary (sink, alt_boundary, 1);
+}
+
+/* Write the body and attachments of MAIL. Does multipart handling. */
+int
+write_mime_structure (sink_t sink, const struct mime_mail_s *mail)
+{
+  LATENCY_SCOPE ("mimemaker::add_body_and_attachments");
+  const char *body = mail->plain_body;
+  int n_att_usable = mail->n_att_usable;
+  int related = is_related (mail);
+  int rc = 0;
+  char inner_boundary[BOUNDARYSIZE+1];
+  char outer_boundary[BOUNDARYSIZE+1];
+  *outer_boundary = 0;
+  *inner_boundary = 0;
+
+  if (((body && n_att_usable) || n_att_usable > 1) && related == 1)
+    {
+      /* A body and at least one attachment or more than one attachment  */
+      generate_boundary (outer_boundary);
+      if ((rc=write_multistring (sink,
+                                 "Content-Type: multipart/related;\r\n",
+                                 "\tboundary=\"", outer_boundary, "\"\r\n",
+                                 "\r\n", /* <--- Outlook adds an extra line. */
+                                 NULL)))
+        return rc;
+    }
+  else if ((body && n_att_usable) || n_att_usable > 1)
+    {
+      generate_boundary (outer_boundary);
+      if ((rc=write_multistring (sink,
+                                 "Content-Type: multipart/mixed;\r\n",
+                                 "\tboundary=\"", outer_boundary, "\"\r\n",
+                                 "\r\n", /* <--- Outlook adds an extra line. */
+                                 NULL)))
+        return rc;
+    }
+
+  /* Only one part.  */
+  if (*outer_boundary && related == 2)
+    {
+      /* We have attachments that are related to the body and unrelated
+         attachments. So we need another part. */
+      if ((rc=write_boundary (sink, outer_boundary, 0)))
+        {
+          return rc;
+        }
+      generate_boundary (inner_boundary);
+      if ((rc=write_multistring (sink,
+                                 "Content-Type: multipart/related;\r\n",
+                                 "\tboundary=\"", inner_boundary, "\"\r\n",
+                                 "\r\n", /* <--- Outlook adds an extra line. */
+                                 NULL)))
+        {
+          return rc;
+        }
+    }
+
+
+  if ((rc=write_body (sink, mail, *inner_boundary ? inner_boundary :
+                                  *outer_boundary ? outer_boundary : NULL)))
+    {
+      log_error ("%s:%s: Adding the body failed.",
+                 SRCNAME, __func__);
+      return rc;
+    }
+  if (!rc && n_att_usable && related)
+    {
+      /* Write the related attachments. */
+      rc = write_attachments (sink, mail,
+                              *inner_boundary? inner_boundary :
+                              *outer_boundary? outer_boundary : NULL, 1);
+      if (rc)
+        {
+          return rc;
+        }
+      /* Close the related part if neccessary.*/
+      if (*inner_boundary && (rc=write_boundary (sink, inner_boundary, 1)))
+        {
+          return rc;
+        }
+    }
+
+  /* Now write the other attachments.
+
+     If we are multipart related the related attachments were already
+     written above. If we are not related we pass 2 to the write_attachements
+     function to force that even attachments with a content id are written
+     out.
+
+     This happens for example when forwarding a plain text mail with
+     attachments.
+     */
+  if (!rc && n_att_usable)
+    {
+      rc = write_attachments (sink, mail,
+                              *outer_boundary? outer_boundary : NULL,
+                              related ? 0 : 2);
+    }
+  if (rc)
+    {
+      return rc;
+    }
+
+  /* Finish the possible multipart/mixed. */
+  if (*outer_boundary && (rc = write_boundary (sink, outer_boundary, 1)))
+    return rc;
+
+  return rc;
+}
+
+
+/* Returns true if the attachment ATT is a part of its own for
+   write_mime_part.  RELATED is the value of is_related for the
+   mail.  */
+static int
+is_separate_part (const struct mime_mail_s *mail, mime_attach_t att,
+                  int related)
+{
+  return att->usable && (!mail->plain_body || !related || !att->content_id);
+}
+
+/* Split the attachments of MAIL into those which stay with the body
+   and the separate ones.  Returns true if there is a body part.  */
+static int
+split_mime_parts (const struct mime_mail_s *mail,
+                  std::vector<struct mime_attach_s> *r_body_atts,
+                  std::vector<mime_attach_t> *r_separate)
+{
+  int related = is_related (mail);
+
+  for (size_t idx = 0; idx < mail->n_attachments; idx++)
+    {
+      mime_attach_t att = mail->attachments + idx;
+
+      if (is_separate_part (mail, att, related))
+        r_separate->push_back (att);
+      else if (att->usable)
+        r_body_atts->push_back (*att);
+    }
+  /* Without anything else the body part is written even if it is
+     empty.  */
+  return mail->plain_body || !r_body_atts->empty () || r_separate->empty ();
+}
+
+/* Return the number of parts write_mime_part writes for MAIL.  */
+int
+count_mime_parts (const struct mime_mail_s *mail)
+{
+  std::vector<struct mime_attach_s> body_atts;
+  std::vector<mime_attach_t> separate;
+
+  int has_body = split_mime_parts (mail, &body_atts, &separate);
+  return has_body + (int) separate.size ();
+}
+
+/* Write the part at IDX of MAIL.  The first part is the body with
+   the attachments shown in it.  Every other attachment is a part of
+   its own.  */
+int
+write_mime_part (sink_t sink, const struct mime_mail_s *mail, int idx)
+{
+  std::vector<struct mime_attach_s> body_atts;
+  std::vector<mime_attach_t> separate;
+  struct mime_mail_s part;
+
+  int has_body = split_mime_parts (mail, &body_atts, &separate);
+  if (idx < 0 || idx >= has_body + (int) separate.size ())
+    {
+      log_error ("%s:%s: No part %d", SRCNAME, __func__, idx);
+      return -1;
+    }
+
+  if (has_body && !idx)
+    {
+      part = *mail;
+      part.attachments = body_atts.empty () ? NULL : body_atts.data ();
+      part.n_attachments = body_atts.size ();
+      part.n_att_usable = (int) body_atts.size ();
+      return write_mime_structure (sink, &part);
+    }
+
+  memset (&part, 0, sizeof part);
+  part.attachments = separate[idx - has_body];
+  part.n_attachments = 1;
+  part.n_att_usable = 1;
+  return write_mime_structure (sink, &part);
+}
+
+
+/* Helper to create the signing header.  This includes enough space
+   for later fixup of the micalg parameter.  The MIME version is only
+   written if FIRST is set.  */
+void
+create_top_signing_header (char *buffer, size_t buflen, protocol_t protocol,
+                           int first, const char *boundary, const char *micalg)
+{
+  snprintf (buffer, buflen,
+            "%s"
+            "Content-Type: multipart/signed;\r\n"
+            "\tprotocol=\"application/%s\";\r\n"
+            "\tmicalg=%-15.15s;\r\n"
+            "\tboundary=\"%s\"\r\n"
+            "\r\n",
+            first? "MIME-Version: 1.0\r\n":"",
+            (protocol==PROTOCOL_OPENPGP? "pgp-signature":"pkcs7-signature"),
+            micalg, boundary);
+}
+
+
+/* Helper from mime_encrypt.  BOUNDARY is a buffer of at least
+   BOUNDARYSIZE+1 bytes which will be set on return from that
+   function.  With BINARY the OpenPGP data is announced as base64
+   instead of armored.  */
+int
+create_top_encryption_header (sink_t sink, protocol_t protocol, char *boundary,
+                              bool is_inline, int exchange_major_version,
+                              bool binary)
+{
+  int rc;
+
+  if (is_inline)
+    {
+      *boundary = 0;
+      rc = 0;
+      /* This would be nice and worked for Google Sync but it failed
+         for Microsoft Exchange Online *sigh* so we put the body
+         instead into the oom body property and stick with IPM Note.
+      rc = write_multistring (sink,
+                              "MIME-Version: 1.0\r\n"
+                              "Content-Type: text/plain;\r\n"
+                              "\tcharset=\"iso-8859-1\"\r\n"
+                              "Content-Transfer-Encoding: 7BIT\r\n"
+                              "\r\n",
+                              NULL);
+     */
+    }
+  else if (protocol == PROTOCOL_SMIME)
+    {
+      *boundary = 0;
+      if (exchange_major_version >= 15)
+        {
+          /*
+             For S/MIME encrypted mails we do not use the S/MIME conversion
+             code anymore. With Exchange 2016 this no longer works. Instead
+             we set an override mime tag, the extended headers in OOM in
+             Mail::update_crypt_oom and let outlook convert the attachment
+             to base64.
+
+             A bit more details can be found in T3853 / T3884
+             */
+          rc = 0;
+        }
+      else
+        {
+          rc = write_multistring (sink,
+                                  "Content-Type: application/pkcs7-mime; "
+                                  "smime-type=enveloped-data;\r\n"
+                                  "\tname=\"smime.p7m\"\r\n"
+                                  "Content-Disposition: attachment; filename=\"smime.p7m\"\r\n"
+                                  "Content-Transfer-Encoding: base64\r\n"
+                                  "MIME-Version: 1.0\r\n"
+                                  "\r\n",
+                                  NULL);
+        }
+    }
+  else
+    {
+      generate_boundary (boundary);
+      rc = write_multistring (sink,
+                              "MIME-Version: 1.0\r\n"
+                              "Content-Type: multipart/encrypted;\r\n"
+                              "\tprotocol=\"application/pgp-encrypted\";\r\n",
+                              "\tboundary=\"", boundary, "\"\r\n",
+                              NULL);
+      if (rc)
+        return rc;
+
+      /* Write the PGP/MIME encrypted part.  */
+      rc = write_boundary (sink, boundary, 0);
+      if (rc)
+        return rc;
+      rc = write_multistring (sink,
+                              "Content-Type: application/pgp-encrypted\r\n"
+                              "\r\n"
+                              "Version: 1\r\n", NULL);
+      if (rc)
+        return rc;
+
+      /* And start the second part.  */
+      rc = write_boundary (sink, boundary, 0);
+      if (rc)
+        return rc;
+      rc = write_multistring (sink,
+                              "Content-Type: application/octet-stream\r\n"
+                              "Content-Disposition: inline;\r\n"
+                              "\tfilename=\"" OPENPGP_ENC_NAME "\"\r\n",
+                              binary? "Content-Transfer-Encoding: base64\r\n"
+                                    : "Content-Transfer-Encoding: 7Bit\r\n",
+                              "\r\n", NULL);
+     }
+
+  return rc;
+}
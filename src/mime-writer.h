@@ -0,0 +1,215 @@
+/* mime-writer.h - Write MIME parts from a data source
+ * Copyright (C) 2007, 2008, 2026 g10 Code GmbH
+ * Copyright (C) 2015, 2016 by Bundesamt für Sicherheit in der Informationstechnik
+ * Software engineering by Intevation GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MIME_WRITER_H
+#define MIME_WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <string>
+
+#include "common_indep.h"
+
+#ifdef __cplusplus
+extern "C" {
+#if 0
+}
+#endif
+#endif
+
+/* Names for our attachments */
+#define OPENPGP_ENC_NAME "openpgp-encrypted-message.asc"
+#define OPENPGP_SIG_NAME "openpgp-digital-signature.asc"
+#define SMIME_SIG_NAME "smime.p7s"
+
+/* The object we use instead of IStream.  It allows us to have a
+   callback method for output and thus for processing stuff
+   recursively.  */
+struct sink_s;
+typedef struct sink_s *sink_t;
+struct sink_s
+{
+  void *cb_data;
+  sink_t extrasink;  /* The next sink if sinks are chained.  */
+  /* Write DATALEN bytes of DATA.  DATA is only valid for the
+     duration of the call; a NULL DATA requests a flush.  */
+  int (*writefnc)(sink_t sink, const void *data, size_t datalen);
+  unsigned long enc_counter; /* Used by write_buffer_for_cb and the
+                                counting sink.  */
+};
+
+/* Small writes like headers and boundaries are collected by a
+   batching sink in a buffer of this size.  */
+#define SINK_BATCH_SIZE 8192
+/* Writes of at least this size are not copied by a batching sink but
+   handed on as they are.  */
+#define SINK_BATCH_DIRECT 1024
+
+/* The state of a batching sink.  */
+struct sink_batch_s
+{
+  size_t len;
+  unsigned long copied;  /* Number of bytes copied into BUF.  */
+  char buf[SINK_BATCH_SIZE];
+};
+
+/* Setup SINK to collect small writes in BATCH and to pass them on to
+   NEXT in larger blocks.  Large writes are passed on without a copy.
+   The caller must flush SINK when done.  */
+void sink_init_batch (sink_t sink, struct sink_batch_s *batch, sink_t next);
+
+/* Setup SINK to count the bytes in its enc_counter and pass them on
+   to NEXT.  This is also an example for a filtering stage: It only
+   looks at the data and forwards the same buffer.  */
+void sink_init_count (sink_t sink, sink_t next);
+
+/* Setup SINK to append everything written to it to STR.  */
+void sink_init_string (sink_t sink, std::string *str);
+
+/* Write to the extrasink of SINK.  A NULL DATA is forwarded as a
+   flush.  */
+int sink_forward (sink_t sink, const void *data, size_t datalen);
+
+/* Flush SINK and all sinks chained to it.  */
+int sink_flush (sink_t sink);
+
+/* The input of a MIME part.  It is read in chunks so that an
+   attachment does not need to be in memory as a whole.  The transfer
+   encoding is inferred before the part's header is written, thus a
+   source must be able to start over.  */
+struct source_s;
+typedef struct source_s *source_t;
+struct source_s
+{
+  void *cb_data;
+  size_t len;      /* Length of the data of a memory source.  */
+  size_t off;      /* Read offset of a memory source.  */
+  /* Read up to SIZE bytes into BUFFER and store the number of bytes
+     read at R_NREAD; 0 indicates the end.  Returns 0 on success.  */
+  int (*readfnc)(source_t source, void *buffer, size_t size,
+                 size_t *r_nread);
+  /* Read from the start again.  Returns 0 on success.  */
+  int (*rewindfnc)(source_t source);
+};
+
+void source_init_mem (source_t source, const void *data, size_t datalen);
+void source_init_file (source_t source, FILE *fp);
+
+int write_buffer_for_cb (void *opaque, const void *data, size_t datalen);
+int write_buffer (sink_t sink, const void *data, size_t datalen);
+int write_string (sink_t sink, const char *text);
+int write_multistring (sink_t sink, const char *text1,
+                       ...) GPGOL_GCC_A_SENTINEL(0);
+
+/* Helper to write a boundary to the output sink.  The leading LF
+   will be written as well.  */
+int write_boundary (sink_t sink, const char *boundary, int lastone);
+int write_b64 (sink_t sink, const void *data, size_t datalen);
+int write_b64_source (sink_t sink, source_t source);
+
+/** @brief Write a MIME part with the data of SOURCE to SINK.
+  *
+  * The content type is inferred from FILENAME and IS_MAPIBODY
+  * (1 for a plain text body, 2 for an HTML body), the transfer
+  * encoding from the data.  Memory use does not depend on the size
+  * of the data.
+  *
+  * @returns 0 on success.
+  */
+int write_part (sink_t sink, source_t source,
+                const char *boundary, const char *filename, int is_mapibody,
+                const char *content_id, const char *added_headers);
+
+/** @brief Same as write_part for DATALEN bytes of DATA. */
+int write_part_mem (sink_t sink, const char *data, size_t datalen,
+                    const char *boundary, const char *filename,
+                    int is_mapibody, const char *content_id,
+                    const char *added_headers);
+
+/* An attachment of a mail for write_mime_structure.  */
+struct mime_attach_s;
+typedef struct mime_attach_s *mime_attach_t;
+struct mime_attach_s
+{
+  const char *filename;
+  const char *content_id;  /* Attachments with a content id are shown
+                              in the HTML body.  */
+  int usable;              /* Only usable attachments are written.  */
+  void *cb_data;
+  /* Setup SOURCE to read the attachment.  Returns 0 on success.  */
+  int (*openfnc)(mime_attach_t attach, source_t source);
+  /* Release what openfnc acquired.  May be NULL.  */
+  void (*closefnc)(mime_attach_t attach, source_t source);
+};
+
+/* The content of a mail for write_mime_structure.  */
+struct mime_mail_s
+{
+  const char *plain_body;     /* The body or NULL.  */
+  int is_alternative;         /* Add HTML_BODY as an alternative.  */
+  const char *html_body;
+  const char *added_headers;  /* Extra headers of the body part.  */
+  int n_att_usable;           /* Number of attachments to be sent.  */
+  mime_attach_t attachments;  /* All attachments of the mail.  */
+  size_t n_attachments;
+};
+
+/** @brief Write the MIME structure of MAIL to SINK.
+  *
+  * The body and the attachments are wrapped into multipart/mixed,
+  * multipart/related and multipart/alternative parts as Outlook
+  * would do it.  Attachments are opened one at a time.
+  *
+  * @returns 0 on success.
+  */
+int write_mime_structure (sink_t sink, const struct mime_mail_s *mail);
+
+/** @brief Split MAIL into parts which can be stored on their own.
+  *
+  * The first part is the body together with the attachments shown
+  * in an HTML body.  Every other usable attachment is a part of its
+  * own.  Each part is a complete MIME structure; a multipart/mixed
+  * of all parts holds the same content as write_mime_structure.
+  * count_mime_parts returns the number of parts, which is at least
+  * one, and write_mime_part writes the part at IDX to SINK.
+  *
+  * @returns 0 on success.
+  */
+int count_mime_parts (const struct mime_mail_s *mail);
+int write_mime_part (sink_t sink, const struct mime_mail_s *mail, int idx);
+
+void create_top_signing_header (char *buffer, size_t buflen,
+                                protocol_t protocol, int first,
+                                const char *boundary, const char *micalg);
+int create_top_encryption_header (sink_t sink, protocol_t protocol,
+                                  char *boundary, bool is_inline = false,
+                                  int exchange_major_version = -1,
+                                  bool binary = false);
+
+/* Encode an input string according to rfc2047
+   caller needs to free result. */
+char *utf8_to_rfc2047b (const char *input);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*MIME_WRITER_H*/
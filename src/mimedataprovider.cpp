@@ -29,6 +29,8 @@
 #include "rfc2047parse.h"
 #include "attachment.h"
 #include "cpphelp.h"
+#include "latency.h"
+#include "alloc-count.h"
 
 #ifndef HAVE_W32_SYSTEM
 #define stricmp strcasecmp
@@ -95,6 +97,8 @@ struct mime_context
                              plain rfc822 message.  */
   int in_protected_headers; /* Indicates if we are in a mime part that was
                                marked by a protected headers header. */
+  int draft_parts;        /* The mail holds the separately encrypted
+                             parts of a draft.  */
 
   /* A linked list describing the structure of the mime message.  This
      list gets build up while parsing the message.  */
@@ -197,6 +201,10 @@ t2body (MimeDataProvider *provider, rfc822parse_t msg)
   char *charset = NULL;
   bool ignore_cid = false;
 
+  /* The parts of a draft are collected one by one.  */
+  if (ctx->draft_parts)
+    ctx->collect_crypto_data = 0;
+
   /* Figure out the encoding.  */
   ctx->is_qp_encoded = 0;
   ctx->is_base64_encoded = 0;
@@ -272,6 +280,16 @@ t2body (MimeDataProvider *provider, rfc822parse_t msg)
   if (!ctx->nesting_level)
     {
       provider->set_content_type (ctmain, ctsub);
+      p = rfc822parse_get_field (msg, DRAFT_PARTS_HEADER, -1, &off);
+      if (p)
+        {
+          ctx->draft_parts = (!provider->signature ()
+                              && !strcmp (ctmain, "multipart")
+                              && !strcmp (ctsub, "mixed"));
+          log_debug ("%s:%s: Found draft parts: %s",
+                     SRCNAME, __func__, ctx->draft_parts ? "yes" : "invalid");
+          xfree (p);
+        }
     }
 
   s = rfc822parse_query_parameter (field, "charset", 0);
@@ -385,13 +403,18 @@ t2body (MimeDataProvider *provider, rfc822parse_t msg)
       log_data ("%s:%s: Collecting signature.",
                        SRCNAME, __func__);
     }
-  else if (ctx->nesting_level == 1 && ctx->is_encrypted
+  else if (ctx->nesting_level == (ctx->draft_parts ? 2 : 1)
+           && ctx->is_encrypted
            && !strcmp (ctmain, "application")
            && (ctx->protocol == PROTOCOL_OPENPGP
                && !strcmp (ctsub, "octet-stream")))
     {
       log_data ("%s:%s: Collecting encrypted PGP data.",
                        SRCNAME, __func__);
+      if (ctx->draft_parts)
+        {
+          provider->begin_crypto_part ();
+        }
       ctx->collect_crypto_data = 1;
     }
   else /* Other type. */
@@ -628,7 +651,7 @@ MimeDataProvider::read(void *buffer, size_t size)
   log_data ("%s:%s: Reading: " SIZE_T_FORMAT "Bytes",
                  SRCNAME, __func__, size);
   ssize_t bRead = m_crypto_data.read (buffer, size);
-  if ((opt.enable_debug & DBG_DATA) && bRead)
+  if (debug_enabled (DBG_DATA) && bRead)
     {
       std::string buf ((char *)buffer, bRead);
 
@@ -654,6 +677,7 @@ size_t
 MimeDataProvider::collect_input_lines(const char *input, size_t insize)
 {
   TSTART;
+  ALLOC_PHASE (ALLOC_PHASE_MIME);
   char linebuf[LINEBUFSIZE];
   const char *s = input;
   size_t pos = 0;
@@ -853,6 +877,8 @@ void
 MimeDataProvider::collect_data(LPSTREAM stream)
 {
   TSTART;
+  LATENCY_SCOPE ("MimeDataProvider::collect_data");
+  ALLOC_PHASE (ALLOC_PHASE_READ);
   if (!stream)
     {
       TRETURN;
@@ -995,6 +1021,8 @@ void
 MimeDataProvider::collect_data(FILE *stream)
 {
   TSTART;
+  LATENCY_SCOPE ("MimeDataProvider::collect_data");
+  ALLOC_PHASE (ALLOC_PHASE_READ);
   if (!stream)
     {
       TRETURN;
@@ -1037,7 +1065,11 @@ MimeDataProvider::collect_data(FILE *stream)
 ssize_t MimeDataProvider::write(const void *buffer, size_t bufSize)
 {
   TSTART;
-  if (m_collect_everything)
+  /* A PGP message found in the body also switches on collect
+     everything.  Its remaining lines must go to the crypto data like
+     those of the first write, independent of how gpgme splits the
+     output.  */
+  if (m_collect_everything && !m_mime_ctx->collect_crypto_data)
     {
       /* Writing with collect everything one means that we are outputprovider.
          In this case for inline messages we want to collect everything. */
@@ -1125,11 +1157,10 @@ static std::string
 get_header (rfc822parse_t msg, const std::string &which)
 {
   TSTART;
-  const char *buf = rfc822parse_get_field (msg,
-                                           which.c_str (), -1,
-                                           nullptr);
+  char *buf = rfc822parse_get_field (msg, which.c_str (), -1, nullptr);
   if (buf)
     {
+      std::string ret;
       /* String is "which: " so the + 3 is the colon, the space and one
          extra to ensure that we do not construct a std::string from null
          below. */
@@ -1137,13 +1168,24 @@ get_header (rfc822parse_t msg, const std::string &which)
         {
           log_error ("%s:%s: Invalid header value '%s'", SRCNAME, __func__,
                      buf);
-          TRETURN std::string ();
+          xfree (buf);
+          TRETURN ret;
         }
-      std::string ret = buf + which.size () + 2;
-      if (ret.size())
+      const char *value = buf + which.size () + 2;
+      /* Most headers fit into the stack buffer.  */
+      char decoded[256];
+      size_t len = rfc2047_parse_buf (value, decoded, sizeof decoded);
+      if (len < sizeof decoded)
         {
-          ret = rfc2047_parse (ret.c_str ());
+          ret = std::string (decoded, len);
         }
+      else
+        {
+          char *tmp = rfc2047_parse (value);
+          ret = tmp;
+          xfree (tmp);
+        }
+      xfree (buf);
       TRETURN ret;
     }
   TRETURN std::string ();
@@ -1152,6 +1194,7 @@ get_header (rfc822parse_t msg, const std::string &which)
 void MimeDataProvider::finalize ()
 {
   TSTART;
+  ALLOC_PHASE (ALLOC_PHASE_FINALIZE);
 
   if (m_protected_headers_version)
     {
@@ -1254,3 +1297,9 @@ MimeDataProvider::set_content_type (const char *ctmain, const char *ctsub)
                                                 std::string ();
   m_content_type = main + sub;
 }
+
+void
+MimeDataProvider::begin_crypto_part ()
+{
+  m_crypto_parts.push_back ((size_t) m_crypto_data.seek (0, SEEK_CUR));
+}
@@ -32,6 +32,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 struct mime_context;
 typedef struct mime_context *mime_context_t;
 class Attachment;
@@ -128,6 +129,13 @@ public:
 
   std::string get_content_type () const;
   void set_content_type (const char *ctmain, const char *ctsub);
+
+  /* The offsets of the separately encrypted parts of a draft in the
+     crypto data.  Empty for other mails.  */
+  const std::vector<size_t> &get_crypto_parts () const
+    {return m_crypto_parts;}
+  /* Start the next part of a draft in the crypto data.  */
+  void begin_crypto_part ();
 private:
 #ifdef HAVE_W32_SYSTEM
   /* Collect the data from mapi. */
@@ -167,5 +175,7 @@ private:
   std::string m_ph_helpbuf;
   /* Main content type */
   std::string m_content_type;
+  /* Offsets of the parts of a draft in m_crypto_data */
+  std::vector<size_t> m_crypto_parts;
 };
 #endif // MIMEDATAPROVIDER_H
@@ -22,9 +22,14 @@
 #ifndef MIMEMAKER_H
 #define MIMEMAKER_H
 
+#include <memory>
+#include <vector>
+
 #include "mapihelp.h"
+#include "mime-writer.h"
 
 class Mail;
+class DraftPart;
 #ifdef __cplusplus
 extern "C" {
 #if 0
@@ -32,34 +37,9 @@ extern "C" {
 #endif
 #endif
 
-/* Names for our attachments */
-#define OPENPGP_ENC_NAME "openpgp-encrypted-message.asc"
-#define OPENPGP_SIG_NAME "openpgp-digital-signature.asc"
-#define SMIME_SIG_NAME "smime.p7s"
-
-/* The object we use instead of IStream.  It allows us to have a
-   callback method for output and thus for processing stuff
-   recursively.  */
-struct sink_s;
-typedef struct sink_s *sink_t;
-struct sink_s
-{
-  void *cb_data;
-  sink_t extrasink;
-  int (*writefnc)(sink_t sink, const void *data, size_t datalen);
-  unsigned long enc_counter; /* Used by write_buffer_for_cb.  */
-/*   struct { */
-/*     int idx; */
-/*     unsigned char inbuf[4]; */
-/*     int quads; */
-/*   } b64; */
-};
-
 int sink_std_write (sink_t sink, const void *data, size_t datalen);
 int sink_file_write (sink_t sink, const void *data, size_t datalen);
 int sink_encryption_write (sink_t encsink, const void *data, size_t datalen);
-int write_buffer_for_cb (void *opaque, const void *data, size_t datalen);
-int write_buffer (sink_t sink, const void *data, size_t datalen);
 
 /** @brief Try to restore a message from the moss attachment.
   *
@@ -75,12 +55,12 @@ int count_usable_attachments (mapi_attach_item_t *table);
 int add_body_and_attachments (sink_t sink, LPMESSAGE message,
                               mapi_attach_item_t *att_table, Mail *mail,
                               const char *body, int n_att_usable);
-int create_top_encryption_header (sink_t sink, protocol_t protocol, char *boundary,
-                              bool is_inline = false, int exchange_major_version = -1);
 
-/* Helper to write a boundary to the output sink.  The leading LF
-   will be written as well.  */
-int write_boundary (sink_t sink, const char *boundary, int lastone);
+/* Collect the body and attachments of MESSAGE split into the parts
+   of write_mime_part.  Returns 0 on success.  */
+int collect_mime_parts (LPMESSAGE message, mapi_attach_item_t *att_table,
+                        Mail *mail, const char *body, int n_att_usable,
+                        std::vector<std::unique_ptr<DraftPart> > &r_parts);
 
 LPATTACH create_mapi_attachment (LPMESSAGE message, sink_t sink,
                                  const char *overrideMimeTag = nullptr);
@@ -89,14 +69,6 @@ int finalize_message (LPMESSAGE message, mapi_attach_item_t *att_table,
                       protocol_t protocol, int encrypt, bool is_inline = false,
                       bool is_draft = false, int exchange_major_version = -1);
 void cancel_mapi_attachment (LPATTACH *attach, sink_t sink);
-void create_top_signing_header (char *buffer, size_t buflen, protocol_t protocol,
-                           int first, const char *boundary, const char *micalg);
-int write_string (sink_t sink, const char *text);
-int write_b64 (sink_t sink, const void *data, size_t datalen);
-
-/* Encode an input string according to rfc2047
-   caller needs to free result. */
-char *utf8_to_rfc2047b (const char *input);
 
 #ifdef __cplusplus
 }
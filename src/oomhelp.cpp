@@ -48,7 +48,7 @@ gpgol_queryInterface (LPUNKNOWN pObj, REFIID riid, LPVOID FAR *ppvObj)
       log_debug ("%s:%s: QueryInterface failed hr=%#lx",
                  SRCNAME, __func__, ret);
     }
-  else if ((opt.enable_debug & DBG_MEMORY) && *ppvObj)
+  else if (debug_enabled (DBG_MEMORY) && *ppvObj)
     {
       memdbg_addRef (*ppvObj);
     }
@@ -68,7 +68,7 @@ gpgol_openProperty (LPMAPIPROP obj, ULONG ulPropTag, LPCIID lpiid,
       log_debug ("%s:%s: OpenProperty failed hr=%#lx %s",
                  SRCNAME, __func__, ret, mapi_err_to_string (ret));
     }
-  else if ((opt.enable_debug & DBG_MEMORY) && *lppUnk)
+  else if (debug_enabled (DBG_MEMORY) && *lppUnk)
     {
       memdbg_addRef (*lppUnk);
       log_debug ("%s:%s: OpenProperty on %p prop %lx result %p",
@@ -273,7 +273,7 @@ get_oom_object (LPDISPATCH pStart, const char *fullname)
         }
       if (!*fullname)
         {
-          if ((opt.enable_debug & DBG_MEMORY))
+          if (debug_enabled (DBG_MEMORY))
             {
               pDisp->AddRef ();
               int ref = pDisp->Release ();
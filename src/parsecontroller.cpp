@@ -26,13 +26,18 @@
 #include "mimedataprovider.h"
 
 #include "keycache.h"
+#include "latency.h"
+#include "alloc-count.h"
 
 #include <gpgme++/context.h>
 #include <gpgme++/decryptionresult.h>
 #include <gpgme++/key.h>
 
+#include <algorithm>
 #include <sstream>
 
+#include <errno.h>
+
 #ifdef HAVE_W32_SYSTEM
 #include "common.h"
 /* We use UTF-8 internally. */
@@ -115,7 +120,8 @@ ParseController::ParseController(LPSTREAM instream, msgtype_t type):
     m_outputprovider (new MimeDataProvider(expect_no_mime(type))),
     m_type (type),
     m_block_html (false),
-    m_second_pass (false)
+    m_second_pass (false),
+    m_allow_draft_parts (false)
 
 {
   TSTART;
@@ -134,7 +140,8 @@ ParseController::ParseController(FILE *instream, msgtype_t type):
     m_outputprovider (new MimeDataProvider(expect_no_mime(type))),
     m_type (type),
     m_block_html (false),
-    m_second_pass (false)
+    m_second_pass (false),
+    m_allow_draft_parts (false)
 {
   TSTART;
   memdbg_ctor ("ParseController");
@@ -334,6 +341,155 @@ is_valid_chksum(const GpgME::Signature &sig)
   TRETURN valid;
 }
 
+/* Reads the bytes from START to END of another Data.  This is used
+   to decrypt a part of the input without copying it.  */
+class DataRangeProvider : public DataProvider
+{
+public:
+  DataRangeProvider (Data &data, off_t start, off_t end) :
+    m_data (data),
+    m_start (start),
+    m_end (end),
+    m_pos (start)
+  {
+  }
+
+  bool isSupported (Operation op) const
+  {
+    return op == Read || op == Seek || op == Release;
+  }
+
+  ssize_t read (void *buffer, size_t bufSize)
+  {
+    size_t n = std::min (bufSize, (size_t) (m_end - m_pos));
+
+    if (!n)
+      {
+        return 0;
+      }
+    if (m_data.seek (m_pos, SEEK_SET) != m_pos)
+      {
+        log_error ("%s:%s: Failed to seek to %ld",
+                   SRCNAME, __func__, (long) m_pos);
+        return -1;
+      }
+    ssize_t nread = m_data.read (buffer, n);
+    if (nread > 0)
+      {
+        m_pos += nread;
+      }
+    return nread;
+  }
+
+  ssize_t write (const void *, size_t)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  off_t seek (off_t offset, int whence)
+  {
+    off_t pos;
+
+    switch (whence)
+      {
+        case SEEK_SET:
+          pos = m_start + offset;
+          break;
+        case SEEK_CUR:
+          pos = m_pos + offset;
+          break;
+        case SEEK_END:
+          pos = m_end + offset;
+          break;
+        default:
+          errno = EINVAL;
+          return -1;
+      }
+    if (pos < m_start || pos > m_end)
+      {
+        errno = EINVAL;
+        return -1;
+      }
+    m_pos = pos;
+    return m_pos - m_start;
+  }
+
+  void release () {}
+
+private:
+  Data &m_data;
+  off_t m_start;
+  off_t m_end;
+  off_t m_pos;
+};
+
+/* The parts of a draft are decrypted one after another and put
+   together as a multipart/mixed.  This gives the same output as a
+   draft which was encrypted as a whole.  Each part is read from
+   INPUT where it is.  */
+void
+ParseController::decrypt_draft_parts (Context &ctx, Data &input,
+                                      Data &output)
+{
+  TSTART;
+  const auto &offsets = m_inputprovider->get_crypto_parts ();
+  char boundary[BOUNDARYSIZE+1];
+
+  if (!m_allow_draft_parts)
+    {
+      log_error ("%s:%s: Draft parts in a mail which is not a draft.",
+                 SRCNAME, __func__);
+      m_decrypt_result = DecryptionResult (Error (gpg_error
+                                                  (GPG_ERR_NO_DATA)));
+      TRETURN;
+    }
+
+  const off_t total = input.seek (0, SEEK_END);
+  if (total < 0)
+    {
+      log_error ("%s:%s: Failed to seek the input", SRCNAME, __func__);
+      m_decrypt_result = DecryptionResult (Error (gpg_error
+                                                  (GPG_ERR_BUG)));
+      TRETURN;
+    }
+  generate_boundary (boundary);
+  const std::string head = std::string ("Content-Type: multipart/mixed;\r\n"
+                                        "\tboundary=\"") + boundary + "\"\r\n";
+  output.write (head.c_str (), head.size ());
+  const std::string sep = std::string ("\r\n--") + boundary;
+  for (size_t idx = 0; idx < offsets.size (); idx++)
+    {
+      off_t start = offsets[idx];
+      off_t end = idx + 1 < offsets.size () ? offsets[idx + 1] : total;
+      if (start > end || end > total)
+        {
+          log_error ("%s:%s: Invalid offset of part %u",
+                     SRCNAME, __func__, (unsigned int) idx);
+          m_decrypt_result = DecryptionResult (Error (gpg_error
+                                                      (GPG_ERR_BUG)));
+          TRETURN;
+        }
+      output.write (sep.c_str (), sep.size ());
+      output.write ("\r\n", 2);
+      DataRangeProvider provider (input, start, end);
+      Data part (&provider);
+      m_decrypt_result = ctx.decrypt (part, output);
+      if (m_decrypt_result.error ())
+        {
+          log_error ("%s:%s: Decrypting part %u failed: %s",
+                     SRCNAME, __func__, (unsigned int) idx,
+                     m_decrypt_result.error ().asString ());
+          TRETURN;
+        }
+    }
+  output.write (sep.c_str (), sep.size ());
+  output.write ("--\r\n", 4);
+  log_debug ("%s:%s: Decrypted %u parts of a draft",
+             SRCNAME, __func__, (unsigned int) offsets.size ());
+  TRETURN;
+}
+
 /* Note on stability:
 
    Experiments have shown that we can have a crash if parse
@@ -350,6 +506,8 @@ void
 ParseController::parse(bool offline)
 {
   TSTART;
+  LATENCY_SCOPE ("ParseController::parse");
+  TimelineScope timeline_scope (m_timeline, TL_PARSE);
   // Wrap the input stream in an attachment / GpgME Data
   Protocol protocol;
   bool decrypt, verify;
@@ -437,11 +595,34 @@ ParseController::parse(bool offline)
              protocol == OpenPGP ? "OpenPGP" :
              protocol == CMS ? "CMS" : "Unknown",
              m_sender.empty() ? "none" : anonstr (m_sender.c_str()), inputType);
-  if (decrypt)
+  if (decrypt && !m_inputprovider->get_crypto_parts ().empty ())
+    {
+      LATENCY_SCOPE ("ParseController::decrypt");
+      ALLOC_PHASE (ALLOC_PHASE_CRYPTO);
+      TimelineScope decrypt_scope (m_timeline, TL_DECRYPT);
+      decrypt_draft_parts (*ctx, input, output);
+      verify = false;
+      if (m_decrypt_result.error () || m_decrypt_result.isNull ())
+        {
+          m_error = format_error (m_decrypt_result, protocol);
+        }
+    }
+  else if (decrypt)
     {
       input.seek (0, SEEK_SET);
       TRACEPOINT;
+      LATENCY_TIMER (decrypt_timer, "ParseController::decrypt");
+      ALLOC_PHASE (ALLOC_PHASE_CRYPTO);
+      if (m_timeline)
+        {
+          m_timeline->begin (TL_DECRYPT);
+        }
       auto combined_result = ctx->decryptAndVerify(input, output);
+      decrypt_timer.stop ();
+      if (m_timeline)
+        {
+          m_timeline->end (TL_DECRYPT);
+        }
       log_debug ("%s:%s:%p decrypt / verify done.",
                  SRCNAME, __func__, this);
       m_decrypt_result = combined_result.first;
@@ -478,6 +659,9 @@ ParseController::parse(bool offline)
   if (verify)
     {
       TRACEPOINT;
+      LATENCY_TIMER (verify_timer, "ParseController::verify");
+      TimelineScope verify_scope (m_timeline, TL_VERIFY);
+      ALLOC_PHASE (ALLOC_PHASE_CRYPTO);
       GpgME::Data *sig = m_inputprovider->signature();
       input.seek (0, SEEK_SET);
       if (sig)
@@ -611,7 +795,7 @@ ParseController::parse(bool offline)
         }
     }
 
-  if (opt.enable_debug & DBG_DATA)
+  if (debug_enabled (DBG_DATA))
     {
       std::stringstream ss;
       TRACEPOINT;
@@ -32,6 +32,7 @@
 #endif
 
 #include "common_indep.h"
+#include "timeline.h"
 
 #include <gpgme++/decryptionresult.h>
 #include <gpgme++/verificationresult.h>
@@ -39,6 +40,10 @@
 
 class Attachment;
 class MimeDataProvider;
+namespace GpgME
+{
+  class Context;
+} // namespace GpgME
 
 #ifdef HAVE_W32_SYSTEM
 #include "oomhelp.h"
@@ -105,7 +110,21 @@ public:
 
   std::string get_content_type () const;
 
+  /** Record parsing, decryption and verification in TIMELINE. */
+  void setTimeline (const std::shared_ptr<Timeline> &timeline)
+  { m_timeline = timeline; }
+
+  /** Accept the separately encrypted parts GpgOL stores for a
+    draft.  Only set this for drafts as nobody else is expected to
+    send them.  */
+  void setAllowDraftParts (bool value)
+  { m_allow_draft_parts = value; }
+
 private:
+  /* Decrypt the parts of a draft one by one into OUTPUT.  */
+  void decrypt_draft_parts (GpgME::Context &ctx, GpgME::Data &input,
+                            GpgME::Data &output);
+
   /* State variables */
   MimeDataProvider *m_inputprovider;
   MimeDataProvider *m_outputprovider;
@@ -117,6 +136,8 @@ private:
   bool m_block_html;
   autocrypt_s m_autocrypt_info; /* Autocrypt info about the mail */
   bool m_second_pass; /* Second pass parsing with the same controller. */
+  bool m_allow_draft_parts; /* Accept the parts of a draft. */
+  std::shared_ptr<Timeline> m_timeline;
 };
 
 #endif /* PARSECONTROLLER_H */
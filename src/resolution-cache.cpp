@@ -0,0 +1,254 @@
+/* @file resolution-cache.cpp
+ * @brief Remember the keys resolved for a set of recipients.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+#include <gpg-error.h>
+
+#include "common_indep.h"
+#include "cpphelp.h"
+#include "resolution-cache.h"
+
+/* How many resolutions we keep.  The least recently used one is
+   dropped first.  */
+#define MAX_RESOLUTIONS 64
+
+GPGRT_LOCK_DEFINE (resolution_lock);
+
+typedef std::pair<std::string,
+                  std::shared_ptr<const ResolutionCache::Resolution> >
+  entry_t;
+
+static bool
+uses_key (const std::vector<GpgME::Key> &keys, const char *fpr)
+{
+  for (const auto &key: keys)
+    {
+      if (key.primaryFingerprint ()
+          && !strcmp (key.primaryFingerprint (), fpr))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+class ResolutionCache::Private
+{
+public:
+  Private ()
+  {
+  }
+
+  std::shared_ptr<const Resolution> get (const std::string &id)
+  {
+    gpgol_lock (&resolution_lock);
+    const auto it = m_map.find (id);
+    if (it == m_map.end ())
+      {
+        gpgol_unlock (&resolution_lock);
+        return nullptr;
+      }
+    /* Move it to the front.  */
+    m_lru.splice (m_lru.begin (), m_lru, it->second);
+    const auto ret = it->second->second;
+    gpgol_unlock (&resolution_lock);
+    return ret;
+  }
+
+  void put (const std::string &id,
+            const std::shared_ptr<const Resolution> &resolution)
+  {
+    gpgol_lock (&resolution_lock);
+    const auto it = m_map.find (id);
+    if (it != m_map.end ())
+      {
+        it->second->second = resolution;
+        m_lru.splice (m_lru.begin (), m_lru, it->second);
+        gpgol_unlock (&resolution_lock);
+        return;
+      }
+    if (m_map.size () >= MAX_RESOLUTIONS)
+      {
+        m_map.erase (m_lru.back ().first);
+        m_lru.pop_back ();
+      }
+    m_lru.push_front (std::make_pair (id, resolution));
+    m_map.insert (std::make_pair (id, m_lru.begin ()));
+    gpgol_unlock (&resolution_lock);
+  }
+
+  void clear ()
+  {
+    gpgol_lock (&resolution_lock);
+    if (!m_map.empty ())
+      {
+        log_debug ("%s:%s: Dropping %lu resolutions",
+                   SRCNAME, __func__, (unsigned long) m_map.size ());
+      }
+    m_map.clear ();
+    m_lru.clear ();
+    gpgol_unlock (&resolution_lock);
+  }
+
+  void dropKey (const char *fpr)
+  {
+    gpgol_lock (&resolution_lock);
+    for (auto it = m_lru.begin (); it != m_lru.end ();)
+      {
+        const Resolution &res = *it->second;
+        bool found = uses_key (res.signer_keys, fpr);
+        for (auto rit = res.recipient_keys.begin ();
+             !found && rit != res.recipient_keys.end (); ++rit)
+          {
+            found = uses_key (rit->second, fpr);
+          }
+        if (!found)
+          {
+            ++it;
+            continue;
+          }
+        log_debug ("%s:%s: Dropping a resolution with %s",
+                   SRCNAME, __func__, anonstr (fpr));
+        m_map.erase (it->first);
+        it = m_lru.erase (it);
+      }
+    gpgol_unlock (&resolution_lock);
+  }
+
+  size_t size ()
+  {
+    gpgol_lock (&resolution_lock);
+    size_t ret = m_map.size ();
+    gpgol_unlock (&resolution_lock);
+    return ret;
+  }
+
+  std::list<entry_t> m_lru;
+  std::unordered_map<std::string, std::list<entry_t>::iterator> m_map;
+};
+
+ResolutionCache::ResolutionCache ():
+  d (new Private)
+{
+}
+
+ResolutionCache *
+ResolutionCache::instance ()
+{
+  static ResolutionCache *singleton;
+
+  if (!singleton)
+    {
+      singleton = new ResolutionCache ();
+    }
+  return singleton;
+}
+
+std::string
+ResolutionCache::normalize (const std::string &mbox)
+{
+  std::string ret = mbox;
+
+  trim (ret);
+  for (auto &c: ret)
+    {
+      if (c >= 'A' && c <= 'Z')
+        {
+          c += 'a' - 'A';
+        }
+    }
+  return ret;
+}
+
+std::string
+ResolutionCache::makeId (const std::vector<std::string> &mboxes,
+                         const std::string &sender,
+                         GpgME::Protocol proto, unsigned int flags)
+{
+  std::vector<std::string> sorted;
+  size_t len = sender.size () + 16;
+
+  sorted.reserve (mboxes.size ());
+  for (const auto &mbox: mboxes)
+    {
+      sorted.push_back (normalize (mbox));
+      len += mbox.size () + 1;
+    }
+  std::sort (sorted.begin (), sorted.end ());
+  sorted.erase (std::unique (sorted.begin (), sorted.end ()), sorted.end ());
+
+  /* A line feed can't be part of a mailbox.  */
+  std::string ret;
+  ret.reserve (len);
+  ret += std::to_string ((int) proto);
+  ret += ':';
+  ret += std::to_string (flags);
+  ret += ':';
+  ret += normalize (sender);
+  for (const auto &mbox: sorted)
+    {
+      ret += '\n';
+      ret += mbox;
+    }
+  return ret;
+}
+
+std::shared_ptr<const ResolutionCache::Resolution>
+ResolutionCache::get (const std::string &id)
+{
+  return d->get (id);
+}
+
+void
+ResolutionCache::put (const std::string &id, const Resolution &resolution)
+{
+  d->put (id, std::make_shared<const Resolution> (resolution));
+}
+
+void
+ResolutionCache::clear ()
+{
+  d->clear ();
+}
+
+void
+ResolutionCache::dropKey (const char *fpr)
+{
+  if (!fpr)
+    {
+      TRACEPOINT;
+      return;
+    }
+  d->dropKey (fpr);
+}
+
+size_t
+ResolutionCache::size () const
+{
+  return d->size ();
+}
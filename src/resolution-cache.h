@@ -0,0 +1,104 @@
+/* @file resolution-cache.h
+ * @brief Remember the keys resolved for a set of recipients.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RESOLUTION_CACHE_H
+#define RESOLUTION_CACHE_H
+
+#include "config.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gpgme++/global.h>
+#include <gpgme++/key.h>
+
+/* Flags which are part of the id of a resolution.  */
+#define RES_FLAG_SIGN         1
+#define RES_FLAG_ENCRYPT      2
+#define RES_FLAG_SMIME        4  /* S/MIME is enabled.  */
+#define RES_FLAG_PREFER_SMIME 8
+
+/** Keys which were resolved for a sender and a set of recipients.
+
+  Users often send to the same group of recipients.  Resolving the
+  keys for every recipient again, or even asking the resolver, is
+  not necessary as long as the key cache did not change.  The
+  KeyCache drops the resolutions when it learns about a new or
+  updated key.
+
+  The resolutions are kept per process and only a limited number of
+  them.  All functions are thread safe.  */
+class ResolutionCache
+{
+protected:
+    /** Internal ctor */
+    explicit ResolutionCache ();
+
+public:
+    /** Get the ResolutionCache */
+    static ResolutionCache* instance ();
+
+    /* The result of a resolution.  */
+    struct Resolution
+    {
+      Resolution () : proto (GpgME::UnknownProtocol) {}
+
+      GpgME::Protocol proto;
+      std::vector<GpgME::Key> signer_keys;
+      /* The keys of each recipient by normalized mailbox.  */
+      std::map<std::string, std::vector<GpgME::Key> > recipient_keys;
+    };
+
+    /* Normalize the mailbox MBOX for the use in an id.  */
+    static std::string normalize (const std::string &mbox);
+
+    /* Build the id of a resolution from the recipient's mailboxes
+       MBOXES, the SENDER, the requested protocol PROTO and a set of
+       RES_FLAG values.  The order and the case of the mailboxes do
+       not matter.  */
+    static std::string makeId (const std::vector<std::string> &mboxes,
+                               const std::string &sender,
+                               GpgME::Protocol proto, unsigned int flags);
+
+    /* Look up the resolution for ID.  Returns NULL if there is
+       none.  The resolution is shared and must not be modified.  */
+    std::shared_ptr<const Resolution> get (const std::string &id);
+
+    /* Remember RESOLUTION under ID.  */
+    void put (const std::string &id, const Resolution &resolution);
+
+    /* Forget all resolutions.  */
+    void clear ();
+
+    /* Forget all resolutions which use the key with the primary
+       fingerprint FPR.  */
+    void dropKey (const char *fpr);
+
+    /* The number of resolutions kept.  */
+    size_t size () const;
+
+private:
+    class Private;
+    std::shared_ptr<Private> d;
+};
+
+#endif
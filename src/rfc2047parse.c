@@ -43,6 +43,7 @@
 #ifdef HAVE_W32_SYSTEM
 # include "mlang-charset.h"
 #endif
+#include "charset-conv.h"
 
 #include "gmime-table-private.h"
 
@@ -150,6 +151,7 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
   /* make sure the first char after the encoding is another '?' */
   if (inptr[1] != '?')
     {
+      xfree (charset);
       TRETURN NULL;
     }
 
@@ -161,6 +163,7 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
       encoding = 'Q';
       break;
     default:
+      xfree (charset);
       TRETURN NULL;
   }
 
@@ -173,6 +176,7 @@ rfc2047_token_new_encoded_word (const char *word, size_t len)
   /* make sure that we don't have something like: =?iso-8859-1?Q?= */
   if (payload > inptr)
     {
+      xfree (charset);
       TRETURN NULL;
     }
 
@@ -241,7 +245,8 @@ tokenize_rfc2047_phrase (const char *in, size_t *len)
                   }
 
                   /* sanity check encoding type */
-                  if (inptr[0] != '?' || !strchr ("BbQq", inptr[1]) || inptr[2] != '?')
+                  if (inptr[0] != '?' || !inptr[1] || !strchr ("BbQq", inptr[1])
+                      || inptr[2] != '?')
                     goto non_rfc2047;
 
                   inptr += 3;
@@ -538,25 +543,185 @@ rfc2047_token_decode (rfc2047_token *token, unsigned char *outbuf, int *state, u
     }
 }
 
-static char *
-rfc2047_decode_tokens (rfc2047_token *tokens, size_t buflen)
+/* The decoded output.  Either a malloced buffer which is grown as
+   needed or a fixed caller provided buffer.  In the latter case
+   output which does not fit is dropped but still counted in LEN so
+   that the caller learns the required size.  */
+typedef struct
+{
+  char *buf;
+  size_t size;
+  size_t len;
+  int fixed;
+} rfc2047_output;
+
+static void
+output_append (rfc2047_output *out, const char *data, size_t n)
+{
+  if (!n)
+    return;
+  if (out->fixed)
+    {
+      if (out->len + 1 < out->size)
+        {
+          size_t avail = out->size - out->len - 1;
+          memcpy (out->buf + out->len, data, n < avail ? n : avail);
+        }
+    }
+  else
+    {
+      if (out->len + n + 1 > out->size)
+        {
+          size_t newsize = out->size * 2;
+          if (newsize < out->len + n + 1)
+            newsize = out->len + n + 1;
+          out->buf = xrealloc (out->buf, newsize);
+          out->size = newsize;
+        }
+      memcpy (out->buf + out->len, data, n);
+    }
+  out->len += n;
+}
+
+/* Terminate OUT.  For a fixed buffer the string is truncated to the
+   buffer size.  */
+static void
+output_finish (rfc2047_output *out)
+{
+  if (out->fixed)
+    {
+      if (out->size)
+        out->buf[out->len < out->size ? out->len : out->size - 1] = 0;
+    }
+  else
+    out->buf[out->len] = 0;
+}
+
+
+/* A small cache of converted encoded words.  Attachment names, display
+   names and subjects tend to repeat within and across mails so this
+   saves the charset conversion for them.  Only words which need a
+   conversion are cached; UTF-8 words are cheap to decode anyway.  */
+#define WORD_CACHE_SIZE 32
+#define WORD_CACHE_MAX_KEY 256
+
+struct word_cache_item_s
+{
+  char *key;      /* "charset?raw decoded bytes" */
+  size_t keylen;
+  char *value;    /* UTF-8 result of the conversion.  */
+};
+
+static struct word_cache_item_s word_cache[WORD_CACHE_SIZE];
+static unsigned int word_cache_next;
+GPGRT_LOCK_DEFINE (word_cache_lock);
+
+/* Build the cache key for CHARSET and the raw decoded DATA of DATALEN
+   into KEY which must have room for WORD_CACHE_MAX_KEY bytes.  Returns
+   the length of the key or 0 if the word is too long to be cached.  */
+static size_t
+word_cache_key (char *key, const char *charset,
+                const unsigned char *data, size_t datalen)
+{
+  size_t cslen = strlen (charset);
+  size_t i;
+
+  if (cslen + 1 + datalen > WORD_CACHE_MAX_KEY)
+    return 0;
+  for (i = 0; i < cslen; i++)
+    key[i] = tolower ((unsigned char)charset[i]);
+  key[cslen] = '?';
+  memcpy (key + cslen + 1, data, datalen);
+  return cslen + 1 + datalen;
+}
+
+/* Append the cached conversion for KEY to OUT.  Returns true if it
+   was found.  */
+static int
+word_cache_lookup (const char *key, size_t keylen, rfc2047_output *out)
+{
+  int i;
+  int found = 0;
+
+  gpgrt_lock_lock (&word_cache_lock);
+  for (i = 0; i < WORD_CACHE_SIZE; i++)
+    {
+      if (word_cache[i].key && word_cache[i].keylen == keylen
+          && !memcmp (word_cache[i].key, key, keylen))
+        {
+          output_append (out, word_cache[i].value,
+                         strlen (word_cache[i].value));
+          found = 1;
+          break;
+        }
+    }
+  gpgrt_lock_unlock (&word_cache_lock);
+  return found;
+}
+
+static void
+word_cache_insert (const char *key, size_t keylen, const char *value)
+{
+  struct word_cache_item_s *item;
+
+  gpgrt_lock_lock (&word_cache_lock);
+  item = word_cache + (word_cache_next++ % WORD_CACHE_SIZE);
+  xfree (item->key);
+  xfree (item->value);
+  item->key = xmalloc (keylen);
+  memcpy (item->key, key, keylen);
+  item->keylen = keylen;
+  item->value = xstrdup (value);
+  gpgrt_lock_unlock (&word_cache_lock);
+}
+
+/* Convert the raw decoded DATA in CHARSET to UTF-8 and append it to
+   OUT.  */
+static void
+convert_word (const char *charset, const unsigned char *data,
+              size_t datalen, rfc2047_output *out)
+{
+  char key[WORD_CACHE_MAX_KEY];
+  size_t keylen;
+  char *str;
+
+  keylen = word_cache_key (key, charset, data, datalen);
+  if (keylen && word_cache_lookup (key, keylen, out))
+    return;
+
+#ifndef BUILD_TESTS
+  str = ansi_charset_to_utf8 (charset, (const char *)data, datalen, 0);
+#else
+  str = charset_to_utf8 (charset, (const char *)data, datalen);
+#endif
+  if (!str)
+    {
+      log_error ("%s:%s: Failed conversion from: %s.",
+                 SRCNAME, __func__, charset);
+      return;
+    }
+  if (keylen)
+    word_cache_insert (key, keylen, str);
+  output_append (out, str, strlen (str));
+  xfree (str);
+}
+
+static void
+rfc2047_decode_tokens (rfc2047_token *tokens, rfc2047_output *out)
 {
   rfc2047_token *token, *next;
   size_t outlen, len, tmplen;
   unsigned char *outptr;
   const char *charset;
-  char *outbuf;
-  char *decoded;
+  unsigned char tmpbuf[256];
+  unsigned char *outbuf;
   char encoding;
   unsigned int save;
   int state;
-  char *str;
 
   TSTART;
-  decoded = xmalloc (buflen + 1);
-  memset (decoded, 0, buflen + 1);
-  tmplen = 76;
-  outbuf = xmalloc (tmplen);
+  tmplen = sizeof tmpbuf;
+  outbuf = tmpbuf;
 
   token = tokens;
   while (token != NULL) {
@@ -579,9 +744,11 @@ rfc2047_decode_tokens (rfc2047_token *tokens, size_t buflen)
           }
 
           /* make sure our temporary output buffer is large enough... */
-          if (len > tmplen)
+          if (len >= tmplen)
             {
-              outbuf = xrealloc (outbuf, len + 1);
+              if (outbuf != tmpbuf)
+                xfree (outbuf);
+              outbuf = xmalloc (len + 1);
               tmplen = len + 1;
             }
 
@@ -603,28 +770,17 @@ rfc2047_decode_tokens (rfc2047_token *tokens, size_t buflen)
 
           /* convert the raw decoded text into UTF-8 */
           if (!strcasecmp (charset, "UTF-8")) {
-              strncat (decoded, (char *) outptr, outlen);
+              /* Like the strncat we used before we stop at an
+                 embedded Nul.  */
+              const unsigned char *nul = memchr (outptr, 0, outlen);
+              if (nul)
+                outlen = nul - outptr;
+              output_append (out, (const char *) outptr, outlen);
           } else {
-#ifndef BUILD_TESTS
-              str = ansi_charset_to_utf8 (charset, outptr, outlen, 0);
-#else
-              log_debug ("%s:%s: Conversion not available for testing",
-                         SRCNAME, __func__);
-              str = strdup (outptr);
-#endif
-              if (!str)
-                {
-                  log_error ("%s:%s: Failed conversion from: %s for word: %s.",
-                             SRCNAME, __func__, charset, anonstr (outptr));
-                }
-              else
-                {
-                  strcat (decoded, str);
-                  xfree (str);
-                }
+              convert_word (charset, outptr, outlen, out);
           }
       } else {
-          strncat (decoded, token->text, token->length);
+          output_append (out, token->text, token->length);
       }
       if (token && token->is_8bit)
       {
@@ -636,38 +792,37 @@ rfc2047_decode_tokens (rfc2047_token *tokens, size_t buflen)
       token = next;
   }
 
-  xfree (outbuf);
+  if (outbuf != tmpbuf)
+    xfree (outbuf);
 
-  TRETURN decoded;
+  output_finish (out);
+  TRETURN;
 }
 
 
 /**
  * g_mime_utils_header_decode_phrase:
  * @phrase: header to decode
+ * @out: the output buffer
  *
  * Decodes an rfc2047 encoded 'phrase' header.
  *
  * Note: See g_mime_set_user_charsets() for details on how charset
  * conversion is handled for unencoded 8bit text and/or wrongly
  * specified rfc2047 encoded-word tokens.
- *
- * Returns: a newly allocated UTF-8 string representing the the decoded
- * header.
  **/
-static char *
-g_mime_utils_header_decode_phrase (const char *phrase)
+static void
+g_mime_utils_header_decode_phrase (const char *phrase, rfc2047_output *out)
 {
   rfc2047_token *tokens;
-  char *decoded;
   size_t len;
 
   TSTART;
   tokens = tokenize_rfc2047_phrase (phrase, &len);
-  decoded = rfc2047_decode_tokens (tokens, len);
+  rfc2047_decode_tokens (tokens, out);
   rfc2047_token_list_free (tokens);
 
-  TRETURN decoded;
+  TRETURN;
 }
 
 /* Try to parse an rfc 2047 filename for attachment handling.
@@ -676,25 +831,70 @@ g_mime_utils_header_decode_phrase (const char *phrase)
 char *
 rfc2047_parse (const char *input)
 {
-  char *decoded;
+  rfc2047_output out;
   TSTART;
   if (!input)
     {
       TRETURN xstrdup ("");
     }
 
+  /* Without the start of an encoded word there is nothing to
+     decode.  */
+  if (!strstr (input, "=?"))
+    {
+      TRETURN xstrdup (input);
+    }
+
   log_data ("%s:%s: Input: \"%s\"",
             SRCNAME, __func__, input);
 
-  decoded = g_mime_utils_header_decode_phrase (input);
+  out.size = strlen (input) + 1;
+  out.buf = xmalloc (out.size);
+  out.len = 0;
+  out.fixed = 0;
+  g_mime_utils_header_decode_phrase (input, &out);
 
   log_data ("%s:%s: Decoded: \"%s\"",
-            SRCNAME, __func__, decoded);
+            SRCNAME, __func__, out.buf);
 
-  if (!decoded || !strlen (decoded))
+  if (!out.len)
     {
-      xfree (decoded);
+      xfree (out.buf);
       TRETURN xstrdup (input);
     }
-  TRETURN decoded;
+  TRETURN out.buf;
+}
+
+size_t
+rfc2047_parse_buf (const char *input, char *buffer, size_t bufsize)
+{
+  rfc2047_output out;
+  size_t len;
+
+  TSTART;
+  if (!input)
+    input = "";
+
+  if (strstr (input, "=?"))
+    {
+      out.buf = buffer;
+      out.size = bufsize;
+      out.len = 0;
+      out.fixed = 1;
+      g_mime_utils_header_decode_phrase (input, &out);
+      if (out.len)
+        {
+          TRETURN out.len;
+        }
+    }
+
+  /* Nothing to decode or nothing decoded; return the input.  */
+  len = strlen (input);
+  if (bufsize)
+    {
+      size_t n = len < bufsize ? len : bufsize - 1;
+      memcpy (buffer, input, n);
+      buffer[n] = 0;
+    }
+  TRETURN len;
 }
@@ -22,6 +22,8 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #if 0
@@ -39,6 +41,17 @@ extern "C" {
   */
 char *
 rfc2047_parse (const char *input);
+
+/** @brief Parse a string according to rfc2047 into a caller buffer.
+  *
+  * Same as rfc2047_parse but the UTF-8 result is stored in BUFFER
+  * of BUFSIZE bytes and always Nul terminated.
+  *
+  * @returns the length of the full result.  If that is not less
+  *          than BUFSIZE the result was truncated.
+  */
+size_t
+rfc2047_parse_buf (const char *input, char *buffer, size_t bufsize);
 #ifdef __cplusplus
 }
 #endif
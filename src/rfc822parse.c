@@ -429,8 +429,9 @@ insert_header (rfc822parse_t msg, const unsigned char *line, size_t length)
   memcpy (hdr->line, line, length);
   hdr->line[length] = 0; /* Make it a string. */
 
-  /* Transform a field name into canonical format. */
-  if (!hdr->cont && strchr (line, ':'))
+  /* Transform a field name into canonical format.  LINE is not Nul
+     terminated, so look at the copy.  */
+  if (!hdr->cont && strchr (hdr->line, ':'))
      capitalize_header_name (hdr->line);
 
   *msg->current_part->hdr_lines_tail = hdr;
@@ -0,0 +1,812 @@
+/* @file split-encrypt.cpp
+ * @brief Encrypt the same mail separately for several recipients.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+
+#include <gpg-error.h>
+
+#include <gpgme++/context.h>
+#include <gpgme++/data.h>
+#include <gpgme++/encryptionresult.h>
+
+#include "common_indep.h"
+#include "split-encrypt.h"
+
+/* More threads than this do not help, the engine processes compete
+   for the same CPUs.  */
+#define MAX_SPLIT_THREADS 16
+
+/* OpenPGP packet tags.  */
+#define PKT_PUBKEY_ENC     1
+#define PKT_ENCRYPTED      9
+#define PKT_ENCRYPTED_MDC 18
+#define PKT_ENCRYPTED_AEAD 20
+
+#define HIDDEN_KEYID "0000000000000000"
+
+/* Bytes armored at a time.  A multiple of 48 so that all lines but
+   the last have 64 characters.  */
+#define ARMOR_CHUNK (48 * 64)
+
+static int
+pgp_packet_tag (unsigned char c)
+{
+  if (!(c & 0x80))
+    {
+      return -1;
+    }
+  return (c & 0x40) ? (c & 0x3f) : ((c >> 2) & 0x0f);
+}
+
+/* Get the length of the packet at OFF in MSG.  The length of its
+   header is stored at R_HDRLEN and the total length at R_LEN.
+   Returns -1 for partial or indeterminate lengths and for truncated
+   packets.  */
+static int
+pgp_packet_length (const std::string &msg, size_t off,
+                   size_t *r_hdrlen, size_t *r_len)
+{
+  const unsigned char *p = (const unsigned char *) msg.data () + off;
+  const size_t avail = msg.size () - off;
+  size_t hdrlen, bodylen;
+
+  if (avail < 2)
+    {
+      return -1;
+    }
+  if (p[0] & 0x40)
+    {
+      /* New format.  */
+      if (p[1] < 192)
+        {
+          hdrlen = 2;
+          bodylen = p[1];
+        }
+      else if (p[1] < 224 && avail >= 3)
+        {
+          hdrlen = 3;
+          bodylen = ((p[1] - 192) << 8) + p[2] + 192;
+        }
+      else if (p[1] == 255 && avail >= 6)
+        {
+          hdrlen = 6;
+          bodylen = ((size_t) p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+        }
+      else
+        {
+          return -1;
+        }
+    }
+  else
+    {
+      /* Old format.  */
+      switch (p[0] & 3)
+        {
+          case 0:
+            hdrlen = 2;
+            bodylen = p[1];
+            break;
+          case 1:
+            if (avail < 3)
+              {
+                return -1;
+              }
+            hdrlen = 3;
+            bodylen = (p[1] << 8) | p[2];
+            break;
+          case 2:
+            if (avail < 5)
+              {
+                return -1;
+              }
+            hdrlen = 5;
+            bodylen = ((size_t) p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            break;
+          default:
+            return -1;
+        }
+    }
+  if (bodylen > avail - hdrlen)
+    {
+      return -1;
+    }
+  *r_hdrlen = hdrlen;
+  *r_len = hdrlen + bodylen;
+  return 0;
+}
+
+int
+pgp_parse_pkesks (const std::string &msg,
+                  std::vector<pgp_pkesk_s> &r_pkesks, size_t *r_body)
+{
+  size_t off = 0;
+
+  r_pkesks.clear ();
+  while (off < msg.size ()
+         && pgp_packet_tag (msg[off]) == PKT_PUBKEY_ENC)
+    {
+      size_t hdrlen, len;
+      pgp_pkesk_s pkesk;
+      char hex[17];
+
+      /* Version 3: The version, the key id and the algorithm.  */
+      if (pgp_packet_length (msg, off, &hdrlen, &len)
+          || len - hdrlen < 10 || msg[off + hdrlen] != 3)
+        {
+          return -1;
+        }
+      for (int i = 0; i < 8; i++)
+        {
+          snprintf (hex + 2 * i, 3, "%02X",
+                    (unsigned char) msg[off + hdrlen + 1 + i]);
+        }
+      pkesk.keyid = hex;
+      pkesk.off = off;
+      pkesk.len = len;
+      r_pkesks.push_back (pkesk);
+      off += len;
+    }
+  if (r_pkesks.empty () || off >= msg.size ())
+    {
+      return -1;
+    }
+  switch (pgp_packet_tag (msg[off]))
+    {
+      case PKT_ENCRYPTED:
+      case PKT_ENCRYPTED_MDC:
+      case PKT_ENCRYPTED_AEAD:
+        *r_body = off;
+        return 0;
+      default:
+        return -1;
+    }
+}
+
+/* Update the CRC-24 of the armor as in RFC 4880 with LEN bytes of
+   DATA.  */
+static unsigned int
+crc24_update (unsigned int crc, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    {
+      crc ^= (unsigned int) (unsigned char) data[i] << 16;
+      for (int j = 0; j < 8; j++)
+        {
+          crc <<= 1;
+          if (crc & 0x1000000)
+            {
+              crc ^= 0x1864cfb;
+            }
+        }
+    }
+  return crc & 0xffffff;
+}
+
+SplitOutputProvider::SplitOutputProvider (std::shared_ptr<const SplitOutput>
+                                          output) :
+  m_output (output),
+  m_raw_off (0),
+  m_pos (0),
+  m_state (0),
+  m_crc (0xb704ce),
+  m_offset (0)
+{
+}
+
+bool
+SplitOutputProvider::isSupported (GpgME::DataProvider::Operation op) const
+{
+  return op == GpgME::DataProvider::Read ||
+         op == GpgME::DataProvider::Seek ||
+         op == GpgME::DataProvider::Release;
+}
+
+/* Copy up to SIZE bytes of the head and the body to BUFFER.  Less
+   are only copied at the end.  */
+size_t
+SplitOutputProvider::readRaw (char *buffer, size_t size)
+{
+  const std::string &head = m_output->head;
+  const size_t body_len = m_output->body ? m_output->body->size () : 0;
+  size_t n = 0;
+
+  if (m_raw_off < head.size ())
+    {
+      n = std::min (size, head.size () - m_raw_off);
+      memcpy (buffer, head.data () + m_raw_off, n);
+      m_raw_off += n;
+    }
+  if (n < size && m_raw_off - head.size () < body_len)
+    {
+      const size_t off = m_raw_off - head.size ();
+      const size_t len = std::min (size - n, body_len - off);
+      memcpy (buffer + n, m_output->body->data () + off, len);
+      m_raw_off += len;
+      n += len;
+    }
+  return n;
+}
+
+/* Put the next lines of the armor into m_armor.  It stays empty at
+   the end.  */
+void
+SplitOutputProvider::armorNext ()
+{
+  m_armor.clear ();
+  m_pos = 0;
+  if (m_state == 0)
+    {
+      m_armor = "-----BEGIN PGP MESSAGE-----\n\n";
+      m_state++;
+      return;
+    }
+  if (m_state == 1)
+    {
+      char raw[ARMOR_CHUNK];
+      const size_t len = readRaw (raw, sizeof raw);
+
+      if (len)
+        {
+          char *b64 = b64_encode (raw, len);
+          const size_t b64len = b64 ? strlen (b64) : 0;
+
+          m_crc = crc24_update (m_crc, raw, len);
+          for (size_t pos = 0; pos < b64len; pos += 64)
+            {
+              m_armor.append (b64 + pos, std::min<size_t> (64, b64len - pos));
+              m_armor += '\n';
+            }
+          xfree (b64);
+          return;
+        }
+      m_state++;
+    }
+  if (m_state == 2)
+    {
+      const char crcbuf[3] = { (char) (m_crc >> 16), (char) (m_crc >> 8),
+                               (char) m_crc };
+      char *b64 = b64_encode (crcbuf, sizeof crcbuf);
+
+      m_armor = "=";
+      m_armor += b64;
+      m_armor += "\n-----END PGP MESSAGE-----\n";
+      xfree (b64);
+      m_state++;
+    }
+}
+
+ssize_t
+SplitOutputProvider::read (void *buffer, size_t bufSize)
+{
+  char *out = static_cast<char *>(buffer);
+  size_t n = 0;
+
+  if (!m_output->armor)
+    {
+      n = readRaw (out, bufSize);
+    }
+  while (m_output->armor && n < bufSize)
+    {
+      if (m_pos == m_armor.size ())
+        {
+          armorNext ();
+          if (m_armor.empty ())
+            {
+              break;
+            }
+        }
+      size_t len = std::min (bufSize - n, m_armor.size () - m_pos);
+      memcpy (out + n, m_armor.data () + m_pos, len);
+      n += len;
+      m_pos += len;
+    }
+  m_offset += n;
+  return n;
+}
+
+ssize_t
+SplitOutputProvider::write (const void *, size_t)
+{
+  errno = EBADF;
+  return -1;
+}
+
+off_t
+SplitOutputProvider::seek (off_t offset, int whence)
+{
+  if (!offset && whence == SEEK_CUR)
+    {
+      return m_offset;
+    }
+  if (!offset && whence == SEEK_SET)
+    {
+      m_raw_off = 0;
+      m_armor.clear ();
+      m_pos = 0;
+      m_state = 0;
+      m_crc = 0xb704ce;
+      m_offset = 0;
+      return 0;
+    }
+  log_debug ("%s:%s: Unsupported seek %ld %i",
+             SRCNAME, __func__, (long) offset, whence);
+  errno = EINVAL;
+  return -1;
+}
+
+/* Reads the shared plaintext at its own offset.  The plaintext is
+   seeked and read under LOCK so that several threads can encrypt it
+   at the same time.  */
+class PlaintextReader : public GpgME::DataProvider
+{
+public:
+  PlaintextReader (GpgME::Data &plaintext, gpgrt_lock_t *lock) :
+    m_plaintext (plaintext),
+    m_lock (lock),
+    m_offset (0)
+  {
+  }
+
+  bool isSupported (Operation op) const
+  {
+    return op == GpgME::DataProvider::Read ||
+           op == GpgME::DataProvider::Seek ||
+           op == GpgME::DataProvider::Release;
+  }
+
+  ssize_t read (void *buffer, size_t bufSize)
+  {
+    ssize_t nread = -1;
+
+    gpgol_lock (m_lock);
+    if (m_plaintext.seek (m_offset, SEEK_SET) == m_offset)
+      {
+        nread = m_plaintext.read (buffer, bufSize);
+      }
+    gpgol_unlock (m_lock);
+    if (nread < 0)
+      {
+        log_error ("%s:%s: Failed to read the plaintext at %ld.",
+                   SRCNAME, __func__, (long) m_offset);
+        errno = EIO;
+        return -1;
+      }
+    m_offset += nread;
+    return nread;
+  }
+
+  ssize_t write (const void *, size_t)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  off_t seek (off_t offset, int whence)
+  {
+    if (whence == SEEK_CUR)
+      {
+        offset += m_offset;
+      }
+    else if (whence != SEEK_SET)
+      {
+        errno = EINVAL;
+        return -1;
+      }
+    m_offset = offset;
+    return m_offset;
+  }
+
+  void release () {}
+
+private:
+  GpgME::Data &m_plaintext;
+  gpgrt_lock_t *m_lock;
+  off_t m_offset;
+};
+
+/* The key ids of all subkeys of KEY.  */
+static std::vector<std::string>
+subkey_ids (const GpgME::Key &key)
+{
+  std::vector<std::string> ret;
+
+  for (const auto &sub: key.subkeys ())
+    {
+      if (sub.keyID ())
+        {
+          ret.push_back (sub.keyID ());
+        }
+    }
+  return ret;
+}
+
+class SplitEncrypter::Private
+{
+public:
+  Private (GpgME::Protocol proto, GpgME::Data &plaintext):
+    m_proto (proto),
+    m_plaintext (plaintext),
+    m_share (false),
+    m_armor (true),
+    m_done (nullptr),
+    m_next (0),
+    m_failed (0)
+  {
+    gpgrt_lock_init (&m_lock);
+    gpgrt_lock_init (&m_read_lock);
+  }
+
+  ~Private ()
+  {
+    gpgrt_lock_destroy (&m_lock);
+    gpgrt_lock_destroy (&m_read_lock);
+  }
+
+  /* Encrypt copies until there are none left.  */
+  void work ()
+  {
+    auto ctx = GpgME::Context::create (m_proto);
+
+    if (ctx)
+      {
+        ctx->setArmor (m_proto == GpgME::OpenPGP && m_armor);
+        ctx->setTextMode (m_proto == GpgME::OpenPGP);
+      }
+    else
+      {
+        log_error ("%s:%s: Failure to create context.",
+                   SRCNAME, __func__);
+      }
+
+    for (;;)
+      {
+        gpgol_lock (&m_lock);
+        const size_t next = m_next++;
+        gpgol_unlock (&m_lock);
+        if (next >= m_todo.size ())
+          {
+            break;
+          }
+        const size_t idx = m_todo[next];
+
+        GpgME::Error err;
+        SplitOutput output;
+        output.proto = m_proto;
+        output.armor = false;
+        output.binary = m_proto == GpgME::OpenPGP && !m_armor;
+        if (!ctx)
+          {
+            err = GpgME::Error (gpg_error (GPG_ERR_GENERAL));
+          }
+        else
+          {
+            PlaintextReader reader (m_plaintext, &m_read_lock);
+            GpgME::Data input (&reader);
+            GpgME::Data cipher;
+            const auto result = ctx->encrypt (m_copies[idx], input, cipher,
+                                              GpgME::Context::AlwaysTrust);
+            err = result.error ();
+            if (!err)
+              {
+                output.head = cipher.toString ();
+              }
+          }
+        if (err)
+          {
+            log_error ("%s:%s: Encryption of copy %u failed: %s",
+                       SRCNAME, __func__, (unsigned int) idx,
+                       err.asString ());
+          }
+
+        gpgol_lock (&m_lock);
+        if (err)
+          {
+            m_failed++;
+          }
+        (*m_done) (idx, err, output);
+        gpgol_unlock (&m_lock);
+      }
+  }
+
+  /* Encrypt the plaintext once to the keys of all copies and give
+     every copy only the session key packets for its own keys.  If
+     this is not possible for all copies they are left in m_todo.  */
+  void wrap ()
+  {
+    TSTART;
+    std::vector<GpgME::Key> all_keys;
+    std::set<std::string> fprs, all_ids;
+
+    for (const auto &keys: m_copies)
+      {
+        for (const auto &key: keys)
+          {
+            if (key.isNull () || !key.primaryFingerprint ())
+              {
+                TRETURN;
+              }
+            if (fprs.insert (key.primaryFingerprint ()).second)
+              {
+                all_keys.push_back (key);
+                const auto ids = subkey_ids (key);
+                all_ids.insert (ids.begin (), ids.end ());
+              }
+          }
+      }
+
+    auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+    if (!ctx)
+      {
+        log_error ("%s:%s: Failure to create context.",
+                   SRCNAME, __func__);
+        TRETURN;
+      }
+    ctx->setArmor (false);
+    ctx->setTextMode (true);
+    PlaintextReader reader (m_plaintext, &m_read_lock);
+    GpgME::Data input (&reader);
+    GpgME::Data cipher;
+    const auto result = ctx->encrypt (all_keys, input, cipher,
+                                      GpgME::Context::AlwaysTrust);
+    if (result.error ())
+      {
+        log_error ("%s:%s: Encryption failed: %s",
+                   SRCNAME, __func__, result.error ().asString ());
+        TRETURN;
+      }
+
+    std::string msg = cipher.toString ();
+    std::vector<pgp_pkesk_s> pkesks;
+    size_t body;
+    if (pgp_parse_pkesks (msg, pkesks, &body))
+      {
+        log_debug ("%s:%s: Unexpected message structure.",
+                   SRCNAME, __func__);
+        TRETURN;
+      }
+    for (const auto &pkesk: pkesks)
+      {
+        if (pkesk.keyid == HIDDEN_KEYID)
+          {
+            log_debug ("%s:%s: Recipients are hidden.",
+                       SRCNAME, __func__);
+            TRETURN;
+          }
+      }
+
+    /* If the session key of a copy can not be found the packets of
+       no copy can be told apart from those of encrypt-to keys.  */
+    std::vector<std::set<std::string> > copy_ids;
+    for (const size_t idx: m_todo)
+      {
+        std::set<std::string> ids;
+
+        for (const auto &key: m_copies[idx])
+          {
+            bool found = false;
+            for (const auto &id: subkey_ids (key))
+              {
+                ids.insert (id);
+                found |= std::any_of (pkesks.begin (), pkesks.end (),
+                                      [&id] (const pgp_pkesk_s &pkesk)
+                                        {
+                                          return pkesk.keyid == id;
+                                        });
+              }
+            if (!found)
+              {
+                log_debug ("%s:%s: No session key for copy %u.",
+                           SRCNAME, __func__, (unsigned int) idx);
+                TRETURN;
+              }
+          }
+        copy_ids.push_back (ids);
+      }
+
+    /* Session keys for keys of no copy were added by the engine,
+       e.g. for an encrypt-to key, and belong to every copy.  */
+    std::vector<std::string> heads (m_todo.size ());
+    for (size_t i = 0; i < m_todo.size (); i++)
+      {
+        for (const auto &pkesk: pkesks)
+          {
+            if (copy_ids[i].count (pkesk.keyid)
+                || !all_ids.count (pkesk.keyid))
+              {
+                heads[i].append (msg, pkesk.off, pkesk.len);
+              }
+          }
+      }
+
+    /* All copies share the encrypted data.  */
+    msg.erase (0, body);
+    const auto shared = std::make_shared<const std::string> (std::move (msg));
+    for (size_t i = 0; i < m_todo.size (); i++)
+      {
+        SplitOutput output;
+
+        output.proto = GpgME::OpenPGP;
+        output.head = std::move (heads[i]);
+        output.body = shared;
+        output.armor = m_armor;
+        output.binary = !m_armor;
+        gpgol_lock (&m_lock);
+        (*m_done) (m_todo[i], GpgME::Error (), output);
+        gpgol_unlock (&m_lock);
+      }
+    log_debug ("%s:%s: Wrapped %u copies.",
+               SRCNAME, __func__, (unsigned int) m_todo.size ());
+    m_todo.clear ();
+    TRETURN;
+  }
+
+#ifdef HAVE_W32_SYSTEM
+  static DWORD WINAPI
+  worker_thread (LPVOID arg)
+  {
+    static_cast<Private *> (arg)->work ();
+    return 0;
+  }
+#else
+  static void *
+  worker_thread (void *arg)
+  {
+    static_cast<Private *> (arg)->work ();
+    return nullptr;
+  }
+#endif
+
+  GpgME::Protocol m_proto;
+  GpgME::Data &m_plaintext;
+  std::vector<std::vector<GpgME::Key> > m_copies;
+  bool m_share;
+  bool m_armor;
+  const done_t *m_done;
+  std::vector<size_t> m_todo;   /* The copies to encrypt.  */
+  size_t m_next;        /* The next of m_todo.  */
+  int m_failed;
+  gpgrt_lock_t m_lock = GPGRT_LOCK_INITIALIZER;
+  /* For the reads of m_plaintext.  */
+  gpgrt_lock_t m_read_lock = GPGRT_LOCK_INITIALIZER;
+};
+
+SplitEncrypter::SplitEncrypter (GpgME::Protocol proto,
+                                GpgME::Data &plaintext):
+  d (new Private (proto, plaintext))
+{
+}
+
+size_t
+SplitEncrypter::addCopy (const std::vector<GpgME::Key> &keys)
+{
+  d->m_copies.push_back (keys);
+  return d->m_copies.size () - 1;
+}
+
+size_t
+SplitEncrypter::size () const
+{
+  return d->m_copies.size ();
+}
+
+void
+SplitEncrypter::setShareSessionKey (bool value)
+{
+  d->m_share = value;
+}
+
+void
+SplitEncrypter::setArmor (bool value)
+{
+  d->m_armor = value;
+}
+
+int
+SplitEncrypter::run (int max_threads, const done_t &done)
+{
+  TSTART;
+  d->m_done = &done;
+  d->m_todo.clear ();
+  for (size_t idx = 0; idx < d->m_copies.size (); idx++)
+    {
+      d->m_todo.push_back (idx);
+    }
+  d->m_next = 0;
+  d->m_failed = 0;
+
+  if (d->m_share && d->m_proto == GpgME::OpenPGP
+      && d->m_copies.size () > 1)
+    {
+      d->wrap ();
+    }
+
+  int n_threads = std::min (max_threads, MAX_SPLIT_THREADS);
+  if ((size_t) n_threads > d->m_todo.size ())
+    {
+      n_threads = (int) d->m_todo.size ();
+    }
+  log_debug ("%s:%s: Encrypting %u copies on %i threads.",
+             SRCNAME, __func__, (unsigned int) d->m_todo.size (),
+             n_threads);
+
+  /* The calling thread works as well.  Should a thread fail to
+     start the others take over its copies.  */
+#ifdef HAVE_W32_SYSTEM
+  HANDLE threads[MAX_SPLIT_THREADS];
+  int started = 0;
+  for (int i = 1; i < n_threads; i++)
+    {
+      HANDLE thread = CreateThread (NULL, 0, Private::worker_thread,
+                                    d.get (), 0, NULL);
+      if (!thread)
+        {
+          log_error ("%s:%s: Failed to create thread.",
+                     SRCNAME, __func__);
+          break;
+        }
+      threads[started++] = thread;
+    }
+  d->work ();
+  if (started)
+    {
+      WaitForMultipleObjects (started, threads, TRUE, INFINITE);
+    }
+  for (int i = 0; i < started; i++)
+    {
+      CloseHandle (threads[i]);
+    }
+#else
+  pthread_t threads[MAX_SPLIT_THREADS];
+  int started = 0;
+  for (int i = 1; i < n_threads; i++)
+    {
+      if (pthread_create (&threads[started], NULL, Private::worker_thread,
+                          d.get ()))
+        {
+          log_error ("%s:%s: Failed to create thread.",
+                     SRCNAME, __func__);
+          break;
+        }
+      started++;
+    }
+  d->work ();
+  for (int i = 0; i < started; i++)
+    {
+      pthread_join (threads[i], NULL);
+    }
+#endif
+
+  d->m_done = nullptr;
+  TRETURN d->m_failed;
+}
@@ -0,0 +1,156 @@
+/* @file split-encrypt.h
+ * @brief Encrypt the same mail separately for several recipients.
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SPLIT_ENCRYPT_H
+#define SPLIT_ENCRYPT_H
+
+#include "config.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gpgme++/global.h>
+#include <gpgme++/key.h>
+#include <gpgme++/interfaces/dataprovider.h>
+
+namespace GpgME
+{
+  class Data;
+  class Error;
+} // namespace GpgME
+
+/* An encrypted copy of a mail which was prepared before the copy
+   itself exists.  The ciphertext is HEAD followed by BODY.  Copies
+   which share one encryption of the plaintext share its BODY and
+   HEAD has only their session key packets.  Otherwise HEAD is the
+   whole ciphertext and BODY is NULL.  Use a SplitOutputProvider to
+   read it.  */
+struct SplitOutput
+{
+  GpgME::Protocol proto;
+  std::string head;
+  std::shared_ptr<const std::string> body;
+  bool armor;           /* HEAD and BODY are armored while read.  */
+  bool binary;          /* OpenPGP data without armor.  */
+};
+
+/* A public key encrypted session key packet of a binary OpenPGP
+   message.  */
+struct pgp_pkesk_s
+{
+  std::string keyid;    /* 16 upper case hex digits, zero if hidden.  */
+  size_t off;           /* Offset of the packet in the message.  */
+  size_t len;           /* Length of the packet including its header.  */
+};
+
+/* Parse the session key packets at the start of the binary OpenPGP
+   message MSG into R_PKESKS and store the offset of the encrypted
+   data which follows them at R_BODY.  Returns 0 on success and -1 if
+   MSG does not start with version 3 session key packets followed by
+   encrypted data.  */
+int pgp_parse_pkesks (const std::string &msg,
+                      std::vector<pgp_pkesk_s> &r_pkesks, size_t *r_body);
+
+/** A GpgME dataprovider which yields the ciphertext of a SplitOutput.
+
+  The head and the shared body are joined only while they are read
+  so that a copy does not need its own copy of the body.  If the
+  output asks for it the message is armored on the fly.  Seeking is
+  only supported to the start.  */
+class SplitOutputProvider : public GpgME::DataProvider
+{
+public:
+  explicit SplitOutputProvider (std::shared_ptr<const SplitOutput> output);
+
+  /* Dataprovider interface */
+  bool isSupported (Operation op) const;
+  ssize_t read (void *buffer, size_t bufSize);
+  ssize_t write (const void *buffer, size_t bufSize);
+  off_t seek (off_t offset, int whence);
+  void release () {}
+
+private:
+  size_t readRaw (char *buffer, size_t size);
+  void armorNext ();
+
+  std::shared_ptr<const SplitOutput> m_output;
+  size_t m_raw_off;     /* Offset into the head and the body.  */
+  std::string m_armor;  /* Armored text not yet read.  */
+  size_t m_pos;         /* Offset into m_armor.  */
+  int m_state;          /* 0: begin line, 1: data, 2: end lines, 3: EOF.  */
+  unsigned int m_crc;   /* The CRC-24 of the armor.  */
+  off_t m_offset;       /* Number of bytes read.  */
+};
+
+/** Encrypt one plaintext separately for several sets of keys.
+
+  When BCC recipients get their own mail every copy has the same
+  content but is encrypted to other keys.  The plaintext is built
+  once and shared read-only while the copies are encrypted
+  concurrently, each on its own thread with its own context.  Each
+  thread reads the plaintext at its own offset, so it is not copied.
+  As the work is done by the engine most threads just wait for it.
+
+  With a shared session key OpenPGP copies cost only one encryption
+  of the plaintext: It is encrypted once to the keys of all copies
+  and every copy gets the encrypted data with only the session key
+  packets for its own keys.  So no copy reveals the other
+  recipients.  The encrypted data is kept only once for all
+  copies.  If this is not possible, e.g. because the engine
+  hides the key ids, every copy is encrypted on its own.  */
+class SplitEncrypter
+{
+public:
+  /* Called for the copy at INDEX once it is encrypted.  On success
+     OUTPUT holds the ciphertext and may be moved away.  */
+  typedef std::function<void (size_t index, const GpgME::Error &err,
+                              SplitOutput &output)> done_t;
+
+  /* PLAINTEXT must be seekable to any offset and stay unchanged
+     until run returns.  */
+  SplitEncrypter (GpgME::Protocol proto, GpgME::Data &plaintext);
+
+  /* Add a copy encrypted to KEYS and return its index.  */
+  size_t addCopy (const std::vector<GpgME::Key> &keys);
+
+  /* The number of copies.  */
+  size_t size () const;
+
+  /* Encrypt the plaintext only once for all OpenPGP copies.  */
+  void setShareSessionKey (bool value);
+
+  /* Armor the OpenPGP copies.  This is the default.  */
+  void setArmor (bool value);
+
+  /* Encrypt all copies on at most MAX_THREADS threads and return
+     when all are done.  DONE is called from the threads as soon as
+     a copy is done but never for two copies at the same time.  With
+     MAX_THREADS of 1 everything runs in the calling thread.  Returns
+     the number of copies which failed.  */
+  int run (int max_threads, const done_t &done);
+
+private:
+  class Private;
+  std::shared_ptr<Private> d;
+};
+
+#endif
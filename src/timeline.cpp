@@ -0,0 +1,276 @@
+/* @file timeline.cpp
+ * @brief Per mail timeline of the read and send paths
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "common_indep.h"
+#include "timeline.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <sstream>
+
+/* Events kept per mail.  A mail which is opened again overwrites its
+   oldest events.  */
+#define TIMELINE_EVENTS 256
+
+/* Number of finished timelines kept for the dump.  */
+#define TIMELINE_ARCHIVE 64
+
+static const char *point_names[TL_N_POINTS] = {
+  "stream open",
+  "parser_lock wait",
+  "ParseController::parse",
+  "decrypt",
+  "verify",
+  "parsingDone",
+  "update body",
+  "charset conversion",
+  "invalidate UI",
+  "resolve keys",
+  "CryptController::do_crypto"
+};
+
+static std::deque<std::shared_ptr<Timeline> > archive;
+GPGRT_LOCK_DEFINE (archive_lock);
+
+static uint64_t
+now_ns ()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+    (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* Timestamps in the trace are relative to the first timeline.  */
+static const uint64_t epoch_ns = now_ns ();
+
+const char *
+timeline_point_name (timeline_point_t point)
+{
+  return point < TL_N_POINTS ? point_names[point] : "unknown";
+}
+
+Timeline::Timeline (const std::string &label) :
+  m_label (label),
+  m_count (0)
+{
+  gpgrt_lock_init (&m_lock);
+}
+
+Timeline::~Timeline ()
+{
+  gpgrt_lock_destroy (&m_lock);
+}
+
+void
+Timeline::add (timeline_point_t point, char phase)
+{
+  if (!(opt.enable_debug & DBG_LATENCY))
+    {
+      return;
+    }
+
+  event_s ev;
+  ev.ns = now_ns ();
+  ev.tid = log_thread_id ();
+  ev.point = point;
+  ev.phase = phase;
+
+  gpgrt_lock_lock (&m_lock);
+  if (m_events.size () < TIMELINE_EVENTS)
+    {
+      m_events.push_back (ev);
+    }
+  else
+    {
+      m_events[m_count % TIMELINE_EVENTS] = ev;
+    }
+  m_count++;
+  gpgrt_lock_unlock (&m_lock);
+}
+
+void
+Timeline::begin (timeline_point_t point)
+{
+  add (point, 'B');
+}
+
+void
+Timeline::end (timeline_point_t point)
+{
+  add (point, 'E');
+}
+
+void
+Timeline::mark (timeline_point_t point)
+{
+  add (point, 'i');
+}
+
+uint64_t
+Timeline::count () const
+{
+  gpgrt_lock_lock (&m_lock);
+  const uint64_t ret = m_count;
+  gpgrt_lock_unlock (&m_lock);
+  return ret;
+}
+
+std::string
+Timeline::toJson (int pid) const
+{
+  std::ostringstream ss;
+  std::map<std::pair<unsigned long, int>, int> open;
+  char buf[64];
+
+  ss << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+     << ",\"args\":{\"name\":\"";
+  for (const char c: m_label)
+    {
+      if (c == '"' || c == '\\')
+        {
+          ss << '\\';
+        }
+      if ((unsigned char) c >= 0x20)
+        {
+          ss << c;
+        }
+    }
+  ss << "\"}}";
+
+  gpgrt_lock_lock (&m_lock);
+  const size_t n = m_events.size ();
+  const size_t first = m_count > n ? m_count % n : 0;
+  for (size_t i = 0; i < n; i++)
+    {
+      const event_s &ev = m_events[(first + i) % n];
+      const auto key = std::make_pair (ev.tid, (int) ev.point);
+
+      /* Skip ends whose begin was overwritten.  */
+      if (ev.phase == 'B')
+        {
+          open[key]++;
+        }
+      else if (ev.phase == 'E')
+        {
+          if (!open[key])
+            {
+              continue;
+            }
+          open[key]--;
+        }
+      snprintf (buf, sizeof buf, "%.3f", (ev.ns - epoch_ns) / 1000.0);
+      ss << ",{\"name\":\"" << point_names[ev.point]
+         << "\",\"cat\":\"gpgol\",\"ph\":\"" << ev.phase
+         << "\",\"ts\":" << buf << ",\"pid\":" << pid
+         << ",\"tid\":" << ev.tid;
+      if (ev.phase == 'i')
+        {
+          ss << ",\"s\":\"t\"";
+        }
+      ss << "}";
+    }
+  gpgrt_lock_unlock (&m_lock);
+  return ss.str ();
+}
+
+TimelineScope::TimelineScope (const std::shared_ptr<Timeline> &timeline,
+                              timeline_point_t point) :
+  m_point (point)
+{
+  if (timeline && (opt.enable_debug & DBG_LATENCY))
+    {
+      m_timeline = timeline;
+      m_timeline->begin (m_point);
+    }
+}
+
+TimelineScope::~TimelineScope ()
+{
+  if (m_timeline)
+    {
+      m_timeline->end (m_point);
+    }
+}
+
+void
+timeline_finish (const std::shared_ptr<Timeline> &timeline)
+{
+  if (!timeline || !timeline->count ())
+    {
+      return;
+    }
+  gpgrt_lock_lock (&archive_lock);
+  archive.push_back (timeline);
+  if (archive.size () > TIMELINE_ARCHIVE)
+    {
+      archive.pop_front ();
+    }
+  gpgrt_lock_unlock (&archive_lock);
+}
+
+std::string
+timeline_report ()
+{
+  std::ostringstream ss;
+  int pid = 1;
+
+  ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  gpgrt_lock_lock (&archive_lock);
+  for (const auto &timeline: archive)
+    {
+      ss << (pid > 1 ? ",\n" : "\n") << timeline->toJson (pid);
+      pid++;
+    }
+  gpgrt_lock_unlock (&archive_lock);
+  ss << "\n]}\n";
+  return ss.str ();
+}
+
+void
+timeline_dump ()
+{
+  if (!(opt.enable_debug & DBG_LATENCY))
+    {
+      return;
+    }
+
+  const std::string logfile = get_log_file ();
+  if (logfile.empty () || logfile == "stdout" || logfile == "stderr")
+    {
+      return;
+    }
+  const std::string name = logfile + ".timeline.json";
+  FILE *fp = fopen (name.c_str (), "w");
+  if (!fp)
+    {
+      log_error ("%s:%s: Failed to open '%s'", SRCNAME, __func__,
+                 name.c_str ());
+      return;
+    }
+  fputs (timeline_report ().c_str (), fp);
+  fclose (fp);
+  log_debug ("%s:%s: Wrote mail timelines to '%s'", SRCNAME, __func__,
+             name.c_str ());
+}
@@ -0,0 +1,123 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+/* @file timeline.h
+ * @brief Per mail timeline of the read and send paths
+ *
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gpg-error.h>
+
+/* A timeline records when a mail passed fixed points so that a slow
+   mail can be broken down into stream reads, lock waits, crypto,
+   charset conversion and UI updates.  Like the latency histograms it
+   only records with the "latency" debug flag (DBG_LATENCY).  The
+   timelines of finished mails are written as Chrome trace event
+   JSON which can be loaded in chrome://tracing or Perfetto.  */
+
+typedef enum
+{
+  TL_STREAM_OPEN = 0,
+  TL_PARSER_LOCK,
+  TL_PARSE,
+  TL_DECRYPT,
+  TL_VERIFY,
+  TL_PARSING_DONE,
+  TL_UPDATE_BODY,
+  TL_CHARSET,
+  TL_INVALIDATE_UI,
+  TL_RESOLVE_KEYS,
+  TL_CRYPTO,
+  TL_N_POINTS
+} timeline_point_t;
+
+/** @brief Name of POINT as shown in the trace. */
+const char *timeline_point_name (timeline_point_t point);
+
+class Timeline
+{
+public:
+  /** @brief A timeline shown as LABEL.  It must not contain private
+    * data.  */
+  explicit Timeline (const std::string &label);
+  ~Timeline ();
+
+  /* Record the begin or end of a span or a single point in time on
+     the calling thread.  */
+  void begin (timeline_point_t point);
+  void end (timeline_point_t point);
+  void mark (timeline_point_t point);
+
+  /** @brief Number of events recorded including overwritten ones. */
+  uint64_t count () const;
+
+  /** @brief The events of this timeline as a comma separated list of
+    * Chrome trace events with the process id PID.  */
+  std::string toJson (int pid) const;
+
+  const std::string &label () const { return m_label; }
+
+private:
+  struct event_s
+  {
+    uint64_t ns;
+    unsigned long tid;
+    timeline_point_t point;
+    char phase;
+  };
+
+  void add (timeline_point_t point, char phase);
+
+  std::string m_label;
+  std::vector<event_s> m_events;
+  uint64_t m_count;
+  mutable gpgrt_lock_t m_lock = GPGRT_LOCK_INITIALIZER;
+};
+
+/* Records the span POINT until it goes out of scope.  TIMELINE may be
+   NULL.  */
+class TimelineScope
+{
+public:
+  TimelineScope (const std::shared_ptr<Timeline> &timeline,
+                 timeline_point_t point);
+  ~TimelineScope ();
+
+private:
+  std::shared_ptr<Timeline> m_timeline;
+  timeline_point_t m_point;
+};
+
+/** @brief Keep TIMELINE for the next timeline_dump.  Only the last
+  * timelines are kept.  */
+void timeline_finish (const std::shared_ptr<Timeline> &timeline);
+
+/** @brief Chrome trace JSON of the finished timelines. */
+std::string timeline_report ();
+
+/** @brief Write the finished timelines to LOGFILE.timeline.json.
+  * Does nothing without DBG_LATENCY.  */
+void timeline_dump ();
+
+#endif // TIMELINE_H
@@ -73,9 +73,9 @@ char *native_to_utf8 (const char *string);
 
 #define utf8_to_wchar(VAR1) ({wchar_t *retval; \
   retval = _utf8_to_wchar (VAR1); \
-  if ((opt.enable_debug & DBG_TRACE) && \
-      (opt.enable_debug & DBG_DATA) && \
-      (opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_TRACE) && \
+      debug_enabled (DBG_DATA) && \
+      debug_enabled (DBG_MEMORY)) \
   { \
     log_debug ("%s:%s:%i wchar_t alloc %p:%S", \
                SRCNAME, __func__, __LINE__, retval, retval); \
@@ -84,9 +84,9 @@ retval;})
 
 #define wchar_to_utf8(VAR1) ({char *retval; \
   retval = _wchar_to_utf8 (VAR1); \
-  if ((opt.enable_debug & DBG_TRACE) && \
-      (opt.enable_debug & DBG_DATA) && \
-      (opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_TRACE) && \
+      debug_enabled (DBG_DATA) && \
+      debug_enabled (DBG_MEMORY)) \
   { \
     log_debug ("%s:%s:%i char utf8 alloc %p:%s", \
                SRCNAME, __func__, __LINE__, retval, retval); \
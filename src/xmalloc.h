@@ -30,17 +30,17 @@ extern "C" {
 /*-- common.c --*/
 #define xmalloc(VAR1) ({void *retval; \
   retval = _xmalloc(VAR1); \
-  if ((opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_MEMORY)) \
   { \
     memdbg_alloc (retval); \
-    if ((opt.enable_debug & DBG_TRACE)) \
+    if (debug_enabled (DBG_TRACE)) \
       memset (retval, 'X', VAR1); \
   } \
 retval;})
 
 #define xcalloc(VAR1, VAR2) ({void *retval; \
   retval = _xcalloc(VAR1, VAR2); \
-  if ((opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_MEMORY)) \
   { \
     memdbg_alloc (retval);\
   } \
@@ -48,7 +48,7 @@ retval;})
 
 #define xrealloc(VAR1, VAR2) ({void *retval; \
   retval = _xrealloc (VAR1, VAR2); \
-  if ((opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_MEMORY)) \
   { \
     memdbg_alloc (retval);\
     memdbg_free ((void*)VAR1); \
@@ -57,7 +57,7 @@ retval;})
 
 #define xfree(VAR1) \
 { \
-  if (VAR1 && (opt.enable_debug & DBG_MEMORY) && !memdbg_free (VAR1)) \
+  if (VAR1 && debug_enabled (DBG_MEMORY) && !memdbg_free (VAR1)) \
     log_debug ("%s:%s:%i %p freed here", \
                log_srcname (__FILE__), __func__, __LINE__, VAR1); \
   _xfree (VAR1); \
@@ -65,7 +65,7 @@ retval;})
 
 #define xstrdup(VAR1) ({char *retval; \
   retval = _xstrdup (VAR1); \
-  if ((opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_MEMORY)) \
   { \
     memdbg_alloc ((void *)retval);\
   } \
@@ -73,7 +73,7 @@ retval;})
 
 #define xwcsdup(VAR1) ({wchar_t *retval; \
   retval = _xwcsdup (VAR1); \
-  if ((opt.enable_debug & DBG_MEMORY)) \
+  if (debug_enabled (DBG_MEMORY)) \
   { \
     memdbg_alloc ((void *)retval);\
   } \
@@ -0,0 +1,85 @@
+/* fuzz-b64.cpp - Fuzz target for the base64 codec.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The input is decoded in one piece and in lines with the state
+   carried over like the MIME parser does; both must agree.  The input
+   is also encoded with b64_encode and must decode to the original
+   again.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "common_indep.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-b64: %s\n", what);
+      abort ();
+    }
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  b64_state_t state;
+  std::string whole ((const char *) data, size);
+  std::string lines;
+
+  b64_init (&state);
+  whole.resize (b64_decode (&state, &whole[0], whole.size ()));
+  const b64_state_t whole_state = state;
+
+  b64_init (&state);
+  const char *s = (const char *) data;
+  const char *end = s + size;
+  while (s < end)
+    {
+      const char *eol = (const char *) memchr (s, '\n', end - s);
+      std::string line (s, eol ? eol + 1 : end);
+
+      line.resize (b64_decode (&state, &line[0], line.size ()));
+      lines += line;
+      s = eol ? eol + 1 : end;
+    }
+  check (whole == lines, "Decoding in lines differs");
+  check (whole_state.stop_seen == state.stop_seen
+         && whole_state.invalid_encoding == state.invalid_encoding,
+         "Decoder state differs");
+
+  char *encoded = b64_encode ((const char *) data, size);
+  if (encoded)
+    {
+      const size_t enclen = 4 * ((size + 2) / 3);
+      check (strlen (encoded) == enclen, "Encoding is not terminated");
+      b64_init (&state);
+      const size_t len = b64_decode (&state, encoded, enclen);
+      check (!state.invalid_encoding, "Encoder produced invalid base64");
+      check (len == size && !memcmp (encoded, data, size),
+             "Round trip failed");
+      xfree (encoded);
+    }
+  return 0;
+}
@@ -0,0 +1,173 @@
+/* fuzz-main.cpp - Run a fuzz target without libFuzzer.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Without --enable-fuzzing the fuzz targets are linked with this
+   driver.  Given files or directories it runs each file once, which
+   is handy to reproduce a crash found by libFuzzer.  Without
+   arguments it runs all files in the test data directory and a fixed
+   number of mutations of each, so that "make check" exercises the
+   targets and their differential checks.  "--mutations N" sets the
+   number of mutations per file.  */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+/* Mutations per seed file.  */
+#define MUTATIONS 64
+
+static bool
+read_file (const std::string &name, std::vector<uint8_t> *r_data)
+{
+  FILE *fp = fopen (name.c_str (), "rb");
+  uint8_t buf[4096];
+  size_t n;
+
+  if (!fp)
+    {
+      fprintf (stderr, "Failed to open '%s'\n", name.c_str ());
+      return false;
+    }
+  r_data->clear ();
+  while ((n = fread (buf, 1, sizeof buf, fp)))
+    r_data->insert (r_data->end (), buf, buf + n);
+  fclose (fp);
+  return true;
+}
+
+/* The regular files NAME or the regular files in the directory NAME
+   are added to FILES.  */
+static void
+collect_files (const std::string &name, std::vector<std::string> *files)
+{
+  struct stat st;
+  DIR *dir;
+  struct dirent *ent;
+
+  if (stat (name.c_str (), &st))
+    {
+      fprintf (stderr, "Failed to stat '%s'\n", name.c_str ());
+      exit (1);
+    }
+  if (!S_ISDIR (st.st_mode))
+    {
+      files->push_back (name);
+      return;
+    }
+  if (!(dir = opendir (name.c_str ())))
+    {
+      fprintf (stderr, "Failed to open '%s'\n", name.c_str ());
+      exit (1);
+    }
+  while ((ent = readdir (dir)))
+    {
+      const std::string path = name + "/" + ent->d_name;
+      if (ent->d_name[0] != '.' && !stat (path.c_str (), &st)
+          && S_ISREG (st.st_mode))
+        files->push_back (path);
+    }
+  closedir (dir);
+}
+
+/* Flip, insert or remove a few bytes or cut the input, like the
+   simplest mutations of libFuzzer.  */
+static void
+mutate (std::vector<uint8_t> *data, unsigned int *seed)
+{
+  static const char interesting[] = "=?\r\n-:;\"\\ \t\x80\xff";
+
+  for (int n = rand_r (seed) % 8; n >= 0; n--)
+    {
+      const size_t len = data->size ();
+      const size_t pos = len ? rand_r (seed) % len : 0;
+      const uint8_t c = rand_r (seed) & 1
+        ? interesting[rand_r (seed) % (sizeof interesting - 1)]
+        : rand_r (seed) & 0xff;
+
+      switch (rand_r (seed) % 4)
+        {
+        case 0:
+          if (len)
+            (*data)[pos] = c;
+          break;
+        case 1:
+          data->insert (data->begin () + pos, c);
+          break;
+        case 2:
+          if (len)
+            data->erase (data->begin () + pos);
+          break;
+        case 3:
+          data->resize (pos);
+          break;
+        }
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  std::vector<std::string> files;
+  std::vector<uint8_t> data;
+  unsigned int runs = 0;
+  int mutations = -1;
+  int i = 1;
+
+  if (argc > 2 && !strcmp (argv[1], "--mutations"))
+    {
+      mutations = atoi (argv[2]);
+      i += 2;
+    }
+  for (; i < argc; i++)
+    collect_files (argv[i], &files);
+  if (files.empty ())
+    {
+      collect_files (DATADIR, &files);
+      if (mutations < 0)
+        mutations = MUTATIONS;
+    }
+
+  for (const auto &name: files)
+    {
+      unsigned int seed = runs;
+
+      if (!read_file (name, &data))
+        exit (1);
+      LLVMFuzzerTestOneInput (data.data (), data.size ());
+      runs++;
+      for (int n = 0; n < mutations; n++)
+        {
+          std::vector<uint8_t> mutated (data);
+          mutate (&mutated, &seed);
+          LLVMFuzzerTestOneInput (mutated.data (), mutated.size ());
+          runs++;
+        }
+    }
+  fprintf (stderr, "%s: %u inputs from %u files\n", argv[0], runs,
+           (unsigned int) files.size ());
+  return 0;
+}
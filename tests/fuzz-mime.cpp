@@ -0,0 +1,123 @@
+/* fuzz-mime.cpp - Fuzz target for the MIME data provider.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The input is parsed as a mail to decrypt or verify, like by the
+   input provider of the ParseController, and as decrypted output,
+   each with and without headers.  The output is written once in one
+   piece and once in chunks of varying size, like gpgme does, and both
+   must give the same result.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_indep.h"
+#include "mimedataprovider.h"
+#include "attachment.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-mime: %s\n", what);
+      abort ();
+    }
+}
+
+static void
+parse_input (const uint8_t *data, size_t size, bool no_headers)
+{
+  FILE *fp = fmemopen ((void *) data, size, "rb");
+  char buf[4096];
+
+  if (!fp)
+    return;
+  MimeDataProvider provider (fp, no_headers);
+  fclose (fp);
+  /* Read the crypto data the way gpgme does.  */
+  while (provider.read (buf, sizeof buf) > 0)
+    ;
+  if (provider.signature ())
+    {
+      provider.signature ()->seek (0, SEEK_SET);
+      while (provider.signature ()->read (buf, sizeof buf) > 0)
+        ;
+    }
+}
+
+static std::string
+describe (MimeDataProvider &provider)
+{
+  std::string ret;
+
+  provider.finalize ();
+  ret = provider.get_body () + '\0' + provider.get_html_body () + '\0'
+        + provider.get_body_charset () + '\0'
+        + provider.get_html_charset () + '\0'
+        + provider.get_content_type () + '\0'
+        + provider.get_protected_header ("Subject") + '\0';
+  for (const auto &attach: provider.get_attachments ())
+    {
+      ret += attach->get_display_name () + '\0'
+             + attach->get_content_type () + '\0'
+             + attach->get_content_id () + '\0'
+             + attach->get_data ().toString () + '\0';
+    }
+  return ret;
+}
+
+/* Parse as output of the crypto operation.  Returns the result as
+   one string for comparison.  CHUNKED selects whether DATA is written
+   in pieces.  */
+static std::string
+parse_output (const uint8_t *data, size_t size, bool no_headers,
+              bool chunked)
+{
+  MimeDataProvider provider (no_headers);
+  unsigned int seed = (unsigned int) size;
+
+  for (size_t pos = 0; pos < size;)
+    {
+      size_t n = size - pos;
+      if (chunked)
+        {
+          seed = seed * 1103515245 + 12345;
+          if (n > 1 + (seed >> 16) % 1024)
+            n = 1 + (seed >> 16) % 1024;
+        }
+      provider.write (data + pos, n);
+      pos += n;
+    }
+  return describe (provider);
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  for (int no_headers = 0; no_headers < 2; no_headers++)
+    {
+      parse_input (data, size, no_headers);
+      check (parse_output (data, size, no_headers, false)
+             == parse_output (data, size, no_headers, true),
+             "Chunked output differs from output written at once");
+    }
+  return 0;
+}
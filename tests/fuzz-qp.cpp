@@ -0,0 +1,75 @@
+/* fuzz-qp.cpp - Fuzz target for the quoted-printable codec.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each line of the input is decoded in place like the MIME parser
+   does.  The whole input is also encoded with qp_encode and must
+   decode to the original again.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "common_indep.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-qp: %s\n", what);
+      abort ();
+    }
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  const char *s = (const char *) data;
+  const char *end = s + size;
+
+  while (s < end)
+    {
+      const char *eol = (const char *) memchr (s, '\n', end - s);
+      std::string line (s, eol ? eol : end);
+      int slbrk;
+
+      const size_t len = qp_decode (&line[0], line.size (), &slbrk);
+      check (len <= line.size (), "Decoded line grew");
+      check (!slbrk || line.size (), "Soft line break in an empty line");
+      s = eol ? eol + 1 : end;
+    }
+
+  size_t enclen;
+  char *encoded = qp_encode ((const char *) data, size, &enclen);
+  if (encoded)
+    {
+      std::string expected ((const char *) data, size);
+      for (auto &c: expected)
+        if (c == ' ')
+          c = '_';
+      check (enclen == strlen (encoded), "Wrong encoded length");
+      const size_t len = qp_decode (encoded, enclen, NULL);
+      check (expected == std::string (encoded, len), "Round trip failed");
+      xfree (encoded);
+    }
+  return 0;
+}
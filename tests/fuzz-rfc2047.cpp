@@ -0,0 +1,83 @@
+/* fuzz-rfc2047.cpp - Fuzz target for the rfc2047 decoder.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each line of the input is decoded twice, the second time with the
+   converted words from the cache, and into caller buffers of
+   several sizes.  All results must agree.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "common_indep.h"
+#include "rfc2047parse.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-rfc2047: %s\n", what);
+      abort ();
+    }
+}
+
+static void
+decode (const std::string &input)
+{
+  char small[16];
+  char *first = rfc2047_parse (input.c_str ());
+  char *second = rfc2047_parse (input.c_str ());
+
+  check (first && second, "Decoding failed");
+  check (!strcmp (first, second), "Cached result differs");
+
+  const size_t len = rfc2047_parse_buf (input.c_str (), small, sizeof small);
+  check (strlen (small) < sizeof small
+         && !strncmp (first, small, strlen (small)),
+         "Truncated result differs");
+
+  std::string buf (len + 1, 'X');
+  check (rfc2047_parse_buf (input.c_str (), &buf[0], buf.size ()) == len,
+         "Result length differs");
+  check (!strcmp (first, buf.c_str ()), "Buffer result differs");
+  xfree (first);
+  xfree (second);
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  const char *s = (const char *) data;
+  const char *end = s + size;
+
+  /* Header lines do not contain Nul or LF.  */
+  while (s < end)
+    {
+      const char *eol = s;
+      while (eol < end && *eol && *eol != '\n')
+        eol++;
+      decode (std::string (s, eol));
+      s = eol + 1;
+    }
+  return 0;
+}
@@ -0,0 +1,114 @@
+/* fuzz-rfc822.cpp - Fuzz target for the rfc822 parser.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The input is split into lines like collect_input_lines does and
+   each header is queried the way the MIME parser does it.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_indep.h"
+#include "rfc822parse.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-rfc822: %s\n", what);
+      abort ();
+    }
+}
+
+static void
+query_field (rfc822parse_t msg, const char *name, const char **params)
+{
+  rfc822parse_field_t field = rfc822parse_parse_field (msg, name, -1);
+  const char *subtype = NULL;
+
+  if (!field)
+    return;
+  const char *type = rfc822parse_query_media_type (field, &subtype);
+  check (!type || subtype, "Media type without subtype");
+  for (; *params; params++)
+    {
+      const char *value = rfc822parse_query_parameter (field, *params, 0);
+      const char *lower = rfc822parse_query_parameter (field, *params, 1);
+      check (!value == !lower
+             && (!value || strlen (value) == strlen (lower)),
+             "Parameter lookups differ");
+    }
+  rfc822parse_release_field (field);
+}
+
+static int
+message_cb (void *opaque, rfc822parse_event_t event, rfc822parse_t msg)
+{
+  static const char *ct_params[] = {"boundary", "charset", "protocol",
+                                    "micalg", "name", "protected-headers",
+                                    NULL};
+  static const char *cd_params[] = {"filename", NULL};
+  (void) opaque;
+
+  if (event == RFC822PARSE_T2BODY)
+    {
+      size_t off;
+      char *value;
+      void *ctx = NULL;
+      const char *line;
+
+      query_field (msg, "Content-Type", ct_params);
+      query_field (msg, "Content-Disposition", cd_params);
+      for (int i = 0; (value = rfc822parse_get_field (msg, "Content-*", i,
+                                                      &off)); i++)
+        {
+          check (off <= strlen (value), "Value offset out of range");
+          xfree (value);
+        }
+      while ((line = rfc822parse_enum_header_lines (msg, &ctx)))
+        ;
+      rfc822parse_enum_header_lines (NULL, &ctx);
+    }
+  return 0;
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  rfc822parse_t msg = rfc822parse_open (message_cb, NULL);
+  const uint8_t *line = data;
+
+  check (msg != NULL, "Failed to open the parser");
+  for (size_t i = 0; i < size; i++)
+    {
+      if (data[i] != '\n')
+        continue;
+      size_t len = data + i - line;
+      if (len && line[len - 1] == '\r')
+        len--;
+      if (rfc822parse_insert (msg, line, len))
+        break;
+      line = data + i + 1;
+    }
+  rfc822parse_finish (msg);
+  rfc822parse_close (msg);
+  return 0;
+}
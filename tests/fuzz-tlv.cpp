@@ -0,0 +1,81 @@
+/* fuzz-tlv.cpp - Fuzz target for the BER parser.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The input is walked as a tree of BER objects.  After each object
+   parse_tlv must have consumed exactly its header.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parsetlv.h"
+
+/* Deeper nesting is not found in mails.  */
+#define MAX_DEPTH 32
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-tlv: %s\n", what);
+      abort ();
+    }
+}
+
+static void
+walk (const char *buffer, size_t size, int depth)
+{
+  tlvinfo_t ti;
+
+  while (size)
+    {
+      const char *p = buffer;
+      size_t n = size;
+
+      if (parse_tlv (&p, &n, &ti))
+        {
+          check (p == buffer && n == size, "Buffer changed on error");
+          return;
+        }
+      check (ti.nhdr && p == buffer + ti.nhdr && n == size - ti.nhdr,
+             "Header length mismatch");
+      if (ti.is_ndef)
+        {
+          /* The end is only known from the end-of-contents octets;
+             just continue with the contents.  */
+          buffer = p;
+          size = n;
+          continue;
+        }
+      if (ti.length > n)
+        return;
+      if (ti.is_cons && depth < MAX_DEPTH)
+        walk (p, ti.length, depth + 1);
+      buffer = p + ti.length;
+      size = n - ti.length;
+    }
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  walk ((const char *) data, size, 0);
+  return 0;
+}
@@ -0,0 +1,99 @@
+/* fuzz-utf8.cpp - Fuzz target for the UTF-8 validator.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* utf8_valid_p checks runs of ASCII with SSE2.  It is compared at
+   each alignment against a plain decoder of the UTF-8 definition.  */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common_indep.h"
+
+static void
+check (bool cond, const char *what)
+{
+  if (!cond)
+    {
+      fprintf (stderr, "fuzz-utf8: %s\n", what);
+      abort ();
+    }
+}
+
+/* Decode each sequence and check the code point against the range
+   of its length, the surrogates and the maximum.  */
+static bool
+reference_valid (const uint8_t *s, size_t len)
+{
+  size_t i = 0;
+
+  while (i < len)
+    {
+      const uint8_t c = s[i];
+      uint32_t cp;
+      int n;
+
+      if (c < 0x80)
+        {
+          i++;
+          continue;
+        }
+      else if ((c & 0xe0) == 0xc0)
+        {
+          n = 1;
+          cp = c & 0x1f;
+        }
+      else if ((c & 0xf0) == 0xe0)
+        {
+          n = 2;
+          cp = c & 0x0f;
+        }
+      else if ((c & 0xf8) == 0xf0)
+        {
+          n = 3;
+          cp = c & 0x07;
+        }
+      else
+        return false;
+      if (len - i <= (size_t) n)
+        return false;
+      for (int k = 1; k <= n; k++)
+        {
+          if ((s[i + k] & 0xc0) != 0x80)
+            return false;
+          cp = (cp << 6) | (s[i + k] & 0x3f);
+        }
+      if ((n == 1 && cp < 0x80) || (n == 2 && cp < 0x800)
+          || (n == 3 && cp < 0x10000) || cp > 0x10ffff
+          || (cp >= 0xd800 && cp <= 0xdfff))
+        return false;
+      i += n + 1;
+    }
+  return true;
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  for (size_t off = 0; off < 16 && off <= size; off++)
+    check (!utf8_valid_p (data + off, size - off)
+           == !reference_valid (data + off, size - off),
+           "Result differs from the reference");
+  return 0;
+}
@@ -22,6 +22,8 @@
 #include "parsecontroller.h"
 #include <iostream>
 #include "attachment.h"
+#include "latency.h"
+#include "alloc-count.h"
 #include <gpgme.h>
 
 static int
@@ -37,6 +39,9 @@ show_usage (int ex)
          "  --clear-signed        clearsigned\n"
          "  --pgp-message         inline pgp message\n"
          "  --repeat N            repeat N times\n"
+         "  --latency             print latency histograms at the end\n"
+         "  --latency-json        print them as JSON\n"
+         "  --allocs              print the allocations of each run\n"
          , stderr);
   exit (ex);
 }
@@ -47,6 +52,11 @@ int main(int argc, char **argv)
   msgtype_t msgtype = MSGTYPE_UNKNOWN;
   FILE *fp_in = NULL;
   int repeats = 1;
+  int latency = 0;
+  int allocs = 0;
+  alloc_profile_t profile;
+  uint64_t total_count = 0;
+  uint64_t total_bytes = 0;
 
   gpgme_check_version (NULL);
 
@@ -100,6 +110,23 @@ int main(int argc, char **argv)
           msgtype = MSGTYPE_GPGOL_PGP_MESSAGE;
           argc--; argv++;
         }
+      else if (!strcmp (*argv, "--latency"))
+        {
+          opt.enable_debug |= DBG_LATENCY;
+          latency = 1;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--latency-json"))
+        {
+          opt.enable_debug |= DBG_LATENCY;
+          latency = 2;
+          argc--; argv++;
+        }
+      else if (!strcmp (*argv, "--allocs"))
+        {
+          allocs = 1;
+          argc--; argv++;
+        }
       else if (!strcmp (*argv, "--repeat"))
         {
             argc--; argv++;
@@ -119,9 +146,19 @@ int main(int argc, char **argv)
 
       if (fp_in)
         {
+          if (allocs)
+            alloc_count_start (&profile);
           ParseController parser(fp_in, msgtype);
           parser.setSender("test@example.com");
           parser.parse(true);
+          if (allocs)
+            {
+              alloc_count_stop ();
+              total_count += alloc_profile_count (&profile, ALLOC_N_PHASES);
+              total_bytes += alloc_profile_bytes (&profile, ALLOC_N_PHASES);
+              std::cerr << "Allocations: " << alloc_profile_format (&profile)
+                        << std::endl;
+            }
           std::cout << "Parse error: " << parser.get_formatted_error ();
           std::cout << "\nDecrypt result:\n" << parser.decrypt_result()
             << "\nVerify result:\n" << parser.verify_result()
@@ -139,4 +176,10 @@ int main(int argc, char **argv)
         }
 
     }
+  if (latency)
+    std::cerr << std::endl << latency_report (latency == 2);
+  if (allocs && repeats > 0)
+    std::cerr << std::endl << "Allocations per run: "
+              << total_count / repeats << " ("
+              << total_bytes / repeats << " bytes)" << std::endl;
 }
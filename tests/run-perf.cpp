@@ -0,0 +1,847 @@
+/* run-perf.cpp - Microbenchmarks for the parser and the codecs.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each benchmark runs a fixed number of iterations a few times and
+   reports the throughput of the fastest round and the allocations
+   per iteration.  The throughput is also given relative to that of
+   a reference loop, which makes it mostly independent of the speed
+   of the machine.  With --baseline the results are compared to a
+   baseline file and the program fails if the relative throughput
+   dropped or the allocations grew by more than the given
+   tolerances.  This is what "make check-perf" does.  --write creates
+   a new baseline.
+
+   The baseline file has one benchmark per line with its name, the
+   relative throughput and the allocations per iteration.  Empty
+   lines and lines starting with '#' are ignored.  */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common_indep.h"
+#include "mimedataprovider.h"
+#include "mime-writer.h"
+#include "rfc2047parse.h"
+#include "charset-conv.h"
+#include "alloc-count.h"
+#include "resolution-cache.h"
+#include "draft-parts.h"
+#include "key-index.h"
+#include "t-support.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Rounds per benchmark.  The fastest one counts.  */
+#define ROUNDS 5
+
+/* Default tolerances in percent.  The allocations depend a little on
+   the C++ runtime.  */
+#define DEFAULT_TOLERANCE 25
+#define DEFAULT_ALLOC_TOLERANCE 10
+
+/* The least number of bytes the encoders pass to a sink per call.  */
+#define MIN_BYTES_PER_CALL 4096
+
+static std::vector<std::string> mails;
+static std::string large_mail;
+static std::string text;
+static std::string latin1_text;
+static std::string qp_text;
+static std::string b64_text;
+static std::string html_text;
+static std::string binary;
+static std::string body_ascii;
+static std::string body_utf8;
+static std::vector<std::string> headers;
+static std::vector<std::string> recipients;
+static std::vector<std::string> fingerprints;
+static KeyIndex key_index;
+
+static std::string
+read_file (const std::string &name)
+{
+  std::string ret;
+  FILE *fp = fopen (name.c_str (), "rb");
+  char buf[4096];
+  size_t n;
+
+  if (!fp)
+    fail ("Failed to open a test mail");
+  while ((n = fread (buf, 1, sizeof buf, fp)))
+    ret.append (buf, n);
+  fclose (fp);
+  return ret;
+}
+
+/* Wrap the base64 encoded DATA into lines of 76 characters.  */
+static std::string
+b64_lines (const std::string &data)
+{
+  char *enc = b64_encode (data.c_str (), data.size ());
+  std::string ret;
+
+  for (size_t i = 0, len = strlen (enc); i < len; i += 76)
+    {
+      ret.append (enc + i, std::min ((size_t) 76, len - i));
+      ret += "\r\n";
+    }
+  xfree (enc);
+  return ret;
+}
+
+/* Encode DATA as quoted-printable body with soft line breaks.
+   qp_encode is only meant for header words.  */
+static std::string
+qp_lines (const std::string &data)
+{
+  std::string ret;
+  size_t col = 0;
+
+  for (size_t i = 0; i < data.size (); i++)
+    {
+      const unsigned char c = data[i];
+      char tmp[4];
+
+      if (c == '\r' && i + 1 < data.size () && data[i + 1] == '\n')
+        {
+          ret += "\r\n";
+          col = 0;
+          i++;
+          continue;
+        }
+      if (col > 72)
+        {
+          ret += "=\r\n";
+          col = 0;
+        }
+      if (c < 0x20 || c > 0x7e || c == '=')
+        {
+          snprintf (tmp, sizeof tmp, "=%02X", c);
+          ret += tmp;
+          col += 3;
+        }
+      else
+        {
+          ret += c;
+          col++;
+        }
+    }
+  return ret;
+}
+
+/* Load the test mails and generate the inputs.  Everything is
+   deterministic so that the numbers of different builds can be
+   compared.  */
+static void
+prepare_inputs ()
+{
+  DIR *dir = opendir (DATADIR);
+  struct dirent *entry;
+  std::vector<std::string> names;
+
+  if (!dir)
+    fail ("Failed to open the data dir");
+  while ((entry = readdir (dir)))
+    if (strstr (entry->d_name, ".mbox"))
+      names.push_back (std::string (DATADIR "/") + entry->d_name);
+  closedir (dir);
+  std::sort (names.begin (), names.end ());
+  for (const auto &name: names)
+    mails.push_back (read_file (name));
+  if (mails.empty ())
+    fail ("No test mails found");
+
+  /* A mostly ASCII text with some umlauts and long lines as it is
+     typical for mails.  */
+  while (text.size () < 256 * 1024)
+    text += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+            "sed do eiusmod tempor incididunt ut labore et dolore magna "
+            "aliqua. Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac 10\r\n";
+  for (size_t i = 0; i < text.size (); i++)
+    {
+      const unsigned char c = text[i];
+      if (c == 0xc3)
+        latin1_text += (char) (0xc0 | (text[++i] & 0x3f));
+      else if (c == 0xe2)
+        {
+          latin1_text += '?';
+          i += 2;
+        }
+      else
+        latin1_text += c;
+    }
+
+  qp_text = qp_lines (latin1_text);
+  b64_text = b64_lines (text);
+  html_text = "<html><body><pre>\r\n" + text + "</pre></body></html>\r\n";
+  for (size_t i = 0; i < 256 * 1024; i++)
+    binary += (char) (i * 7 + i / 251);
+
+  /* Two 20 MB bodies, one which is sent as 7bit and one which needs
+     quoted-printable.  */
+  while (body_ascii.size () < 20 * 1024 * 1024)
+    body_ascii += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+                  "sed do eiusmod tempor incididunt ut labore.\r\n";
+  while (body_utf8.size () < 20 * 1024 * 1024)
+    body_utf8 += text;
+
+  /* A large distribution list whose keys were resolved before.  */
+  ResolutionCache::Resolution res;
+  for (int i = 0; i < 1000; i++)
+    {
+      recipients.push_back ("Team.Member" + std::to_string (i)
+                            + "@Example.org");
+      res.recipient_keys[ResolutionCache::normalize (recipients.back ())]
+        .push_back (GpgME::Key ());
+    }
+  ResolutionCache::instance ()->put
+    (ResolutionCache::makeId (recipients, "sender@example.org",
+                              GpgME::OpenPGP, RES_FLAG_ENCRYPT), res);
+
+  /* A key cache with a thousand keys of two subkeys each.  The
+     fingerprints list the primary and the subkey fingerprints of
+     each key followed by one which is not in the cache.  */
+  for (int i = 0; i < 1000; i++)
+    {
+      char fpr[4][41];
+      bool inserted;
+
+      for (int j = 0; j < 4; j++)
+        snprintf (fpr[j], sizeof fpr[j], "%08X%08X%08X%08X%08X",
+                  i, j, i * 2654435761u, j * 40503u, i ^ 0x5a5a5a5a);
+      for (int j = 1; j < 3; j++)
+        key_index.addSubkey (fpr[j], fpr[0]);
+      key_index.insert (fpr[0], GpgME::Key (), &inserted);
+      for (int j = 0; j < 4; j++)
+        fingerprints.push_back (fpr[j]);
+    }
+
+  headers.push_back ("Re: Meeting on Monday");
+  headers.push_back ("=?utf-8?q?Gr=C3=BC=C3=9Fe_aus_D=C3=BCsseldorf?=");
+  headers.push_back ("=?iso-8859-1?Q?Fw:_=C4nderung_der_Tagesordnung?=");
+  headers.push_back ("=?UTF-8?B?w4RuZGVydW5nIGRlciBUYWdlc29yZG51bmc=?= "
+                     "=?UTF-8?B?IGbDvHIgTW9udGFn?=");
+  headers.push_back ("\"M\xc3\xbcller, Erika\" <erika@example.org>");
+
+  /* A signed mail with a quoted-printable Latin-1 text, a base64
+     HTML alternative and a base64 attachment.  */
+  large_mail =
+    "Content-Type: multipart/mixed; boundary=\"=-outer\"\r\n"
+    "Subject: =?utf-8?q?Gr=C3=BC=C3=9Fe?=\r\n"
+    "\r\n"
+    "--=-outer\r\n"
+    "Content-Type: multipart/alternative; boundary=\"=-inner\"\r\n"
+    "\r\n"
+    "--=-inner\r\n"
+    "Content-Type: text/plain; charset=iso-8859-1\r\n"
+    "Content-Transfer-Encoding: quoted-printable\r\n"
+    "\r\n" + qp_text + "\r\n"
+    "--=-inner\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Content-Transfer-Encoding: base64\r\n"
+    "\r\n" + b64_text +
+    "--=-inner--\r\n"
+    "\r\n"
+    "--=-outer\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Disposition: attachment; filename=\"data.bin\"\r\n"
+    "Content-Transfer-Encoding: base64\r\n"
+    "\r\n" + b64_text +
+    "--=-outer--\r\n";
+}
+
+/* The benchmarks.  Each returns the number of input bytes it
+   processed.  */
+
+/* Read the mails like the input provider of the ParseController.  */
+static size_t
+bench_parser_input ()
+{
+  char buf[4096];
+  size_t total = 0;
+
+  for (const auto &mail: mails)
+    {
+      FILE *fp = fmemopen ((void *) mail.data (), mail.size (), "rb");
+      if (!fp)
+        fail ("fmemopen failed");
+      MimeDataProvider provider (fp);
+      fclose (fp);
+      while (provider.read (buf, sizeof buf) > 0)
+        ;
+      total += mail.size ();
+    }
+  return total;
+}
+
+/* Parse DATA as the decrypted output, written in blocks like gpgme
+   does.  Returns the size of the body.  */
+static size_t
+parse_output (const std::string &data)
+{
+  MimeDataProvider provider;
+
+  for (size_t pos = 0; pos < data.size (); pos += 4096)
+    provider.write (data.data () + pos,
+                    std::min ((size_t) 4096, data.size () - pos));
+  provider.finalize ();
+  return provider.get_body ().size ();
+}
+
+static size_t
+bench_parser_output ()
+{
+  size_t total = 0;
+
+  for (const auto &mail: mails)
+    {
+      parse_output (mail);
+      total += mail.size ();
+    }
+  return total;
+}
+
+static size_t
+bench_parser_large ()
+{
+  if (parse_output (large_mail) < latin1_text.size ())
+    fail ("The body is incomplete");
+  return large_mail.size ();
+}
+
+static size_t
+bench_qp_decode ()
+{
+  std::string buf (qp_text);
+  char *p = &buf[0];
+  char *end = p + buf.size ();
+
+  /* Line by line like the MIME parser.  */
+  while (p < end)
+    {
+      char *eol = (char *) memchr (p, '\n', end - p);
+      size_t len = eol ? eol - p : end - p;
+      int slbrk;
+      if (len && p[len - 1] == '\r')
+        len--;
+      qp_decode (p, len, &slbrk);
+      p += (eol ? eol - p + 1 : end - p);
+    }
+  return qp_text.size ();
+}
+
+static size_t
+bench_qp_encode ()
+{
+  size_t len;
+  char *enc = qp_encode (latin1_text.c_str (), latin1_text.size (), &len);
+
+  xfree (enc);
+  return latin1_text.size ();
+}
+
+static size_t
+bench_b64_decode ()
+{
+  std::string buf (b64_text);
+  b64_state_t state;
+
+  b64_init (&state);
+  b64_decode (&state, &buf[0], buf.size ());
+  return b64_text.size ();
+}
+
+static size_t
+bench_b64_encode ()
+{
+  char *enc = b64_encode (text.c_str (), text.size ());
+
+  xfree (enc);
+  return text.size ();
+}
+
+static size_t
+bench_rfc2047 ()
+{
+  size_t total = 0;
+
+  for (const auto &hdr: headers)
+    {
+      char *dec = rfc2047_parse (hdr.c_str ());
+      xfree (dec);
+      total += hdr.size ();
+    }
+  return total;
+}
+
+static size_t
+bench_charset_latin1 ()
+{
+  char *conv = charset_to_utf8 ("iso-8859-1", latin1_text.c_str (),
+                                latin1_text.size ());
+
+  xfree (conv);
+  return latin1_text.size ();
+}
+
+static size_t
+bench_charset_utf8 ()
+{
+  std::string body (text);
+
+  if (!charset_convert_to_utf8 ("utf-8", body))
+    fail ("UTF-8 conversion failed");
+  return text.size ();
+}
+
+static size_t
+bench_utf8_valid ()
+{
+  if (!utf8_valid_p (text.c_str (), text.size ()))
+    fail ("UTF-8 validation failed");
+  return text.size ();
+}
+
+static int
+bench_attach_open (mime_attach_t attach, source_t source)
+{
+  const std::string *data = static_cast<const std::string *>(attach->cb_data);
+
+  source_init_mem (source, data->data (), data->size ());
+  return 0;
+}
+
+static int
+discard_write (sink_t sink, const void *data, size_t datalen)
+{
+  (void) sink;
+  (void) data;
+  (void) datalen;
+  return 0;
+}
+
+/* Bytes copied by the batching sink and bytes written on the send
+   path.  */
+static unsigned long send_copied;
+static unsigned long send_written;
+
+/* Setup MAIL with an HTML alternative, an inline image and a text
+   attachment.  ATTACHMENTS must have room for two.  */
+static void
+init_send_mail (struct mime_attach_s *attachments, struct mime_mail_s *mail)
+{
+  memset (attachments, 0, 2 * sizeof *attachments);
+  attachments[0].filename = "image.png";
+  attachments[0].content_id = "image001.png@01DA0000.00000000";
+  attachments[0].cb_data = &binary;
+  attachments[1].filename = "notes.txt";
+  attachments[1].cb_data = &text;
+  for (int i = 0; i < 2; i++)
+    {
+      attachments[i].usable = 1;
+      attachments[i].openfnc = bench_attach_open;
+    }
+  memset (mail, 0, sizeof *mail);
+  mail->plain_body = text.c_str ();
+  mail->is_alternative = 1;
+  mail->html_body = html_text.c_str ();
+  mail->n_att_usable = 2;
+  mail->attachments = attachments;
+  mail->n_attachments = 2;
+}
+
+/* Build the MIME structure of the mail of init_send_mail like the
+   send path does before signing or encrypting.  The output goes
+   through the same chain of sinks as in collect_data.  */
+static size_t
+bench_send_path ()
+{
+  struct mime_attach_s attachments[2];
+  struct mime_mail_s mail;
+  struct sink_batch_s batch;
+  struct sink_s sinkmem, countmem, batchmem;
+
+  init_send_mail (attachments, &mail);
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.writefnc = discard_write;
+  sink_init_count (&countmem, &sinkmem);
+  sink_init_batch (&batchmem, &batch, &countmem);
+
+  if (write_mime_structure (&batchmem, &mail) || sink_flush (&batchmem))
+    fail ("Writing the MIME structure failed");
+  send_copied += batch.copied;
+  send_written += countmem.enc_counter;
+  return 2 * text.size () + html_text.size () + binary.size ();
+}
+
+/* Save the mail of init_send_mail as an unchanged draft: Each part
+   is built and hashed and its ciphertext is found in the cache, so
+   nothing needs to be encrypted.  */
+static size_t
+bench_draft_save ()
+{
+  struct mime_attach_s attachments[2];
+  struct mime_mail_s mail;
+  struct sink_s sinkmem;
+  auto cache = DraftPartCache::instance ();
+
+  init_send_mail (attachments, &mail);
+  for (int idx = 0; idx < count_mime_parts (&mail); idx++)
+    {
+      DraftPart part;
+
+      part.initSink (&sinkmem);
+      if (write_mime_part (&sinkmem, &mail, idx) || part.finish ())
+        fail ("Writing the MIME part failed");
+      const auto id = DraftPartCache::makeId
+        (part.hash (), "draft", GpgME::OpenPGP,
+         { "1BA323932B3FAA826132C79E8D9860C58F246DE6" }, false);
+      if (!cache->get (id))
+        cache->put (id, std::make_shared<const std::string>
+                          (part.data ().toString ()));
+    }
+  return 2 * text.size () + html_text.size () + binary.size ();
+}
+
+/* Calls of the sink's write function and the bytes written by
+   bench_sink_calls.  */
+static unsigned long sink_calls;
+static unsigned long sink_bytes;
+
+static int
+calls_write (sink_t sink, const void *data, size_t datalen)
+{
+  (void) sink;
+  if (data)
+    {
+      sink_calls++;
+      sink_bytes += datalen;
+    }
+  return 0;
+}
+
+/* Write the 20 MB bodies to a sink which counts the calls of its
+   write function.  Without a batching sink in front this is what
+   the line encoders hand to gpgme.  */
+static size_t
+bench_sink_calls ()
+{
+  struct sink_s sinkmem;
+
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.writefnc = calls_write;
+  if (write_part_mem (&sinkmem, body_ascii.data (), body_ascii.size (),
+                      NULL, NULL, 1, NULL, NULL)
+      || write_part_mem (&sinkmem, body_utf8.data (), body_utf8.size (),
+                         NULL, NULL, 1, NULL, NULL))
+    fail ("Writing the body failed");
+  return body_ascii.size () + body_utf8.size ();
+}
+
+/* Look up the keys of a large recipient list like resolve_keys
+   does for a repeated send.  */
+static size_t
+bench_resolve_memo ()
+{
+  size_t bytes = 0;
+
+  const auto res = ResolutionCache::instance ()->get
+    (ResolutionCache::makeId (recipients, "sender@example.org",
+                              GpgME::OpenPGP, RES_FLAG_ENCRYPT));
+  if (!res || res->recipient_keys.size () != recipients.size ())
+    fail ("Resolution not found");
+  for (const auto &recp: recipients)
+    bytes += recp.size ();
+  return bytes;
+}
+
+/* Look up keys by the fingerprints of signatures and overrides
+   like the KeyCache does.  */
+static size_t
+bench_key_cache ()
+{
+  size_t bytes = 0;
+
+  if (key_index.size () != 1000)
+    fail ("Keys not indexed");
+  for (const auto &fpr: fingerprints)
+    {
+      key_index.get (fpr.c_str ());
+      bytes += fpr.size ();
+    }
+  return bytes;
+}
+
+/* The reference for the throughput: a byte wise hash over the large
+   mail.  Like the inner loops of the parser and the codecs it
+   loads, compares and computes per byte, but it does not call into
+   the code under test.  */
+static volatile unsigned int reference_hash;
+
+static size_t
+bench_reference ()
+{
+  unsigned int hash = 2166136261u;
+
+  for (const unsigned char c: large_mail)
+    {
+      hash = (hash ^ c) * 16777619u;
+      if (c == '\n')
+        hash++;
+    }
+  reference_hash = hash;
+  return large_mail.size ();
+}
+
+struct benchmark
+{
+  const char *name;
+  unsigned int iterations;
+  size_t (*run) ();
+};
+
+static const struct benchmark reference = { "reference", 50,
+                                            bench_reference };
+
+/* The iteration counts are fixed so that the allocation numbers are
+   comparable.  Changing them requires a new baseline.  */
+static const struct benchmark benchmarks[] =
+{
+  { "parser-input", 500, bench_parser_input },
+  { "parser-output", 500, bench_parser_output },
+  { "parser-large", 50, bench_parser_large },
+  { "qp-decode", 200, bench_qp_decode },
+  { "qp-encode", 100, bench_qp_encode },
+  { "b64-decode", 200, bench_b64_decode },
+  { "b64-encode", 200, bench_b64_encode },
+  { "rfc2047", 50000, bench_rfc2047 },
+  { "charset-latin1", 200, bench_charset_latin1 },
+  { "charset-utf8", 200, bench_charset_utf8 },
+  { "utf8-valid", 500, bench_utf8_valid },
+  { "send-path", 50, bench_send_path },
+  { "sink-calls", 2, bench_sink_calls },
+  { "resolve-memo", 200, bench_resolve_memo },
+  { "key-cache", 200, bench_key_cache },
+  { "draft-save", 50, bench_draft_save },
+  { NULL, 0, NULL }
+};
+
+struct result
+{
+  double mbps;
+  double ratio;    /* Throughput relative to the reference loop.  */
+  double allocs;
+};
+
+static result
+run_benchmark (const struct benchmark *bench)
+{
+  result ret = { 0, 0, 0 };
+  alloc_profile_t profile;
+
+  /* Warm up caches and converter pools.  */
+  bench->run ();
+  for (int round = 0; round < ROUNDS; round++)
+    {
+      size_t bytes = 0;
+
+      alloc_count_start (&profile);
+      const auto start = bench_clock::now ();
+      for (unsigned int i = 0; i < bench->iterations; i++)
+        bytes += bench->run ();
+      const double secs = std::chrono::duration<double>
+        (bench_clock::now () - start).count ();
+      alloc_count_stop ();
+
+      ret.mbps = std::max (ret.mbps, bytes / secs / (1024 * 1024));
+      ret.allocs = (double) alloc_profile_count (&profile, ALLOC_N_PHASES)
+                   / bench->iterations;
+    }
+  return ret;
+}
+
+static std::map<std::string, result>
+read_baseline (const char *fname)
+{
+  std::map<std::string, result> ret;
+  FILE *fp = fopen (fname, "r");
+  char line[256], name[64];
+  result res;
+
+  if (!fp)
+    fail ("Failed to open the baseline");
+  while (fgets (line, sizeof line, fp))
+    {
+      if (*line == '#' || *line == '\n')
+        continue;
+      if (sscanf (line, "%63s %lf %lf", name, &res.ratio, &res.allocs) != 3)
+        fail ("Invalid line in the baseline");
+      ret[name] = res;
+    }
+  fclose (fp);
+  return ret;
+}
+
+static void
+write_baseline (const char *fname, const std::map<std::string, result> &res)
+{
+  FILE *fp = fopen (fname, "w");
+
+  if (!fp)
+    fail ("Failed to create the baseline");
+  fputs ("# Baseline for \"make check-perf\", written by run-perf --write.\n"
+         "# The throughput is relative to the reference loop.\n"
+         "# name           ratio  allocs/iteration\n", fp);
+  for (const struct benchmark *bench = benchmarks; bench->name; bench++)
+    {
+      const auto &r = res.at (bench->name);
+      fprintf (fp, "%-16s %8.3f %10.2f\n", bench->name, r.ratio, r.allocs);
+    }
+  if (fclose (fp))
+    fail ("Failed to write the baseline");
+}
+
+static void
+usage ()
+{
+  fputs ("usage: run-perf [options] [benchmarks]\n"
+         "Options:\n"
+         "  --baseline FILE         compare with the baseline in FILE\n"
+         "  --tolerance PCT         allowed drop of the relative throughput\n"
+         "  --alloc-tolerance PCT   allowed allocation increase\n"
+         "  --write FILE            write the results as baseline\n",
+         stderr);
+  exit (2);
+}
+
+int main (int argc, char **argv)
+{
+  const char *baseline_file = NULL;
+  const char *write_file = NULL;
+  double tolerance = DEFAULT_TOLERANCE;
+  double alloc_tolerance = DEFAULT_ALLOC_TOLERANCE;
+  std::vector<std::string> only;
+  std::map<std::string, result> baseline, results;
+  int failed = 0;
+
+  for (int i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "--baseline") && i + 1 < argc)
+        baseline_file = argv[++i];
+      else if (!strcmp (argv[i], "--tolerance") && i + 1 < argc)
+        tolerance = atof (argv[++i]);
+      else if (!strcmp (argv[i], "--alloc-tolerance") && i + 1 < argc)
+        alloc_tolerance = atof (argv[++i]);
+      else if (!strcmp (argv[i], "--write") && i + 1 < argc)
+        write_file = argv[++i];
+      else if (*argv[i] == '-')
+        usage ();
+      else
+        only.push_back (argv[i]);
+    }
+  if (write_file && !only.empty ())
+    fail ("A baseline needs all benchmarks");
+
+  if (baseline_file)
+    baseline = read_baseline (baseline_file);
+  prepare_inputs ();
+
+  const double ref_mbps = run_benchmark (&reference).mbps;
+  printf ("reference: %.1f MB/s\n", ref_mbps);
+  printf ("%-16s %8s %8s %10s %10s %10s\n", "benchmark", "MB/s", "ratio",
+          "allocs", "base ratio", "base alloc");
+  for (const struct benchmark *bench = benchmarks; bench->name; bench++)
+    {
+      if (!only.empty ()
+          && std::find (only.begin (), only.end (), bench->name)
+             == only.end ())
+        continue;
+
+      result res = run_benchmark (bench);
+      res.ratio = res.mbps / ref_mbps;
+      results[bench->name] = res;
+      printf ("%-16s %8.1f %8.3f %10.2f", bench->name, res.mbps, res.ratio,
+              res.allocs);
+
+      const auto it = baseline.find (bench->name);
+      if (!baseline_file)
+        ;
+      else if (it == baseline.end ())
+        printf ("  (no baseline)");
+      else
+        {
+          const result &base = it->second;
+          printf (" %10.3f %10.2f", base.ratio, base.allocs);
+          /* Allow for rounding of the allocation count in the
+             baseline.  */
+          if (res.ratio < base.ratio * (100 - tolerance) / 100)
+            {
+              printf ("  FAIL: throughput %+.0f%%",
+                      100 * res.ratio / base.ratio - 100);
+              failed++;
+            }
+          if (res.allocs > base.allocs * (100 + alloc_tolerance) / 100
+                           + 0.005)
+            {
+              printf ("  FAIL: allocations +%.2f",
+                      res.allocs - base.allocs);
+              failed++;
+            }
+        }
+      putchar ('\n');
+    }
+
+  if (send_written)
+    printf ("send-path: %.4f bytes copied per byte by the batching sink\n",
+            (double) send_copied / send_written);
+  if (sink_calls)
+    {
+      /* The line encoders collect their output in blocks of 8 KiB.
+         Small writes mean that lines are passed on one by one.  */
+      const double per_call = (double) sink_bytes / sink_calls;
+
+      printf ("sink-calls: %.0f bytes per write call\n", per_call);
+      if (per_call < MIN_BYTES_PER_CALL)
+        {
+          fprintf (stderr, "sink-calls: less than %d bytes per write call\n",
+                   MIN_BYTES_PER_CALL);
+          failed++;
+        }
+    }
+
+  if (write_file)
+    write_baseline (write_file, results);
+  if (failed)
+    {
+      fprintf (stderr, "%d performance regression%s; throughput "
+               "tolerance %.0f%%, allocation tolerance %.0f%%\n",
+               failed, failed == 1 ? "" : "s", tolerance, alloc_tolerance);
+      return 1;
+    }
+  return 0;
+}
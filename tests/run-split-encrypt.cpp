@@ -0,0 +1,169 @@
+/* run-split-encrypt.cpp - Benchmark the encryption of split copies.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Encrypts one MIME body separately for a number of copies as it is
+   done when BCC recipients get their own mail.  This is done once on
+   a single thread and once on several threads and the wall times are
+   compared.  All copies are encrypted to the key of the test
+   keyring.  With --share the parallel run shares one session key.  Unlike run-perf this depends on the engine and the
+   machine, so there is no baseline.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <gpgme.h>
+#include <gpgme++/context.h>
+#include <gpgme++/data.h>
+#include <gpgme++/key.h>
+
+#include "common_indep.h"
+#include "split-encrypt.h"
+#include "t-support.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* The "unittest key (no password)" of the test keyring.  */
+#define TEST_KEY "1BA323932B3FAA826132C79E8D9860C58F246DE6"
+
+/* A multipart/mixed with a text body and a base64 attachment of
+   about SIZE bytes.  */
+static std::string
+make_mime (size_t size)
+{
+  std::string ret;
+
+  ret = "Content-Type: multipart/mixed; boundary=\"=-=bench=-=\"\r\n"
+        "\r\n"
+        "--=-=bench=-=\r\n"
+        "Content-Type: text/plain; charset=utf-8\r\n"
+        "\r\n"
+        "Please find the report attached.\r\n"
+        "--=-=bench=-=\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Disposition: attachment; filename=\"report.bin\"\r\n"
+        "Content-Transfer-Encoding: base64\r\n"
+        "\r\n";
+  for (unsigned int i = 0; ret.size () < size; i++)
+    {
+      for (int j = 0; j < 76; j++)
+        ret += "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+               [(i * 31 + j * 7) % 64];
+      ret += "\r\n";
+    }
+  ret += "--=-=bench=-=--\r\n";
+  return ret;
+}
+
+/* Encrypt COPIES copies of PLAINTEXT to KEY on THREADS threads and
+   return the wall time in seconds.  */
+static double
+run (const std::string &plaintext, const GpgME::Key &key, int copies,
+     int threads, bool share)
+{
+  GpgME::Data data (plaintext.data (), plaintext.size (), false);
+  SplitEncrypter encrypter (GpgME::OpenPGP, data);
+  size_t bytes = 0;
+
+  encrypter.setShareSessionKey (share);
+
+  for (int i = 0; i < copies; i++)
+    encrypter.addCopy ({ key });
+  const auto start = bench_clock::now ();
+  if (encrypter.run (threads, [&bytes] (size_t, const GpgME::Error &,
+                                        SplitOutput &output)
+                       {
+                         bytes += output.head.size ();
+                         if (output.body)
+                           bytes += output.body->size ();
+                       }))
+    fail ("Encryption failed");
+  const double secs = std::chrono::duration<double>
+    (bench_clock::now () - start).count ();
+  if (bytes < plaintext.size () * copies)
+    fail ("Output is too short");
+  return secs;
+}
+
+static void
+usage ()
+{
+  fputs ("usage: run-split-encrypt [options]\n"
+         "Options:\n"
+         "  --copies N    number of copies (default 8)\n"
+         "  --threads N   threads for the parallel run (default 4)\n"
+         "  --size KB     size of the MIME body (default 256)\n"
+         "  --share       share the session key in the parallel run\n",
+         stderr);
+  exit (2);
+}
+
+int main (int argc, char **argv)
+{
+  int copies = 8;
+  int threads = 4;
+  size_t size = 256;
+  bool share = false;
+  GpgME::Error err;
+
+  for (int i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "--copies") && i + 1 < argc)
+        copies = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "--threads") && i + 1 < argc)
+        threads = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "--size") && i + 1 < argc)
+        size = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "--share"))
+        share = true;
+      else
+        usage ();
+    }
+  if (copies < 1 || threads < 1 || !size)
+    usage ();
+
+  putenv ((char*) "GNUPGHOME=" GPGHOMEDIR);
+  gpgme_check_version (NULL);
+
+  auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+  const auto key = ctx->key (TEST_KEY, err, false);
+  if (err || key.isNull ())
+    fail ("Test key not found");
+
+  const std::string plaintext = make_mime (size * 1024);
+
+  /* Start the engine and fill the caches.  */
+  run (plaintext, key, 1, 1, false);
+
+  const double sequential = run (plaintext, key, copies, 1, false);
+  const double parallel = run (plaintext, key, copies, threads, share);
+
+  printf ("%d copies of %lu KiB\n", copies, (unsigned long) size);
+  printf ("%-12s %8s %10s\n", "threads", "ms", "ms/copy");
+  printf ("%-12d %8.1f %10.1f\n", 1, sequential * 1000,
+          sequential * 1000 / copies);
+  printf ("%-12d %8.1f %10.1f%s\n", threads, parallel * 1000,
+          parallel * 1000 / copies, share ? " shared" : "");
+  printf ("speedup %.2f\n", sequential / parallel);
+  return 0;
+}
@@ -0,0 +1,199 @@
+/* t-anonstr.cpp - Test for gpgOL's anonymized log strings.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common_indep.h"
+#include "t-support.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Something like the fingerprints and addresses seen in the log.  */
+static std::vector<std::string>
+make_strings (int count)
+{
+  std::vector<std::string> ret;
+  char buf[64];
+
+  for (int i = 0; i < count; i++)
+    {
+      snprintf (buf, sizeof buf, "%08X%032X", i * 2654435761u, i);
+      ret.push_back (buf);
+      snprintf (buf, sizeof buf, "user%d@example.org", i);
+      ret.push_back (buf);
+    }
+  return ret;
+}
+
+/* Anonymize all STRINGS in a different order per thread.  */
+static void
+intern_thread (const std::vector<std::string> *strings, int offset,
+               std::vector<const char *> *result)
+{
+  const size_t n = strings->size ();
+
+  result->resize (n);
+  for (size_t i = 0; i < n; i++)
+    {
+      const size_t idx = (i + offset) % n;
+      (*result)[idx] = anonstr ((*strings)[idx].c_str ());
+    }
+}
+
+static void
+run_tests ()
+{
+  const int nthreads = 4;
+  const auto strings = make_strings (200);
+  std::vector<std::vector<const char *> > results (nthreads);
+  std::vector<std::thread> threads;
+
+  if (strcmp (anonstr (NULL), "gpgol_str_null")
+      || strcmp (anonstr (""), "gpgol_str_empty"))
+    fail ("Wrong special strings");
+
+  opt.enable_debug = DBG_DATA;
+  if (anonstr (strings[0].c_str ()) != strings[0].c_str ())
+    fail ("Data not passed through with DBG_DATA");
+  opt.enable_debug = 0;
+
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (intern_thread, &strings, i * 97,
+                                    &results[i]));
+  for (auto &t: threads)
+    t.join ();
+
+  std::set<std::string> seen;
+  for (size_t i = 0; i < strings.size (); i++)
+    {
+      const char *anon = results[0][i];
+      if (strncmp (anon, "gpgol_string_", 13) || strstr (anon, "overflow"))
+        fail ("Unexpected anonymized string");
+      for (int t = 1; t < nthreads; t++)
+        if (results[t][i] != anon)
+          fail ("Threads got different strings");
+      if (!seen.insert (anon).second)
+        fail ("Two strings anonymized the same");
+      /* A copy must give the same result.  */
+      if (anonstr (std::string (strings[i]).c_str ()) != anon)
+        fail ("Lookup of a copy failed");
+    }
+  pass ("interning");
+
+  /* Fill the table.  */
+  const char *last = nullptr;
+  char buf[32];
+  for (int i = 0; i < 10000; i++)
+    {
+      snprintf (buf, sizeof buf, "overflow-%d", i);
+      last = anonstr (buf);
+    }
+  if (strcmp (last, "gpgol_string_overflow"))
+    fail ("No overflow");
+  if (anonstr (strings[0].c_str ()) != results[0][0])
+    fail ("Known string lost after overflow");
+  pass ("overflow");
+}
+
+/* The former implementation with one lock and a map of copies for
+   comparison.  */
+static std::mutex legacy_lock;
+static std::unordered_map<std::string, std::string> legacy_map;
+
+static const char *
+legacy_anonstr (const char *data)
+{
+  static int64_t cnt;
+  std::lock_guard<std::mutex> guard (legacy_lock);
+  const std::string strData (data);
+  auto it = legacy_map.find (strData);
+
+  if (it == legacy_map.end ())
+    {
+      const auto anon = std::string ("gpgol_string_") + std::to_string (++cnt);
+      legacy_map.insert (std::make_pair (strData, anon));
+      it = legacy_map.find (strData);
+    }
+  return it->second.c_str ();
+}
+
+static void
+bench_thread (bool legacy, const std::vector<std::string> *strings, int count)
+{
+  const size_t n = strings->size ();
+
+  for (int i = 0; i < count; i++)
+    {
+      const char *data = (*strings)[i % n].c_str ();
+      if (legacy)
+        legacy_anonstr (data);
+      else
+        anonstr (data);
+    }
+}
+
+/* Lookups of strings seen before, which is the common case.  */
+static void
+run_bench (int count)
+{
+  const auto strings = make_strings (256);
+
+  for (const auto &s: strings)
+    {
+      anonstr (s.c_str ());
+      legacy_anonstr (s.c_str ());
+    }
+  for (int nthreads = 1; nthreads <= 4; nthreads *= 4)
+    for (int legacy = 1; legacy >= 0; legacy--)
+      {
+        std::vector<std::thread> threads;
+
+        const auto start = bench_clock::now ();
+        for (int i = 0; i < nthreads; i++)
+          threads.push_back (std::thread (bench_thread, legacy, &strings,
+                                          count));
+        for (auto &t: threads)
+          t.join ();
+        const double ns = std::chrono::duration<double, std::nano>
+          (bench_clock::now () - start).count ();
+        printf ("%-6s %d threads: %6.1f ns per call, %10.0f calls/s\n",
+                legacy ? "former" : "table", nthreads,
+                ns / count, (double) count * nthreads / ns * 1e9);
+      }
+}
+
+int main (int argc, char **argv)
+{
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    run_bench (argc > 2 ? atoi (argv[2]) : 1000000);
+  else
+    run_tests ();
+  exit (0);
+}
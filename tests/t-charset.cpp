@@ -0,0 +1,228 @@
+/* t-charset.cpp - Test for gpgOL's charset conversion.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <set>
+#include <string>
+
+#include "common_indep.h"
+#include "charset-conv.h"
+#include "t-support.h"
+
+/* Collect the values of all charset parameters in FILE.  */
+static void
+collect_charsets (const std::string &file, std::set<std::string> &charsets)
+{
+  FILE *fp = fopen (file.c_str (), "rb");
+  char line[1024];
+
+  if (!fp)
+    {
+      fprintf (stderr, "Failed to open input file: %s\n", file.c_str ());
+      exit (1);
+    }
+  while (fgets (line, sizeof line, fp))
+    {
+      const char *p = strstr (line, "charset=");
+      if (!p)
+        continue;
+      p += 8;
+      if (*p == '"')
+        p++;
+      std::string cs;
+      for (; *p && *p != '"' && *p != ';' && !ascii_isspace (*p); p++)
+        cs += *p;
+      if (!cs.empty ())
+        charsets.insert (cs);
+    }
+  fclose (fp);
+}
+
+/* Convert INPUT with and without the fast paths and compare the
+   results.  */
+static void
+check_conversion (const char *charset, const std::string &input,
+                  const char *expected)
+{
+  char *fast = charset_to_utf8 (charset, input.c_str (), input.size ());
+  char *ref = charset_iconv_to_utf8 (charset, input.c_str (), input.size ());
+
+  if (!fast || !ref)
+    {
+      fprintf (stderr, "Conversion from %s failed: fast=%p iconv=%p\n",
+               charset, fast, ref);
+      exit (1);
+    }
+  if (strcmp (fast, ref) || (expected && strcmp (fast, expected)))
+    {
+      fprintf (stderr, "Conversion mismatch for %s:\n"
+               " fast:  \"%s\"\n iconv: \"%s\"\n", charset, fast, ref);
+      exit (1);
+    }
+  xfree (fast);
+  xfree (ref);
+}
+
+/* Check that valid UTF-8 is converted in place without a copy.  */
+static void
+check_in_place ()
+{
+  std::string data = "Gr\xc3\xbc\xc3\x9f" "e, this is long enough to be "
+                     "stored outside of the string object.";
+  const char *orig = data.c_str ();
+
+  if (!charset_convert_to_utf8 ("UTF-8", data) || data.c_str () != orig
+      || !charset_convert_to_utf8 ("us-ascii", data = "plain ascii text "
+                                   "which is long enough for the heap")
+      || !charset_utf8_compatible_p ("utf-8", "", 0))
+    {
+      fprintf (stderr, "UTF-8 input was not used as is\n");
+      exit (1);
+    }
+
+  data = "Gr\xfc\xdf" "e";
+  if (charset_utf8_compatible_p ("utf-8", data.c_str (), data.size ())
+      || !charset_convert_to_utf8 ("iso-8859-1", data)
+      || data != "Gr\xc3\xbc\xc3\x9f" "e")
+    {
+      fprintf (stderr, "Latin-1 input was not converted\n");
+      exit (1);
+    }
+
+  data = "\xc3\x28";
+  if (charset_convert_to_utf8 ("utf-8", data) || data != "\xc3\x28")
+    {
+      fprintf (stderr, "Invalid UTF-8 was accepted\n");
+      exit (1);
+    }
+}
+
+/* Compare the copying conversion with the in place conversion for a
+   large, mostly ASCII UTF-8 body as it is typical for decrypted
+   HTML mails.  */
+static void
+run_bench (unsigned int iterations)
+{
+  std::string body;
+  size_t copied = 0;
+  clock_t start;
+
+  while (body.size () < 4 * 1024 * 1024)
+    body += "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit. "
+            "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac 10</p>\r\n";
+
+  start = clock ();
+  for (unsigned int it = 0; it < iterations; it++)
+    {
+      char *converted = charset_to_utf8 ("utf-8", body.c_str (),
+                                         body.size ());
+      copied += strlen (converted);
+      xfree (converted);
+    }
+  printf ("charset_to_utf8:         %u x %lu bytes in %.3fs, "
+          "%lu bytes copied\n", iterations, (unsigned long)body.size (),
+          (double)(clock () - start) / CLOCKS_PER_SEC,
+          (unsigned long)copied);
+
+  copied = 0;
+  start = clock ();
+  for (unsigned int it = 0; it < iterations; it++)
+    {
+      const char *orig = body.c_str ();
+      charset_convert_to_utf8 ("utf-8", body);
+      if (body.c_str () != orig)
+        copied += body.size ();
+    }
+  printf ("charset_convert_to_utf8: %u x %lu bytes in %.3fs, "
+          "%lu bytes copied\n", iterations, (unsigned long)body.size (),
+          (double)(clock () - start) / CLOCKS_PER_SEC,
+          (unsigned long)copied);
+}
+
+int main (int argc, char **argv)
+{
+  std::set<std::string> charsets;
+
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    {
+      run_bench (argc > 2 ? atoi (argv[2]) : 100);
+      exit (0);
+    }
+
+  DIR *dir = opendir (DATADIR);
+  struct dirent *entry;
+
+  if (!dir)
+    {
+      fprintf (stderr, "Failed to open data dir: %s\n", DATADIR);
+      exit (1);
+    }
+  while ((entry = readdir (dir)))
+    if (strstr (entry->d_name, ".mbox"))
+      collect_charsets (std::string (DATADIR "/") + entry->d_name, charsets);
+  closedir (dir);
+
+  if (charsets.empty ())
+    {
+      fprintf (stderr, "No charsets found in %s\n", DATADIR);
+      exit (1);
+    }
+
+  std::string ascii;
+  for (int c = 1; c < 0x80; c++)
+    ascii += (char) c;
+  std::string high = ascii;
+  for (int c = 0xa0; c < 0x100; c++)
+    high += (char) c;
+  const char *utf8 = "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac \xf0\x9f\x94\x91";
+
+  for (const auto &cs: charsets)
+    {
+      check_conversion (cs.c_str (), ascii, ascii.c_str ());
+      if (!strcasecmp (cs.c_str (), "utf-8"))
+        check_conversion (cs.c_str (), utf8, utf8);
+      else if (strcasecmp (cs.c_str (), "us-ascii"))
+        check_conversion (cs.c_str (), high, nullptr);
+      pass ("%s", cs.c_str ());
+    }
+
+  /* Invalid input must not be passed through.  */
+  if (charset_to_utf8 ("utf-8", "\xc3\x28", 2)
+      || charset_to_utf8 ("us-ascii", "\xe4", 1)
+      || charset_to_utf8 ("no-such-charset", "abc", 3))
+    {
+      fprintf (stderr, "Invalid input was converted\n");
+      exit (1);
+    }
+
+  /* Run a charset without a fast path a few times to use the pooled
+     converter.  */
+  for (int i = 0; i < 100; i++)
+    check_conversion ("windows-1252", "\x80 10", "\xe2\x82\xac 10");
+  pass ("windows-1252");
+
+  check_in_place ();
+  pass ("in place");
+  exit (0);
+}
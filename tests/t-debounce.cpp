@@ -0,0 +1,234 @@
+/* t-debounce.cpp - Tests for the debounce scheduler.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "debounce.h"
+#include "t-support.h"
+
+#define DELAY 500
+
+/* A job which records its name when it runs.  */
+static DebounceScheduler::job_t
+job (std::vector<std::string> &log, const char *name)
+{
+  return [&log, name] (const DebounceScheduler::Token &)
+    {
+      log.push_back (name);
+    };
+}
+
+/* A job runs only after the delay and only once.  */
+static void
+test_delay ()
+{
+  DebounceScheduler sched (DELAY);
+  std::vector<std::string> log;
+
+  if (sched.nextDue (0, 12345) != 12345)
+    fail ("Idle scheduler has something due");
+  sched.schedule ("mail", 1000, job (log, "a"));
+  if (sched.nextDue (1000, 12345) != DELAY
+      || sched.nextDue (1200, 12345) != DELAY - 200)
+    fail ("Wrong next due time");
+  if (sched.runDue (1000 + DELAY - 1) || !log.empty ())
+    fail ("Job ran too early");
+  if (sched.nextDue (2000, 12345) != 0)
+    fail ("Due job not reported");
+  if (sched.runDue (1000 + DELAY) != 1 || log.size () != 1)
+    fail ("Job did not run");
+  if (sched.runDue (100000) || log.size () != 1 || sched.pending ())
+    fail ("Job ran twice");
+  pass ("delay");
+}
+
+/* Changes within the delay start it over and only the last job
+   runs.  */
+static void
+test_debounce ()
+{
+  DebounceScheduler sched (DELAY);
+  std::vector<std::string> log;
+
+  sched.schedule ("mail", 0, job (log, "a"));
+  sched.schedule ("mail", 300, job (log, "b"));
+  sched.schedule ("mail", 600, job (log, "c"));
+  if (sched.pending () != 1)
+    fail ("More than one job pending for a key");
+  if (sched.runDue (DELAY) || sched.runDue (600 + DELAY - 1))
+    fail ("Replaced job ran");
+  if (sched.runDue (600 + DELAY) != 1 || log.size () != 1 || log[0] != "c")
+    fail ("Not the last job ran");
+  pass ("debounce");
+}
+
+/* Keys are independent of each other.  */
+static void
+test_keys ()
+{
+  DebounceScheduler sched (DELAY);
+  std::vector<std::string> log;
+
+  sched.schedule ("mail1", 0, job (log, "a"));
+  sched.schedule ("mail2", 400, job (log, "b"));
+  if (sched.runDue (DELAY) != 1 || log.back () != "a")
+    fail ("First key did not run");
+  if (sched.nextDue (DELAY, 12345) != 400)
+    fail ("Wrong next due time for the second key");
+  if (sched.runDue (400 + DELAY) != 1 || log.back () != "b")
+    fail ("Second key did not run");
+  pass ("keys");
+}
+
+static void
+test_cancel ()
+{
+  DebounceScheduler sched (DELAY);
+  std::vector<std::string> log;
+
+  sched.schedule ("mail", 0, job (log, "a"));
+  sched.cancel ("mail");
+  sched.cancel ("unknown");
+  if (sched.runDue (100000) || !log.empty () || sched.pending ())
+    fail ("Canceled job ran");
+
+  sched.schedule ("mail", 0, job (log, "a"));
+  sched.schedule ("other", 0, job (log, "b"));
+  sched.cancelAll ();
+  if (sched.runDue (100000) || !log.empty () || sched.pending ())
+    fail ("Job ran after cancelAll");
+  pass ("cancel");
+}
+
+/* A change while a job runs makes it stale and schedules the next
+   run.  */
+static void
+test_stale ()
+{
+  DebounceScheduler sched (DELAY);
+  std::vector<std::string> log;
+  bool current_before = false, current_after = true;
+
+  sched.schedule ("mail", 0, [&] (const DebounceScheduler::Token &token)
+    {
+      current_before = token.isCurrent ();
+      sched.schedule ("mail", DELAY, job (log, "b"));
+      current_after = token.isCurrent ();
+    });
+  if (sched.runDue (DELAY) != 1)
+    fail ("Job did not run");
+  if (!current_before || current_after)
+    fail ("Token does not follow the changes");
+  if (sched.pending () != 1 || sched.runDue (2 * DELAY) != 1
+      || log.size () != 1)
+    fail ("Job scheduled while running was lost");
+
+  sched.schedule ("mail", 0, [&] (const DebounceScheduler::Token &token)
+    {
+      sched.cancel ("mail");
+      current_after = token.isCurrent ();
+    });
+  sched.runDue (DELAY);
+  if (current_after || sched.pending ())
+    fail ("Canceled job is still current");
+
+  current_after = true;
+  sched.schedule ("mail", 0, [&] (const DebounceScheduler::Token &token)
+    {
+      sched.cancelAll ();
+      current_after = token.isCurrent ();
+    });
+  sched.runDue (DELAY);
+  if (current_after || sched.pending ())
+    fail ("Job is still current after cancelAll");
+  pass ("stale");
+}
+
+static DebounceScheduler::msec_t
+now_ms ()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>
+    (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/* A worker thread as GpgOL runs it while another thread keeps
+   scheduling.  Only the last job of a burst must run.  */
+static void
+test_threads ()
+{
+  DebounceScheduler sched (20);
+  std::atomic<bool> done (false);
+  std::atomic<int> runs (0), last (-1);
+
+  std::thread worker ([&] ()
+    {
+      while (!done || sched.pending ())
+        {
+          sched.runDue (now_ms ());
+          std::this_thread::sleep_for (std::chrono::milliseconds
+                                       (std::min<DebounceScheduler::msec_t>
+                                        (sched.nextDue (now_ms (), 5), 5)));
+        }
+    });
+  for (int burst = 0; burst < 5; burst++)
+    {
+      for (int i = 0; i < 100; i++)
+        {
+          const int value = burst * 100 + i;
+          sched.schedule ("mail", now_ms (),
+                          [&runs, &last, value]
+                          (const DebounceScheduler::Token &token)
+            {
+              if (token.isCurrent ())
+                last = value;
+              runs++;
+            });
+        }
+      std::this_thread::sleep_for (std::chrono::milliseconds (60));
+    }
+  done = true;
+  worker.join ();
+  if (last != 499)
+    fail ("The last job did not run last");
+  if (runs < 5 || runs > 50)
+    {
+      fprintf (stderr, "%d runs for 5 bursts\n", (int) runs);
+      exit (1);
+    }
+  pass ("threads");
+}
+
+int main ()
+{
+  test_delay ();
+  test_debounce ();
+  test_keys ();
+  test_cancel ();
+  test_stale ();
+  test_threads ();
+  return 0;
+}
@@ -0,0 +1,245 @@
+/* t-draft-parts.cpp - Tests for the cache of encrypted draft parts.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "draft-parts.h"
+#include "t-support.h"
+
+#define FPR_A "1BA323932B3FAA826132C79E8D9860C58F246DE6"
+#define FPR_B "00949E2AF4A985AFB572FDD214B79E26050467AA"
+
+static std::shared_ptr<const std::string>
+cipher (size_t size, char c)
+{
+  return std::make_shared<const std::string> (size, c);
+}
+
+/* The test vectors of FIPS 180-2 and a few lengths around the block
+   and padding sizes.  */
+static void
+test_hash ()
+{
+  static const struct
+  {
+    std::string data;
+    const char *hash;
+  } vectors[] = {
+    { "",
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc",
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { std::string (1000000, 'a'),
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    { std::string (55, 'x'),
+      "d5e285683cd4efc02d021a5c62014694958901005d6f71e89e0989fac77e4072" },
+    { std::string (56, 'x'),
+      "04c26261370ee7541549d16dee320c723e3fd14671e66a099afe0a377c16888e" },
+    { std::string (64, 'x'),
+      "7ce100971f64e7001e8fe5a51973ecdfe1ced42befe7ee8d5fd6219506b5393c" },
+    { std::string (119, 'x'),
+      "000b48d4edf0fa7bee3c6236ecd2785baa5db4eeb8bb54341b029e0d9fa5fb0c" },
+  };
+
+  for (size_t i = 0; i < sizeof vectors / sizeof *vectors; i++)
+    {
+      if (draft_part_hash (vectors[i].data.data (), vectors[i].data.size ())
+          != vectors[i].hash)
+        {
+          fprintf (stderr, "Hash %u is wrong\n", (unsigned int) i);
+          exit (1);
+        }
+    }
+  pass ("hash");
+}
+
+/* A part is hashed while it is written and reads back the same.  */
+static void
+test_part ()
+{
+  static const size_t sizes[] = { 0, 1000, 3 * 1024 * 1024 + 17 };
+
+  for (size_t size: sizes)
+    {
+      std::string text;
+      DraftPart part;
+      struct sink_s sinkmem;
+
+      for (size_t i = 0; i < size; i++)
+        text += (char) (i * 7 + i / 251);
+      part.initSink (&sinkmem);
+      for (size_t off = 0; off < size; off += 4093)
+        if (sinkmem.writefnc (&sinkmem, text.data () + off,
+                              std::min ((size_t) 4093, size - off)))
+          fail ("Writing the part failed");
+      if (sinkmem.writefnc (&sinkmem, NULL, 0) || part.finish ())
+        fail ("Finishing the part failed");
+      if (part.size () != size
+          || part.hash () != draft_part_hash (text.data (), text.size ()))
+        fail ("Wrong hash of a part");
+
+      for (int round = 0; round < 2; round++)
+        {
+          GpgME::Data data = part.data ();
+          std::string out;
+          char buf[8192];
+          ssize_t nread;
+
+          while ((nread = data.read (buf, sizeof buf)) > 0)
+            out.append (buf, nread);
+          if (out != text)
+            fail ("Part does not read back");
+        }
+    }
+  pass ("part");
+}
+
+/* Everything the ciphertext depends on is part of the id.  */
+static void
+test_id ()
+{
+  const auto id = DraftPartCache::makeId ("part", "draft1", GpgME::OpenPGP,
+                                          { FPR_A, FPR_B }, false);
+
+  if (DraftPartCache::makeId ("part", "draft1", GpgME::OpenPGP,
+                              { FPR_B, FPR_A }, false) != id)
+    fail ("Order of the keys matters");
+  if (DraftPartCache::makeId ("Part", "draft1", GpgME::OpenPGP,
+                              { FPR_A, FPR_B }, false) == id)
+    fail ("Id does not depend on the part");
+  if (DraftPartCache::makeId ("part", "draft2", GpgME::OpenPGP,
+                              { FPR_A, FPR_B }, false) == id)
+    fail ("Id does not depend on the draft");
+  if (DraftPartCache::makeId ("part", "draft1", GpgME::CMS,
+                              { FPR_A, FPR_B }, false) == id)
+    fail ("Id does not depend on the protocol");
+  if (DraftPartCache::makeId ("part", "draft1", GpgME::OpenPGP,
+                              { FPR_A }, false) == id)
+    fail ("Id does not depend on the keys");
+  if (DraftPartCache::makeId ("part", "draft1", GpgME::OpenPGP,
+                              { FPR_A, FPR_B }, true) == id)
+    fail ("Id does not depend on the armor");
+  pass ("id");
+}
+
+static void
+test_get_put ()
+{
+  auto cache = DraftPartCache::instance ();
+  const auto id = DraftPartCache::makeId ("body", "draft1", GpgME::OpenPGP,
+                                          { FPR_A }, false);
+
+  cache->clear ();
+  if (cache->get (id))
+    fail ("Found a part in an empty cache");
+  cache->put (id, cipher (100, 'a'));
+  const auto part = cache->get (id);
+  if (!part || *part != std::string (100, 'a'))
+    fail ("Part not found");
+  cache->put (id, cipher (50, 'b'));
+  if (cache->size () != 1 || cache->bytes () != 50
+      || *cache->get (id) != std::string (50, 'b'))
+    fail ("Part not replaced");
+  pass ("get/put");
+}
+
+/* The least recently used parts are dropped to stay within the
+   limit, but not those of the draft which was stored last.  */
+static void
+test_limit ()
+{
+  auto cache = DraftPartCache::instance ();
+  std::string ids[5];
+
+  cache->clear ();
+  cache->setLimit (1000);
+  for (int i = 0; i < 3; i++)
+    {
+      ids[i] = DraftPartCache::makeId (std::to_string (i), "draft1",
+                                       GpgME::OpenPGP, { FPR_A }, false);
+      cache->put (ids[i], cipher (300, 'a' + i));
+    }
+  cache->get (ids[0]);
+  ids[3] = DraftPartCache::makeId ("3", "draft2", GpgME::OpenPGP,
+                                   { FPR_A }, false);
+  cache->put (ids[3], cipher (300, 'd'));
+  if (cache->size () != 3 || cache->bytes () != 900)
+    fail ("Limit not kept");
+  if (!cache->get (ids[0]) || cache->get (ids[1]) || !cache->get (ids[2])
+      || !cache->get (ids[3]))
+    fail ("Not the least recently used part was dropped");
+
+  ids[4] = DraftPartCache::makeId ("4", "draft2", GpgME::OpenPGP,
+                                   { FPR_A }, false);
+  cache->put (ids[4], cipher (1001, 'x'));
+  if (!cache->get (ids[4]) || !cache->get (ids[3]) || cache->size () != 2
+      || cache->bytes () != 1301)
+    fail ("Parts of the current draft were dropped");
+
+  cache->put (ids[0], cipher (300, 'a'));
+  if (cache->get (ids[4]) || cache->size () != 2 || cache->bytes () != 600)
+    fail ("Parts of the previous draft were kept");
+
+  cache->put (ids[3], cipher (300, 'd'));
+  cache->setLimit (300);
+  if (cache->size () != 1 || !cache->get (ids[3]))
+    fail ("Lowering the limit did not drop parts");
+  cache->setLimit (64 * 1024 * 1024);
+  pass ("limit");
+}
+
+static void
+test_drop_draft ()
+{
+  auto cache = DraftPartCache::instance ();
+  const auto id1 = DraftPartCache::makeId ("body", "draft1", GpgME::OpenPGP,
+                                           { FPR_A }, false);
+  const auto id10 = DraftPartCache::makeId ("body", "draft10",
+                                            GpgME::OpenPGP, { FPR_A },
+                                            false);
+
+  cache->clear ();
+  cache->put (id1, cipher (10, 'a'));
+  cache->put (id10, cipher (20, 'b'));
+  cache->dropDraft ("draft1");
+  if (cache->get (id1) || !cache->get (id10) || cache->bytes () != 20)
+    fail ("Wrong parts dropped");
+  cache->clear ();
+  if (cache->size () || cache->bytes ())
+    fail ("Cache not cleared");
+  pass ("drop draft");
+}
+
+int main ()
+{
+  test_hash ();
+  test_part ();
+  test_id ();
+  test_get_put ();
+  test_limit ();
+  test_drop_draft ();
+  return 0;
+}
@@ -0,0 +1,100 @@
+/* t-latency.cpp - Test for gpgOL's latency histograms.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common_indep.h"
+#include "latency.h"
+#include "t-support.h"
+
+/* Record the values 1 .. COUNT microseconds.  */
+static void
+record_range (latency_hist_t *hist, int count)
+{
+  for (int i = 1; i <= count; i++)
+    latency_record (hist, (uint64_t) i * 1000);
+}
+
+static void
+check_percentile (latency_hist_t *hist, double percent, double expected)
+{
+  const double got = (double) latency_percentile (hist, percent);
+
+  if (got < expected || got > expected * 1.07)
+    {
+      fprintf (stderr, "p%g is %.0f, expected %.0f\n", percent, got,
+               expected);
+      exit (1);
+    }
+}
+
+static void
+timed_function ()
+{
+  LATENCY_SCOPE ("t-latency::timed_function");
+}
+
+int main ()
+{
+  const int nthreads = 4;
+  const int count = 10000;
+  latency_hist_t *hist = latency_get ("t-latency::uniform");
+  std::vector<std::thread> threads;
+
+  if (!hist || latency_get ("t-latency::uniform") != hist)
+    fail ("Histogram lookup failed");
+
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (record_range, hist, count));
+  for (auto &t: threads)
+    t.join ();
+  if (latency_count (hist) != (uint64_t) nthreads * count)
+    fail ("Lost samples");
+  check_percentile (hist, 50, count * 500.0);
+  check_percentile (hist, 99, count * 990.0);
+  check_percentile (hist, 100, count * 1000.0);
+  pass ("percentiles");
+
+  /* Timers only record with the debug flag.  */
+  timed_function ();
+  opt.enable_debug |= DBG_LATENCY;
+  timed_function ();
+  timed_function ();
+  if (latency_count (latency_get ("t-latency::timed_function")) != 2)
+    fail ("Timer did not record");
+  pass ("timer");
+
+  const auto json = latency_report (true);
+  if (json.find ("{\"histograms\":[{\"name\":\"t-latency::uniform\"")
+      || json.find ("\"name\":\"t-latency::timed_function\"")
+         == std::string::npos)
+    fail ("Unexpected JSON report");
+  const auto text = latency_report (false);
+  if (text.find ("t-latency::uniform") == std::string::npos)
+    fail ("Unexpected text report");
+  fprintf (stderr, "%s", text.c_str ());
+  pass ("report");
+  exit (0);
+}
@@ -0,0 +1,258 @@
+/* t-log.cpp - Test for gpgOL's buffered logging.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common_indep.h"
+#include "t-support.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::string
+read_file (const char *name)
+{
+  std::string ret;
+  FILE *fp = fopen (name, "rb");
+  char buf[4096];
+  size_t n;
+
+  if (!fp)
+    fail ("Failed to open the log file");
+  while ((n = fread (buf, 1, sizeof buf, fp)))
+    ret.append (buf, n);
+  fclose (fp);
+  return ret;
+}
+
+static void
+producer (int id, int count)
+{
+  for (int i = 0; i < count; i++)
+    log_debug ("%s:%s: producer %d message %d", SRCNAME, __func__, id, i);
+}
+
+/* Check that the messages of each thread arrive complete and in
+   order and that everything which is missing has been counted as
+   dropped.  */
+static void
+check_order (const char *logname, int nthreads, int count)
+{
+  std::map<int, int> next;
+  unsigned long received = 0, dropped = 0;
+  const auto data = read_file (logname);
+  size_t pos = 0;
+
+  while (pos < data.size ())
+    {
+      size_t end = data.find ('\n', pos);
+      if (end == std::string::npos)
+        fail ("Incomplete line in log");
+      const auto line = data.substr (pos, end - pos);
+      const char *p;
+      int id, seq;
+      unsigned long n;
+
+      pos = end + 1;
+      if ((p = strstr (line.c_str (), "producer ")))
+        {
+          if (sscanf (p, "producer %d message %d", &id, &seq) != 2)
+            fail ("Garbled log line");
+          if (seq < next[id])
+            fail ("Log messages out of order");
+          next[id] = seq + 1;
+          received++;
+        }
+      else if ((p = strstr (line.c_str (), ": "))
+               && sscanf (p, ": %lu log messages dropped", &n) == 1)
+        dropped += n;
+    }
+  if (received + dropped != (unsigned long) nthreads * count)
+    {
+      fprintf (stderr, "Lost log messages: %lu received %lu dropped\n",
+               received, dropped);
+      exit (1);
+    }
+  pass ("order (%lu messages, %lu dropped)", received, dropped);
+}
+
+static void
+run_tests (const char *logname)
+{
+  const int nthreads = 8;
+  const int count = 2000;
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (producer, i, count));
+  for (auto &t: threads)
+    t.join ();
+  log_flush ();
+  check_order (logname, nthreads, count);
+
+  /* Errors must be on disk without an explicit flush.  */
+  log_error ("%s:%s: this is an error", SRCNAME, __func__);
+  if (read_file (logname).find ("ERROR/") == std::string::npos)
+    fail ("Error was not flushed");
+  pass ("error flush");
+
+  /* Messages too long for the ring are written directly.  */
+  std::string big (100000, 'x');
+  log_debug ("big:%s:end", big.c_str ());
+  log_flush ();
+  if (read_file (logname).find ("big:" + big + ":end\n") == std::string::npos)
+    fail ("Long message was not logged");
+  pass ("long message");
+
+  /* Many short lived threads must reuse the rings.  */
+  for (int i = 0; i < 300; i++)
+    std::thread (producer, 1000 + i, 1).join ();
+  log_flush ();
+  pass ("thread churn");
+
+  /* The arguments of categories which are not compiled in must not
+     be evaluated even if the category is enabled.  */
+  int evaluated = 0;
+  opt.enable_debug = DBG_DATA | DBG_TRACE;
+  log_data ("%s:%s: %d", SRCNAME, __func__, evaluated++);
+  log_trace ("%s:%s: %d", SRCNAME, __func__, evaluated++);
+  opt.enable_debug = 0;
+  if (evaluated != !!(DBG_COMPILED & DBG_DATA) + !!(DBG_COMPILED & DBG_TRACE))
+    fail ("Unexpected evaluation of log arguments");
+  pass ("log level");
+}
+
+/* The logging as it was done before: format and flush under a lock
+   on every call.  */
+static std::mutex sync_mutex;
+static FILE *sync_fp;
+
+static void
+sync_log (const char *fmt, ...)
+{
+  va_list a;
+
+  std::lock_guard<std::mutex> guard (sync_mutex);
+  va_start (a, fmt);
+  vfprintf (sync_fp, fmt, a);
+  va_end (a);
+  putc ('\n', sync_fp);
+  fflush (sync_fp);
+}
+
+static void
+bench_thread (bool async, int count, std::vector<double> *latencies)
+{
+  for (int i = 0; i < count; i++)
+    {
+      const auto start = bench_clock::now ();
+      if (async)
+        log_debug ("%s:%s:%d: message %d", SRCNAME, __func__, __LINE__, i);
+      else
+        sync_log ("%s:%s:%d: message %d", SRCNAME, __func__, __LINE__, i);
+      (*latencies)[i] = std::chrono::duration<double, std::nano>
+        (bench_clock::now () - start).count ();
+    }
+}
+
+static void
+run_bench (const char *logname, bool async, int nthreads, int count)
+{
+  std::vector<std::vector<double> > latencies (nthreads,
+                                               std::vector<double> (count));
+  std::vector<std::thread> threads;
+  std::vector<double> all;
+
+  if (truncate (logname, 0))
+    fail ("Failed to truncate the log file");
+
+  const auto start = bench_clock::now ();
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (bench_thread, async, count,
+                                    &latencies[i]));
+  for (auto &t: threads)
+    t.join ();
+  if (async)
+    log_flush ();
+  const double secs = std::chrono::duration<double>
+    (bench_clock::now () - start).count ();
+
+  for (const auto &l: latencies)
+    all.insert (all.end (), l.begin (), l.end ());
+  std::sort (all.begin (), all.end ());
+  double sum = 0;
+  for (auto v: all)
+    sum += v;
+
+  const auto data = read_file (logname);
+  unsigned long written = 0;
+  for (size_t pos = 0; (pos = data.find (": message ", pos))
+       != std::string::npos; pos++)
+    written++;
+
+  printf ("%-6s %d threads: %9.0f calls/s  latency avg %6.0fns "
+          "p50 %5.0fns p99 %6.0fns max %8.0fns  %5.1f%% dropped\n",
+          async ? "async" : "sync", nthreads, all.size () / secs,
+          sum / all.size (), all[all.size () / 2],
+          all[all.size () * 99 / 100], all.back (),
+          100.0 * (all.size () - written) / all.size ());
+}
+
+int main (int argc, char **argv)
+{
+  char logname[] = "/tmp/t-log-XXXXXX";
+  int fd = mkstemp (logname);
+
+  if (fd == -1)
+    fail ("Failed to create log file");
+  close (fd);
+  set_log_file (logname);
+
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    {
+      int count = argc > 2 ? atoi (argv[2]) : 100000;
+
+      sync_fp = fopen (logname, "a");
+      if (!sync_fp)
+        fail ("Failed to open the log file");
+      for (int nthreads = 1; nthreads <= 4; nthreads *= 4)
+        {
+          run_bench (logname, false, nthreads, count);
+          run_bench (logname, true, nthreads, count);
+        }
+      fclose (sync_fp);
+    }
+  else
+    run_tests (logname);
+
+  log_shutdown ();
+  set_log_file (NULL);
+  unlink (logname);
+  exit (0);
+}
@@ -0,0 +1,265 @@
+/* t-memdbg.cpp - Test for gpgOL's memory debugging helpers.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common_indep.h"
+#include "t-support.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::string
+read_file (const char *name)
+{
+  std::string ret;
+  FILE *fp = fopen (name, "rb");
+  char buf[4096];
+  size_t n;
+
+  if (!fp)
+    fail ("Failed to open the log file");
+  while ((n = fread (buf, 1, sizeof buf, fp)))
+    ret.append (buf, n);
+  fclose (fp);
+  return ret;
+}
+
+static unsigned long
+count_matches (const std::string &data, const std::string &what)
+{
+  unsigned long ret = 0;
+
+  for (size_t pos = 0; (pos = data.find (what, pos)) != std::string::npos;
+       pos++)
+    ret++;
+  return ret;
+}
+
+static std::atomic<int> alloc_line;
+
+/* Allocate COUNT blocks and free every second one.  The rest is
+   returned in KEPT.  */
+static void
+worker (int count, std::vector<char *> *kept)
+{
+  /* A different pointer for the same class name.  */
+  static const char name[] = "TestObject";
+
+  for (int i = 0; i < count; i++)
+    {
+      char *p = (char *) xmalloc (16); alloc_line = __LINE__;
+      memdbg_ctor ("TestObject");
+      if (i & 1)
+        {
+          xfree (p);
+          memdbg_dtor (name);
+        }
+      else
+        kept->push_back (p);
+    }
+}
+
+static void
+run_tests (const char *logname)
+{
+  const int nthreads = 4;
+  const int count = 1000;
+  std::vector<std::vector<char *> > kept (nthreads);
+  std::vector<std::thread> threads;
+  int objects[3];
+
+  opt.enable_debug = DBG_MEMORY;
+
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (worker, count, &kept[i]));
+  for (auto &t: threads)
+    t.join ();
+
+  for (int i = 0; i < 3; i++)
+    _memdbg_addRef (&objects[i], "object");
+  _memdbg_addRef (&objects[0], "object");
+  memdbg_released (&objects[1]);
+
+  if (memdbg_free (objects))
+    fail ("Free of an unregistered pointer succeeded");
+  memdbg_dtor ("NeverConstructed");
+
+  memdbg_dump ();
+  log_flush ();
+
+  auto data = read_file (logname);
+  const size_t start = data.find ("MEMORY DUMP");
+  if (start == std::string::npos
+      || data.find ("-- Allocated Addresses End --", start)
+         == std::string::npos)
+    fail ("No memory dump");
+  if (count_matches (data, "Dtor of NeverConstructed before ctor") != 1)
+    fail ("Dtor without ctor not detected");
+  data = data.substr (start);
+  if (count_matches (data, "TestObject\t: "
+                           + std::to_string (nthreads * count / 2) + "\n")
+      != 1)
+    fail ("Wrong C++ object count");
+  if (count_matches (data, "NeverConstructed\t: 0\n") != 1)
+    fail ("Unexpected object count of a class without ctor");
+  if (count_matches (data, "t-memdbg.cpp:worker:") != nthreads * count / 2)
+    fail ("Wrong number of allocated addresses");
+  char buf[64];
+  snprintf (buf, sizeof buf, "t-memdbg.cpp:worker:%d: %p\n",
+            alloc_line.load (), kept[0][0]);
+  if (count_matches (data, buf) != 1)
+    fail ("Allocation without its call site");
+  if (count_matches (data, "\t: 2\n") != 1
+      || count_matches (data, "\t: 1\n") != 1)
+    fail ("Wrong Outlook object references");
+  pass ("dump");
+
+  for (auto &v: kept)
+    for (auto p: v)
+      xfree (p);
+  if (truncate (logname, 0))
+    fail ("Failed to truncate the log file");
+  memdbg_dump ();
+  log_flush ();
+  data = read_file (logname);
+  if (count_matches (data, "t-memdbg.cpp:worker:")
+      || count_matches (data, "ERROR/"))
+    fail ("Unexpected allocations after free");
+  pass ("free");
+
+  opt.enable_debug = 0;
+}
+
+/* The former implementation with one lock and a string per
+   allocation for comparison.  */
+static std::mutex legacy_lock;
+static std::unordered_map<void *, std::string> legacy_allocs;
+
+static void
+legacy_alloc (void *ptr, const char *srcname, const char *func, int line)
+{
+  std::lock_guard<std::mutex> guard (legacy_lock);
+  const std::string identifier = std::string (srcname) + std::string (":") +
+                                 std::string (func) + std::string (":") +
+                                 std::to_string (line);
+  if (legacy_allocs.find (ptr) == legacy_allocs.end ())
+    legacy_allocs.insert (std::make_pair (ptr, identifier));
+}
+
+static void
+legacy_free (void *ptr)
+{
+  std::lock_guard<std::mutex> guard (legacy_lock);
+  legacy_allocs.erase (ptr);
+}
+
+/* Track COUNT allocations of 64 live blocks and COUNT ctor / dtor
+   pairs.  MODE 0 is untracked, 1 memdbg and 2 the former code.  */
+static void
+bench_thread (int mode, int count)
+{
+  void *live[64];
+
+  for (int i = 0; i < 64; i++)
+    live[i] = malloc (32);
+  for (int i = 0; i < count; i++)
+    {
+      void *p = live[i & 63];
+      if (mode == 1)
+        {
+          memdbg_alloc (p);
+          memdbg_free (p);
+          memdbg_ctor ("BenchObject");
+          memdbg_dtor ("BenchObject");
+        }
+      else if (mode == 2)
+        {
+          legacy_alloc (p, log_srcname (__FILE__), __func__, __LINE__);
+          legacy_free (p);
+        }
+    }
+  for (int i = 0; i < 64; i++)
+    free (live[i]);
+}
+
+static void
+run_bench (int count)
+{
+  static const char *names[] = {"untracked", "memdbg", "former"};
+
+  for (int nthreads = 1; nthreads <= 4; nthreads *= 4)
+    {
+      double base = 0;
+      for (int mode = 0; mode < 3; mode++)
+        {
+          std::vector<std::thread> threads;
+
+          opt.enable_debug = mode == 1 ? DBG_MEMORY : 0;
+          const auto start = bench_clock::now ();
+          for (int i = 0; i < nthreads; i++)
+            threads.push_back (std::thread (bench_thread, mode, count));
+          for (auto &t: threads)
+            t.join ();
+          const double ns = std::chrono::duration<double, std::nano>
+            (bench_clock::now () - start).count ();
+          /* memdbg tracks an alloc, a free, a ctor and a dtor; the
+             former code only allocs and frees.  */
+          const int events = mode == 1 ? 4 : 2;
+          if (!mode)
+            base = ns;
+          printf ("%-9s %d threads: %7.1f ns per tracked event\n",
+                  names[mode], nthreads,
+                  mode ? (ns - base) / ((double) count * nthreads * events)
+                       : 0.0);
+        }
+    }
+  opt.enable_debug = 0;
+}
+
+int main (int argc, char **argv)
+{
+  char logname[] = "/tmp/t-memdbg-XXXXXX";
+  int fd = mkstemp (logname);
+
+  if (fd == -1)
+    fail ("Failed to create log file");
+  close (fd);
+  set_log_file (logname);
+
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    run_bench (argc > 2 ? atoi (argv[2]) : 1000000);
+  else
+    run_tests (logname);
+
+  log_shutdown ();
+  set_log_file (NULL);
+  unlink (logname);
+  exit (0);
+}
@@ -0,0 +1,536 @@
+/* t-mime-crypt.cpp - Tests for the MIME structures around crypto data.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gpgme.h>
+#include <gpgme++/context.h>
+#include <gpgme++/key.h>
+#include <gpgme++/signingresult.h>
+#include <gpgme++/encryptionresult.h>
+#include <gpgme++/decryptionresult.h>
+#include <gpgme++/verificationresult.h>
+
+#include "common_indep.h"
+#include "mime-crypt.h"
+#include "split-encrypt.h"
+#include "alloc-count.h"
+#include "t-support.h"
+
+/* The "unittest key (no password)" of the test keyring.  */
+#define TEST_KEY "1BA323932B3FAA826132C79E8D9860C58F246DE6"
+
+/* A MIME part of about SIZE bytes as collect_data would create it.  */
+static GpgME::Data
+make_mime (size_t size)
+{
+  std::string text;
+  GpgME::Data ret;
+  struct sink_s sinkmem;
+
+  for (int i = 0; text.size () < size; i++)
+    text += "Line " + std::to_string (i) + " of the signed text\r\n";
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &ret;
+  sinkmem.writefnc = sink_data_write;
+  if (write_part_mem (&sinkmem, text.c_str (), text.size (), NULL, NULL, 1,
+                      NULL, NULL))
+    fail ("write_part_mem failed");
+  ret.seek (0, SEEK_SET);
+  return ret;
+}
+
+/* Read all of PROVIDER with reads of at most CHUNK bytes.  */
+static std::string
+read_provider (GpgME::DataProvider &provider, size_t chunk)
+{
+  std::string ret;
+  std::vector<char> buf (chunk);
+  ssize_t nread;
+
+  while ((nread = provider.read (buf.data (), chunk)) > 0)
+    ret.append (buf.data (), nread);
+  if (nread < 0)
+    fail ("Read from provider failed");
+  return ret;
+}
+
+/* Replace the random boundary of the multipart in S so that two
+   multiparts can be compared.  */
+static std::string
+fixed_boundary (const std::string &s)
+{
+  const std::string key = "boundary=\"";
+  size_t pos = s.find (key);
+
+  if (pos == std::string::npos)
+    fail ("No boundary");
+  pos += key.size ();
+  const std::string boundary = s.substr (pos, s.find ('"', pos) - pos);
+  std::string ret = s;
+  for (pos = 0; (pos = ret.find (boundary, pos)) != std::string::npos;)
+    ret.replace (pos, boundary.size (), "=-=fixed=-=");
+  return ret;
+}
+
+static std::unique_ptr<GpgME::Context>
+make_context (GpgME::Key &key)
+{
+  GpgME::Error err;
+  auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+
+  if (!ctx)
+    fail ("Failed to create context");
+  key = ctx->key (TEST_KEY, err, true);
+  if (err || key.isNull ())
+    fail ("Test key not found");
+  ctx->addSigningKey (key);
+  ctx->setArmor (true);
+  ctx->setTextMode (true);
+  return ctx;
+}
+
+/* The provider yields what create_sign_attach writes, no matter
+   how it is read.  */
+static void
+test_signed_provider ()
+{
+  GpgME::Key key;
+  auto ctx = make_context (key);
+  GpgME::Data mime = make_mime (100000);
+  GpgME::Data signature;
+
+  if (ctx->sign (mime, signature, GpgME::Detached).error ())
+    fail ("Signing failed");
+
+  for (int proto = 0; proto < 2; proto++)
+    {
+      const protocol_t protocol = proto? PROTOCOL_SMIME : PROTOCOL_OPENPGP;
+      GpgME::Data whole;
+      struct sink_s sinkmem;
+
+      memset (&sinkmem, 0, sizeof sinkmem);
+      sinkmem.cb_data = &whole;
+      sinkmem.writefnc = sink_data_write;
+      if (create_sign_attach (&sinkmem, protocol, signature, mime,
+                              "pgp-sha256"))
+        fail ("create_sign_attach failed");
+      const std::string expected = fixed_boundary (whole.toString ());
+
+      SignedMimeProvider provider (protocol, signature, mime, "pgp-sha256");
+      if (provider.failed ())
+        fail ("Provider failed");
+      for (size_t chunk : { 1, 7, 4096, 1 << 20 })
+        {
+          if (provider.seek (0, SEEK_SET))
+            fail ("Rewind failed");
+          const std::string streamed = read_provider (provider, chunk);
+          if (fixed_boundary (streamed) != expected)
+            fail ("Provider differs from create_sign_attach");
+          if (provider.seek (0, SEEK_CUR) != (off_t) streamed.size ())
+            fail ("Wrong offset");
+        }
+
+      /* Every offset can be read from on its own, as the threads of
+         the SplitEncrypter do.  */
+      if (provider.seek (0, SEEK_SET))
+        fail ("Rewind failed");
+      const std::string streamed = read_provider (provider, 4096);
+      for (size_t off : { (size_t) 10, (size_t) 500, streamed.size () / 2,
+                          streamed.size () - 3, streamed.size () })
+        {
+          if (provider.seek (off, SEEK_SET) != (off_t) off)
+            fail ("Seek failed");
+          if (read_provider (provider, 1000) != streamed.substr (off))
+            fail ("Provider differs after a seek");
+        }
+      if (provider.seek (streamed.size () + 1, SEEK_SET) != -1)
+        fail ("Seek beyond the end succeeded");
+    }
+  pass ("signed provider");
+}
+
+/* Reading the provider allocates no memory proportional to the
+   signed data.  */
+static void
+test_signed_provider_memory ()
+{
+  GpgME::Data mime = make_mime (4 * 1024 * 1024);
+  GpgME::Data signature ("-----BEGIN PGP SIGNATURE-----\r\n", 31);
+  SignedMimeProvider provider (PROTOCOL_OPENPGP, signature, mime,
+                               "pgp-sha256");
+  char buf[4096];
+  size_t total = 0;
+  ssize_t nread;
+  alloc_profile_t profile;
+
+  alloc_count_start (&profile);
+  while ((nread = provider.read (buf, sizeof buf)) > 0)
+    total += nread;
+  alloc_count_stop ();
+  if (total < 4 * 1024 * 1024)
+    fail ("Output is too short");
+  if (alloc_profile_bytes (&profile, ALLOC_N_PHASES) > 64 * 1024)
+    {
+      fprintf (stderr, "%lu bytes allocated for %lu bytes output\n",
+               (unsigned long) alloc_profile_bytes (&profile, ALLOC_N_PHASES),
+               (unsigned long) total);
+      exit (1);
+    }
+  pass ("signed provider memory");
+}
+
+/* Sign and encrypt as do_crypto does it and check that the result
+   decrypts to the multipart/signed with a valid signature.  */
+static void
+test_sign_encrypt ()
+{
+  GpgME::Key key;
+  auto ctx = make_context (key);
+  GpgME::Data mime = make_mime (300000);
+  GpgME::Data signature;
+  GpgME::Data cipher;
+  GpgME::Data plain;
+
+  if (ctx->sign (mime, signature, GpgME::Detached).error ())
+    fail ("Signing failed");
+
+  SignedMimeProvider provider (PROTOCOL_OPENPGP, signature, mime,
+                               "pgp-sha256");
+  const std::string expected = read_provider (provider, 65536);
+  provider.seek (0, SEEK_SET);
+  GpgME::Data multipart (&provider);
+  if (ctx->encrypt ({ key }, multipart, cipher,
+                    GpgME::Context::AlwaysTrust).error ())
+    fail ("Encryption failed");
+
+  cipher.seek (0, SEEK_SET);
+  if (ctx->decrypt (cipher, plain).error ())
+    fail ("Decryption failed");
+  if (plain.toString () != expected)
+    fail ("Decrypted data differs");
+
+  if (expected.find ("protocol=\"application/pgp-signature\"")
+      == std::string::npos
+      || expected.find (mime.toString ()) == std::string::npos
+      || expected.find (signature.toString ()) == std::string::npos)
+    fail ("Unexpected multipart/signed");
+
+  mime.seek (0, SEEK_SET);
+  signature.seek (0, SEEK_SET);
+  const auto verify = ctx->verifyDetachedSignature (signature, mime);
+  if (verify.error () || verify.numSignatures () != 1
+      || verify.signature (0).status ())
+    fail ("Signature does not verify");
+  pass ("sign encrypt");
+}
+
+/* S/MIME data for older Exchange versions is base64 encoded in
+   chunks; everything else is passed through.  */
+static void
+test_encrypt_attach ()
+{
+  std::string data;
+
+  for (int i = 0; i < 200000; i++)
+    data += (char) (i * 13 + i / 241);
+
+  for (int version = 14; version <= 15; version++)
+    for (int proto = 0; proto < 2; proto++)
+      {
+        const protocol_t protocol = proto? PROTOCOL_SMIME : PROTOCOL_OPENPGP;
+        GpgME::Data encrypted (data.data (), data.size ());
+        GpgME::Data out;
+        struct sink_s sinkmem;
+
+        memset (&sinkmem, 0, sizeof sinkmem);
+        sinkmem.cb_data = &out;
+        sinkmem.writefnc = sink_data_write;
+        if (create_encrypt_attach (&sinkmem, protocol, encrypted, version))
+          fail ("create_encrypt_attach failed");
+        std::string result = out.toString ();
+
+        if (protocol == PROTOCOL_SMIME && version < 15)
+          {
+            size_t pos = result.find ("\r\n\r\n");
+            if (pos == std::string::npos
+                || result.find ("Content-Transfer-Encoding: base64") > pos)
+              fail ("Missing S/MIME header");
+            std::string body = result.substr (pos + 4);
+            b64_state_t state;
+            b64_init (&state);
+            body.resize (b64_decode (&state, &body[0], body.size ()));
+            if (body != data)
+              fail ("Base64 round trip failed");
+          }
+        else if (protocol == PROTOCOL_SMIME)
+          {
+            if (result != data)
+              fail ("S/MIME data was modified");
+          }
+        else if (result.find (data) == std::string::npos
+                 || result.find ("multipart/encrypted") == std::string::npos
+                 || result.compare (result.size () - 4, 4, "--\r\n"))
+          fail ("Unexpected multipart/encrypted");
+      }
+
+  /* Binary OpenPGP data is base64 encoded once.  */
+  GpgME::Data encrypted (data.data (), data.size ());
+  GpgME::Data out;
+  struct sink_s sinkmem;
+
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &out;
+  sinkmem.writefnc = sink_data_write;
+  if (create_encrypt_attach (&sinkmem, PROTOCOL_OPENPGP, encrypted, 15, true))
+    fail ("create_encrypt_attach failed");
+  const std::string result = out.toString ();
+  const size_t start = result.find ("Content-Transfer-Encoding: base64\r\n\r\n");
+  const size_t end = result.rfind ("\r\n--");
+  if (start == std::string::npos || end == std::string::npos || end < start
+      || result.find ("7Bit") != std::string::npos)
+    fail ("Missing base64 header");
+  std::string body = result.substr (start + 37, end - start - 37);
+  b64_state_t state;
+  b64_init (&state);
+  body.resize (b64_decode (&state, &body[0], body.size ()));
+  if (body != data)
+    fail ("Binary round trip failed");
+  pass ("encrypt attach");
+}
+
+/* The ciphertext of a copy as it is written to the mail.  */
+static std::string
+read_output (const SplitOutput &output)
+{
+  SplitOutputProvider provider (std::make_shared<const SplitOutput>
+                                  (output));
+  GpgME::Data data (&provider);
+
+  return data.toString ();
+}
+
+/* Every copy is reported once and decrypts to the shared
+   plaintext, no matter how many threads encrypt.  The threads also
+   share a multipart/signed which is put together while it is
+   read.  */
+static void
+test_split_encrypt ()
+{
+  GpgME::Key key;
+  auto ctx = make_context (key);
+  GpgME::Data mime = make_mime (100000);
+  GpgME::Data signature;
+
+  if (ctx->sign (mime, signature, GpgME::Detached).error ())
+    fail ("Signing failed");
+  SignedMimeProvider provider (PROTOCOL_OPENPGP, signature, mime,
+                               "pgp-sha256");
+  GpgME::Data multipart (&provider);
+  const std::string mime_text = mime.toString ();
+  const std::string multipart_text = multipart.toString ();
+  const struct
+  {
+    GpgME::Data *data;
+    const std::string *text;
+    int threads;
+  } inputs[] = {
+    { &mime, &mime_text, 1 },
+    { &mime, &mime_text, 3 },
+    { &mime, &mime_text, 8 },
+    { &multipart, &multipart_text, 3 },
+  };
+
+  for (const auto &input : inputs)
+    {
+      SplitEncrypter encrypter (GpgME::OpenPGP, *input.data);
+      std::vector<std::string> outputs (5);
+      std::vector<int> reported (5);
+
+      for (size_t i = 0; i < outputs.size (); i++)
+        if (encrypter.addCopy ({ key }) != i)
+          fail ("Wrong index for copy");
+      const int failed = encrypter.run (input.threads,
+                                        [&] (size_t idx,
+                                             const GpgME::Error &err,
+                                             SplitOutput &output)
+        {
+          if (err)
+            fail ("Encryption of a copy failed");
+          reported[idx]++;
+          outputs[idx] = read_output (output);
+        });
+      if (failed)
+        fail ("Copies failed");
+      for (size_t i = 0; i < outputs.size (); i++)
+        {
+          GpgME::Data cipher (outputs[i].data (), outputs[i].size ());
+          GpgME::Data plain;
+
+          if (reported[i] != 1)
+            fail ("Copy not reported once");
+          if (outputs[i].find ("-----BEGIN PGP MESSAGE-----"))
+            fail ("Copy is not armored");
+          if (ctx->decrypt (cipher, plain).error ())
+            fail ("Decryption of a copy failed");
+          if (plain.toString () != *input.text)
+            fail ("Copy differs from the plaintext");
+        }
+    }
+  pass ("split encrypt");
+}
+
+/* Keys of the test keyring with secret keys.  */
+#define TEST_KEY_2 "00949E2AF4A985AFB572FDD214B79E26050467AA"
+#define TEST_KEY_3 "CA739AC832766152139B5C49FC4FAB94C727D4BB"
+
+/* Return true if the message was encrypted to exactly the
+   encryption subkeys of KEYS.  */
+static bool
+encrypted_to (const GpgME::DecryptionResult &result,
+              const std::vector<GpgME::Key> &keys)
+{
+  std::set<std::string> want, got;
+
+  for (const auto &key: keys)
+    for (const auto &sub: key.subkeys ())
+      if (sub.canEncrypt ())
+        want.insert (sub.keyID ());
+  for (const auto &recp: result.recipients ())
+    got.insert (recp.keyID ());
+  return want == got;
+}
+
+/* With a shared session key every copy decrypts and carries only the
+   session keys of its own keys, with and without armor.  */
+static void
+test_split_share ()
+{
+  GpgME::Key key;
+  GpgME::Error keyerr;
+  auto ctx = make_context (key);
+  const auto key2 = ctx->key (TEST_KEY_2, keyerr, false);
+  const auto key3 = ctx->key (TEST_KEY_3, keyerr, false);
+  if (key2.isNull () || key3.isNull ())
+    fail ("Test keys not found");
+  GpgME::Data mime = make_mime (100000);
+  const std::string plaintext = mime.toString ();
+  const std::vector<std::vector<GpgME::Key> > copies =
+    { { key, key2 }, { key, key3 }, { key3 }, { key, key2 } };
+
+  for (bool armor: { true, false })
+    {
+      SplitEncrypter encrypter (GpgME::OpenPGP, mime);
+      std::vector<std::string> outputs (copies.size ());
+      std::set<const std::string *> bodies;
+      encrypter.setShareSessionKey (true);
+      encrypter.setArmor (armor);
+      for (const auto &keys: copies)
+        encrypter.addCopy (keys);
+      if (encrypter.run (2, [&] (size_t idx, const GpgME::Error &err,
+                                 SplitOutput &output)
+            {
+              if (err)
+                fail ("Encryption of a copy failed");
+              if (output.binary == armor)
+                fail ("Copy has the wrong binary flag");
+              bodies.insert (output.body.get ());
+              outputs[idx] = read_output (output);
+            }))
+        fail ("Copies failed");
+      if (bodies.size () != 1 || !*bodies.begin ())
+        fail ("Copies do not share the encrypted data");
+
+      for (size_t i = 0; i < outputs.size (); i++)
+        {
+          GpgME::Data cipher (outputs[i].data (), outputs[i].size ());
+          GpgME::Data plain;
+
+          const bool armored =
+            !outputs[i].compare (0, 27, "-----BEGIN PGP MESSAGE-----");
+          if (armored != armor)
+            fail ("Copy is not armored as requested");
+          const auto result = ctx->decrypt (cipher, plain);
+          if (result.error ())
+            fail ("Decryption of a copy failed");
+          if (plain.toString () != plaintext)
+            fail ("Copy differs from the plaintext");
+          if (!encrypted_to (result, copies[i]))
+            fail ("Copy has session keys of other copies");
+        }
+      if (outputs[0] != outputs[3])
+        fail ("Copies do not share the encryption");
+    }
+  pass ("split share");
+}
+
+/* Malformed messages are not split.  */
+static void
+test_parse_pkesks ()
+{
+  /* A session key packet in the old format and encrypted data with
+     MDC in the new format.  */
+  const std::string pkesk ("\x84\x0a\x03\x01\x02\x03\x04\x05\x06\x07\x08\x01",
+                           12);
+  const std::string body ("\xd2\x02\x01\x00", 4);
+  std::vector<pgp_pkesk_s> pkesks;
+  size_t off;
+
+  if (pgp_parse_pkesks (pkesk + pkesk + body, pkesks, &off)
+      || pkesks.size () != 2 || off != 24 || pkesks[1].off != 12
+      || pkesks[1].len != 12 || pkesks[0].keyid != "0102030405060708")
+    fail ("Valid message not parsed");
+  if (!pgp_parse_pkesks ("", pkesks, &off)
+      || !pgp_parse_pkesks ("-----BEGIN PGP MESSAGE-----", pkesks, &off)
+      || !pgp_parse_pkesks (body, pkesks, &off)
+      || !pgp_parse_pkesks (pkesk, pkesks, &off)
+      || !pgp_parse_pkesks (pkesk.substr (0, 8), pkesks, &off)
+      || !pgp_parse_pkesks (pkesk + pkesk.substr (0, 4) + body, pkesks, &off))
+    fail ("Malformed message parsed");
+  /* Version 2 and a literal data packet.  */
+  std::string v2 = pkesk;
+  v2[2] = 2;
+  if (!pgp_parse_pkesks (v2 + body, pkesks, &off)
+      || !pgp_parse_pkesks (pkesk + std::string ("\xcb\x01\x62", 3),
+                            pkesks, &off))
+    fail ("Unexpected packet parsed");
+  pass ("parse pkesks");
+}
+
+int main ()
+{
+  putenv ((char*) "GNUPGHOME=" GPGHOMEDIR);
+  gpgme_check_version (NULL);
+
+  test_signed_provider ();
+  test_signed_provider_memory ();
+  test_sign_encrypt ();
+  test_encrypt_attach ();
+  test_split_encrypt ();
+  test_split_share ();
+  test_parse_pkesks ();
+  return 0;
+}
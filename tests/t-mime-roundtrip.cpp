@@ -0,0 +1,372 @@
+/* t-mime-roundtrip.cpp - Parse what the MIME writer builds.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Each mail is built with write_mime_structure, signed or encrypted
+   like the CryptController does it and then parsed again with the
+   ParseController.  The parsed body and attachments must match what
+   went in.  The same is done for drafts which are encrypted in parts
+   built with write_mime_part.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gpgme.h>
+#include <gpgme++/context.h>
+#include <gpgme++/key.h>
+#include <gpgme++/signingresult.h>
+#include <gpgme++/encryptionresult.h>
+#include <gpgme++/verificationresult.h>
+
+#include "parsecontroller.h"
+#include "attachment.h"
+#include "mime-crypt.h"
+#include "t-support.h"
+
+/* The "unittest key (no password)" of the test keyring.  */
+#define TEST_KEY "1BA323932B3FAA826132C79E8D9860C58F246DE6"
+
+struct test_attach
+{
+  const char *filename;
+  const char *content_id;
+  std::string data;
+};
+
+struct test_mail
+{
+  const char *name;
+  const char *body;
+  const char *html_body;
+  std::vector<test_attach> attachments;
+};
+
+static void
+fail (const char *name, const char *what)
+{
+  fprintf (stderr, "%s: %s\n", name, what);
+  exit (1);
+}
+
+static int
+attach_open (mime_attach_t attach, source_t source)
+{
+  const std::string *data = static_cast<const std::string *>(attach->cb_data);
+
+  source_init_mem (source, data->data (), data->size ());
+  return 0;
+}
+
+/* The CR,LF in front of a boundary belongs to the boundary, so the
+   parser may or may not keep the line end of the last line.  */
+static std::string
+strip_eol (std::string s)
+{
+  while (!s.empty () && (s.back () == '\n' || s.back () == '\r'))
+    s.pop_back ();
+  return s;
+}
+
+/* Setup MIMEMAIL for MAIL.  ATTACHMENTS must stay valid as long as
+   MIMEMAIL is used.  */
+static void
+fill_mime_mail (const test_mail &mail,
+                std::vector<struct mime_attach_s> &attachments,
+                struct mime_mail_s *mimemail)
+{
+  attachments.resize (mail.attachments.size ());
+  for (size_t i = 0; i < attachments.size (); i++)
+    {
+      memset (&attachments[i], 0, sizeof attachments[i]);
+      attachments[i].filename = mail.attachments[i].filename;
+      attachments[i].content_id = mail.attachments[i].content_id;
+      attachments[i].usable = 1;
+      attachments[i].cb_data = (void *) &mail.attachments[i].data;
+      attachments[i].openfnc = attach_open;
+    }
+  memset (mimemail, 0, sizeof *mimemail);
+  mimemail->plain_body = mail.body;
+  mimemail->is_alternative = !!mail.html_body;
+  mimemail->html_body = mail.html_body;
+  mimemail->n_att_usable = (int) attachments.size ();
+  mimemail->attachments = attachments.empty () ? NULL : attachments.data ();
+  mimemail->n_attachments = attachments.size ();
+}
+
+static GpgME::Data
+build (const test_mail &mail)
+{
+  std::vector<struct mime_attach_s> attachments;
+  struct mime_mail_s mimemail;
+  struct sink_s sinkmem;
+  GpgME::Data ret;
+
+  fill_mime_mail (mail, attachments, &mimemail);
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &ret;
+  sinkmem.writefnc = sink_data_write;
+  if (write_mime_structure (&sinkmem, &mimemail))
+    fail (mail.name, "write_mime_structure failed");
+  ret.seek (0, SEEK_SET);
+  return ret;
+}
+
+/* Sign or encrypt MIME and wrap it like update_mail_mapi does.  With
+   BINARY the ciphertext is not armored but base64 encoded.  The
+   result is written to a temporary file.  */
+static FILE *
+protect (const test_mail &mail, GpgME::Data &mime, bool encrypt,
+         bool binary)
+{
+  GpgME::Error err;
+  auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+  GpgME::Data output;
+  GpgME::Data result;
+  struct sink_s sinkmem;
+  int rc;
+
+  const auto key = ctx->key (TEST_KEY, err, true);
+  if (err || key.isNull ())
+    fail (mail.name, "Test key not found");
+  ctx->addSigningKey (key);
+  ctx->setArmor (!binary);
+  ctx->setTextMode (true);
+
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &result;
+  sinkmem.writefnc = sink_data_write;
+  if (encrypt)
+    {
+      if (ctx->encrypt ({ key }, mime, output,
+                        GpgME::Context::AlwaysTrust).error ())
+        fail (mail.name, "Encryption failed");
+      rc = create_encrypt_attach (&sinkmem, PROTOCOL_OPENPGP, output, -1,
+                                  binary);
+    }
+  else
+    {
+      if (ctx->sign (mime, output, GpgME::Detached).error ())
+        fail (mail.name, "Signing failed");
+      rc = create_sign_attach (&sinkmem, PROTOCOL_OPENPGP, output, mime,
+                               "pgp-sha256");
+    }
+  if (rc)
+    fail (mail.name, "Creating the MIME wrapper failed");
+
+  const std::string data = result.toString ();
+  FILE *fp = tmpfile ();
+  if (!fp || fwrite (data.data (), 1, data.size (), fp) != data.size ())
+    fail (mail.name, "Failed to write temporary file");
+  rewind (fp);
+  return fp;
+}
+
+/* Encrypt each part of MAIL on its own and write them like
+   update_mail_mapi does for a draft.  Returns the number of parts
+   at R_NPARTS.  */
+static FILE *
+protect_draft (const test_mail &mail, bool binary, int *r_nparts)
+{
+  std::vector<struct mime_attach_s> attachments;
+  std::vector<std::shared_ptr<const std::string> > ciphers;
+  struct mime_mail_s mimemail;
+  struct sink_s sinkmem;
+  GpgME::Error err;
+  GpgME::Data result;
+  auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+
+  const auto key = ctx->key (TEST_KEY, err, false);
+  if (err || key.isNull ())
+    fail (mail.name, "Test key not found");
+  ctx->setArmor (!binary);
+
+  fill_mime_mail (mail, attachments, &mimemail);
+  *r_nparts = count_mime_parts (&mimemail);
+  for (int idx = 0; idx < *r_nparts; idx++)
+    {
+      GpgME::Data part;
+      GpgME::Data output;
+
+      memset (&sinkmem, 0, sizeof sinkmem);
+      sinkmem.cb_data = &part;
+      sinkmem.writefnc = sink_data_write;
+      if (write_mime_part (&sinkmem, &mimemail, idx))
+        fail (mail.name, "write_mime_part failed");
+      part.seek (0, SEEK_SET);
+      if (ctx->encrypt ({ key }, part, output,
+                        GpgME::Context::AlwaysTrust).error ())
+        fail (mail.name, "Encryption failed");
+      ciphers.push_back (std::make_shared<const std::string>
+                         (output.toString ()));
+    }
+
+  memset (&sinkmem, 0, sizeof sinkmem);
+  sinkmem.cb_data = &result;
+  sinkmem.writefnc = sink_data_write;
+  if (create_draft_parts_attach (&sinkmem, PROTOCOL_OPENPGP, ciphers, -1,
+                                 binary))
+    fail (mail.name, "Creating the draft parts failed");
+
+  const std::string data = result.toString ();
+  FILE *fp = tmpfile ();
+  if (!fp || fwrite (data.data (), 1, data.size (), fp) != data.size ())
+    fail (mail.name, "Failed to write temporary file");
+  rewind (fp);
+  return fp;
+}
+
+/* Compare what PARSER found with MAIL.  */
+static void
+compare (const test_mail &mail, ParseController &parser)
+{
+  if (strip_eol (parser.get_body ())
+      != strip_eol (mail.body ? mail.body : ""))
+    {
+      fprintf (stderr, "Body was:\n\"%s\"\n", parser.get_body ().c_str ());
+      fail (mail.name, "Body differs");
+    }
+  if (mail.html_body
+      && strip_eol (parser.get_html_body ()) != strip_eol (mail.html_body))
+    fail (mail.name, "HTML body differs");
+
+  const auto attachments = parser.get_attachments ();
+  if (attachments.size () != mail.attachments.size ())
+    {
+      fprintf (stderr, "%s: %u attachments instead of %u\n", mail.name,
+               (unsigned int) attachments.size (),
+               (unsigned int) mail.attachments.size ());
+      exit (1);
+    }
+  /* The attachments shown in an HTML body come first.  */
+  std::vector<const test_attach *> expected;
+  for (const auto &att: mail.attachments)
+    if (att.content_id && mail.html_body)
+      expected.push_back (&att);
+  for (const auto &att: mail.attachments)
+    if (!att.content_id || !mail.html_body)
+      expected.push_back (&att);
+  for (size_t i = 0; i < attachments.size (); i++)
+    {
+      const test_attach *att = expected[i];
+      if (attachments[i]->get_display_name () != att->filename)
+        fail (mail.name, "Attachment name differs");
+      if (att->content_id
+          && attachments[i]->get_content_id ().find (att->content_id)
+             == std::string::npos)
+        fail (mail.name, "Content-ID differs");
+      std::string data = attachments[i]->get_data ().toString ();
+      if (strip_eol (data) != strip_eol (att->data))
+        fail (mail.name, "Attachment data differs");
+    }
+}
+
+static void
+check_mail (const test_mail &mail, bool encrypt, bool binary = false)
+{
+  GpgME::Data mime = build (mail);
+  FILE *fp = protect (mail, mime, encrypt, binary);
+  ParseController parser (fp, encrypt ? MSGTYPE_GPGOL_MULTIPART_ENCRYPTED :
+                                        MSGTYPE_GPGOL_MULTIPART_SIGNED);
+  fclose (fp);
+  parser.parse (true);
+
+  const auto verify = parser.verify_result ();
+  if (parser.decrypt_result ().error () || verify.error ())
+    fail (mail.name, "Decrypt or verify error");
+  if (!encrypt && (verify.numSignatures () != 1
+                   || verify.signature (0).status ()))
+    fail (mail.name, "Signature is not valid");
+
+  compare (mail, parser);
+  pass ("%s %s", mail.name,
+        binary ? "binary" : encrypt ? "encrypted" : "signed");
+}
+
+/* A draft in parts is only decrypted if the parser is told that it
+   parses a draft.  */
+static void
+check_draft (const test_mail &mail, bool binary)
+{
+  int nparts;
+
+  for (int allow = 0; allow < 2; allow++)
+    {
+      FILE *fp = protect_draft (mail, binary, &nparts);
+      ParseController parser (fp, MSGTYPE_GPGOL_MULTIPART_ENCRYPTED);
+      fclose (fp);
+      parser.setAllowDraftParts (allow);
+      parser.parse (true);
+
+      if (!allow)
+        {
+          if (nparts > 1 && !parser.decrypt_result ().error ())
+            fail (mail.name, "Draft parts decrypted in a mail");
+          continue;
+        }
+      if (parser.decrypt_result ().error ())
+        fail (mail.name, "Decrypt error");
+      compare (mail, parser);
+    }
+  pass ("%s draft in %d parts%s", mail.name, nparts,
+        binary ? " binary" : "");
+}
+
+int main ()
+{
+  std::string binary;
+  std::string text;
+
+  putenv ((char*) "GNUPGHOME=" GPGHOMEDIR);
+  gpgme_check_version (NULL);
+
+  for (int i = 0; i < 100000; i++)
+    binary += (char) (i * 7 + i / 251);
+  for (int i = 0; text.size () < 50000; i++)
+    text += "Zeile " + std::to_string (i) + ": Gr\xc3\xbc\xc3\x9f" "e\r\n";
+
+  const test_mail mails[] = {
+    { "plain", "Hello,\r\n\r\njust a body.\r\n-- \r\nSender\r\n", NULL, {} },
+    { "attachments", "See attached.\r\n", NULL,
+      { { "notes.txt", NULL, text },
+        { "data.bin", NULL, binary } } },
+    { "attachments-only", NULL, NULL,
+      { { "data.bin", NULL, binary },
+        { "report.txt", NULL, "A short report.\r\n" } } },
+    { "html", "Hello \xc3\xa4\r\n", "<html><body>Hello &auml;</body></html>",
+      {} },
+    { "html-related", "Look:\r\n",
+      "<html><body><img src=\"cid:image001@example\"></body></html>",
+      { { "image.png", "image001@example", binary },
+        { "notes.txt", NULL, text } } },
+  };
+
+  for (const auto &mail: mails)
+    {
+      check_mail (mail, false);
+      check_mail (mail, true);
+      check_mail (mail, true, true);
+      check_draft (mail, false);
+      check_draft (mail, true);
+    }
+  return 0;
+}
@@ -0,0 +1,601 @@
+/* t-mime-writer.cpp - Tests for the MIME part writer.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common_indep.h"
+#include "mime-writer.h"
+#include "mimedataprovider.h"
+#include "attachment.h"
+#include "alloc-count.h"
+#include "t-support.h"
+
+static int
+count_write (sink_t sink, const void *data, size_t datalen)
+{
+  if (data)
+    *(size_t *) sink->cb_data += datalen;
+  return 0;
+}
+
+/* A memory source which returns only a few bytes per read so that
+   every position becomes a chunk boundary.  */
+static unsigned int trickle_seed;
+
+static int
+trickle_read (source_t source, void *buffer, size_t size, size_t *r_nread)
+{
+  size_t n = source->len - source->off;
+  const size_t max = 1 + rand_r (&trickle_seed) % 13;
+
+  if (n > size)
+    n = size;
+  if (n > max)
+    n = max;
+  memcpy (buffer, (const char *) source->cb_data + source->off, n);
+  source->off += n;
+  *r_nread = n;
+  return 0;
+}
+
+static int
+trickle_rewind (source_t source)
+{
+  source->off = 0;
+  return 0;
+}
+
+static std::string
+write_with (source_t source, const char *filename)
+{
+  struct sink_s sinkmem;
+  std::string out;
+
+  sink_init_string (&sinkmem, &out);
+  if (write_part (&sinkmem, source, "=-=boundary", filename, 0, NULL, NULL))
+    fail ("write_part failed");
+  return out;
+}
+
+static std::string
+header_value (const std::string &out, const char *name)
+{
+  size_t pos = out.find (name);
+
+  if (pos == std::string::npos)
+    return std::string ();
+  pos += strlen (name);
+  return out.substr (pos, out.find ("\r\n", pos) - pos);
+}
+
+/* The input as it is expected after decoding a text encoding: all
+   line ends are CR,LF and the last line is terminated.  */
+static std::string
+canonical_text (const std::string &in, bool plain)
+{
+  std::string ret;
+  size_t start = 0;
+
+  while (start < in.size ())
+    {
+      size_t eol = in.find ('\n', start);
+      if (eol == std::string::npos)
+        eol = in.size ();
+      std::string line = in.substr (start, eol - start);
+      if (eol < in.size () && !line.empty () && line.back () == '\r')
+        line.pop_back ();
+      /* The plain encoder protects lines with a single dot.  */
+      if (plain && line == ".")
+        line += ' ';
+      ret += line + "\r\n";
+      start = eol + 1;
+    }
+  return ret;
+}
+
+/* Encode IN as whole, in tiny reads and from a file and check that
+   the results agree and decode to IN.  */
+static void
+check_roundtrip (const std::string &in, const char *filename,
+                 const char *expected_cte)
+{
+  struct source_s source;
+
+  source_init_mem (&source, in.data (), in.size ());
+  const std::string whole = write_with (&source, filename);
+
+  memset (&source, 0, sizeof source);
+  source.cb_data = (void *) in.data ();
+  source.len = in.size ();
+  source.readfnc = trickle_read;
+  source.rewindfnc = trickle_rewind;
+  if (write_with (&source, filename) != whole)
+    fail ("Output differs for short reads");
+
+  FILE *fp = tmpfile ();
+  if (!fp || fwrite (in.data (), 1, in.size (), fp) != in.size ())
+    fail ("Failed to create a temporary file");
+  source_init_file (&source, fp);
+  if (write_with (&source, filename) != whole)
+    fail ("Output differs for a file");
+  fclose (fp);
+
+  const std::string cte = header_value (whole,
+                                        "Content-Transfer-Encoding: ");
+  if (expected_cte && cte != expected_cte)
+    {
+      fprintf (stderr, "Expected %s but got %s\n", expected_cte,
+               cte.c_str ());
+      exit (1);
+    }
+
+  size_t pos = whole.find ("\r\n\r\n");
+  if (pos == std::string::npos)
+    fail ("No end of header");
+  std::string body = whole.substr (pos + 4);
+  std::string expected;
+  if (cte == "base64")
+    {
+      b64_state_t state;
+      b64_init (&state);
+      body.resize (b64_decode (&state, &body[0], body.size ()));
+      expected = in;
+    }
+  else if (cte == "quoted-printable")
+    {
+      body.resize (qp_decode (&body[0], body.size (), NULL));
+      expected = canonical_text (in, false);
+    }
+  else
+    expected = canonical_text (in, true);
+  if (body != expected)
+    fail ("Round trip failed");
+}
+
+/* Text lines with all the line start hazards, placed so that they
+   end up at many different offsets to the chunk boundaries.  */
+static std::string
+make_text (size_t size, bool hazards)
+{
+  static const char *lines[] = {
+    "Hello world,", "From here on", "-- ", ".", "--=-=not ours",
+    "trailing space ", "tab\t", "", "Just some text with a few more "
+    "words to fill the line", NULL
+  };
+  std::string ret;
+  unsigned int seed = size;
+
+  for (int i = 0; ret.size () < size; i++)
+    {
+      const char *line = lines[rand_r (&seed) % 9];
+      if (!hazards && (!strncmp (line, "From", 4) || *line == '-'))
+        continue;
+      ret += line;
+      ret += (i % 7)? "\r\n" : "\n";
+      ret.append (rand_r (&seed) % 4, 'x');
+    }
+  return ret;
+}
+
+static void
+test_roundtrip ()
+{
+  std::string s;
+
+  check_roundtrip ("", NULL, "7bit");
+  check_roundtrip ("x", NULL, "7bit");
+  check_roundtrip ("Just a line\r\n", NULL, "7bit");
+  check_roundtrip (make_text (200000, false), NULL, "7bit");
+  check_roundtrip (make_text (200000, true), NULL, "quoted-printable");
+  check_roundtrip (make_text (5000, true) + "\r", NULL, "quoted-printable");
+
+  s = make_text (100000, false);
+  for (size_t i = 0; i < s.size (); i += 97)
+    s[i] = (char) 0xe4;
+  check_roundtrip (s, "notes.txt", "quoted-printable");
+
+  s.assign (150000, 'a');
+  check_roundtrip (s, NULL, "quoted-printable");
+
+  s.clear ();
+  for (int i = 0; i < 200000; i++)
+    s += (char) (i * 7 + i / 251);
+  check_roundtrip (s, NULL, "base64");
+  for (size_t n = 1; n < 5; n++)
+    check_roundtrip (s.substr (0, n), "image.png", "base64");
+  check_roundtrip (make_text (1000, false), "archive.zip", "base64");
+  pass ("roundtrip");
+}
+
+/* Memory use must not depend on the size of an attachment.  */
+static void
+test_memory ()
+{
+  const size_t size = 8 * 1024 * 1024;
+  const std::string line = "The same line over and over, \xc3\xa4\r\n";
+  struct sink_s sinkmem;
+  struct source_s source;
+  size_t written;
+  alloc_profile_t profile;
+  FILE *fp;
+
+  for (int binary = 0; binary < 2; binary++)
+    {
+      if (!(fp = tmpfile ()))
+        fail ("Failed to create a temporary file");
+      for (size_t n = 0; n < size; n += line.size ())
+        if (binary)
+          {
+            for (size_t i = 0; i < line.size (); i++)
+              putc ((int) (n + i * 31), fp);
+          }
+        else
+          fputs (line.c_str (), fp);
+
+      memset (&sinkmem, 0, sizeof sinkmem);
+      written = 0;
+      sinkmem.cb_data = &written;
+      sinkmem.writefnc = count_write;
+      source_init_file (&source, fp);
+      alloc_count_start (&profile);
+      if (write_part (&sinkmem, &source, NULL, "data", 0, NULL, NULL))
+        fail ("write_part failed");
+      alloc_count_stop ();
+      fclose (fp);
+
+      if (written < size)
+        fail ("Output is too short");
+      if (alloc_profile_bytes (&profile, ALLOC_N_PHASES) > 256 * 1024)
+        {
+          fprintf (stderr, "%lu bytes allocated for %lu bytes input\n",
+                   (unsigned long) alloc_profile_bytes (&profile,
+                                                        ALLOC_N_PHASES),
+                   (unsigned long) size);
+          exit (1);
+        }
+    }
+  pass ("memory");
+}
+
+/* Records what reaches the end of a sink chain.  */
+struct chain_end
+{
+  std::string out;
+  unsigned int n_writes;
+  unsigned int n_flushes;
+  const void *last;
+};
+
+static int
+chain_end_write (sink_t sink, const void *data, size_t datalen)
+{
+  struct chain_end *end = (struct chain_end *) sink->cb_data;
+
+  if (!data)
+    end->n_flushes++;
+  else
+    {
+      end->out.append ((const char *) data, datalen);
+      end->n_writes++;
+    }
+  end->last = data;
+  return 0;
+}
+
+/* A batching and a counting sink in front of the output must not
+   change it, but reduce the number of writes and pass large writes
+   on without a copy.  */
+static void
+test_chain ()
+{
+  const std::string text = make_text (100000, true);
+  std::string binary;
+  struct sink_batch_s batch;
+  struct sink_s endsink, countsink, batchsink;
+  struct chain_end end;
+
+  for (int i = 0; i < 100000; i++)
+    binary += (char) (i * 7 + i / 251);
+
+  std::string expected;
+  for (int i = 0; i < 2; i++)
+    {
+      struct sink_s sinkmem;
+
+      sink_init_string (&sinkmem, &expected);
+      if (write_part_mem (&sinkmem, text.data (), text.size (), "=-=b",
+                          "notes.txt", 0, NULL, NULL)
+          || write_part_mem (&sinkmem, binary.data (), binary.size (),
+                             "=-=b", "data.bin", 0, NULL, NULL)
+          || write_boundary (&sinkmem, "=-=b", 1))
+        fail ("write_part_mem failed");
+    }
+
+  end.n_writes = end.n_flushes = 0;
+  memset (&endsink, 0, sizeof endsink);
+  endsink.cb_data = &end;
+  endsink.writefnc = chain_end_write;
+  sink_init_count (&countsink, &endsink);
+  sink_init_batch (&batchsink, &batch, &countsink);
+  for (int i = 0; i < 2; i++)
+    if (write_part_mem (&batchsink, text.data (), text.size (), "=-=b",
+                        "notes.txt", 0, NULL, NULL)
+        || write_part_mem (&batchsink, binary.data (), binary.size (),
+                           "=-=b", "data.bin", 0, NULL, NULL)
+        || write_boundary (&batchsink, "=-=b", 1))
+      fail ("write_part_mem failed");
+  if (end.out.size () == expected.size ())
+    fail ("Nothing was held back by the batching sink");
+  if (sink_flush (&batchsink) || end.n_flushes != 1)
+    fail ("Flush was not passed on");
+  if (end.out != expected)
+    fail ("Output of the chain differs");
+  if (countsink.enc_counter != expected.size ())
+    fail ("Wrong count");
+  /* The encoders already write in large blocks, thus only the
+     headers and boundaries are copied.  */
+  if (batch.copied * 100 > expected.size ())
+    {
+      fprintf (stderr, "%lu bytes copied for %lu bytes output\n",
+               batch.copied, (unsigned long) expected.size ());
+      exit (1);
+    }
+  if (end.n_writes > 2 * (expected.size () / SINK_BATCH_DIRECT))
+    fail ("Too many writes");
+
+  /* A large write is handed on as it is.  */
+  if (write_string (&batchsink, "small")
+      || write_buffer (&batchsink, binary.data (), binary.size ()))
+    fail ("write_buffer failed");
+  if (end.last != binary.data ()
+      || end.out.compare (end.out.size () - binary.size () - 5,
+                          std::string::npos, "small" + binary))
+    fail ("Large write was not passed on unchanged");
+  pass ("chain");
+}
+
+static int
+attach_open (mime_attach_t attach, source_t source)
+{
+  const std::string *data = static_cast<const std::string *>(attach->cb_data);
+
+  source_init_mem (source, data->data (), data->size ());
+  return 0;
+}
+
+/* Parse MIME like decrypted output and return what was found as one
+   string.  Trailing line ends of the body, the order of the
+   attachments and how they are nested do not matter.  */
+static std::string
+describe (const std::string &mime)
+{
+  MimeDataProvider provider;
+  std::vector<std::string> atts;
+  std::string body;
+
+  provider.write (mime.data (), mime.size ());
+  provider.finalize ();
+  body = provider.get_body ();
+  while (!body.empty () && (body.back () == '\r' || body.back () == '\n'))
+    body.pop_back ();
+  for (const auto &attach: provider.get_attachments ())
+    {
+      /* The parser reports some containers as empty attachments.  */
+      if (!attach->get_content_type ().compare (0, 10, "multipart/"))
+        continue;
+      atts.push_back (attach->get_display_name () + '\0'
+                      + attach->get_content_id () + '\0'
+                      + attach->get_data ().toString ());
+    }
+  std::sort (atts.begin (), atts.end ());
+  std::string ret = body + '\0' + provider.get_html_body ();
+  for (const auto &att: atts)
+    ret += '\0' + att;
+  return ret;
+}
+
+/* Put all parts of MAIL into a multipart/mixed.  A single part is
+   returned as it is.  */
+static std::string
+join_parts (const struct mime_mail_s *mail)
+{
+  std::string ret;
+  struct sink_s sinkmem;
+
+  sink_init_string (&sinkmem, &ret);
+  if (count_mime_parts (mail) == 1)
+    {
+      if (write_mime_part (&sinkmem, mail, 0))
+        fail ("write_mime_part failed");
+      return ret;
+    }
+  ret = "Content-Type: multipart/mixed;\r\n"
+        "\tboundary=\"=-=parts=-=\"\r\n";
+  for (int idx = 0; idx < count_mime_parts (mail); idx++)
+    {
+      if (write_boundary (&sinkmem, "=-=parts=-=", 0)
+          || write_mime_part (&sinkmem, mail, idx))
+        fail ("write_mime_part failed");
+    }
+  if (write_boundary (&sinkmem, "=-=parts=-=", 1))
+    fail ("write_boundary failed");
+  return ret;
+}
+
+/* The body stays together with the attachments shown in it and
+   every other attachment is a part of its own.  Together the parts
+   hold the same as the whole structure.  */
+static void
+test_parts ()
+{
+  const std::string text = make_text (20000, false);
+  const std::string html = "<html><body><img src=\"cid:img@example\">"
+                           "</body></html>";
+  std::string binary, out;
+  struct mime_attach_s atts[3];
+  struct mime_mail_s mail;
+  struct sink_s sinkmem;
+  static const struct
+  {
+    int body;
+    int html;
+    int usable[3];
+    int n_parts;
+  } cases[] = {
+    { 1, 0, { 0, 0, 0 }, 1 },  /* Only the body.  */
+    { 1, 0, { 1, 1, 0 }, 3 },  /* Body and attachments.  */
+    { 1, 1, { 1, 1, 1 }, 3 },  /* Related and mixed.  */
+    { 1, 1, { 0, 1, 0 }, 1 },  /* Only related.  */
+    { 0, 0, { 1, 0, 1 }, 2 },  /* Only attachments.  */
+    { 0, 1, { 1, 1, 0 }, 2 },  /* No body, so nothing related.  */
+  };
+
+  for (int i = 0; i < 100000; i++)
+    binary += (char) (i * 7 + i / 251);
+
+  memset (atts, 0, sizeof atts);
+  atts[0].filename = "notes.txt";
+  atts[0].cb_data = (void *) &text;
+  atts[1].filename = "image.png";
+  atts[1].content_id = "img@example";
+  atts[1].cb_data = (void *) &binary;
+  atts[2].filename = "data.bin";
+  atts[2].cb_data = (void *) &binary;
+  for (auto &att: atts)
+    att.openfnc = attach_open;
+
+  sink_init_string (&sinkmem, &out);
+
+  for (const auto &c: cases)
+    {
+      memset (&mail, 0, sizeof mail);
+      mail.plain_body = c.body ? "Hello,\r\n\r\nsee attached.\r\n" : NULL;
+      mail.is_alternative = c.html;
+      mail.html_body = c.html ? html.c_str () : NULL;
+      mail.attachments = atts;
+      mail.n_attachments = 3;
+      for (int i = 0; i < 3; i++)
+        {
+          atts[i].usable = c.usable[i];
+          mail.n_att_usable += c.usable[i];
+        }
+
+      if (count_mime_parts (&mail) != c.n_parts)
+        {
+          fprintf (stderr, "%d parts instead of %d\n",
+                   count_mime_parts (&mail), c.n_parts);
+          exit (1);
+        }
+      out.clear ();
+      if (!write_mime_part (&sinkmem, &mail, c.n_parts) || !out.empty ())
+        fail ("Wrote a part which does not exist");
+      if (write_mime_structure (&sinkmem, &mail))
+        fail ("write_mime_structure failed");
+      if (describe (join_parts (&mail)) != describe (out))
+        fail ("Parts differ from the whole");
+    }
+  pass ("parts");
+}
+
+/* A source which fails after the number of bytes in the attachment's
+   cb_data like a stream with a read error.  */
+static int
+broken_read (source_t source, void *buffer, size_t size, size_t *r_nread)
+{
+  size_t n = std::min (size, source->len - source->off);
+
+  if (!n)
+    return -1;
+  memset (buffer, 'x', n);
+  source->off += n;
+  *r_nread = n;
+  return 0;
+}
+
+static int
+broken_open (mime_attach_t attach, source_t source)
+{
+  source->len = *static_cast<const size_t *>(attach->cb_data);
+  source->readfnc = broken_read;
+  return 0;
+}
+
+static int broken_closed;
+
+static void
+broken_close (mime_attach_t attach, source_t source)
+{
+  (void) attach;
+  (void) source;
+  broken_closed++;
+}
+
+/* A read error of an attachment must fail the whole mail and not
+   send it with the attachment cut off.  */
+static void
+test_read_error ()
+{
+  static const size_t sizes[] = { 0, 100, 20000, 300000 };
+  struct mime_attach_s att;
+  struct mime_mail_s mail;
+  struct sink_s sinkmem;
+  std::string out;
+
+  sink_init_string (&sinkmem, &out);
+
+  for (const auto &size: sizes)
+    {
+      memset (&att, 0, sizeof att);
+      att.filename = "notes.txt";
+      att.usable = 1;
+      att.cb_data = (void *) &size;
+      att.openfnc = broken_open;
+      att.closefnc = broken_close;
+      memset (&mail, 0, sizeof mail);
+      mail.plain_body = "Hello,\r\n\r\nsee attached.\r\n";
+      mail.attachments = &att;
+      mail.n_attachments = 1;
+      mail.n_att_usable = 1;
+
+      broken_closed = 0;
+      if (!write_mime_structure (&sinkmem, &mail))
+        fail ("Read error of an attachment not reported");
+      if (!write_mime_part (&sinkmem, &mail, 1))
+        fail ("Read error of an attachment part not reported");
+      if (broken_closed != 2)
+        fail ("Attachment not closed after a read error");
+    }
+  pass ("read error");
+}
+
+int main ()
+{
+  test_roundtrip ();
+  test_memory ();
+  test_chain ();
+  test_parts ();
+  test_read_error ();
+  return 0;
+}
@@ -22,6 +22,9 @@
 #include "parsecontroller.h"
 #include <iostream>
 #include "attachment.h"
+#include "latency.h"
+#include "timeline.h"
+#include "alloc-count.h"
 #include <gpgme.h>
 
 struct
@@ -32,81 +35,98 @@ struct
   const char *expected_html_body_file;
   int attachment_cnt;
   const char *expected_charset;
+  /* Allocations allowed for reading the input, MIME parsing and
+     finalize.  Measured with "run-parser --allocs" plus half as much
+     for other C++ runtimes.  Decrypt, verify and the gpgme++
+     wrappers are not budgeted as they differ between versions.  */
+  unsigned int max_allocs;
 } test_data[] = {
   { DATADIR "/inlinepgpencrypted.mbox",
     MSGTYPE_GPGOL_PGP_MESSAGE,
     DATADIR "/inlinepgpencrypted.plain",
     NULL,
     0,
-    NULL},
+    NULL,
+    20},
   { DATADIR "/openpgp-encrypted.mbox",
     MSGTYPE_GPGOL_MULTIPART_ENCRYPTED,
     DATADIR "/openpgp-encrypted.plain",
     NULL,
     0,
-    NULL},
+    NULL,
+    40},
   { DATADIR "/openpgp-signed-no-attach.mbox",
     MSGTYPE_GPGOL_MULTIPART_SIGNED,
     DATADIR "/openpgp-signed-no-attach.plain",
     NULL,
     0,
-    "iso-8859-1"},
+    "iso-8859-1",
+    200},
   { DATADIR "/openpgp-signed-no-attach-gpgol.mbox",
     MSGTYPE_GPGOL_MULTIPART_SIGNED,
     DATADIR "/openpgp-signed-no-attach-gpgol.plain",
     NULL,
     0,
-    "iso-8859-1"},
+    "iso-8859-1",
+    180},
   { DATADIR "/openpgp-signed-two-attachments.mbox",
     MSGTYPE_GPGOL_MULTIPART_SIGNED,
     DATADIR "/openpgp-signed-two-attachments.plain",
     NULL,
     2,
-    "us-ascii"},
+    "us-ascii",
+    480},
   { DATADIR "/openpgp-encrypted+signed.mbox",
     MSGTYPE_GPGOL_MULTIPART_ENCRYPTED,
     DATADIR "/openpgp-encrypted+signed.plain",
     NULL,
     0,
-    "us-ascii"},
+    "us-ascii",
+    40},
   { DATADIR "/openpgp-encrypted-attachment.mbox",
     MSGTYPE_GPGOL_MULTIPART_ENCRYPTED,
     DATADIR "/openpgp-encrypted-attachment.plain",
     NULL,
     1,
-    "us-ascii"},
+    "us-ascii",
+    350},
   /* Same as above but without any headers */
   { DATADIR "/openpgp-encrypted-attachment-no-headers.mbox",
     MSGTYPE_GPGOL_MULTIPART_ENCRYPTED,
     DATADIR "/openpgp-encrypted-attachment.plain",
     NULL,
     1,
-    "us-ascii"},
+    "us-ascii",
+    350},
   { DATADIR "/smime-opaque-sign.mbox",
     MSGTYPE_GPGOL_OPAQUE_SIGNED,
     DATADIR "/smime-opaque-sign.plain",
     NULL,
     0,
-    "utf-8"},
+    "utf-8",
+    40},
   { DATADIR "/smime-encrypted.mbox",
     MSGTYPE_GPGOL_OPAQUE_ENCRYPTED,
     DATADIR "/smime-encrypted.plain",
     NULL,
     0,
-    "us-ascii"},
+    "us-ascii",
+    40},
   { DATADIR "/smime-opaque-signed-encrypted-attachment.mbox",
     MSGTYPE_GPGOL_OPAQUE_ENCRYPTED,
     DATADIR "/smime-opaque-signed-encrypted-attachment.plain",
     NULL,
     1,
-    "us-ascii"},
+    "us-ascii",
+    190},
   { DATADIR "/openpgp-encrypted-attachment-gpgol.mbox",
     MSGTYPE_GPGOL_MULTIPART_ENCRYPTED,
     DATADIR "/openpgp-encrypted-attachment-gpgol.plain",
     NULL,
     1,
-    "utf-8"},
-  { NULL, MSGTYPE_UNKNOWN, NULL, NULL, 0, NULL }
+    "utf-8",
+    330},
+  { NULL, MSGTYPE_UNKNOWN, NULL, NULL, 0, NULL, 0 }
 };
 
 
@@ -115,6 +135,7 @@ int main()
   int i = 0;
   putenv ((char*) "GNUPGHOME=" GPGHOMEDIR);
   gpgme_check_version (NULL);
+  opt.enable_debug |= DBG_LATENCY;
 
   while (test_data[i].input_file)
     {
@@ -125,11 +146,35 @@ int main()
                    test_data[i].input_file);
           exit(1);
         }
+      auto timeline = std::make_shared<Timeline> (test_data[i].input_file);
+      alloc_profile_t allocs;
+      alloc_count_start (&allocs);
       ParseController parser (input, test_data[i].type);
+      parser.setTimeline (timeline);
 
       fclose(input);
 
-      parser.parse();
+      parser.parse (true);
+      alloc_count_stop ();
+
+      fprintf (stderr, "Allocations: %s\n",
+               alloc_profile_format (&allocs).c_str ());
+      if (allocs.count[ALLOC_PHASE_READ] + allocs.count[ALLOC_PHASE_MIME]
+          + allocs.count[ALLOC_PHASE_FINALIZE] > test_data[i].max_allocs)
+        {
+          fprintf (stderr, "Allocation budget of %u exceeded\n",
+                   test_data[i].max_allocs);
+          exit(1);
+        }
+
+      /* At least the begin and end of the parse.  */
+      if (timeline->count () < 2
+          || timeline->toJson (1).find ("\"ph\":\"E\"") == std::string::npos)
+        {
+          fprintf (stderr, "Parse timeline was not recorded\n");
+          exit(1);
+        }
+      timeline_finish (timeline);
 
       auto decResult = parser.decrypt_result();
       auto verifyResult = parser.verify_result();
@@ -202,5 +247,11 @@ int main()
       fprintf (stderr, "Pass: %s\n", test_data[i].input_file);
       i++;
     }
+  if (latency_count (latency_get ("ParseController::parse")) != (uint64_t) i)
+    {
+      fprintf (stderr, "Parse latency was not recorded\n");
+      exit(1);
+    }
+  fprintf (stderr, "%s", latency_report (false).c_str ());
   exit(0);
 }
@@ -0,0 +1,182 @@
+/* t-resolution-cache.cpp - Tests for the remembered key resolutions.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gpgme.h>
+#include <gpgme++/context.h>
+#include <gpgme++/key.h>
+
+#include "resolution-cache.h"
+#include "t-support.h"
+
+/* The "unittest key (no password)" of the test keyring.  */
+#define TEST_KEY "1BA323932B3FAA826132C79E8D9860C58F246DE6"
+
+#define SENDER "sender@example.org"
+
+static std::string
+id_for (int n, GpgME::Protocol proto = GpgME::UnknownProtocol)
+{
+  const std::string mbox = "r" + std::to_string (n) + "@example.org";
+
+  return ResolutionCache::makeId ({ mbox }, SENDER, proto, RES_FLAG_ENCRYPT);
+}
+
+/* The order, the case and duplicates of the recipients do not
+   matter, everything else does.  */
+static void
+test_id ()
+{
+  const unsigned int flags = RES_FLAG_SIGN | RES_FLAG_ENCRYPT;
+  const auto id = ResolutionCache::makeId ({ "a@example.org",
+                                             "B@Example.org" },
+                                           SENDER, GpgME::OpenPGP, flags);
+
+  if (id != ResolutionCache::makeId ({ "b@example.org", " a@example.org",
+                                       "a@example.org" },
+                                     "Sender@example.org", GpgME::OpenPGP,
+                                     flags))
+    fail ("Equivalent recipient sets differ");
+  if (id == ResolutionCache::makeId ({ "a@example.org" }, SENDER,
+                                     GpgME::OpenPGP, flags)
+      || id == ResolutionCache::makeId ({ "a@example.org", "b@example.org" },
+                                        "other@example.org",
+                                        GpgME::OpenPGP, flags)
+      || id == ResolutionCache::makeId ({ "a@example.org", "b@example.org" },
+                                        SENDER, GpgME::CMS, flags)
+      || id == ResolutionCache::makeId ({ "a@example.org", "b@example.org" },
+                                        SENDER, GpgME::OpenPGP,
+                                        RES_FLAG_ENCRYPT))
+    fail ("Different resolutions have the same id");
+  /* The separator must not allow for two ways to split the list.  */
+  if (ResolutionCache::makeId ({ "a@x,b@y" }, SENDER, GpgME::OpenPGP, flags)
+      == ResolutionCache::makeId ({ "a@x", "b@y" }, SENDER,
+                                  GpgME::OpenPGP, flags))
+    fail ("Ambiguous id");
+  pass ("id");
+}
+
+static void
+test_get_put (const GpgME::Key &key)
+{
+  auto cache = ResolutionCache::instance ();
+  ResolutionCache::Resolution res;
+
+  cache->clear ();
+  if (cache->get (id_for (1)))
+    fail ("Found a resolution in an empty cache");
+
+  res.proto = GpgME::OpenPGP;
+  res.signer_keys.push_back (key);
+  res.recipient_keys["r1@example.org"].push_back (key);
+  cache->put (id_for (1), res);
+  const auto got = cache->get (id_for (1));
+  if (!got)
+    fail ("Resolution not found");
+  if (got->proto != GpgME::OpenPGP || got->signer_keys.size () != 1
+      || got->recipient_keys.size () != 1
+      || strcmp (got->recipient_keys.at ("r1@example.org")[0]
+                 .primaryFingerprint (), TEST_KEY))
+    fail ("Resolution differs");
+  if (cache->get (id_for (1, GpgME::CMS)))
+    fail ("Found a resolution for another protocol");
+
+  cache->clear ();
+  if (cache->get (id_for (1)) || cache->size ())
+    fail ("Resolution not cleared");
+  pass ("get put");
+}
+
+/* The least recently used resolutions are dropped first.  */
+static void
+test_limit ()
+{
+  auto cache = ResolutionCache::instance ();
+  ResolutionCache::Resolution res;
+  int n;
+
+  cache->clear ();
+  for (n = 0; n < 1000; n++)
+    {
+      cache->put (id_for (n), res);
+      /* Keep the first one in use.  */
+      if (!cache->get (id_for (0)))
+        fail ("Resolution in use was dropped");
+    }
+  if (cache->size () > 100)
+    fail ("The cache is not limited");
+  if (cache->get (id_for (1)))
+    fail ("Old resolution was not dropped");
+  if (!cache->get (id_for (n - 1)))
+    fail ("New resolution was dropped");
+  cache->clear ();
+  pass ("limit");
+}
+
+/* A key update drops only the resolutions with that key.  */
+static void
+test_drop_key (const GpgME::Key &key)
+{
+  auto cache = ResolutionCache::instance ();
+  ResolutionCache::Resolution with_recp, with_signer, without;
+
+  cache->clear ();
+  with_recp.recipient_keys["r1@example.org"].push_back (key);
+  with_signer.signer_keys.push_back (key);
+  without.recipient_keys["r3@example.org"].push_back (GpgME::Key ());
+  cache->put (id_for (1), with_recp);
+  cache->put (id_for (2), with_signer);
+  cache->put (id_for (3), without);
+
+  cache->dropKey ("0000000000000000000000000000000000000000");
+  if (cache->size () != 3)
+    fail ("Unrelated key dropped a resolution");
+  cache->dropKey (TEST_KEY);
+  if (cache->get (id_for (1)) || cache->get (id_for (2)))
+    fail ("Resolution with the key was not dropped");
+  if (!cache->get (id_for (3)))
+    fail ("Resolution without the key was dropped");
+  cache->clear ();
+  pass ("drop key");
+}
+
+int main ()
+{
+  GpgME::Error err;
+
+  putenv ((char*) "GNUPGHOME=" GPGHOMEDIR);
+  gpgme_check_version (NULL);
+
+  auto ctx = GpgME::Context::create (GpgME::OpenPGP);
+  const auto key = ctx->key (TEST_KEY, err, false);
+  if (err || key.isNull ())
+    fail ("Test key not found");
+
+  test_id ();
+  test_get_put (key);
+  test_limit ();
+  test_drop_key (key);
+  return 0;
+}
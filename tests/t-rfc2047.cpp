@@ -0,0 +1,203 @@
+/* t-rfc2047.cpp - Test for gpgOL's rfc2047 header decoder.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include "common_indep.h"
+#include "rfc2047parse.h"
+#include "t-support.h"
+
+struct
+{
+  const char *input;
+  const char *expected;
+} test_data[] = {
+  { "plain ascii subject", "plain ascii subject" },
+  { "=?utf-8?Q?Gr=C3=BC=C3=9Fe?=", "Gr\xc3\xbc\xc3\x9f" "e" },
+  { "=?UTF-8?B?R3LDvMOfZQ==?=", "Gr\xc3\xbc\xc3\x9f" "e" },
+  { "=?utf-8?q?hello_world?=", "hello world" },
+  /* Whitespace between encoded words is dropped.  */
+  { "=?utf-8?Q?foo?= =?utf-8?Q?bar?=", "foobar" },
+  /* A QP triplet split between two words.  */
+  { "=?utf-8?Q?a=C3?= =?utf-8?Q?=BCb?=", "a\xc3\xbc" "b" },
+  { "Re: =?utf-8?Q?caf=C3=A9?= menu", "Re: caf\xc3\xa9 menu" },
+  { "=?utf-8*de?Q?Stra=C3=9Fe?=", "Stra\xc3\x9f" "e" },
+  { "=?iso-8859-1?Q?Gr=FC=DFe?=", "Gr\xc3\xbc\xc3\x9f" "e" },
+  { "=?ISO-8859-15?B?pA==?=", "\xe2\x82\xac" },
+  /* Malformed words are passed through.  */
+  { "=?utf-8?X?abc?=", "=?utf-8?X?abc?=" },
+  { "=?utf-8?Q?unterminated", "=?utf-8?Q?unterminated" },
+  { "=?", "=?" },
+  { "=??Q?x?=", "=??Q?x?=" },
+  { "", "" },
+  { NULL, NULL }
+};
+
+/* Some internationalized headers for the benchmark.  */
+static const char *bench_corpus[] = {
+  "=?utf-8?B?0J/RgNC40LLQtdGCINC80LjRgCDQuCDQstGB0LXQvCDQv9GA0LjQstC10YI=?=",
+  "=?utf-8?Q?R=C3=A9union_d'=C3=A9quipe_=E2=80=93_ordre_du_jour?=",
+  "=?UTF-8?B?5Lya6K2w44Gu6K2w5LqL6Yyy?= =?UTF-8?B?44Gu44GK55+l44KJ44Gb?=",
+  "AW: =?utf-8?Q?Angebot_f=C3=BCr_die_n=C3=A4chste_Woche?=",
+  "Weekly status report 2026-10 (no encoding at all)",
+  "=?utf-8?Q?Rechnung=5F2026=2D10=2Epdf?=",
+  "\"=?utf-8?Q?M=C3=BCller=2C_J=C3=BCrgen?=\" <juergen@example.org>",
+  NULL
+};
+
+static void
+fail (const char *what, const char *input, const char *got,
+      const char *expected)
+{
+  fprintf (stderr, "%s for \"%s\":\n got:      \"%s\"\n expected: \"%s\"\n",
+           what, input, got, expected);
+  exit (1);
+}
+
+/* Check that the buffer variant agrees with the allocating one for
+   every buffer size up to the full length.  */
+static void
+check_buf_variant (const char *input, const std::string &full)
+{
+  char buf[512];
+
+  for (size_t size = 1; size <= full.size () + 1 && size <= sizeof buf;
+       size++)
+    {
+      size_t len = rfc2047_parse_buf (input, buf, size);
+      if (len != full.size ())
+        fail ("Length mismatch", input, buf, full.c_str ());
+      if (strlen (buf) != (size > len ? len : size - 1)
+          || full.compare (0, strlen (buf), buf))
+        fail ("Truncation mismatch", input, buf, full.c_str ());
+    }
+}
+
+static std::string
+parse (const char *input)
+{
+  char *res = rfc2047_parse (input);
+  std::string ret = res;
+  xfree (res);
+  return ret;
+}
+
+/* Feed randomly mutated versions of the test vectors into the
+   decoder.  This is no replacement for a real fuzzer but it catches
+   the obvious out of bounds problems when run under a sanitizer.  */
+static void
+run_fuzz (unsigned int iterations)
+{
+  static const char alphabet[] = "=?_ QqBbutf-8aZ09+/\t\x80\xff";
+  char input[300];
+
+  srand (42);
+  for (unsigned int it = 0; it < iterations; it++)
+    {
+      int idx = rand () % (DIM (test_data) - 1);
+      size_t len = strlen (test_data[idx].input);
+
+      if (len >= sizeof input - 1)
+        len = sizeof input - 2;
+      memcpy (input, test_data[idx].input, len);
+      for (int n = rand () % 8; n >= 0; n--)
+        {
+          size_t pos = len ? rand () % len : 0;
+          switch (rand () % 3)
+            {
+            case 0: /* Replace */
+              if (len)
+                input[pos] = alphabet[rand () % (sizeof alphabet - 1)];
+              break;
+            case 1: /* Insert */
+              if (len < sizeof input - 2)
+                {
+                  memmove (input + pos + 1, input + pos, len - pos);
+                  input[pos] = alphabet[rand () % (sizeof alphabet - 1)];
+                  len++;
+                }
+              break;
+            default: /* Truncate */
+              len = pos;
+              break;
+            }
+        }
+      input[len] = 0;
+      check_buf_variant (input, parse (input));
+    }
+}
+
+static void
+run_bench (unsigned int iterations)
+{
+  char buf[1024];
+  size_t total = 0;
+  clock_t start;
+
+  start = clock ();
+  for (unsigned int it = 0; it < iterations; it++)
+    for (int i = 0; bench_corpus[i]; i++)
+      {
+        char *res = rfc2047_parse (bench_corpus[i]);
+        total += strlen (res);
+        xfree (res);
+      }
+  printf ("rfc2047_parse:     %u headers in %.3fs (%lu bytes)\n",
+          iterations * (unsigned int)(DIM (bench_corpus) - 1),
+          (double)(clock () - start) / CLOCKS_PER_SEC,
+          (unsigned long)total);
+
+  total = 0;
+  start = clock ();
+  for (unsigned int it = 0; it < iterations; it++)
+    for (int i = 0; bench_corpus[i]; i++)
+      total += rfc2047_parse_buf (bench_corpus[i], buf, sizeof buf);
+  printf ("rfc2047_parse_buf: %u headers in %.3fs (%lu bytes)\n",
+          iterations * (unsigned int)(DIM (bench_corpus) - 1),
+          (double)(clock () - start) / CLOCKS_PER_SEC,
+          (unsigned long)total);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    {
+      run_bench (argc > 2 ? atoi (argv[2]) : 100000);
+      exit (0);
+    }
+
+  for (int i = 0; test_data[i].input; i++)
+    {
+      const auto res = parse (test_data[i].input);
+      if (res != test_data[i].expected)
+        fail ("Decoding mismatch", test_data[i].input, res.c_str (),
+              test_data[i].expected);
+      check_buf_variant (test_data[i].input, res);
+    }
+  pass ("vectors");
+
+  run_fuzz (argc > 1 ? atoi (argv[1]) : 20000);
+  pass ("fuzz");
+  exit (0);
+}
@@ -0,0 +1,146 @@
+/* t-timeline.cpp - Test for gpgOL's per mail timelines.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common_indep.h"
+#include "timeline.h"
+#include "t-support.h"
+
+static unsigned long
+count_matches (const std::string &data, const std::string &what)
+{
+  unsigned long ret = 0;
+
+  for (size_t pos = 0; (pos = data.find (what, pos)) != std::string::npos;
+       pos++)
+    ret++;
+  return ret;
+}
+
+/* Something like the read path of one mail.  */
+static void
+read_path (std::shared_ptr<Timeline> timeline)
+{
+  TimelineScope parse (timeline, TL_PARSE);
+  timeline->begin (TL_DECRYPT);
+  timeline->end (TL_DECRYPT);
+  TimelineScope verify (timeline, TL_VERIFY);
+}
+
+static void
+run_tests ()
+{
+  /* Nothing is recorded without the debug flag.  */
+  opt.enable_debug = 0;
+  auto timeline = std::make_shared<Timeline> ("Mail \"quiet\"");
+  read_path (timeline);
+  timeline->mark (TL_INVALIDATE_UI);
+  if (timeline->count ())
+    fail ("Recorded without DBG_LATENCY");
+  timeline_finish (timeline);
+  if (count_matches (timeline_report (), "\"pid\":"))
+    fail ("Empty timeline archived");
+  pass ("disabled");
+
+  opt.enable_debug = DBG_LATENCY;
+  timeline = std::make_shared<Timeline> ("Mail \"1\"\\\n");
+  read_path (timeline);
+  timeline->mark (TL_INVALIDATE_UI);
+  if (timeline->count () != 7)
+    fail ("Wrong number of events");
+  std::string json = timeline->toJson (1);
+  if (json.find ("\"args\":{\"name\":\"Mail \\\"1\\\"\\\\\"}}")
+         == std::string::npos)
+    fail ("Label not escaped");
+  if (count_matches (json, "\"ph\":\"B\"") != 3
+      || count_matches (json, "\"ph\":\"E\"") != 3
+      || count_matches (json, "\"ph\":\"i\",") != 1
+      || count_matches (json, "\"name\":\"ParseController::parse\"") != 2
+      || count_matches (json, "\"name\":\"invalidate UI\"") != 1)
+    fail ("Wrong events");
+  /* The parse ends last.  */
+  if (json.rfind ("ParseController::parse") < json.rfind ("\"verify\""))
+    fail ("Wrong event order");
+  pass ("events");
+
+  /* Events of several threads end up in one timeline.  */
+  timeline = std::make_shared<Timeline> ("threads");
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+    threads.push_back (std::thread (read_path, timeline));
+  for (auto &t: threads)
+    t.join ();
+  json = timeline->toJson (2);
+  if (timeline->count () != 4 * 6
+      || count_matches (json, "\"ph\":\"E\"") != 4 * 3)
+    fail ("Events of threads lost");
+  pass ("threads");
+
+  /* The oldest events are overwritten.  An end without its begin is
+     dropped so that the trace viewer does not get confused.  */
+  timeline = std::make_shared<Timeline> ("ring");
+  timeline->begin (TL_UPDATE_BODY);
+  for (int i = 0; i < 1000; i++)
+    timeline->mark (TL_CHARSET);
+  timeline->end (TL_UPDATE_BODY);
+  json = timeline->toJson (3);
+  if (timeline->count () != 1002
+      || count_matches (json, "\"ph\":\"i\",") != 255
+      || count_matches (json, "update body"))
+    fail ("Wrong ring buffer");
+  pass ("ring");
+
+  /* Only the last timelines are kept.  */
+  for (int i = 0; i < 100; i++)
+    {
+      char label[32];
+      snprintf (label, sizeof label, "archived %d", i);
+      timeline = std::make_shared<Timeline> (label);
+      timeline->mark (TL_STREAM_OPEN);
+      timeline_finish (timeline);
+    }
+  const std::string report = timeline_report ();
+  if (report.compare (0, 39, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[")
+      || report.compare (report.size () - 4, 4, "\n]}\n")
+      || count_matches (report, "process_name") != 64
+      || count_matches (report, "\"archived 35\"")
+      || count_matches (report, "\"archived 36\"") != 1
+      || count_matches (report, "\"archived 99\"") != 1)
+    fail ("Wrong archive");
+  pass ("archive");
+
+  opt.enable_debug = 0;
+}
+
+int main (int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  run_tests ();
+  exit (0);
+}
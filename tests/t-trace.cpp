@@ -0,0 +1,201 @@
+/* t-trace.cpp - Test for gpgOL's binary trace.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common_indep.h"
+#include "t-support.h"
+
+static int
+inner (int i)
+{
+  TSTART;
+  if (i < 0)
+    {
+      TRETURN 0;
+    }
+  TRETURN i & 1;
+}
+
+static int
+outer (int count)
+{
+  int sum = 0;
+
+  TSTART;
+  for (int i = 0; i < count; i++)
+    {
+      sum += inner (i);
+      TRACEPOINT;
+    }
+  TRETURN sum;
+}
+
+/* Check the events of one thread calling outer (COUNT).  */
+static void
+check_thread (const std::vector<trace_event_t> &events,
+              const std::vector<trace_site_rec_t> &sites, int count)
+{
+  std::vector<std::string> expected;
+  uint64_t last = 0;
+
+  expected.push_back ("outer/0");
+  for (int i = 0; i < count; i++)
+    {
+      expected.push_back ("inner/0");
+      expected.push_back ("inner/1");
+      expected.push_back ("outer/3");
+    }
+  expected.push_back ("outer/1");
+
+  if (events.size () != expected.size ())
+    fail ("Unexpected number of events");
+  for (size_t i = 0; i < events.size (); i++)
+    {
+      const uint32_t id = events[i].site >> 2;
+      if (!id || id > sites.size ())
+        fail ("Invalid site id");
+      const trace_site_rec_t &rec = sites[id - 1];
+      if (strcmp (rec.file, "t-trace.cpp"))
+        fail ("Unexpected site file");
+      if (std::string (rec.func) + "/" + std::to_string (events[i].site & 3)
+          != expected[i])
+        fail ("Unexpected event");
+      if (events[i].ticks < last)
+        fail ("Time goes backwards");
+      last = events[i].ticks;
+    }
+}
+
+static void
+run_tests (const char *tracename)
+{
+  const int nthreads = 4;
+  const int count = 100;
+  std::vector<std::thread> threads;
+
+  if (trace_open (tracename))
+    fail ("Failed to open trace");
+  opt.enable_debug |= DBG_TRACE_BIN;
+
+  for (int i = 0; i < nthreads; i++)
+    threads.push_back (std::thread (outer, count));
+  for (auto &t: threads)
+    t.join ();
+
+  opt.enable_debug &= ~DBG_TRACE_BIN;
+  trace_close ();
+
+  FILE *fp = fopen (tracename, "rb");
+  trace_header_t hdr;
+  if (!fp || fread (&hdr, sizeof hdr, 1, fp) != 1)
+    fail ("Failed to read trace");
+  if (memcmp (hdr.magic, TRACE_MAGIC, sizeof hdr.magic)
+      || hdr.version != TRACE_VERSION)
+    fail ("Invalid trace header");
+  /* Two enters, two returns and a tracepoint; the early return of
+     inner is never taken and thus not registered.  */
+  if (hdr.n_sites != 5)
+    fail ("Unexpected number of call sites");
+  if (hdr.n_events != (uint64_t) nthreads * (2 + 3 * count))
+    fail ("Unexpected number of events");
+
+  std::vector<trace_site_rec_t> sites (hdr.n_sites);
+  std::vector<trace_event_t> events (hdr.n_events);
+  if (fseek (fp, TRACE_SITES_OFFSET, SEEK_SET)
+      || fread (&sites[0], sizeof sites[0], sites.size (), fp)
+         != sites.size ()
+      || fseek (fp, TRACE_SITES_OFFSET
+                    + hdr.max_sites * sizeof (trace_site_rec_t), SEEK_SET)
+      || fread (&events[0], sizeof events[0], events.size (), fp)
+         != events.size ())
+    fail ("Failed to read trace");
+  fclose (fp);
+
+  std::map<uint32_t, std::vector<trace_event_t> > per_thread;
+  for (const auto &ev: events)
+    per_thread[ev.tid].push_back (ev);
+  if (per_thread.size () != (size_t) nthreads)
+    fail ("Unexpected number of threads");
+  for (const auto &pair: per_thread)
+    check_thread (pair.second, sites, count);
+  pass ("events");
+}
+
+/* Compare the cost of a trace event in text and in binary mode.  */
+static void
+run_bench (const char *tracename, int count)
+{
+  char logname[] = "/tmp/t-trace-log-XXXXXX";
+  int fd = mkstemp (logname);
+  clock_t start;
+
+  if (fd == -1)
+    fail ("Failed to create log file");
+  close (fd);
+  set_log_file (logname);
+  if (trace_open (tracename))
+    fail ("Failed to open trace");
+
+  opt.enable_debug = DBG_TRACE;
+  start = clock ();
+  outer (count);
+  log_flush ();
+  printf ("text:   %d events in %.3fs\n", 2 + 3 * count,
+          (double)(clock () - start) / CLOCKS_PER_SEC);
+
+  opt.enable_debug = DBG_TRACE_BIN;
+  start = clock ();
+  outer (count);
+  printf ("binary: %d events in %.3fs\n", 2 + 3 * count,
+          (double)(clock () - start) / CLOCKS_PER_SEC);
+
+  opt.enable_debug = 0;
+  trace_close ();
+  log_shutdown ();
+  set_log_file (NULL);
+  unlink (logname);
+}
+
+int main (int argc, char **argv)
+{
+  char tracename[] = "/tmp/t-trace-XXXXXX";
+  int fd = mkstemp (tracename);
+
+  if (fd == -1)
+    fail ("Failed to create trace file");
+  close (fd);
+
+  if (argc > 1 && !strcmp (argv[1], "--bench"))
+    run_bench (tracename, argc > 2 ? atoi (argv[2]) : 100000);
+  else
+    run_tests (tracename);
+
+  unlink (tracename);
+  exit (0);
+}
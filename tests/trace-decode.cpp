@@ -0,0 +1,353 @@
+/* trace-decode.cpp - Profile report from a gpgOL binary trace.
+ * Copyright (C) 2026 g10 Code GmbH
+ *
+ * This file is part of GpgOL.
+ *
+ * GpgOL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GpgOL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Reads the trace file written with the "trace-binary" debug flag,
+   rebuilds the call tree of each thread from the TSTART / TRETURN
+   events and prints the inclusive and exclusive time per function.
+   The trace file of a Windows system can be decoded anywhere.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "binary-trace.h"
+
+struct stats
+{
+  stats () : calls (0), incl (0), excl (0), max (0), points (0) {}
+  uint64_t calls;
+  uint64_t incl;
+  uint64_t excl;
+  uint64_t max;
+  uint64_t points;
+};
+
+/* A node of a per thread call tree.  */
+struct node
+{
+  node () : parent (nullptr) {}
+  std::string func;
+  node *parent;
+  std::map<std::string, std::unique_ptr<node> > children;
+  stats st;
+};
+
+struct frame
+{
+  std::string func;
+  node *n;
+  uint64_t start;
+  uint64_t children;
+};
+
+struct thread_state
+{
+  thread_state () : unmatched (0), first (0), last (0) {}
+  node root;
+  std::vector<frame> stack;
+  uint64_t unmatched;
+  uint64_t first;
+  uint64_t last;
+};
+
+static double ticks_per_ms;
+
+static void
+show_usage (int ex)
+{
+  fputs ("usage: trace-decode [OPTIONS] TRACEFILE\n"
+         "Options:\n"
+         "  --tree        print the call tree of each thread\n"
+         "  --min PERCENT hide tree nodes below PERCENT of the thread\n"
+         "  --top N       print only the N most expensive functions\n",
+         stderr);
+  exit (ex);
+}
+
+static std::string
+site_name (const trace_site_rec_t *rec)
+{
+  char file[sizeof rec->file + 1], func[sizeof rec->func + 1];
+
+  memcpy (file, rec->file, sizeof rec->file);
+  file[sizeof rec->file] = 0;
+  memcpy (func, rec->func, sizeof rec->func);
+  func[sizeof rec->func] = 0;
+  return std::string (file) + ":" + func;
+}
+
+/* Close the innermost frame of T at TICKS.  */
+static void
+pop_frame (thread_state &t, std::map<std::string, stats> &flat,
+           uint64_t ticks)
+{
+  frame f = t.stack.back ();
+  t.stack.pop_back ();
+
+  const uint64_t incl = ticks - f.start;
+  const uint64_t excl = incl > f.children ? incl - f.children : 0;
+  stats &s = flat[f.func];
+  bool recursive = false;
+
+  for (const auto &other: t.stack)
+    if (other.func == f.func)
+      recursive = true;
+
+  s.calls++;
+  s.excl += excl;
+  /* Only the outermost call of a recursion counts as inclusive.  */
+  if (!recursive)
+    s.incl += incl;
+  s.max = std::max (s.max, incl);
+
+  f.n->st.calls++;
+  f.n->st.incl += incl;
+  f.n->st.excl += excl;
+  f.n->st.max = std::max (f.n->st.max, incl);
+
+  if (!t.stack.empty ())
+    t.stack.back ().children += incl;
+}
+
+static void
+print_tree (const node *n, int depth, uint64_t total, double min_percent)
+{
+  std::vector<const node *> children;
+
+  for (const auto &pair: n->children)
+    children.push_back (pair.second.get ());
+  std::sort (children.begin (), children.end (),
+             [] (const node *a, const node *b)
+               {
+                 return a->st.incl > b->st.incl;
+               });
+  for (const auto child: children)
+    {
+      if (total && 100.0 * child->st.incl / total < min_percent)
+        continue;
+      printf ("%10.3f %10.3f %8lu  %*s%s\n",
+              child->st.incl / ticks_per_ms, child->st.excl / ticks_per_ms,
+              (unsigned long) child->st.calls, depth * 2, "",
+              child->func.c_str ());
+      print_tree (child, depth + 1, total, min_percent);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  bool show_tree = false;
+  double min_percent = 0;
+  size_t top = 0;
+  FILE *fp;
+  trace_header_t hdr;
+
+  for (argc--, argv++; argc && !strncmp (*argv, "--", 2); argc--, argv++)
+    {
+      if (!strcmp (*argv, "--tree"))
+        show_tree = true;
+      else if (!strcmp (*argv, "--min") && argc > 1)
+        {
+          argc--; argv++;
+          min_percent = atof (*argv);
+        }
+      else if (!strcmp (*argv, "--top") && argc > 1)
+        {
+          argc--; argv++;
+          top = atoi (*argv);
+        }
+      else if (!strcmp (*argv, "--help"))
+        show_usage (0);
+      else
+        show_usage (1);
+    }
+  if (argc != 1)
+    show_usage (1);
+
+  fp = fopen (*argv, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "Failed to open '%s'\n", *argv);
+      exit (1);
+    }
+  if (fread (&hdr, sizeof hdr, 1, fp) != 1
+      || memcmp (hdr.magic, TRACE_MAGIC, sizeof hdr.magic)
+      || hdr.version != TRACE_VERSION || !hdr.ticks_per_sec
+      || !hdr.max_events || hdr.n_sites > hdr.max_sites)
+    {
+      fprintf (stderr, "'%s' is not a gpgol trace file\n", *argv);
+      exit (1);
+    }
+  ticks_per_ms = hdr.ticks_per_sec / 1000.0;
+
+  std::vector<trace_site_rec_t> sites (hdr.n_sites);
+  if (fseek (fp, TRACE_SITES_OFFSET, SEEK_SET)
+      || (hdr.n_sites
+          && fread (&sites[0], sizeof sites[0], hdr.n_sites, fp)
+             != hdr.n_sites))
+    {
+      fprintf (stderr, "Failed to read the call sites\n");
+      exit (1);
+    }
+  std::vector<std::string> names;
+  for (const auto &rec: sites)
+    names.push_back (site_name (&rec));
+
+  /* Read the ring in order starting with the oldest event.  */
+  const uint64_t n = std::min<uint64_t> (hdr.n_events, hdr.max_events);
+  const uint64_t first = hdr.n_events - n;
+  const long events_offset = TRACE_SITES_OFFSET
+                             + (long) hdr.max_sites * sizeof (trace_site_rec_t);
+  std::vector<trace_event_t> ring (hdr.max_events);
+  if (fseek (fp, events_offset, SEEK_SET)
+      || fread (&ring[0], sizeof ring[0], hdr.max_events, fp)
+         != hdr.max_events)
+    {
+      fprintf (stderr, "Failed to read the events\n");
+      exit (1);
+    }
+  fclose (fp);
+
+  std::map<uint32_t, thread_state> threads;
+  std::map<std::string, stats> flat;
+  uint64_t bad = 0;
+
+  for (uint64_t i = first; i < hdr.n_events; i++)
+    {
+      const trace_event_t &ev = ring[i % hdr.max_events];
+      const uint32_t id = ev.site >> 2;
+
+      /* A crash may leave a partly written event behind.  */
+      if (!id || id > hdr.n_sites || !ev.ticks)
+        {
+          bad++;
+          continue;
+        }
+      const std::string &func = names[id - 1];
+      thread_state &t = threads[ev.tid];
+      if (!t.first)
+        t.first = ev.ticks;
+      t.last = ev.ticks;
+
+      switch (ev.site & 3)
+        {
+          case TRACE_ENTER:
+            {
+              node *parent = t.stack.empty () ? &t.root : t.stack.back ().n;
+              auto &child = parent->children[func];
+              if (!child)
+                {
+                  child.reset (new node);
+                  child->func = func;
+                  child->parent = parent;
+                }
+              t.stack.push_back ({func, child.get (), ev.ticks, 0});
+            }
+            break;
+          case TRACE_RETURN:
+            {
+              /* Functions without TRETURN on every path leave frames
+                 behind.  Close them with the return of a caller.  */
+              auto it = std::find_if (t.stack.rbegin (), t.stack.rend (),
+                                      [&func] (const frame &f)
+                                        {
+                                          return f.func == func;
+                                        });
+              if (it == t.stack.rend ())
+                {
+                  /* Entered before the trace started.  */
+                  t.unmatched++;
+                  break;
+                }
+              while (t.stack.back ().func != func)
+                pop_frame (t, flat, ev.ticks);
+              pop_frame (t, flat, ev.ticks);
+            }
+            break;
+          default:
+            flat[func].points++;
+            break;
+        }
+    }
+
+  /* Close what is still open at the end of the trace.  */
+  for (auto &pair: threads)
+    while (!pair.second.stack.empty ())
+      pop_frame (pair.second, flat, pair.second.last);
+
+  printf ("%lu events from %lu threads, %lu call sites",
+          (unsigned long) n, (unsigned long) threads.size (),
+          (unsigned long) hdr.n_sites);
+  if (hdr.n_events > n)
+    printf (", %lu older events overwritten",
+            (unsigned long) (hdr.n_events - n));
+  if (bad)
+    printf (", %lu invalid events", (unsigned long) bad);
+  printf ("\n\n");
+
+  std::vector<std::pair<std::string, stats> > sorted (flat.begin (),
+                                                      flat.end ());
+  std::sort (sorted.begin (), sorted.end (),
+             [] (const std::pair<std::string, stats> &a,
+                 const std::pair<std::string, stats> &b)
+               {
+                 return a.second.excl > b.second.excl;
+               });
+  if (top && sorted.size () > top)
+    sorted.resize (top);
+
+  printf ("%10s %10s %8s %10s %10s %8s  %s\n", "incl ms", "excl ms",
+          "calls", "avg us", "max ms", "points", "function");
+  for (const auto &pair: sorted)
+    {
+      const stats &s = pair.second;
+      printf ("%10.3f %10.3f %8lu %10.1f %10.3f %8lu  %s\n",
+              s.incl / ticks_per_ms, s.excl / ticks_per_ms,
+              (unsigned long) s.calls,
+              s.calls ? 1000.0 * s.incl / ticks_per_ms / s.calls : 0.0,
+              s.max / ticks_per_ms, (unsigned long) s.points,
+              pair.first.c_str ());
+    }
+
+  if (show_tree)
+    for (const auto &pair: threads)
+      {
+        const thread_state &t = pair.second;
+        uint64_t total = 0;
+
+        for (const auto &child: t.root.children)
+          total += child.second->st.incl;
+        printf ("\nThread %lu: %.3f ms traced, %.3f ms in calls",
+                (unsigned long) pair.first,
+                (t.last - t.first) / ticks_per_ms, total / ticks_per_ms);
+        if (t.unmatched)
+          printf (", %lu returns without entry",
+                  (unsigned long) t.unmatched);
+        printf ("\n%10s %10s %8s  %s\n", "incl ms", "excl ms", "calls",
+                "function");
+        print_tree (&t.root, 0, total, min_percent);
+      }
+  return 0;
+}